@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// DxilContainerArchive.h                                                    //
+// Copyright (C) Microsoft Corporation. All rights reserved.                 //
+// This file is distributed under the University of Illinois Open Source     //
+// License. See LICENSE.TXT for details.                                     //
+//                                                                           //
+// Packed archive of many dxil containers with shared parts.                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "dxc/Support/Global.h"
+#include "dxc/Support/WinIncludes.h"
+#include "dxc/DxilContainer/DxilContainer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+}
+
+namespace hlsl {
+
+class AbstractMemoryStream;
+
+// Archive layout; all offsets are from the start of the archive, and all
+// integers are little-endian.
+//
+//   DxilArchiveHeader
+//   part payloads, each 4-byte aligned and stored once however many
+//     containers include it
+//   DxilArchivePart[PartCount]
+//   uint32_t PartRefs[PartRefCount] - indices into the part table, in each
+//     container's part order
+//   DxilArchiveShader[ShaderCount]
+//   uint32_t Buckets[BucketCount] - open-addressed hash table from container
+//     digest to shader index + 1, with 0 for an empty bucket
+//   uint32_t ShaderHashBuckets[ShaderHashBucketCount] - the same, from the
+//     HASH part digest; several shaders may share one
+//   DxilArchiveFooter
+//
+// Tables are written after the payloads, so an archive is written in a single
+// pass; the footer is found from the end. Offsets are 64-bit, but archives are
+// capped at DxilArchiveMaxSize so they can be mapped the way containers are.
+
+static const uint32_t DxilArchiveMagic = 0x52415844; // 'DXAR'
+static const uint16_t DxilArchiveVersionMajor = 1;
+static const uint16_t DxilArchiveVersionMinor = 0;
+static const uint64_t DxilArchiveMaxSize = UINT32_MAX;
+
+struct DxilArchiveHeader {
+  uint32_t Magic;
+  uint16_t MajorVersion;
+  uint16_t MinorVersion;
+};
+
+struct DxilArchivePart {
+  uint64_t Offset;
+  uint32_t FourCC;
+  uint32_t Size;
+};
+
+// MD5 of a whole container, which is what identifies a shader in an archive.
+struct DxilArchiveDigest {
+  uint8_t Digest[DxilContainerHashSize];
+};
+
+enum class DxilArchiveShaderFlags : uint32_t {
+  None = 0,
+  HasShaderHash = 1, // The container has a HASH part, copied to ShaderHash.
+};
+
+struct DxilArchiveShader {
+  DxilArchiveDigest ContainerDigest;
+  DxilShaderHash ShaderHash; // Zero unless HasShaderHash is set
+  DxilContainerHash ContainerHash;
+  DxilContainerVersion Version;
+  uint32_t FirstPartRef;
+  uint32_t PartCount;
+  uint32_t Flags; // DxilArchiveShaderFlags
+};
+
+struct DxilArchiveFooter {
+  uint64_t PartTableOffset;
+  uint64_t PartRefOffset;
+  uint64_t ShaderTableOffset;
+  uint64_t BucketOffset;
+  uint64_t ShaderHashBucketOffset;
+  uint32_t PartCount;
+  uint32_t PartRefCount;
+  uint32_t ShaderCount;
+  uint32_t BucketCount;
+  uint32_t ShaderHashBucketCount;
+  uint32_t Magic; // Last, so a truncated archive is rejected.
+};
+
+static_assert(sizeof(DxilArchivePart) == 16, "else archive part is padded");
+static_assert(sizeof(DxilArchiveShader) == 68, "else archive shader is padded");
+static_assert(sizeof(DxilArchiveFooter) == 64, "else archive footer is padded");
+
+// Streams containers into an archive. Payloads are written as containers are
+// added; only the tables are held until Finish.
+class DxilArchiveWriter {
+public:
+  explicit DxilArchiveWriter(llvm::raw_ostream &OS);
+
+  // Returns S_FALSE if an identical container was already added,
+  // DXC_E_CONTAINER_INVALID if the container isn't laid out the way
+  // DxilContainerWriter lays it out, since it couldn't be rebuilt, and
+  // DXC_E_DATA_TOO_LARGE if the finished archive would go over
+  // DxilArchiveMaxSize. Nothing is written when a container is rejected.
+  HRESULT AddContainer(_In_reads_bytes_(size) const void *pContainer,
+                       uint32_t size);
+  // Writes the tables and footer.
+  void Finish();
+
+  uint32_t GetShaderCount() const { return (uint32_t)m_Shaders.size(); }
+  uint32_t GetPartCount() const { return (uint32_t)m_Parts.size(); }
+
+private:
+  llvm::raw_ostream &m_OS;
+  std::vector<DxilArchivePart> m_Parts;
+  std::vector<uint32_t> m_PartRefs;
+  std::vector<DxilArchiveShader> m_Shaders;
+  std::unordered_map<std::string, uint32_t> m_PartIndex; // FourCC + MD5
+  std::unordered_map<std::string, uint32_t> m_ShaderIndex; // Container MD5
+
+  void WritePadding();
+  uint64_t GetFinishedSizeBound(uint64_t NewPayloadSize, uint64_t NewPartCount,
+                                uint64_t NewPartRefCount) const;
+};
+
+// Reads an archive in place; payloads are never copied until a container is
+// rebuilt.
+class DxilArchiveReader {
+public:
+  // Validates the footer and tables. Returns DXC_E_CONTAINER_INVALID if
+  // they don't describe an archive of this size.
+  HRESULT Load(_In_reads_bytes_(size) const void *pArchive, uint64_t size);
+
+  uint32_t GetShaderCount() const { return m_pFooter->ShaderCount; }
+  const DxilArchiveShader &GetShader(uint32_t index) const {
+    return m_pShaders[index];
+  }
+  // Returns false if no shader has the given container digest.
+  bool FindShader(_In_reads_(DxilContainerHashSize) const uint8_t *pDigest,
+                  _Out_ uint32_t *pIndex) const;
+  // Appends the index of every shader whose HASH part has the given digest;
+  // containers with the same program but other parts share one.
+  void FindShadersByHash(
+      _In_reads_(DxilContainerHashSize) const uint8_t *pDigest,
+      std::vector<uint32_t> &Indices) const;
+
+  llvm::ArrayRef<uint32_t> GetShaderPartRefs(uint32_t index) const;
+  const DxilArchivePart &GetPart(uint32_t partIndex) const {
+    return m_pParts[partIndex];
+  }
+  const void *GetPartData(uint32_t partIndex) const {
+    return m_pArchive + m_pParts[partIndex].Offset;
+  }
+
+  // Size of the container UnpackContainer writes.
+  uint32_t GetContainerSize(uint32_t index) const;
+  // Rebuilds the container as it was added.
+  void UnpackContainer(uint32_t index, _In_ AbstractMemoryStream *pStream) const;
+
+private:
+  const uint8_t *m_pArchive = nullptr;
+  const DxilArchiveFooter *m_pFooter = nullptr;
+  const DxilArchivePart *m_pParts = nullptr;
+  const uint32_t *m_pPartRefs = nullptr;
+  const DxilArchiveShader *m_pShaders = nullptr;
+  const uint32_t *m_pBuckets = nullptr;
+  const uint32_t *m_pShaderHashBuckets = nullptr;
+};
+
+} // namespace hlsl
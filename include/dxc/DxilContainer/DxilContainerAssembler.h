@@ -53,7 +53,8 @@ void SerializeDxilContainerForModule(hlsl::DxilModule *pModule,
                                      SerializeDxilFlags Flags,
                                      DxilShaderHash *pShaderHashOut = nullptr,
                                      AbstractMemoryStream *pReflectionStreamOut = nullptr,
-                                     AbstractMemoryStream *pRootSigStreamOut = nullptr);
+                                     AbstractMemoryStream *pRootSigStreamOut = nullptr,
+                                     AbstractMemoryStream **ppProgramBitcodeOut = nullptr);
 void SerializeDxilContainerForRootSignature(hlsl::RootSignatureHandle *pRootSigHandle,
                                      AbstractMemoryStream *pStream);
 
@@ -45,6 +45,32 @@ class DxrFallbackCompiler
 public:
   typedef std::map<int, std::string> IntToFuncNameMap;
 
+  // State functions of shaders, kept between compiles so that shaders that
+  // haven't changed aren't transformed again. Entries are keyed by a hash of
+  // the bodies of a shader and the functions it calls, and of everything else
+  // the transform depends on, and hold the state functions as bitcode.
+  class StateFunctionCache
+  {
+  public:
+    size_t size() const { return m_entries.size(); }
+    // Number of shaders whose state functions were restored from the cache
+    unsigned hits() const { return m_hits; }
+    void clear() { m_entries.clear(); m_hits = 0; }
+
+  private:
+    friend class DxrFallbackCompiler;
+    struct Entry
+    {
+      std::string bitcode;
+      std::vector<std::string> stateFunctionNames;
+      // Shaders by the indices their state IDs are referred to with
+      std::map<int, std::string> shaderIndices;
+      unsigned int stackSize = 0;
+    };
+    std::map<std::string, Entry> m_entries;
+    unsigned m_hits = 0;
+  };
+
   // If findCalledShaders is true, then the list of shaderNames is expanded to 
   // include shader functions (functions with attribute "exp-shader") that are 
   // called by functions in shaderNames. Shader entry state IDs are still
@@ -58,6 +84,10 @@ public:
   // 3 - dump intermediate stages of SFT to file
   void setDebugOutputLevel(int val);
 
+  // Reuses and adds to the state functions in pCache in compile(). The cache
+  // must outlive the compiler.
+  void setStateFunctionCache(StateFunctionCache* pCache);
+
   // Returns the entry state id for each of shaderNames. The transformations 
   // are performed in place on the module.
   void compile(std::vector<int>& shaderEntryStateIds, std::vector<unsigned int> &shaderStackSizes, IntToFuncNameMap *pCachedMap);
@@ -75,6 +105,7 @@ private:
   unsigned m_maxAttributeSize = 0;
   bool m_findCalledShaders = false;
   int m_debugOutputLevel = 0;
+  StateFunctionCache* m_stateFunctionCache = nullptr;
 
   StringToFuncMap m_shaderMap;
 
@@ -84,6 +115,8 @@ private:
   void lowerReportHit();
   void lowerTraceRay(llvm::Type* runtimeDataArgTy);
   void createStateFunctions(IntToFuncMap& stateFunctionMap, std::vector<int>& shaderEntryStateIds, std::vector<unsigned int>& shaderStackSizes, int baseStateId, const std::vector<std::string>& shaderNames, llvm::Type* runtimeDataArgTy);
+  bool restoreStateFunctions(const std::string& cacheKey, llvm::Function* F, const std::vector<std::string>& shaderNames, std::vector<llvm::Function*>& stateFunctions, unsigned int& shaderStackSize);
+  void storeStateFunctions(const std::string& cacheKey, const std::vector<std::string>& shaderNames, const std::vector<llvm::Function*>& stateFunctions, unsigned int shaderStackSize);
   void createLaunchParams(llvm::Function* func);
   void createStack(llvm::Function* func);
   void createStateDispatch(llvm::Function* func, const IntToFuncMap& stateFunctionMap, llvm::Type* runtimeDataArgTy);
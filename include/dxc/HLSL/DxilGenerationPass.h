@@ -11,6 +11,8 @@
 
 #pragma once
 
+#include <functional>
+
 namespace llvm {
 class Module;
 class ModulePass;
@@ -20,6 +22,9 @@ class Instruction;
 class PassRegistry;
 class StringRef;
 struct PostDominatorTree;
+namespace legacy {
+class PassManagerBase;
+}
 }
 
 namespace hlsl {
@@ -131,4 +136,12 @@ void initializeDxilNoOptLegalizePass(llvm::PassRegistry&);
 ModulePass *createDxilNoOptSimplifyInstructionsPass();
 void initializeDxilNoOptSimplifyInstructionsPass(llvm::PassRegistry&);
 
+/// \brief Runs the function passes added by AddPasses on every function of a
+/// library, optimizing functions concurrently on up to ThreadCount threads,
+/// or one per hardware thread if it is 0.
+ModulePass *createDxilParallelFunctionPassesPass(
+    std::function<void(legacy::PassManagerBase &)> AddPasses,
+    unsigned ThreadCount = 0);
+void initializeDxilParallelFunctionPassesPass(llvm::PassRegistry&);
+
 }
@@ -303,12 +303,16 @@ bool VerifyFeatureInfoMatches(_In_ llvm::Module *pModule,
                               _In_reads_bytes_(FeatureInfoSize) const void *pFeatureInfoData,
                               _In_ uint32_t FeatureInfoSize);
 
-// Validate the container parts, assuming supplied module is valid, loaded from the container provided
+// Validate the container parts, assuming supplied module is valid, loaded from the container provided.
+// If the module is instead the one the container was assembled from, pass the
+// bitcode it was serialized to, which the program part must hold exactly.
 struct DxilContainerHeader;
 HRESULT ValidateDxilContainerParts(_In_ llvm::Module *pModule,
                                    _In_opt_ llvm::Module *pDebugModule,
                                    _In_reads_bytes_(ContainerSize) const DxilContainerHeader *pContainer,
-                                   _In_ uint32_t ContainerSize);
+                                   _In_ uint32_t ContainerSize,
+                                   _In_reads_bytes_opt_(ProgramBitcodeSize) const char *pProgramBitcode = nullptr,
+                                   _In_ uint32_t ProgramBitcodeSize = 0);
 
 // Loads module, validating load, but not module.
 HRESULT ValidateLoadModule(_In_reads_bytes_(ILLength) const char *pIL,
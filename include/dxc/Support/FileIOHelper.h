@@ -161,6 +161,13 @@ DxcCreateBlobFromFile(_In_opt_ IMalloc *pMalloc, LPCWSTR pFileName,
 HRESULT DxcCreateBlobFromFile(LPCWSTR pFileName, _In_opt_ UINT32 *pCodePage,
                               _COM_Outptr_ IDxcBlobEncoding **ppBlobEncoding) throw();
 
+// Maps a file read-only instead of reading it; pages are only read as they
+// are touched. The file must not be truncated while the blob is alive.
+HRESULT
+DxcCreateBlobFromFileMapping(_In_opt_ IMalloc *pMalloc, LPCWSTR pFileName,
+                             _In_opt_ UINT32 *pCodePage,
+                             _COM_Outptr_ IDxcBlobEncoding **ppBlobEncoding) throw();
+
 // Given a blob, creates a subrange view.
 HRESULT DxcCreateBlobFromBlob(_In_ IDxcBlob *pBlob, UINT32 offset,
                               UINT32 length,
@@ -35,6 +35,10 @@ enum class SpirvLayoutRule {
   Max,               // This is an invalid layout rule
 };
 
+/// The recipe saved for shaders whose passes can't all be named by flags.
+/// They are optimized with the performance passes and never tuned again.
+static const char kSpirvOptRecipeUntunable[] = "# untunable";
+
 struct SpirvCodeGenOptions {
   /// Disable legalization and optimization and emit raw SPIR-V
   bool codeGenHighLevel;
@@ -62,6 +66,8 @@ struct SpirvCodeGenOptions {
   SpirvLayoutRule ampPayloadLayoutRule;
   llvm::StringRef stageIoOrder;
   llvm::StringRef targetEnv;
+  llvm::StringRef optRecipeDir;
+  llvm::StringRef optRecipeClass;
   llvm::SmallVector<int32_t, 4> bShift;
   llvm::SmallVector<int32_t, 4> sShift;
   llvm::SmallVector<int32_t, 4> tShift;
@@ -70,6 +76,17 @@ struct SpirvCodeGenOptions {
   llvm::SmallVector<llvm::StringRef, 4> optConfig;
   std::vector<std::string> bindRegister;
   std::vector<std::string> bindGlobals;
+  /// Time each optimization pass as its own region of the thread's
+  /// llvm::TimingListener
+  bool timeReport = false;
+  /// Flags of a saved optimizer recipe, run in place of the performance passes
+  /// when there are no -Oconfig passes and every flag names a pass
+  std::vector<std::string> optRecipe;
+  /// If set, and neither -Oconfig passes nor a usable optRecipe are given, the
+  /// performance passes run one at a time and the flags of those that changed
+  /// the module are stored here, or kSpirvOptRecipeUntunable if a pass has no
+  /// flag to save
+  std::vector<std::string> *tunedOptConfig = nullptr;
 
   // String representation of all command line options.
   std::string clOptions;
@@ -430,6 +430,25 @@ struct IDxcUtils : public IUnknown {
     _In_ IDxcBlob *pPDBBlob, _COM_Outptr_ IDxcBlob **ppHash, _COM_Outptr_ IDxcBlob **ppContainer) = 0;
 };
 
+// Include handler that keeps the files it loads, so one instance can be passed
+// to many compiles, including concurrent ones, without reading a header again.
+// Files are keyed by resolved path; identical contents share one blob. A path
+// that doesn't exist is remembered as missing; other failures are retried.
+// Cached files are mapped rather than read, so they shouldn't be rewritten
+// until the cache is cleared.
+CROSS_PLATFORM_UUIDOF(IDxcIncludeCache, "3b29236d-b510-4d08-bb32-89c9dd39d98e")
+struct IDxcIncludeCache : public IDxcIncludeHandler {
+  // Drops every cached file, e.g. after sources changed on disk.
+  virtual HRESULT STDMETHODCALLTYPE Clear() = 0;
+};
+
+CROSS_PLATFORM_UUIDOF(IDxcUtils2, "76bfc94f-667c-4cae-8587-edfad9146c8d")
+struct IDxcUtils2 : public IDxcUtils {
+  // Create a file-system include handler that is shared across compiles.
+  virtual HRESULT STDMETHODCALLTYPE CreateIncludeCache(
+    _COM_Outptr_ IDxcIncludeCache **ppResult) = 0;
+};
+
 // For use with IDxcResult::[Has|Get]Output dxcOutKind argument
 // Note: text outputs returned from version 2 APIs are UTF-8 or UTF-16 based on -encoding option
 typedef enum DXC_OUT_KIND {
@@ -444,6 +463,7 @@ typedef enum DXC_OUT_KIND {
   DXC_OUT_REFLECTION = 8,     // IDxcBlob - RDAT part with reflection data
   DXC_OUT_ROOT_SIGNATURE = 9, // IDxcBlob - Serialized root signature output
   DXC_OUT_EXTRA_OUTPUTS  = 10,// IDxcExtraResults - Extra outputs
+  DXC_OUT_TIME_REPORT = 11,   // IDxcBlobUtf8 or IDxcBlobUtf16 - time and peak allocation per compile phase and pass (-ftime-report)
 
   DXC_OUT_FORCE_DWORD = 0xFFFFFFFF
 } DXC_OUT_KIND;
@@ -495,6 +515,60 @@ struct IDxcCompiler3 : public IUnknown {
     ) = 0;
 };
 
+// Counters reported by IDxcCompileCache::GetStatistics
+typedef struct DxcCompileCacheStatistics {
+  UINT64 Hits;          // Compiles served from memory or disk
+  UINT64 DiskHits;      // Subset of Hits that were loaded from disk
+  UINT64 Misses;        // Eligible compiles that ran the full pipeline
+  UINT64 Evictions;     // Entries dropped to honor the size limits
+  UINT64 EntryCount;    // Entries currently held in memory
+  UINT64 MemoryBytes;   // Output bytes currently held in memory
+} DxcCompileCacheStatistics;
+
+// Opt-in cache of IDxcCompiler3::Compile results, obtained from the compiler
+// through QueryInterface.  Entries are keyed on the preprocessed source, the
+// normalized arguments and the validator version.
+CROSS_PLATFORM_UUIDOF(IDxcCompileCache, "5b621716-d028-4e97-98ed-2a025ca325bf")
+struct IDxcCompileCache : public IUnknown {
+  // Enables the cache.  pDirectory is optional; when provided, entries are
+  // also persisted there.  A limit of zero disables that tier.
+  virtual HRESULT STDMETHODCALLTYPE Configure(
+    _In_opt_z_ LPCWSTR pDirectory,                // Directory for persisted entries
+    _In_ UINT64 maxMemoryBytes,                   // Limit for in-memory entries
+    _In_ UINT64 maxDiskBytes                      // Limit for entries written to pDirectory
+  ) = 0;
+  virtual HRESULT STDMETHODCALLTYPE GetStatistics(_Out_ DxcCompileCacheStatistics *pStats) = 0;
+  // Drops in-memory entries and resets the counters; persisted entries are kept.
+  virtual HRESULT STDMETHODCALLTYPE Clear() = 0;
+};
+
+// Entry point and target profile for IDxcMultiEntryCompiler::CompileEntries
+typedef struct DxcEntryPoint {
+  LPCWSTR Name;       // Entry point name
+  LPCWSTR Profile;    // Shader profile to compile
+} DxcEntryPoint;
+
+// Compiles several entry points of one source, obtained from the compiler
+// through QueryInterface.  Entries whose profiles share a shader model version
+// are parsed once and code generated per entry; sources that test
+// __SHADER_TARGET_STAGE are compiled once per entry instead.
+CROSS_PLATFORM_UUIDOF(IDxcMultiEntryCompiler, "a4e6a5e3-7e2b-4c8b-9a39-2f8c1d6e0b54")
+struct IDxcMultiEntryCompiler : public IUnknown {
+  // Produces one result per entry, as IDxcCompiler3::Compile would with the
+  // given arguments plus -E and -T for the entry.
+  virtual HRESULT STDMETHODCALLTYPE CompileEntries(
+    _In_ const DxcBuffer *pSource,                // Source text to compile
+    _In_opt_count_(argCount) LPCWSTR *pArguments, // Array of pointers to arguments
+    _In_ UINT32 argCount,                         // Number of arguments
+    _In_opt_ IDxcIncludeHandler *pIncludeHandler, // user-provided interface to handle #include directives (optional)
+    _In_count_(entryCount)
+      const DxcEntryPoint *pEntries,              // Array of entry points
+    _In_ UINT32 entryCount,                       // Number of entry points
+    _Out_writes_(entryCount)
+      IDxcResult **ppResults                      // Result for each entry point
+  ) = 0;
+};
+
 static const UINT32 DxcValidatorFlags_Default = 0;
 static const UINT32 DxcValidatorFlags_InPlaceEdit = 1;  // Validator is allowed to update shader blob in-place.
 static const UINT32 DxcValidatorFlags_RootSignatureOnly = 2;
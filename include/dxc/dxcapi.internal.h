@@ -248,4 +248,14 @@ public:
   virtual HRESULT STDMETHODCALLTYPE RegisterDxilContainerEventHandler(IDxcContainerEventsHandler *pHandler, UINT64 *pCookie) = 0;
   virtual HRESULT STDMETHODCALLTYPE UnRegisterDxilContainerEventHandler(UINT64 cookie) = 0;
 };
+
+// Reports on the validator a compiler object keeps for all of its compiles,
+// for tests to check it is created once.
+CROSS_PLATFORM_UUIDOF(IDxcValidatorSession, "6d5854bf-c339-428a-b1ee-e8f0e8cf1733")
+struct IDxcValidatorSession : public IUnknown
+{
+public:
+  // Number of validators created so far: one once anything has needed it.
+  virtual HRESULT STDMETHODCALLTYPE GetValidatorCreateCount(_Out_ UINT32 *pCount) = 0;
+};
 #endif
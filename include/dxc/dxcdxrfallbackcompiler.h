@@ -96,6 +96,16 @@ struct __declspec(uuid("76bb3c85-006d-4b72-9e10-63cd97df57f0"))
   ) = 0;
 };
 
+// Obtained from a fallback compiler through QueryInterface. This is intended
+// for testing purposes.
+struct __declspec(uuid("bc2eae61-7e27-42e1-8038-a00c5f749538"))
+  IDxcDxrFallbackCompilerStats : public IUnknown {
+
+  // Number of shaders whose state functions Compile() reused from an earlier
+  // Compile() on this object.
+  virtual HRESULT STDMETHODCALLTYPE GetStateFunctionCacheHits(_Out_ UINT32 *pHits) = 0;
+};
+
 // Note: __declspec(selectany) requires 'extern'
 // On Linux __declspec(selectany) is removed and using 'extern' results in link error.
 #ifdef _MSC_VER
@@ -11,7 +11,9 @@
 #define LLVM_ANALYSIS_DXILVALUECACHE_H
 
 #include "llvm/Pass.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/ValueMap.h"
+#include <vector>
 
 namespace llvm {
 
@@ -24,28 +26,49 @@ struct DxilValueCache : public ImmutablePass {
   static char ID;
 
   // Special Weak Value to Weak Value map.
+  //
+  // Each entry remembers the entries that were derived from it. When a key is
+  // replaced or deleted, its entry and everything derived from it is dropped,
+  // and the rest of the cache stays valid.
+  //
+  // New edges and retargeted branches aren't visible to value handles, so
+  // clients that make such edits call Invalidate on the branch or block.
   struct WeakValueMap {
-    struct ValueVH : public CallbackVH {
-      ValueVH(Value *V) : CallbackVH(V) {}
-      void allUsesReplacedWith(Value *) override { setValPtr(nullptr); }
-    };
     struct ValueEntry {
       WeakVH Value;
-      ValueVH Self;
-      ValueEntry() : Value(nullptr), Self(nullptr) {}
-      inline void Set(llvm::Value *Key, llvm::Value *V) { Self = Key; Value = V; }
-      inline bool IsStale() const { return Self == nullptr; }
+      bool Stale;
+      SmallPtrSet<const llvm::Value *, 4> Dependents;
+      ValueEntry() : Value(nullptr), Stale(true) {}
+      inline void Set(llvm::Value *V) { Stale = false; Value = V; }
+      inline bool IsStale() const { return Stale; }
+    };
+    struct MapConfig : public ValueMapConfig<const llvm::Value *> {
+      enum { FollowRAUW = false };
+      typedef WeakValueMap *ExtraData;
+      static void onRAUW(WeakValueMap *Owner, const llvm::Value *Old, const llvm::Value *) {
+        Owner->Invalidate(Old);
+      }
+      static void onDelete(WeakValueMap *Owner, const llvm::Value *Old) {
+        Owner->Invalidate(Old);
+      }
     };
-    ValueMap<const Value *, ValueEntry> Map;
+    ValueMap<const Value *, ValueEntry, MapConfig> Map;
+    WeakValueMap() : Map(this) {}
     Value *Get(Value *V);
     void Set(Value *Key, Value *V);
     bool Seen(Value *v);
     void SetSentinel(Value *V);
+    void AddDependent(Value *Key, Value *Dependent);
+    void Invalidate(const Value *Key);
     void ResetUnknowns();
+    void ResetReachability();
     void dump() const;
   private:
     Value *GetSentinel(LLVMContext &Ctx);
+    void CompactUnknowns();
     std::unique_ptr<Value> Sentinel;
+    std::vector<const Value *> Unknowns; // Keys set to the sentinel since the last reset
+    std::vector<const Value *> Reachability; // Block and branch keys since the last reset
   };
 
 private:
@@ -75,7 +98,12 @@ public:
   Value *GetValue(Value *V, DominatorTree *DT=nullptr);
   Constant *GetConstValue(Value *V, DominatorTree *DT = nullptr);
   ConstantInt *GetConstInt(Value *V, DominatorTree *DT = nullptr);
+  // Forgets unknown values and block reachability, so they're worked out
+  // again from the current IR.
   void ResetUnknowns() { ValueMap.ResetUnknowns(); }
+  // Drops what's cached for V and everything derived from it, for changes
+  // value handles can't see, like edits to a PHI's incoming blocks.
+  void Invalidate(Value *V) { ValueMap.Invalidate(V); }
   bool IsAlwaysReachable(BasicBlock *BB, DominatorTree *DT=nullptr);
   bool IsUnreachable(BasicBlock *BB, DominatorTree *DT=nullptr);
 };
@@ -13,6 +13,7 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/DataTypes.h"
 #include <cassert>
+#include <memory> // HLSL Change
 #include <string>
 #include <utility>
 #include <vector>
@@ -184,6 +185,53 @@ private:
   void PrintQueuedTimers(raw_ostream &OS);
 };
 
+// HLSL Change Starts - per-thread region timing
+/// TimingListener - Receives the regions entered and left on the thread it is
+/// installed on: every pass run by the legacy pass managers plus the phases
+/// the front end reports.  Regions nest, and each regionFinished call closes
+/// the innermost open region.  Unlike -time-passes, this is scoped to a
+/// thread, so concurrent compiles can each collect their own profile.
+class TimingListener {
+public:
+  virtual ~TimingListener() {}
+  virtual void regionStarted(StringRef Name) = 0;
+  virtual void regionFinished() = 0;
+  /// Adds Delta to a named count of the innermost open region, such as the
+  /// change in instruction count a pass made.
+  virtual void regionCount(StringRef Counter, int64_t Delta) {}
+  /// Returns a listener for another thread doing work on behalf of the
+  /// innermost open region, or null if that work isn't of interest.  Once the
+  /// thread is done, mergeThreadListener adds what the returned listener
+  /// collected to the region; both are called on this listener's thread.
+  virtual std::unique_ptr<TimingListener> createThreadListener() {
+    return nullptr;
+  }
+  virtual void mergeThreadListener(TimingListener &L) {}
+};
+
+/// Sets the listener for the current thread and returns the prior one.
+TimingListener *setThreadTimingListener(TimingListener *L);
+TimingListener *getThreadTimingListener();
+
+/// TimingListenerRegion - Reports a region to the thread's listener, if any,
+/// for the lifetime of this object.
+class TimingListenerRegion {
+  TimingListener *L;
+  TimingListenerRegion(const TimingListenerRegion &) = delete;
+public:
+  explicit TimingListenerRegion(StringRef Name)
+      : L(getThreadTimingListener()) {
+    if (L) L->regionStarted(Name);
+  }
+  ~TimingListenerRegion() {
+    if (L) L->regionFinished();
+  }
+  void count(StringRef Counter, int64_t Delta) {
+    if (L) L->regionCount(Counter, Delta);
+  }
+};
+// HLSL Change Ends
+
 } // End llvm namespace
 
 #endif
@@ -134,7 +134,10 @@ public:
   unsigned ScanLimit = 0; // HLSL Change
   bool EnableGVN = true; // HLSL Change
   bool StructurizeLoopExitsForUnroll = false; // HLSL Change
+  unsigned HLSLUnrollBudget = 0; // HLSL Change - instructions [unroll] may add per function, 0 for no limit
   bool HLSLEnableLifetimeMarkers = false; // HLSL Change
+  bool HLSLParallelFunctionOpt = false; // HLSL Change
+  unsigned HLSLParallelFunctionThreads = 0; // HLSL Change - 0 for one per hardware thread
 
 private:
   /// ExtensionList - This is list of all of the extensions that are registered.
@@ -23,6 +23,7 @@
 #include "llvm/IR/ValueHandle.h"
 #include "llvm/IR/ValueMap.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
+#include <functional> // HLSL Change
 
 namespace llvm {
 
@@ -51,6 +52,14 @@ class DominatorTree;
 ///
 Module *CloneModule(const Module *M);
 Module *CloneModule(const Module *M, ValueToValueMapTy &VMap);
+// HLSL Change Begin - clone selected definitions only.
+/// CloneModule - Return a copy of the specified module in which only the
+/// global definitions accepted by ShouldCloneDefinition keep their bodies or
+/// initializers; the others become external declarations.
+Module *
+CloneModule(const Module *M, ValueToValueMapTy &VMap,
+            std::function<bool(const GlobalValue *)> ShouldCloneDefinition);
+// HLSL Change End
 
 /// ClonedCodeInfo - This struct can be used to capture information about code
 /// being cloned, while it is being cloned.
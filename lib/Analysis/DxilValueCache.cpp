@@ -157,6 +157,14 @@ Value *DxilValueCache::ProcessAndSimplify_Br(Instruction *I, DominatorTree *DT)
   BranchInst *Br = cast<BranchInst>(I);
 
   BasicBlock *BB = Br->getParent();
+
+  // Whatever we learn about the successors comes from this branch and the
+  // reachability of its block.
+  for (unsigned i = 0; i < Br->getNumSuccessors(); i++) {
+    ValueMap.AddDependent(Br, Br->getSuccessor(i));
+    ValueMap.AddDependent(BB, Br->getSuccessor(i));
+  }
+
   if (Br->isConditional()) {
 
     BasicBlock *TrueSucc = Br->getSuccessor(0);
@@ -332,7 +340,49 @@ Value *DxilValueCache::WeakValueMap::Get(Value *V) {
 }
 
 void DxilValueCache::WeakValueMap::SetSentinel(Value *Key) {
-  Map[Key].Set(Key, GetSentinel(Key->getContext()));
+  Map[Key].Set(GetSentinel(Key->getContext()));
+  if (isa<BasicBlock>(Key) || isa<TerminatorInst>(Key))
+    Reachability.push_back(Key);
+  Unknowns.push_back(Key);
+  // Most keys get a value right after the sentinel, so the list is mostly
+  // dead weight. Keep it within a small multiple of the map.
+  if (Unknowns.size() > 2 * Map.size() + 64)
+    CompactUnknowns();
+}
+
+void DxilValueCache::WeakValueMap::CompactUnknowns() {
+  SmallPtrSet<const Value *, 64> Kept;
+  unsigned NumKept = 0;
+  for (const Value *Key : Unknowns) {
+    auto FindIt = Map.find(Key);
+    if (FindIt == Map.end() || FindIt->second.IsStale() ||
+        FindIt->second.Value != Sentinel.get())
+      continue;
+    if (Kept.insert(Key).second)
+      Unknowns[NumKept++] = Key;
+  }
+  Unknowns.resize(NumKept);
+}
+
+void DxilValueCache::WeakValueMap::AddDependent(Value *Key, Value *Dependent) {
+  Map[Key].Dependents.insert(Dependent);
+}
+
+void DxilValueCache::WeakValueMap::Invalidate(const Value *Key) {
+  // Only marks entries stale, since this runs from the map's own value
+  // handle callbacks. Clearing the dependents as we go also stops cycles.
+  SmallVector<const Value *, 16> WorkList;
+  WorkList.push_back(Key);
+  while (WorkList.size()) {
+    auto FindIt = Map.find(WorkList.pop_back_val());
+    if (FindIt == Map.end())
+      continue;
+    ValueEntry &Entry = FindIt->second;
+    Entry.Stale = true;
+    Entry.Value = nullptr;
+    WorkList.append(Entry.Dependents.begin(), Entry.Dependents.end());
+    Entry.Dependents.clear();
+  }
 }
 
 Value *DxilValueCache::WeakValueMap::GetSentinel(LLVMContext &Ctx) {
@@ -345,10 +395,22 @@ Value *DxilValueCache::WeakValueMap::GetSentinel(LLVMContext &Ctx) {
 void DxilValueCache::WeakValueMap::ResetUnknowns() {
   if (!Sentinel)
     return;
-  for (auto it = Map.begin(); it != Map.end(); it++) {
-    if (it->second.Value == Sentinel.get())
-      it->second.Value = nullptr;
+  // Keys may have been deleted or set to a value since, in which case
+  // they're either gone from the map or no longer hold the sentinel.
+  for (const Value *Key : Unknowns) {
+    auto FindIt = Map.find(Key);
+    if (FindIt != Map.end() && FindIt->second.Value == Sentinel.get())
+      FindIt->second.Stale = true;
   }
+  Unknowns.clear();
+  ResetReachability();
+}
+
+void DxilValueCache::WeakValueMap::ResetReachability() {
+  // Everything derived from a block's reachability goes with it.
+  for (const Value *Key : Reachability)
+    Invalidate(Key);
+  Reachability.clear();
 }
 
 LLVM_DUMP_METHOD
@@ -382,7 +444,7 @@ void DxilValueCache::WeakValueMap::dump() const {
 }
 
 void DxilValueCache::WeakValueMap::Set(Value *Key, Value *V) {
-  Map[Key].Set(Key, V);
+  Map[Key].Set(V);
 }
 
 // If there's a cached value, return it. Otherwise, return
@@ -421,13 +483,17 @@ ConstantInt *DxilValueCache::GetConstInt(Value *V, DominatorTree *DT) {
   return nullptr;
 }
 
+// Reachability is only worked out once per block. What's cached stays until
+// something it was derived from changes, or ResetUnknowns is called.
 bool DxilValueCache::IsAlwaysReachable(BasicBlock *BB, DominatorTree *DT) {
-  ProcessValue(BB, DT);
+  if (!ValueMap.Seen(BB))
+    ProcessValue(BB, DT);
   return IsAlwaysReachable_(BB);
 }
 
 bool DxilValueCache::IsUnreachable(BasicBlock *BB, DominatorTree *DT) {
-  ProcessValue(BB, DT);
+  if (!ValueMap.Seen(BB))
+    ProcessValue(BB, DT);
   return IsUnreachable_(BB);
 }
 
@@ -478,6 +544,7 @@ Value *DxilValueCache::ProcessValue(Value *NewV, DominatorTree *DT) {
           Instruction *UseI = dyn_cast<Instruction>(U.get());
           if (!UseI)
             continue;
+          ValueMap.AddDependent(UseI, I);
           if (!ValueMap.Seen(UseI))
             WorkList.push_back(UseI);
         }
@@ -486,6 +553,8 @@ Value *DxilValueCache::ProcessValue(Value *NewV, DominatorTree *DT) {
           for (unsigned i = 0; i < PN->getNumIncomingValues(); i++) {
             BasicBlock *BB = PN->getIncomingBlock(i);
             TerminatorInst *Term = BB->getTerminator();
+            ValueMap.AddDependent(Term, I);
+            ValueMap.AddDependent(BB, I);
             if (!ValueMap.Seen(Term))
               WorkList.push_back(Term);
             if (!ValueMap.Seen(BB))
@@ -500,6 +569,8 @@ Value *DxilValueCache::ProcessValue(Value *NewV, DominatorTree *DT) {
         for (pred_iterator PI = pred_begin(BB), E = pred_end(BB); PI != E; PI++) {
           BasicBlock *PredBB = *PI;
           TerminatorInst *Term = PredBB->getTerminator();
+          ValueMap.AddDependent(Term, BB);
+          ValueMap.AddDependent(PredBB, BB);
           if (!ValueMap.Seen(Term))
             WorkList.push_back(Term);
           if (!ValueMap.Seen(PredBB))
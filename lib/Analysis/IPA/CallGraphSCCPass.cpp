@@ -127,6 +127,7 @@ bool CGPassManager::RunPassOnSCC(Pass *P, CallGraphSCC &CurSCC,
 
     {
       TimeRegion PassTimer(getPassTimer(CGSP));
+      TimingListenerRegion PassRegion(CGSP->getPassName()); // HLSL Change
       Changed = CGSP->runOnSCC(CurSCC);
     }
     
@@ -151,6 +152,7 @@ bool CGPassManager::RunPassOnSCC(Pass *P, CallGraphSCC &CurSCC,
       dumpPassInfo(P, EXECUTION_MSG, ON_FUNCTION_MSG, F->getName());
       {
         TimeRegion PassTimer(getPassTimer(FPP));
+        TimingListenerRegion PassRegion(FPP->getPassName()); // HLSL Change
         Changed |= FPP->runOnFunction(*F);
       }
       F->getContext().yield();
@@ -247,6 +247,7 @@ bool LPPassManager::runOnFunction(Function &F) {
       {
         PassManagerPrettyStackEntry X(P, *CurrentLoop->getHeader());
         TimeRegion PassTimer(getPassTimer(P));
+        TimingListenerRegion PassRegion(P->getPassName()); // HLSL Change
 
         Changed |= P->runOnLoop(CurrentLoop, *this);
       }
@@ -96,6 +96,7 @@ bool RGPassManager::runOnFunction(Function &F) {
         PassManagerPrettyStackEntry X(P, *CurrentRegion->getEntry());
 
         TimeRegion PassTimer(getPassTimer(P));
+        TimingListenerRegion PassRegion(P->getPassName()); // HLSL Change
         Changed |= P->runOnRegion(CurrentRegion, *this);
       }
 
@@ -22,6 +22,8 @@
 
 #ifdef _WIN32
 #include <intsafe.h>
+#else
+#include <sys/mman.h>
 #endif
 
 #define CP_UTF16 1200
@@ -757,6 +759,111 @@ HRESULT DxcCreateBlobFromFile(LPCWSTR pFileName, UINT32 *pCodePage,
   return DxcCreateBlobFromFile(DxcGetThreadMallocNoRef(), pFileName, pCodePage, ppBlobEncoding);
 }
 
+// Read-only view of a whole file. Pages are read in as they are touched, and
+// the view is unmapped when the blob is released.
+class MappedFileBlob : public IDxcBlob {
+private:
+  DXC_MICROCOM_TM_REF_FIELDS() // an underlying m_pMalloc that owns this
+  LPVOID m_pView = nullptr;
+  SIZE_T m_ViewSize = 0;
+public:
+  DXC_MICROCOM_ADDREF_IMPL(m_dwRef)
+  ULONG STDMETHODCALLTYPE Release() override {
+    // Like the other blobs, avoid TLS so utilities can use these.
+    ULONG result = (ULONG)--m_dwRef;
+    if (result == 0) {
+      CComPtr<IMalloc> pTmp(m_pMalloc);
+      this->~MappedFileBlob();
+      pTmp->Free(this);
+    }
+    return result;
+  }
+  DXC_MICROCOM_TM_CTOR(MappedFileBlob)
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void **ppvObject) override {
+    return DoBasicQueryInterface<IDxcBlob>(this, iid, ppvObject);
+  }
+
+  ~MappedFileBlob() {
+    if (m_pView == nullptr)
+      return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_pView);
+#else
+    munmap(m_pView, m_ViewSize);
+#endif
+  }
+
+  HRESULT Map(HANDLE hFile, SIZE_T size) {
+    // Empty files can't be mapped; they're simply empty blobs.
+    if (size == 0)
+      return S_OK;
+#ifdef _WIN32
+    HANDLE hMapping =
+        CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (hMapping == nullptr)
+      return HRESULT_FROM_WIN32(GetLastError());
+    CHandle m(hMapping);
+    m_pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, size);
+    if (m_pView == nullptr)
+      return HRESULT_FROM_WIN32(GetLastError());
+#else
+    LPVOID pView =
+        mmap(nullptr, size, PROT_READ, MAP_PRIVATE, (int)(size_t)hFile, 0);
+    if (pView == MAP_FAILED)
+      return HRESULT_FROM_WIN32(GetLastError());
+    m_pView = pView;
+#endif
+    m_ViewSize = size;
+    return S_OK;
+  }
+
+  virtual LPVOID STDMETHODCALLTYPE GetBufferPointer(void) override {
+    return m_pView;
+  }
+  virtual SIZE_T STDMETHODCALLTYPE GetBufferSize(void) override {
+    return m_ViewSize;
+  }
+};
+
+_Use_decl_annotations_
+HRESULT
+DxcCreateBlobFromFileMapping(IMalloc *pMalloc, LPCWSTR pFileName,
+                             UINT32 *pCodePage,
+                             IDxcBlobEncoding **ppBlobEncoding) throw() {
+  if (pFileName == nullptr || ppBlobEncoding == nullptr) {
+    return E_POINTER;
+  }
+  *ppBlobEncoding = nullptr;
+  if (!pMalloc)
+    pMalloc = DxcGetThreadMallocNoRef();
+
+  HANDLE hFile = CreateFileW(pFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    return HRESULT_FROM_WIN32(GetLastError());
+  }
+  CHandle h(hFile);
+
+  LARGE_INTEGER FileSize;
+  if (!GetFileSizeEx(hFile, &FileSize)) {
+    return HRESULT_FROM_WIN32(GetLastError());
+  }
+  // Blob sizes and container offsets are 32-bit, as for ReadBinaryFile.
+  if (FileSize.u.HighPart != 0) {
+    return DXC_E_INPUT_FILE_TOO_LARGE;
+  }
+
+  CComPtr<MappedFileBlob> pMapped = MappedFileBlob::Alloc(pMalloc);
+  IFROOM(pMapped.p);
+  IFR(pMapped->Map(hFile, FileSize.u.LowPart));
+
+  // The view outlives the file handle; the encoding blob references it.
+  bool known = (pCodePage != nullptr);
+  UINT32 codePage = (pCodePage != nullptr) ? *pCodePage : 0;
+  return DxcCreateBlobEncodingFromBlob(pMapped, 0, 0, known, codePage, pMalloc,
+                                       ppBlobEncoding);
+}
+
 _Use_decl_annotations_
 HRESULT
 DxcCreateBlobWithEncodingSet(IMalloc *pMalloc, IDxcBlob *pBlob, UINT32 codePage,
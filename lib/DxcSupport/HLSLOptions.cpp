@@ -603,6 +603,7 @@ int ReadDxcOpts(const OptTable *optionTable, unsigned flagsToInclude,
   else
     opts.OptLevel = 3;
   opts.OptDump = Args.hasFlag(OPT_Odump, OPT_INVALID, false);
+  opts.TimeReport = Args.hasFlag(OPT_ftime_report, OPT_INVALID, false);
 
   opts.DisableValidation = Args.hasFlag(OPT_VD, OPT_INVALID, false);
 
@@ -876,6 +877,13 @@ int ReadDxcOpts(const OptTable *optionTable, unsigned flagsToInclude,
     }
   }
 
+  opts.SpirvOptions.optRecipeDir = Args.getLastArgValue(OPT_fspv_opt_recipe_dir_EQ);
+  opts.SpirvOptions.optRecipeClass = Args.getLastArgValue(OPT_fspv_opt_recipe_class_EQ, opts.TargetProfile);
+  if (!opts.SpirvOptions.optRecipeDir.empty() && numOconfigs > 0) {
+    errors << "-fspv-opt-recipe-dir should not be used together with -Oconfig";
+    return 1;
+  }
+
 #else
   if (Args.hasFlag(OPT_spirv, OPT_INVALID, false) ||
       Args.hasFlag(OPT_fvk_invert_y, OPT_INVALID, false) ||
@@ -893,6 +901,8 @@ int ReadDxcOpts(const OptTable *optionTable, unsigned flagsToInclude,
       !Args.getLastArgValue(OPT_fspv_extension_EQ).empty() ||
       !Args.getLastArgValue(OPT_fspv_target_env_EQ).empty() ||
       !Args.getLastArgValue(OPT_Oconfig).empty() ||
+      !Args.getLastArgValue(OPT_fspv_opt_recipe_dir_EQ).empty() ||
+      !Args.getLastArgValue(OPT_fspv_opt_recipe_class_EQ).empty() ||
       !Args.getLastArgValue(OPT_fvk_bind_register).empty() ||
       !Args.getLastArgValue(OPT_fvk_bind_globals).empty() ||
       !Args.getLastArgValue(OPT_fvk_b_shift).empty() ||
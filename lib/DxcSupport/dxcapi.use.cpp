@@ -78,6 +78,14 @@ void ReadFileIntoBlob(DxcDllSupport &dxcSupport, _In_ LPCWSTR pFileName,
            pFileName);
 }
 
+void MapFileIntoBlob(_In_ LPCWSTR pFileName,
+                     _COM_Outptr_ IDxcBlobEncoding **ppBlobEncoding) {
+  IFT_Data(hlsl::DxcCreateBlobFromFileMapping(hlsl::GetGlobalHeapMalloc(),
+                                              pFileName, nullptr,
+                                              ppBlobEncoding),
+           pFileName);
+}
+
 void WriteOperationErrorsToConsole(_In_ IDxcOperationResult *pResult,
                                    bool outputWarnings) {
   HRESULT status;
@@ -0,0 +1,400 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// DxilContainerArchive.cpp                                                  //
+// Copyright (C) Microsoft Corporation. All rights reserved.                 //
+// This file is distributed under the University of Illinois Open Source     //
+// License. See LICENSE.TXT for details.                                     //
+//                                                                           //
+// Packed archive of many dxil containers with shared parts.                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "dxc/DxilContainer/DxilContainerArchive.h"
+#include "dxc/DxilContainer/DxilContainerAssembler.h"
+#include "dxc/Support/FileIOHelper.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+
+using namespace llvm;
+
+namespace hlsl {
+
+static std::string DigestKey(const uint8_t *pDigest) {
+  return std::string((const char *)pDigest, DxilContainerHashSize);
+}
+
+static uint32_t DigestBucket(const uint8_t *pDigest, uint32_t BucketCount) {
+  uint32_t Value;
+  memcpy(&Value, pDigest, sizeof(Value));
+  return Value & (BucketCount - 1);
+}
+
+static_assert(sizeof(MD5::MD5Result) == DxilContainerHashSize,
+              "else MD5 digests don't fit in container hashes");
+
+///////////////////////////////////////////////////////////////////////////////
+// DxilArchiveWriter
+
+DxilArchiveWriter::DxilArchiveWriter(raw_ostream &OS) : m_OS(OS) {
+  DxilArchiveHeader Header;
+  Header.Magic = DxilArchiveMagic;
+  Header.MajorVersion = DxilArchiveVersionMajor;
+  Header.MinorVersion = DxilArchiveVersionMinor;
+  m_OS.write((const char *)&Header, sizeof(Header));
+}
+
+// An upper bound on the size Finish leaves the archive at, were payloads of
+// the given size and the given table entries added to what's there.
+uint64_t DxilArchiveWriter::GetFinishedSizeBound(uint64_t NewPayloadSize,
+                                                 uint64_t NewPartCount,
+                                                 uint64_t NewPartRefCount) const {
+  uint64_t ShaderCount = m_Shaders.size() + 1;
+  uint64_t Size = m_OS.tell() + NewPayloadSize;
+  Size += (m_Parts.size() + NewPartCount) * sizeof(DxilArchivePart);
+  Size += (m_PartRefs.size() + NewPartRefCount) * sizeof(uint32_t);
+  Size += ShaderCount * sizeof(DxilArchiveShader);
+  // Each bucket table has fewer than four buckets per shader.
+  Size += 2 * (4 * ShaderCount + 2) * sizeof(uint32_t);
+  // Padding before the part table, shader table and footer.
+  Size += 3 * 8;
+  return Size + sizeof(DxilArchiveFooter);
+}
+
+void DxilArchiveWriter::WritePadding() {
+  // Eight, so the 64-bit offsets in the part table are aligned as well.
+  static const char Zeros[8] = {};
+  uint64_t Misalignment = m_OS.tell() % sizeof(Zeros);
+  if (Misalignment)
+    m_OS.write(Zeros, sizeof(Zeros) - Misalignment);
+}
+
+_Use_decl_annotations_
+HRESULT DxilArchiveWriter::AddContainer(const void *pContainer, uint32_t size) {
+  const DxilContainerHeader *pHeader = IsDxilContainerLike(pContainer, size);
+  if (pHeader == nullptr || !IsValidDxilContainer(pHeader, size))
+    return DXC_E_CONTAINER_INVALID;
+
+  // Only the parts are kept, so they must follow the offset table back to
+  // back for the container to come back byte for byte.
+  const uint32_t *pPartOffsets = reinterpret_cast<const uint32_t *>(pHeader + 1);
+  uint64_t Offset = sizeof(DxilContainerHeader) +
+                    GetOffsetTableSize(pHeader->PartCount);
+  for (uint32_t i = 0; i < pHeader->PartCount; ++i) {
+    if (pPartOffsets[i] != Offset)
+      return DXC_E_CONTAINER_INVALID;
+    Offset += sizeof(DxilPartHeader) + GetDxilContainerPart(pHeader, i)->PartSize;
+  }
+  if (Offset != pHeader->ContainerSizeInBytes)
+    return DXC_E_CONTAINER_INVALID;
+
+  // Shaders are keyed by the whole container rather than the HASH part, which
+  // covers only the program: containers that differ in root signature,
+  // signatures or debug parts are distinct shaders. The HASH part is kept as
+  // a secondary key.
+  DxilArchiveShader Shader = {};
+  MD5 ContainerHash;
+  ContainerHash.update(ArrayRef<uint8_t>((const uint8_t *)pHeader,
+                                         pHeader->ContainerSizeInBytes));
+  MD5::MD5Result ContainerDigest;
+  ContainerHash.final(ContainerDigest);
+  memcpy(Shader.ContainerDigest.Digest, ContainerDigest,
+         sizeof(Shader.ContainerDigest.Digest));
+  std::string ShaderKey = DigestKey(Shader.ContainerDigest.Digest);
+  if (m_ShaderIndex.count(ShaderKey))
+    return S_FALSE;
+  const DxilPartHeader *pHashPart =
+      GetDxilPartByType(pHeader, DFCC_ShaderHash);
+  if (pHashPart && pHashPart->PartSize == sizeof(DxilShaderHash)) {
+    memcpy(&Shader.ShaderHash, GetDxilPartData(pHashPart),
+           sizeof(DxilShaderHash));
+    Shader.Flags = (uint32_t)DxilArchiveShaderFlags::HasShaderHash;
+  }
+  Shader.ContainerHash = pHeader->Hash;
+  Shader.Version = pHeader->Version;
+  Shader.FirstPartRef = (uint32_t)m_PartRefs.size();
+  Shader.PartCount = pHeader->PartCount;
+
+  // Work out which parts are new before writing any, so a container that
+  // would take the archive over the size limit is rejected whole.
+  std::vector<std::string> PartKeys;
+  PartKeys.reserve(pHeader->PartCount);
+  uint64_t NewPayloadSize = 0, NewPartCount = 0;
+  for (auto it = begin(pHeader), e = end(pHeader); it != e; ++it) {
+    const DxilPartHeader *pPart = *it;
+    MD5 Hash;
+    Hash.update(ArrayRef<uint8_t>((const uint8_t *)GetDxilPartData(pPart),
+                                  pPart->PartSize));
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    std::string Key((const char *)&pPart->PartFourCC, sizeof(uint32_t));
+    Key.append((const char *)&pPart->PartSize, sizeof(uint32_t));
+    Key.append((const char *)Result, sizeof(Result));
+    if (!m_PartIndex.count(Key)) {
+      NewPayloadSize += pPart->PartSize + 8; // With padding
+      ++NewPartCount;
+    }
+    PartKeys.push_back(std::move(Key));
+  }
+  if (GetFinishedSizeBound(NewPayloadSize, NewPartCount, pHeader->PartCount) >
+      DxilArchiveMaxSize)
+    return DXC_E_DATA_TOO_LARGE;
+
+  m_ShaderIndex.insert(std::make_pair(ShaderKey, (uint32_t)m_Shaders.size()));
+  uint32_t PartIndex = 0;
+  for (auto it = begin(pHeader), e = end(pHeader); it != e; ++it) {
+    const DxilPartHeader *pPart = *it;
+    const char *pData = GetDxilPartData(pPart);
+    auto Inserted = m_PartIndex.insert(
+        std::make_pair(PartKeys[PartIndex++], (uint32_t)m_Parts.size()));
+    if (Inserted.second) {
+      WritePadding();
+      DxilArchivePart Part;
+      Part.Offset = m_OS.tell();
+      Part.FourCC = pPart->PartFourCC;
+      Part.Size = pPart->PartSize;
+      m_Parts.push_back(Part);
+      m_OS.write(pData, pPart->PartSize);
+    }
+    m_PartRefs.push_back(Inserted.first->second);
+  }
+  m_Shaders.push_back(Shader);
+  return S_OK;
+}
+
+void DxilArchiveWriter::Finish() {
+  DxilArchiveFooter Footer = {};
+  Footer.Magic = DxilArchiveMagic;
+
+  WritePadding();
+  Footer.PartTableOffset = m_OS.tell();
+  Footer.PartCount = (uint32_t)m_Parts.size();
+  m_OS.write((const char *)m_Parts.data(),
+             m_Parts.size() * sizeof(DxilArchivePart));
+
+  Footer.PartRefOffset = m_OS.tell();
+  Footer.PartRefCount = (uint32_t)m_PartRefs.size();
+  m_OS.write((const char *)m_PartRefs.data(),
+             m_PartRefs.size() * sizeof(uint32_t));
+
+  WritePadding();
+  Footer.ShaderTableOffset = m_OS.tell();
+  Footer.ShaderCount = (uint32_t)m_Shaders.size();
+  m_OS.write((const char *)m_Shaders.data(),
+             m_Shaders.size() * sizeof(DxilArchiveShader));
+
+  // At most half full, so probes stay short and always reach an empty bucket.
+  auto WriteBuckets = [&](bool ByShaderHash, uint64_t &Offset,
+                          uint32_t &Count) {
+    uint32_t EntryCount = 0;
+    for (const DxilArchiveShader &Shader : m_Shaders) {
+      if (!ByShaderHash ||
+          (Shader.Flags & (uint32_t)DxilArchiveShaderFlags::HasShaderHash))
+        ++EntryCount;
+    }
+    uint32_t BucketCount = 0;
+    if (EntryCount) {
+      BucketCount = 2;
+      while (BucketCount < EntryCount * 2)
+        BucketCount *= 2;
+    }
+    std::vector<uint32_t> Buckets(BucketCount, 0);
+    for (uint32_t i = 0; i < m_Shaders.size(); ++i) {
+      const DxilArchiveShader &Shader = m_Shaders[i];
+      const uint8_t *pDigest = Shader.ContainerDigest.Digest;
+      if (ByShaderHash) {
+        if (!(Shader.Flags & (uint32_t)DxilArchiveShaderFlags::HasShaderHash))
+          continue;
+        pDigest = Shader.ShaderHash.Digest;
+      }
+      uint32_t Bucket = DigestBucket(pDigest, BucketCount);
+      while (Buckets[Bucket] != 0)
+        Bucket = (Bucket + 1) & (BucketCount - 1);
+      Buckets[Bucket] = i + 1;
+    }
+    Offset = m_OS.tell();
+    Count = BucketCount;
+    m_OS.write((const char *)Buckets.data(), Buckets.size() * sizeof(uint32_t));
+  };
+  WriteBuckets(false, Footer.BucketOffset, Footer.BucketCount);
+  WriteBuckets(true, Footer.ShaderHashBucketOffset,
+               Footer.ShaderHashBucketCount);
+
+  WritePadding();
+  m_OS.write((const char *)&Footer, sizeof(Footer));
+  m_OS.flush();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// DxilArchiveReader
+
+static bool IsTableInRange(uint64_t Offset, uint64_t Count, uint64_t ElemSize,
+                           uint64_t Alignment, uint64_t Limit) {
+  return Offset % Alignment == 0 && Offset >= sizeof(DxilArchiveHeader) &&
+         Offset <= Limit && Count * ElemSize <= Limit - Offset;
+}
+
+_Use_decl_annotations_
+HRESULT DxilArchiveReader::Load(const void *pArchive, uint64_t size) {
+  m_pFooter = nullptr;
+  if (pArchive == nullptr)
+    return E_POINTER;
+  if (size < sizeof(DxilArchiveHeader) + sizeof(DxilArchiveFooter))
+    return DXC_E_CONTAINER_INVALID;
+  const uint8_t *pBytes = (const uint8_t *)pArchive;
+  const DxilArchiveHeader *pHeader = (const DxilArchiveHeader *)pBytes;
+  if (pHeader->Magic != DxilArchiveMagic ||
+      pHeader->MajorVersion != DxilArchiveVersionMajor)
+    return DXC_E_CONTAINER_INVALID;
+
+  uint64_t Limit = size - sizeof(DxilArchiveFooter);
+  const DxilArchiveFooter *pFooter =
+      (const DxilArchiveFooter *)(pBytes + Limit);
+  if (pFooter->Magic != DxilArchiveMagic ||
+      !IsTableInRange(pFooter->PartTableOffset, pFooter->PartCount,
+                      sizeof(DxilArchivePart), 8, Limit) ||
+      !IsTableInRange(pFooter->PartRefOffset, pFooter->PartRefCount,
+                      sizeof(uint32_t), 4, Limit) ||
+      !IsTableInRange(pFooter->ShaderTableOffset, pFooter->ShaderCount,
+                      sizeof(DxilArchiveShader), 4, Limit) ||
+      !IsTableInRange(pFooter->BucketOffset, pFooter->BucketCount,
+                      sizeof(uint32_t), 4, Limit) ||
+      !IsTableInRange(pFooter->ShaderHashBucketOffset,
+                      pFooter->ShaderHashBucketCount, sizeof(uint32_t), 4,
+                      Limit))
+    return DXC_E_CONTAINER_INVALID;
+  if ((pFooter->BucketCount & (pFooter->BucketCount - 1)) != 0 ||
+      pFooter->BucketCount < pFooter->ShaderCount ||
+      (pFooter->ShaderHashBucketCount &
+       (pFooter->ShaderHashBucketCount - 1)) != 0)
+    return DXC_E_CONTAINER_INVALID;
+
+  const DxilArchivePart *pParts =
+      (const DxilArchivePart *)(pBytes + pFooter->PartTableOffset);
+  const uint32_t *pPartRefs =
+      (const uint32_t *)(pBytes + pFooter->PartRefOffset);
+  const DxilArchiveShader *pShaders =
+      (const DxilArchiveShader *)(pBytes + pFooter->ShaderTableOffset);
+  const uint32_t *pBuckets = (const uint32_t *)(pBytes + pFooter->BucketOffset);
+  const uint32_t *pShaderHashBuckets =
+      (const uint32_t *)(pBytes + pFooter->ShaderHashBucketOffset);
+
+  // Check everything the accessors rely on up front, so they don't have to.
+  for (uint32_t i = 0; i < pFooter->PartCount; ++i) {
+    const DxilArchivePart &Part = pParts[i];
+    if (Part.Offset < sizeof(DxilArchiveHeader) || Part.Offset > Limit ||
+        Part.Size > Limit - Part.Offset)
+      return DXC_E_CONTAINER_INVALID;
+  }
+  for (uint32_t i = 0; i < pFooter->PartRefCount; ++i) {
+    if (pPartRefs[i] >= pFooter->PartCount)
+      return DXC_E_CONTAINER_INVALID;
+  }
+  for (uint32_t i = 0; i < pFooter->ShaderCount; ++i) {
+    const DxilArchiveShader &Shader = pShaders[i];
+    if ((uint64_t)Shader.FirstPartRef + Shader.PartCount > pFooter->PartRefCount)
+      return DXC_E_CONTAINER_INVALID;
+    uint64_t ContainerSize = sizeof(DxilContainerHeader) +
+                             GetOffsetTableSize(Shader.PartCount);
+    for (uint32_t j = 0; j < Shader.PartCount; ++j)
+      ContainerSize += sizeof(DxilPartHeader) +
+                       pParts[pPartRefs[Shader.FirstPartRef + j]].Size;
+    if (ContainerSize > UINT32_MAX)
+      return DXC_E_CONTAINER_INVALID;
+  }
+  for (uint32_t i = 0; i < pFooter->BucketCount; ++i) {
+    if (pBuckets[i] > pFooter->ShaderCount)
+      return DXC_E_CONTAINER_INVALID;
+  }
+  for (uint32_t i = 0; i < pFooter->ShaderHashBucketCount; ++i) {
+    if (pShaderHashBuckets[i] > pFooter->ShaderCount)
+      return DXC_E_CONTAINER_INVALID;
+  }
+
+  m_pArchive = pBytes;
+  m_pFooter = pFooter;
+  m_pParts = pParts;
+  m_pPartRefs = pPartRefs;
+  m_pShaders = pShaders;
+  m_pBuckets = pBuckets;
+  m_pShaderHashBuckets = pShaderHashBuckets;
+  return S_OK;
+}
+
+_Use_decl_annotations_
+bool DxilArchiveReader::FindShader(const uint8_t *pDigest,
+                                   uint32_t *pIndex) const {
+  uint32_t BucketCount = m_pFooter->BucketCount;
+  if (BucketCount == 0)
+    return false;
+  uint32_t Bucket = DigestBucket(pDigest, BucketCount);
+  for (uint32_t Probe = 0; Probe < BucketCount; ++Probe) {
+    uint32_t Entry = m_pBuckets[Bucket];
+    if (Entry == 0)
+      return false;
+    if (memcmp(m_pShaders[Entry - 1].ContainerDigest.Digest, pDigest,
+               DxilContainerHashSize) == 0) {
+      *pIndex = Entry - 1;
+      return true;
+    }
+    Bucket = (Bucket + 1) & (BucketCount - 1);
+  }
+  return false;
+}
+
+_Use_decl_annotations_
+void DxilArchiveReader::FindShadersByHash(
+    const uint8_t *pDigest, std::vector<uint32_t> &Indices) const {
+  uint32_t BucketCount = m_pFooter->ShaderHashBucketCount;
+  if (BucketCount == 0)
+    return;
+  uint32_t Bucket = DigestBucket(pDigest, BucketCount);
+  for (uint32_t Probe = 0; Probe < BucketCount; ++Probe) {
+    uint32_t Entry = m_pShaderHashBuckets[Bucket];
+    if (Entry == 0)
+      return;
+    if (memcmp(m_pShaders[Entry - 1].ShaderHash.Digest, pDigest,
+               DxilContainerHashSize) == 0)
+      Indices.push_back(Entry - 1);
+    Bucket = (Bucket + 1) & (BucketCount - 1);
+  }
+}
+
+ArrayRef<uint32_t> DxilArchiveReader::GetShaderPartRefs(uint32_t index) const {
+  const DxilArchiveShader &Shader = m_pShaders[index];
+  return ArrayRef<uint32_t>(m_pPartRefs + Shader.FirstPartRef,
+                            Shader.PartCount);
+}
+
+uint32_t DxilArchiveReader::GetContainerSize(uint32_t index) const {
+  uint32_t PartsSize = 0;
+  for (uint32_t PartIndex : GetShaderPartRefs(index))
+    PartsSize += m_pParts[PartIndex].Size;
+  return (uint32_t)GetDxilContainerSizeFromParts(m_pShaders[index].PartCount,
+                                                 PartsSize);
+}
+
+_Use_decl_annotations_
+void DxilArchiveReader::UnpackContainer(uint32_t index,
+                                        AbstractMemoryStream *pStream) const {
+  std::unique_ptr<DxilContainerWriter> pWriter(NewDxilContainerWriter());
+  for (uint32_t PartIndex : GetShaderPartRefs(index)) {
+    const DxilArchivePart &Part = m_pParts[PartIndex];
+    const void *pData = GetPartData(PartIndex);
+    pWriter->AddPart(Part.FourCC, Part.Size,
+                     [pData, &Part](AbstractMemoryStream *pStream) {
+                       ULONG cbWritten;
+                       IFT(pStream->Write(pData, Part.Size, &cbWritten));
+                     });
+  }
+
+  // The writer fills in a fresh header; put back the one that was packed.
+  UINT64 Start = pStream->GetPosition();
+  pWriter->write(pStream);
+  DxilContainerHeader *pHeader =
+      reinterpret_cast<DxilContainerHeader *>(pStream->GetPtr() + Start);
+  pHeader->Hash = m_pShaders[index].ContainerHash;
+  pHeader->Version = m_pShaders[index].Version;
+}
+
+} // namespace hlsl
@@ -1544,6 +1544,17 @@ public:
 
 } // namespace
 
+// Writes the current state of the module to a new bitcode stream.
+static CComPtr<AbstractMemoryStream>
+SerializeModuleState(Module *pModule, bool bPreserveUseListOrder) {
+  CComPtr<AbstractMemoryStream> pStream;
+  IFT(CreateMemoryStream(DxcGetThreadMallocNoRef(), &pStream));
+  raw_stream_ostream outStream(pStream.p);
+  WriteBitcodeToFile(pModule, outStream, bPreserveUseListOrder);
+  outStream.flush();
+  return pStream;
+}
+
 void hlsl::SerializeDxilContainerForModule(DxilModule *pModule,
                                            AbstractMemoryStream *pModuleBitcode,
                                            AbstractMemoryStream *pFinalStream,
@@ -1551,7 +1562,8 @@ void hlsl::SerializeDxilContainerForModule(DxilModule *pModule,
                                            SerializeDxilFlags Flags,
                                            DxilShaderHash *pShaderHashOut,
                                            AbstractMemoryStream *pReflectionStreamOut,
-                                           AbstractMemoryStream *pRootSigStreamOut) {
+                                           AbstractMemoryStream *pRootSigStreamOut,
+                                           AbstractMemoryStream **ppProgramBitcodeOut) {
   // TODO: add a flag to update the module and remove information that is not part
   // of DXIL proper and is used only to assemble the container.
 
@@ -1661,23 +1673,24 @@ void hlsl::SerializeDxilContainerForModule(DxilModule *pModule,
     }
   }
 
-  // If metadata was stripped, re-serialize the input module.
-  CComPtr<AbstractMemoryStream> pInputProgramStream = pModuleBitcode;
-  if (bMetadataStripped) {
-    pInputProgramStream.Release();
-    IFT(CreateMemoryStream(DxcGetThreadMallocNoRef(), &pInputProgramStream));
-    raw_stream_ostream outStream(pInputProgramStream.p);
-    WriteBitcodeToFile(pModule->GetModule(), outStream, true);
-  }
+  // Each module state is serialized at most once, and only if a part needs
+  // it.  The input module (as emitted, less any stripped metadata) is needed
+  // for the debug part, or as the program if there's no debug info to strip.
+  // It must be written here: emitting reflection below re-emits metadata,
+  // which would put back what was stripped (e.g. dx.rootSignature).
+  bool bHasDebugInfo = HasDebugInfo(*pModule->GetModule());
+  CComPtr<AbstractMemoryStream> pInputProgramStream;
+  if (!bMetadataStripped)
+    pInputProgramStream = pModuleBitcode;
+  else if (!bHasDebugInfo || (Flags & SerializeDxilFlags::IncludeDebugInfoPart))
+    pInputProgramStream = SerializeModuleState(pModule->GetModule(), true);
 
   // If we have debug information present, serialize it to a debug part, then use the stripped version as the canonical program version.
-  CComPtr<AbstractMemoryStream> pProgramStream = pInputProgramStream;
   bool bModuleStripped = false;
-  bool bHasDebugInfo = HasDebugInfo(*pModule->GetModule());
   if (bHasDebugInfo) {
-    uint32_t debugInUInt32, debugPaddingBytes;
-    GetPaddedProgramPartSize(pInputProgramStream, debugInUInt32, debugPaddingBytes);
     if (Flags & SerializeDxilFlags::IncludeDebugInfoPart) {
+      uint32_t debugInUInt32, debugPaddingBytes;
+      GetPaddedProgramPartSize(pInputProgramStream, debugInUInt32, debugPaddingBytes);
       writer.AddPart(DFCC_ShaderDebugInfoDXIL, debugInUInt32 * sizeof(uint32_t) + sizeof(DxilProgramHeader), [&](AbstractMemoryStream *pStream) {
         WriteProgramPart(pModule->GetShaderModel(), pInputProgramStream, pStream);
       });
@@ -1702,17 +1715,17 @@ void hlsl::SerializeDxilContainerForModule(DxilModule *pModule,
     pModule->ReEmitDxilResources();
     pModule->EmitDxilCounters();
 
-    reflectionModule.reset(llvm::CloneModule(pModule->GetModule()));
+    // Function bodies aren't part of reflection, so leave them out of the
+    // clone rather than copying and then deleting them.
+    ValueToValueMapTy VMap;
+    reflectionModule.reset(llvm::CloneModule(
+        pModule->GetModule(), VMap,
+        [](const GlobalValue *GV) { return !isa<Function>(GV); }));
 
     // Now restore validator version on main module and re-emit metadata.
     pModule->SetValidatorVersion(ValMajor, ValMinor);
     pModule->ReEmitDxilResources();
 
-    for (Function &F : reflectionModule->functions()) {
-      if (!F.isDeclaration()) {
-        F.deleteBody();
-      }
-    }
     // Just make sure this doesn't crash/assert on debug build:
     DXASSERT_NOMSG(&reflectionModule->GetOrCreateDxilModule());
   }
@@ -1722,10 +1735,8 @@ void hlsl::SerializeDxilContainerForModule(DxilModule *pModule,
   uint32_t reflectPartSizeInBytes = 0;
   if (bEmitReflection)
   {
-    IFT(CreateMemoryStream(DxcGetThreadMallocNoRef(), &pReflectionBitcodeStream));
-    raw_stream_ostream outStream(pReflectionBitcodeStream.p);
-    WriteBitcodeToFile(reflectionModule.get(), outStream, false);
-    outStream.flush();
+    pReflectionBitcodeStream = SerializeModuleState(reflectionModule.get(), false);
+    reflectionModule.reset();
     uint32_t reflectInUInt32 = 0, reflectPaddingBytes = 0;
     GetPaddedProgramPartSize(pReflectionBitcodeStream, reflectInUInt32, reflectPaddingBytes);
     reflectPartSizeInBytes = reflectInUInt32 * sizeof(uint32_t) + sizeof(DxilProgramHeader);
@@ -1759,12 +1770,14 @@ void hlsl::SerializeDxilContainerForModule(DxilModule *pModule,
     bModuleStripped |= pModule->StripReflection();
   }
 
-  // If debug info or reflection was stripped, re-serialize the module.
+  // If debug info or reflection was stripped, re-serialize the module;
+  // otherwise the program is the input module.
+  CComPtr<AbstractMemoryStream> pProgramStream;
   if (bModuleStripped) {
-    pProgramStream.Release();
-    IFT(CreateMemoryStream(DxcGetThreadMallocNoRef(), &pProgramStream));
-    raw_stream_ostream outStream(pProgramStream.p);
-    WriteBitcodeToFile(pModule->GetModule(), outStream, false);
+    pProgramStream = SerializeModuleState(pModule->GetModule(), false);
+  } else {
+    DXASSERT_NOMSG(pInputProgramStream);
+    pProgramStream = pInputProgramStream;
   }
 
   // Compute hash if needed.
@@ -1845,6 +1858,11 @@ void hlsl::SerializeDxilContainerForModule(DxilModule *pModule,
   });
 
   writer.write(pFinalStream);
+
+  // The program bitcode, for checking the part against the module it came
+  // from without serializing the module again.
+  if (ppProgramBitcodeOut)
+    IFT(pProgramStream.CopyTo(ppProgramBitcodeOut));
 }
 
 void hlsl::SerializeDxilContainerForRootSignature(hlsl::RootSignatureHandle *pRootSigHandle,
@@ -11,9 +11,13 @@
 
 #include "DxilDiaSession.h"
 
+#include <algorithm>
+#include <tuple>
+
 #include "dxc/DxilPIXPasses/DxilPIXPasses.h"
 #include "dxc/DxilPIXPasses/DxilPIXVirtualRegisters.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instruction.h"
@@ -82,7 +86,10 @@ void dxil_dia::Session::Init(
         continue;
       }
       m_rvaMap.insert({ &i, rva });
-      m_instructions.insert({ rva, &i});
+      if (rva >= m_instructions.size())
+        m_instructions.resize(rva + 1, nullptr);
+      if (m_instructions[rva] == nullptr)
+        m_instructions[rva] = &i;
       if (llvm::DebugLoc DL = i.getDebugLoc()) {
         auto result = m_lineToInfoMap.emplace(DL.getLine(), LineInfo(DL.getCol(), rva, rva + 1));
         if (!result.second) {
@@ -95,37 +102,87 @@ void dxil_dia::Session::Init(
   }
 
   // Sanity check to make sure rva map is same as instruction index.
-  for (auto It = m_instructions.begin(); It != m_instructions.end(); ++It) {
-    DXASSERT(m_rvaMap.find(It->second) != m_rvaMap.end(), "instruction not mapped to rva");
-    DXASSERT(m_rvaMap[It->second] == It->first, "instruction mapped to wrong rva");
+  for (RVA rva = 0; rva < m_instructions.size(); ++rva) {
+    if (m_instructions[rva] == nullptr)
+      continue;
+    DXASSERT(m_rvaMap.find(m_instructions[rva]) != m_rvaMap.end(), "instruction not mapped to rva");
+    DXASSERT(m_rvaMap[m_instructions[rva]] == rva, "instruction mapped to wrong rva");
+  }
+
+  // Index the source files by name; the first file with a name is the one
+  // found by it.
+  if (m_contents != nullptr) {
+    for (unsigned i = 0; i < m_contents->getNumOperands(); ++i) {
+      llvm::StringRef fn =
+        llvm::dyn_cast<llvm::MDString>(m_contents->getOperand(i)->getOperand(0))
+        ->getString();
+      m_fileIds.insert({ fn, i });
+    }
   }
+}
 
-  // Initialize symbols
-  try {
-      m_symsMgr.Init(this);
-  } catch (const hlsl::Exception &) {
-      m_symsMgr = std::move(dxil_dia::SymbolManager());
+dxil_dia::SymbolManager &dxil_dia::Session::SymMgr() {
+  // Symbols are only needed by clients that walk scopes and variables, so
+  // the debug info isn't indexed until one of them asks.
+  if (!m_symsMgrInitialized) {
+    m_symsMgrInitialized = true;
+    DxcThreadMalloc TM(m_pMalloc);
+    try {
+        m_symsMgr.Init(this);
+    } catch (const hlsl::Exception &) {
+        m_symsMgr = std::move(dxil_dia::SymbolManager());
+    }
   }
+  return m_symsMgr;
 }
 
 HRESULT dxil_dia::Session::getSourceFileIdByName(
     llvm::StringRef fileName,
     DWORD *pRetVal) {
-  if (Contents() != nullptr) {
-    for (unsigned i = 0; i < Contents()->getNumOperands(); ++i) {
-      llvm::StringRef fn =
-        llvm::dyn_cast<llvm::MDString>(Contents()->getOperand(i)->getOperand(0))
-        ->getString();
-      if (fn.equals(fileName)) {
-        *pRetVal = i;
-        return S_OK;
-      }
-    }
+  auto it = m_fileIds.find(fileName);
+  if (it != m_fileIds.end()) {
+    *pRetVal = it->second;
+    return S_OK;
   }
   *pRetVal = 0;
   return S_FALSE;
 }
 
+HRESULT dxil_dia::Session::getSourceFileIdByScope(
+    llvm::MDNode *pScope,
+    DWORD *pRetVal) {
+  auto *pBlock = llvm::dyn_cast_or_null<llvm::DILexicalBlock>(pScope);
+  if (pBlock != nullptr) {
+    return getSourceFileIdByName(pBlock->getFile()->getFilename(), pRetVal);
+  }
+  auto *pSubProgram = llvm::dyn_cast_or_null<llvm::DISubprogram>(pScope);
+  if (pSubProgram != nullptr) {
+    return getSourceFileIdByName(pSubProgram->getFile()->getFilename(), pRetVal);
+  }
+  *pRetVal = 0;
+  return S_FALSE;
+}
+
+static bool LineIndexLess(const dxil_dia::Session::LineIndexEntry &a,
+                          const dxil_dia::Session::LineIndexEntry &b) {
+  return std::tie(a.FileId, a.Line) < std::tie(b.FileId, b.Line);
+}
+
+const dxil_dia::Session::LineIndex &dxil_dia::Session::LineIndexRef() {
+  if (m_lineIndex.empty() && !m_instructionLines.empty()) {
+    m_lineIndex.reserve(m_instructionLines.size());
+    for (const llvm::Instruction *inst : m_instructionLines) {
+      const llvm::DebugLoc &DL = inst->getDebugLoc();
+      DWORD fileId;
+      if (getSourceFileIdByScope(DL.getScope(), &fileId) != S_OK)
+        fileId = kNoSourceFileId;
+      m_lineIndex.push_back({ fileId, DL.getLine(), inst });
+    }
+    std::stable_sort(m_lineIndex.begin(), m_lineIndex.end(), LineIndexLess);
+  }
+  return m_lineIndex;
+}
+
 STDMETHODIMP dxil_dia::Session::get_loadAddress(
     /* [retval][out] */ ULONGLONG *pRetVal) {
   *pRetVal = 0;
@@ -142,7 +199,7 @@ STDMETHODIMP dxil_dia::Session::get_globalScope(
   *pRetVal = nullptr;
 
   Symbol *ret;
-  IFR(m_symsMgr.GetGlobalScope(&ret));
+  IFR(SymMgr().GetGlobalScope(&ret));
   *pRetVal = ret;
   return S_OK;
 }
@@ -236,16 +293,14 @@ static HRESULT DxcDiaFindLineNumbersByRVA(
     return E_POINTER;
 
   std::vector<const llvm::Instruction*> instructions;
-  auto &allInstructions = pSession->InstructionsRef();
 
   // Gather the list of insructions that map to the given rva range.
   for (DWORD i = rva; i < rva + length; ++i) {
-    auto It = allInstructions.find(i);
-    if (It == allInstructions.end())
+    const llvm::Instruction *inst = pSession->InstructionAt(i);
+    if (inst == nullptr)
       return E_INVALIDARG;
 
     // Only include the instruction if it has debug info for line mappings.
-    const llvm::Instruction *inst = It->second;
     if (inst->getDebugLoc())
       instructions.push_back(inst);
   }
@@ -299,17 +354,6 @@ STDMETHODIMP dxil_dia::Session::findLinesByLinenum(
     *ppResult = nullptr;
 
     DxcThreadMalloc TM(m_pMalloc);
-    CComPtr<IDiaTable> pTable;
-    VARIANT vtIndex;
-    vtIndex.vt = VT_UI4;
-    vtIndex.uintVal = (int)Table::Kind::LineNumbers;
-    IFR(m_pEnumTables->Item(vtIndex, &pTable));
-
-    CComPtr<IDiaEnumLineNumbers> pLineTable;
-    IFR(pTable->QueryInterface(&pLineTable));
-    HRESULT hr;
-    CComPtr<IDiaLineNumber> line;
-    ULONG cnt;
     std::vector<const llvm::Instruction *> lines;
 
     std::function<bool(DWORD, DWORD)>column_matches = [column](DWORD colStart, DWORD colEnd) -> bool {
@@ -322,20 +366,25 @@ STDMETHODIMP dxil_dia::Session::findLinesByLinenum(
         };
     }
 
-    pLineTable->Reset();
-    while (SUCCEEDED(hr = pLineTable->Next(1, &line, &cnt)) && hr == S_OK && cnt == 1) {
+    // Only the source files of this session have lines in it.
+    DWORD fileId = kNoSourceFileId;
+    bool fileFound = true;
+    if (file != nullptr) {
+        IFR(file->get_uniqueId(&fileId));
         CComPtr<IDiaSourceFile> f;
-        DWORD ln, lnEnd, cn, cnEnd;
-        IFR(line->get_lineNumber(&ln));
-        IFR(line->get_lineNumberEnd(&lnEnd));
-        IFR(line->get_columnNumber(&cn));
-        IFR(line->get_columnNumberEnd(&cnEnd));
-        IFR(line->get_sourceFile(&f));
-        
-        if (file == f && (ln <= linenum && linenum <= lnEnd) && column_matches(cn, cnEnd)) {
-            lines.emplace_back(reinterpret_cast<LineNumber*>(line.p)->Inst());
+        fileFound = SUCCEEDED(findFileById(fileId, &f)) && file == f;
+    }
+
+    if (fileFound) {
+        const LineIndex &index = LineIndexRef();
+        LineIndexEntry key = { fileId, linenum, nullptr };
+        auto range = std::equal_range(index.begin(), index.end(), key, LineIndexLess);
+        for (auto it = range.first; it != range.second; ++it) {
+            DWORD cn = it->Inst->getDebugLoc().getCol();
+            if (column_matches(cn, cn)) {
+                lines.emplace_back(it->Inst);
+            }
         }
-        line.Release();
     }
 
     HRESULT result = lines.empty() ? S_FALSE : S_OK;
@@ -380,15 +429,14 @@ STDMETHODIMP dxil_dia::Session::findInlineFramesByAddr(
   *ppResult = nullptr;
 
   DxcThreadMalloc TM(m_pMalloc);
-  auto &allInstructions = InstructionsRef();
-  auto It = allInstructions.find(offset);
-  if (It == allInstructions.end()) {
+  const llvm::Instruction *inst = InstructionAt(offset);
+  if (inst == nullptr) {
     return E_INVALIDARG;
   }
 
   HRESULT hr;
   SymbolChildrenEnumerator *ChildrenEnum;
-  IFR(hr = m_symsMgr.DbgScopeOf(It->second, &ChildrenEnum));
+  IFR(hr = SymMgr().DbgScopeOf(inst, &ChildrenEnum));
 
   *ppResult = ChildrenEnum;
   return hr;
@@ -22,6 +22,7 @@
 
 #include "dxc/dxcpix.h"
 #include "dxc/DXIL/DxilModule.h"
+#include "llvm/ADT/StringMap.h"
 
 #include "dxc/Support/Global.h"
 #include "dxc/Support/microcom.h"
@@ -33,7 +34,8 @@ namespace dxil_dia {
 class Session : public IDiaSession, public IDxcPixDxilDebugInfoFactory {
 public:
   using RVA = unsigned;
-  using RVAMap = std::map<RVA, const llvm::Instruction *>;
+  // Instructions indexed by RVA; null where no instruction has the RVA.
+  using RVAMap = std::vector<const llvm::Instruction *>;
 
   struct LineInfo {
     LineInfo(std::uint32_t start_col, RVA first, RVA last)
@@ -47,6 +49,18 @@ public:
   };
   using LineToInfoMap = std::unordered_map<std::uint32_t, LineInfo>;
 
+  // An instruction with line info, by source file and line.
+  struct LineIndexEntry {
+    DWORD FileId;
+    std::uint32_t Line;
+    const llvm::Instruction *Inst;
+  };
+  // Sorted by file and line; the instructions of a line are in
+  // InstructionLinesRef order.
+  using LineIndex = std::vector<LineIndexEntry>;
+  // File ID of lines whose scope has no file in the source contents.
+  static constexpr DWORD kNoSourceFileId = ~0u;
+
   DXC_MICROCOM_TM_ADDREF_RELEASE_IMPL()
   DXC_MICROCOM_TM_CTOR(Session)
 
@@ -63,13 +77,18 @@ public:
   hlsl::DxilModule &DxilModuleRef() { return *m_dxilModule.get(); }
   llvm::Module &ModuleRef() { return *m_module.get(); }
   llvm::DebugInfoFinder &InfoRef() { return *m_finder.get(); }
-  const SymbolManager &SymMgr() const { return m_symsMgr; }
+  // Indexes the symbols on first use; see SymbolManager::Init.
+  SymbolManager &SymMgr();
   const RVAMap &InstructionsRef() const { return m_instructions; }
+  const llvm::Instruction *InstructionAt(RVA rva) const {
+    return rva < m_instructions.size() ? m_instructions[rva] : nullptr;
+  }
   const std::vector<const llvm::Instruction *> &InstructionLinesRef() const { return m_instructionLines; }
   const std::unordered_map<const llvm::Instruction *, RVA> &RvaMapRef() const { return m_rvaMap; }
   const LineToInfoMap &LineToColumnStartMapRef() const { return m_lineToInfoMap; }
 
   HRESULT getSourceFileIdByName(llvm::StringRef fileName, DWORD *pRetVal);
+  HRESULT getSourceFileIdByScope(llvm::MDNode *pScope, DWORD *pRetVal);
 
   HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void **ppvObject) {
     return DoBasicQueryInterface<IDiaSession, IDxcPixDxilDebugInfoFactory>(this, iid, ppvObject);
@@ -396,7 +415,12 @@ private:
   std::vector<const llvm::Instruction *> m_instructionLines; // Instructions with line info.
   std::unordered_map<const llvm::Instruction *, RVA> m_rvaMap; // Map instruction to its RVA.
   LineToInfoMap m_lineToInfoMap;
+  llvm::StringMap<DWORD> m_fileIds; // Map file name to its source file ID.
+  LineIndex m_lineIndex; // Built on the first lookup by line.
   SymbolManager m_symsMgr;
+  bool m_symsMgrInitialized = false;
+
+  const LineIndex &LineIndexRef();
 
 private:
   CComPtr<IDiaEnumTables> m_pEnumTables;
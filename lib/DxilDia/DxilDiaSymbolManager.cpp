@@ -18,6 +18,7 @@
 
 #include "dxc/DxilPIXPasses/DxilPIXVirtualRegisters.h"
 #include "dxc/Support/Unicode.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/Constants.h"
@@ -647,8 +648,12 @@ public:
 
   HRESULT CreateFunctionsForAllCUs();
   HRESULT CreateGlobalVariablesForAllCUs();
-  HRESULT CreateLocalVariables();
-  HRESULT CreateLiveRanges();
+  HRESULT IndexFunctionBodies();
+  HRESULT CreateNextFunctionBody();
+  size_t NumFunctionBodies() const { return m_Bodies.size(); }
+  size_t NumFunctionBodiesCreated() const { return m_NumBodiesCreated; }
+  bool FindBodyOfFunction(const llvm::Function *F, size_t *pBody) const;
+  bool FindBodyOfFunctionSymbol(DWORD dwFunctionID, size_t *pBody) const;
   HRESULT IsDbgDeclareCall(llvm::Module *M, const llvm::Instruction *I,
                            DWORD *pReg, DWORD *pRegSize,
                            llvm::DILocalVariable **LV, uint64_t *pStartOffset,
@@ -675,6 +680,8 @@ private:
   HRESULT CreateFunctionBlockForInstruction(llvm::Instruction *I);
   HRESULT CreateFunctionBlocksForFunction(llvm::Function *F);
   HRESULT CreateFunctionsForCU(llvm::DICompileUnit *CU);
+  HRESULT CreateLocalVariables(llvm::ArrayRef<llvm::CallInst *> Declares);
+  HRESULT CreateLiveRanges(llvm::Function *F);
   HRESULT CreateGlobalVariablesForCU(llvm::DICompileUnit *CU);
   HRESULT GetScopeID(llvm::DIScope *S, DWORD *pScopeID);
   HRESULT CreateType(llvm::DIType *T, DWORD *pNewTypeID);
@@ -698,6 +705,20 @@ private:
   // parent of m_symbol[i].
   std::vector<std::uint32_t> m_Parent;
 
+  // The code of a function, with the dbg.declare calls in it. Its blocks,
+  // local variables and their live ranges are created together.
+  struct FunctionBody {
+    llvm::Function *F;
+    std::vector<llvm::CallInst *> Declares;
+  };
+  std::vector<FunctionBody> m_Bodies;
+  size_t m_NumBodiesCreated = 0;
+  llvm::DenseMap<const llvm::Function *, size_t> m_FunctionToBody;
+  llvm::DenseMap<DWORD, size_t> m_FunctionIDToBody;
+
+  // Symbols before this one were checked by PopulateParentToChildrenIDMap.
+  size_t m_NumSymbolsChecked = 0;
+
   LocalVarToIDMap m_VarToID;
 
   UDTFieldToIDMap m_FieldToID;
@@ -1240,7 +1261,6 @@ HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateFunctionBlocksForFuncti
 }
 
 HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateFunctionsForCU(llvm::DICompileUnit *CU) {
-  bool FoundFunctions = false;
   for (llvm::DISubprogram *SubProgram : CU->getSubprograms()) {
     DWORD dwNewFunID;
     const DWORD dwParentID = SubProgram->isLocalToUnit() ? HlslCompilandId : HlslProgramId;
@@ -1250,23 +1270,6 @@ HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateFunctionsForCU(llvm::DI
     m_ScopeToSym.insert(std::make_pair(SubProgram, dwNewFunID));
   }
 
-  for (llvm::DISubprogram* SubProgram : CU->getSubprograms()) {
-    if (llvm::Function *F = SubProgram->getFunction()) {
-      IFR(CreateFunctionBlocksForFunction(F));
-      FoundFunctions = true;
-    }
-  }
-
-  if (!FoundFunctions) {
-    // This works around an old bug in dxcompiler whose effects are still
-    // sometimes present in PIX users' traces. (The bug was that the subprogram(s)
-    // weren't pointing to their contained function.)
-    llvm::Module *M = &m_Session.ModuleRef();
-    auto &DM = M->GetDxilModule();
-    llvm::Function *EntryPoint = DM.GetEntryFunction();
-    IFR(CreateFunctionBlocksForFunction(EntryPoint));
-  }
-
   return S_OK;
 }
 
@@ -1297,6 +1300,100 @@ HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateGlobalVariablesForAllCU
   return S_OK;
 }
 
+HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::IndexFunctionBodies() {
+  auto AddBody = [this](llvm::Function *F) {
+    if (m_FunctionToBody.count(F) == 0) {
+      m_FunctionToBody.insert(std::make_pair(F, m_Bodies.size()));
+      m_Bodies.emplace_back();
+      m_Bodies.back().F = F;
+    }
+  };
+
+  for (llvm::DICompileUnit *pCU : m_Session.InfoRef().compile_units()) {
+    for (llvm::DISubprogram *SubProgram : pCU->getSubprograms()) {
+      if (llvm::Function *F = SubProgram->getFunction()) {
+        AddBody(F);
+        m_FunctionIDToBody.insert(
+            std::make_pair(m_ScopeToSym[SubProgram], m_FunctionToBody[F]));
+      }
+    }
+  }
+
+  if (m_Bodies.empty()) {
+    // This works around an old bug in dxcompiler whose effects are still
+    // sometimes present in PIX users' traces. (The bug was that the subprogram(s)
+    // weren't pointing to their contained function.) The entry point is then
+    // the only body, and any function may own its blocks.
+    llvm::Module *M = &m_Session.ModuleRef();
+    auto &DM = M->GetDxilModule();
+    if (llvm::Function *EntryPoint = DM.GetEntryFunction()) {
+      AddBody(EntryPoint);
+      for (llvm::DICompileUnit *pCU : m_Session.InfoRef().compile_units()) {
+        for (llvm::DISubprogram *SubProgram : pCU->getSubprograms()) {
+          m_FunctionIDToBody.insert(std::make_pair(m_ScopeToSym[SubProgram], 0));
+        }
+      }
+    }
+  }
+
+  // The types of local variables are shared with the rest of the program, so
+  // they are created here; only the variables wait for their body.
+  llvm::Module *M = &m_Session.ModuleRef();
+  llvm::Function *DbgDeclare = llvm::Intrinsic::getDeclaration(M, llvm::Intrinsic::dbg_declare);
+  for (llvm::Value *U : DbgDeclare->users()) {
+    auto *CI = llvm::dyn_cast<llvm::CallInst>(U);
+    auto *LocalNameMetadata = llvm::dyn_cast<llvm::MetadataAsValue>(CI->getArgOperand(1));
+    auto *LV = llvm::dyn_cast<llvm::DILocalVariable>(LocalNameMetadata->getMetadata());
+    if (LV == nullptr) {
+      continue;
+    }
+    if (m_Bodies.empty()) {
+      return E_FAIL;
+    }
+
+    DWORD dwUnusedLVTypeID;
+    IFR(CreateType(dyn_cast_to_ditype_or_null<llvm::DIType>(LV->getType()), &dwUnusedLVTypeID));
+
+    // A declare outside of the functions with debug info goes with the last
+    // body, so it can only fail once everything before it was created.
+    size_t Body;
+    if (!FindBodyOfFunction(CI->getParent()->getParent(), &Body)) {
+      Body = m_Bodies.size() - 1;
+    }
+    m_Bodies[Body].Declares.emplace_back(CI);
+  }
+
+  return S_OK;
+}
+
+HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateNextFunctionBody() {
+  DXASSERT(m_NumBodiesCreated < m_Bodies.size(), "no function body left to create");
+  // A body that fails isn't retried.
+  const FunctionBody &Body = m_Bodies[m_NumBodiesCreated++];
+  IFR(CreateFunctionBlocksForFunction(Body.F));
+  IFR(CreateLocalVariables(Body.Declares));
+  IFR(CreateLiveRanges(Body.F));
+  return S_OK;
+}
+
+bool dxil_dia::hlsl_symbols::SymbolManagerInit::FindBodyOfFunction(const llvm::Function *F, size_t *pBody) const {
+  auto it = m_FunctionToBody.find(F);
+  if (it == m_FunctionToBody.end()) {
+    return false;
+  }
+  *pBody = it->second;
+  return true;
+}
+
+bool dxil_dia::hlsl_symbols::SymbolManagerInit::FindBodyOfFunctionSymbol(DWORD dwFunctionID, size_t *pBody) const {
+  auto it = m_FunctionIDToBody.find(dwFunctionID);
+  if (it == m_FunctionIDToBody.end()) {
+    return false;
+  }
+  *pBody = it->second;
+  return true;
+}
+
 HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::GetScopeID(llvm::DIScope *S, DWORD *pScopeID) {
   auto ParentScopeIt = m_ScopeToSym.find(S);
   if (ParentScopeIt != m_ScopeToSym.end()) {
@@ -1806,12 +1903,8 @@ HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateUDTField(DWORD dwParent
   return S_OK;
 }
 
-HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateLocalVariables() {
-  llvm::Module *M = &m_Session.ModuleRef();
-
-  llvm::Function *DbgDeclare = llvm::Intrinsic::getDeclaration(M, llvm::Intrinsic::dbg_declare);
-  for (llvm::Value *U : DbgDeclare->users()) {
-    auto *CI = llvm::dyn_cast<llvm::CallInst>(U);
+HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateLocalVariables(llvm::ArrayRef<llvm::CallInst *> Declares) {
+  for (llvm::CallInst *CI : Declares) {
     auto *LS = llvm::dyn_cast_or_null<llvm::DILocalScope>(CI->getDebugLoc()->getInlinedAtScope());
     auto SymIt = m_ScopeToSym.find(LS);
     if (SymIt == m_ScopeToSym.end()) {
@@ -1828,7 +1921,7 @@ HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateLocalVariables() {
   return S_OK;
 }
 
-HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateLiveRanges() {
+HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateLiveRanges(llvm::Function *F) {
   // Simple algorithm:
   //   live_range = map from SymbolID to SymbolManager.LiveRange
   //   end_of_scope = map from Scope to RVA
@@ -1838,13 +1931,16 @@ HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::CreateLiveRanges() {
   //       end_of_scope[scope] = rva(I)
   //     if I is dbg.declare:
   //       live_range[symbol of I] = SymbolManager.LiveRange[FirstUseRVA, end_of_scope[scope]]
+  // Only the instructions of F are looked at. PIX only numbers the entry
+  // function's instructions, so for it this is the whole walk.
   llvm::Module *M = &m_Session.ModuleRef();
-  m_SymToLR.clear();
   const auto &Instrs = m_Session.InstructionsRef();
   llvm::DenseMap<llvm::DILocalScope *, Session::RVA> EndOfScope;
-  for (auto It = Instrs.rbegin(); It != Instrs.rend(); ++It) {
-    const Session::RVA RVA = It->first;
-    const auto *I = It->second;
+  for (Session::RVA RVA = Instrs.size(); RVA-- > 0;) {
+    const auto *I = Instrs[RVA];
+    if (I == nullptr || I->getParent()->getParent() != F) {
+      continue;
+    }
     const llvm::DebugLoc &DL = I->getDebugLoc();
     if (!DL) {
       continue;
@@ -2027,7 +2123,7 @@ HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::PopulateParentToChildrenIDMap
                 m_SymCtors.size(),
                 m_Parent.size());
 
-  for (size_t i = 0; i < m_Parent.size(); ++i) {
+  for (size_t i = m_NumSymbolsChecked; i < m_Parent.size(); ++i) {
 #ifndef NDEBUG
     {
       CComPtr<Symbol> S;
@@ -2041,8 +2137,28 @@ HRESULT dxil_dia::hlsl_symbols::SymbolManagerInit::PopulateParentToChildrenIDMap
 
     DXASSERT_ARGS(m_Parent[i] != kNullSymbolID || (i + 1) == HlslProgramId,
                   "Parentless symbol %d", i + 1);
+  }
+  m_NumSymbolsChecked = m_Parent.size();
+
+  // Count the children of each parent, then place each child after the
+  // children of the parents before its own.
+  std::vector<DWORD> &Begin = pParentToChildren->ChildrenBegin;
+  std::vector<DWORD> &Children = pParentToChildren->Children;
+  Begin.assign(m_Parent.size() + 2, 0);
+  for (std::uint32_t dwParentID : m_Parent) {
+    if (dwParentID != kNullSymbolID) {
+      ++Begin[dwParentID + 1];
+    }
+  }
+  for (size_t i = 1; i < Begin.size(); ++i) {
+    Begin[i] += Begin[i - 1];
+  }
+
+  std::vector<DWORD> Next(Begin.begin(), Begin.end() - 1);
+  Children.resize(Begin.back());
+  for (size_t i = 0; i < m_Parent.size(); ++i) {
     if (m_Parent[i] != kNullSymbolID) {
-      pParentToChildren->emplace(m_Parent[i], i + 1);
+      Children[Next[m_Parent[i]]++] = i + 1;
     }
   }
 
@@ -2056,6 +2172,10 @@ dxil_dia::SymbolManager::SymbolFactory::~SymbolFactory() = default;
 
 dxil_dia::SymbolManager::SymbolManager() = default;
 
+dxil_dia::SymbolManager::SymbolManager(SymbolManager &&) = default;
+
+dxil_dia::SymbolManager &dxil_dia::SymbolManager::operator =(SymbolManager &&) = default;
+
 dxil_dia::SymbolManager::~SymbolManager() {
   m_pSession = nullptr;
 }
@@ -2064,7 +2184,9 @@ void dxil_dia::SymbolManager::Init(Session *pSes) {
   DXASSERT(m_pSession == nullptr, "SymbolManager already initialized");
   m_pSession = pSes;
   m_symbolCtors.clear();
-  m_parentToChildren.clear();
+  m_parentToChildren.ChildrenBegin.clear();
+  m_parentToChildren.Children.clear();
+  m_pInit.reset();
 
   llvm::DebugInfoFinder &DIFinder = pSes->InfoRef();
   if (DIFinder.compile_unit_count() != 1) {
@@ -2072,7 +2194,8 @@ void dxil_dia::SymbolManager::Init(Session *pSes) {
   }
   llvm::DICompileUnit *ShaderCU = *DIFinder.compile_units().begin();
 
-  hlsl_symbols::SymbolManagerInit SMI(pSes, &m_symbolCtors, &m_scopeToID, &m_symbolToLiveRange);
+  m_pInit.reset(new hlsl_symbols::SymbolManagerInit(pSes, &m_symbolCtors, &m_scopeToID, &m_symbolToLiveRange));
+  hlsl_symbols::SymbolManagerInit &SMI = *m_pInit;
 
   DWORD dwHlslProgramID;
   IFT(SMI.AddSymbol<hlsl_symbols::symbol_factory::GlobalScope>(kNullSymbolID, &dwHlslProgramID));
@@ -2141,12 +2264,39 @@ void dxil_dia::SymbolManager::Init(Session *pSes) {
 
   IFT(SMI.CreateFunctionsForAllCUs());
   IFT(SMI.CreateGlobalVariablesForAllCUs());
-  IFT(SMI.CreateLocalVariables());
-  IFT(SMI.CreateLiveRanges());
+  IFT(SMI.IndexFunctionBodies());
   IFT(SMI.PopulateParentToChildrenIDMap(&m_parentToChildren));
 }
 
-HRESULT dxil_dia::SymbolManager::GetSymbolByID(size_t id, Symbol **ppSym) const {
+HRESULT dxil_dia::SymbolManager::CreateFunctionBodies(size_t NumBodies) {
+  if (m_pInit == nullptr || m_pInit->NumFunctionBodiesCreated() >= NumBodies) {
+    return S_OK;
+  }
+
+  DxcThreadMalloc TM(m_pSession->GetMallocNoRef());
+  HRESULT hr = S_OK;
+  try {
+    while (SUCCEEDED(hr) && m_pInit->NumFunctionBodiesCreated() < NumBodies) {
+      hr = m_pInit->CreateNextFunctionBody();
+    }
+    // Index the children of whatever was created, even if a body failed.
+    HRESULT hrChildren = m_pInit->PopulateParentToChildrenIDMap(&m_parentToChildren);
+    if (SUCCEEDED(hr)) {
+      hr = hrChildren;
+    }
+  }
+  CATCH_CPP_ASSIGN_HRESULT();
+  return hr;
+}
+
+size_t dxil_dia::SymbolManager::NumSymbols() {
+  if (m_pInit != nullptr) {
+    CreateFunctionBodies(m_pInit->NumFunctionBodies());
+  }
+  return m_symbolCtors.size();
+}
+
+HRESULT dxil_dia::SymbolManager::GetSymbolByID(size_t id, Symbol **ppSym) {
   if (ppSym == nullptr) {
     return E_INVALIDARG;
   }
@@ -2159,6 +2309,10 @@ HRESULT dxil_dia::SymbolManager::GetSymbolByID(size_t id, Symbol **ppSym) const
   if (id <= 0) {
     return E_INVALIDARG;
   }
+  while (id > m_symbolCtors.size() && m_pInit != nullptr &&
+         m_pInit->NumFunctionBodiesCreated() < m_pInit->NumFunctionBodies()) {
+    IFR(CreateFunctionBodies(m_pInit->NumFunctionBodiesCreated() + 1));
+  }
   if (id > m_symbolCtors.size()) {
     return S_FALSE;
   }
@@ -2182,28 +2336,39 @@ HRESULT dxil_dia::SymbolManager::GetLiveRangeOf(Symbol *pSym, LiveRange *LR) con
   return S_OK;
 }
 
-HRESULT dxil_dia::SymbolManager::GetGlobalScope(Symbol **ppSym) const {
+HRESULT dxil_dia::SymbolManager::GetGlobalScope(Symbol **ppSym) {
   return GetSymbolByID(HlslProgramId, ppSym);
 }
 
-HRESULT dxil_dia::SymbolManager::ChildrenOf(DWORD ID, std::vector<CComPtr<Symbol>> *pChildren) const {
+HRESULT dxil_dia::SymbolManager::ChildrenOf(DWORD ID, std::vector<CComPtr<Symbol>> *pChildren) {
   pChildren->clear();
-  auto childrenList = m_parentToChildren.equal_range(ID);
-  for (auto it = childrenList.first; it != childrenList.second; ++it) {
+  // Only functions get children from their bodies; the children of a block
+  // come from the body that created it.
+  size_t Body;
+  if (m_pInit != nullptr && m_pInit->FindBodyOfFunctionSymbol(ID, &Body)) {
+    IFR(CreateFunctionBodies(Body + 1));
+  }
+
+  const std::vector<DWORD> &Begin = m_parentToChildren.ChildrenBegin;
+  if (size_t(ID) + 1 >= Begin.size()) {
+    return S_OK;
+  }
+  pChildren->reserve(Begin[ID + 1] - Begin[ID]);
+  for (DWORD i = Begin[ID]; i < Begin[ID + 1]; ++i) {
     CComPtr<Symbol> Child;
-    IFR(GetSymbolByID(it->second, &Child));
+    IFR(GetSymbolByID(m_parentToChildren.Children[i], &Child));
     pChildren->emplace_back(Child);
   }
   return S_OK;
 }
 
-HRESULT dxil_dia::SymbolManager::ChildrenOf(Symbol *pSym, std::vector<CComPtr<Symbol>> *pChildren) const {
+HRESULT dxil_dia::SymbolManager::ChildrenOf(Symbol *pSym, std::vector<CComPtr<Symbol>> *pChildren) {
   const std::uint32_t pSymID = pSym->GetID();
   IFR(ChildrenOf(pSymID, pChildren));
   return S_OK;
 }
 
-HRESULT dxil_dia::SymbolManager::DbgScopeOf(const llvm::Instruction *instr, SymbolChildrenEnumerator **ppRet) const {
+HRESULT dxil_dia::SymbolManager::DbgScopeOf(const llvm::Instruction *instr, SymbolChildrenEnumerator **ppRet) {
   *ppRet = nullptr;
 
   const llvm::DebugLoc &DL = instr->getDebugLoc();
@@ -2224,6 +2389,14 @@ HRESULT dxil_dia::SymbolManager::DbgScopeOf(const llvm::Instruction *instr, Symb
     return E_FAIL;
   }
 
+  if (m_pInit != nullptr) {
+    size_t Body;
+    IFR(CreateFunctionBodies(
+        m_pInit->FindBodyOfFunction(instr->getParent()->getParent(), &Body)
+            ? Body + 1
+            : m_pInit->NumFunctionBodies()));
+  }
+
   auto scopeIt = m_scopeToID.find(LS);
   if (scopeIt == m_scopeToID.end()) {
     // This is a failure because all scopes should already exist in the symbol manager.
@@ -14,6 +14,7 @@
 
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
@@ -34,6 +35,9 @@ namespace dxil_dia {
 class Session;
 class Symbol;
 class SymbolChildrenEnumerator;
+namespace hlsl_symbols {
+class SymbolManagerInit;
+}  // namespace hlsl_symbols
 
 class SymbolManager {
 public:
@@ -56,25 +60,36 @@ public:
 
   using ScopeToIDMap = llvm::DenseMap<llvm::DIScope *, DWORD>;
   using IDToLiveRangeMap = std::unordered_map<DWORD, LiveRange>;
-  using ParentToChildrenMap = std::unordered_multimap<DWORD, DWORD>;
+  // The children of symbol ID are Children[ChildrenBegin[ID]] up to
+  // Children[ChildrenBegin[ID + 1]], in ID order.
+  struct ParentToChildrenMap {
+    std::vector<DWORD> ChildrenBegin;
+    std::vector<DWORD> Children;
+  };
 
 
   SymbolManager();
-  SymbolManager(SymbolManager &&) = default;
-  SymbolManager &operator =(SymbolManager &&) = default;
+  SymbolManager(SymbolManager &&);
+  SymbolManager &operator =(SymbolManager &&);
   ~SymbolManager();
 
+  // Indexes the program, its functions, global variables and types. The
+  // blocks and local variables of each function body are created when a
+  // lookup first needs them, in body order, so IDs don't depend on the order
+  // of the lookups.
   void Init(Session *pSes);
 
-  size_t NumSymbols() const { return m_symbolCtors.size(); }
-  HRESULT GetSymbolByID(size_t id, Symbol **ppSym) const;
+  size_t NumSymbols();
+  HRESULT GetSymbolByID(size_t id, Symbol **ppSym);
   HRESULT GetLiveRangeOf(Symbol *pSym, LiveRange *LR) const;
-  HRESULT GetGlobalScope(Symbol **ppSym) const;
-  HRESULT ChildrenOf(Symbol *pSym, std::vector<CComPtr<Symbol>> *pChildren) const;
-  HRESULT DbgScopeOf(const llvm::Instruction *instr, SymbolChildrenEnumerator **ppRet) const;
+  HRESULT GetGlobalScope(Symbol **ppSym);
+  HRESULT ChildrenOf(Symbol *pSym, std::vector<CComPtr<Symbol>> *pChildren);
+  HRESULT DbgScopeOf(const llvm::Instruction *instr, SymbolChildrenEnumerator **ppRet);
 
 private:
-  HRESULT ChildrenOf(DWORD ID, std::vector<CComPtr<Symbol>> *pChildren) const;
+  HRESULT ChildrenOf(DWORD ID, std::vector<CComPtr<Symbol>> *pChildren);
+  // Creates the symbols of the first NumBodies function bodies.
+  HRESULT CreateFunctionBodies(size_t NumBodies);
 
   // Not a CComPtr, and not AddRef'd - m_pSession is the owner of this.
   Session *m_pSession = nullptr;
@@ -93,5 +108,9 @@ private:
   IDToLiveRangeMap m_symbolToLiveRange;
 
   ParentToChildrenMap m_parentToChildren;
+
+  // Creates the function bodies. It refers to the members above, so an
+  // initialized SymbolManager is never moved from.
+  std::unique_ptr<hlsl_symbols::SymbolManagerInit> m_pInit;
 };
 }  // namespace dxil_dia
@@ -15,15 +15,20 @@
 #include "dxc/DXIL/DxilInstructions.h"
 
 #include "llvm/Analysis/CallGraph.h"
+#include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
 
 #include "FunctionBuilder.h"
 #include "LLVMUtils.h"
@@ -31,6 +36,7 @@
 #include "StateFunctionTransform.h"
 
 #include <queue>
+#include <set>
 
 using namespace hlsl;
 using namespace llvm;
@@ -203,6 +209,11 @@ void DxrFallbackCompiler::setDebugOutputLevel(int val)
   m_debugOutputLevel = val;
 }
 
+void DxrFallbackCompiler::setStateFunctionCache(StateFunctionCache* pCache)
+{
+  m_stateFunctionCache = pCache;
+}
+
 static bool isShader(Function* F)
 {
   if (F->hasFnAttribute("exp-shader"))
@@ -300,14 +311,94 @@ void DxrFallbackCompiler::initShaderMap(std::vector<std::string>& shaderNames)
   }
 }
 
+// The runtime is parsed from its textual IR once per process and kept as
+// bitcode, which each compile reads lazily into its own context.
+static const std::string& getRuntimeBitcode()
+{
+  static const std::string bitcode = []() {
+    // The bitcode outlives any compile, so it can't come from a compile's
+    // allocator.
+    DxcThreadMalloc TM(nullptr);
+    LLVMContext context;
+    std::unique_ptr<Module> runtimeModule = loadModuleFromAsmString(context, getRuntimeString());
+    IFTBOOLMSG(runtimeModule, E_FAIL, "Error parsing runtime");
+    std::string result;
+    raw_string_ostream out(result);
+    WriteBitcodeToFile(runtimeModule.get(), out);
+    out.flush();
+    return result;
+  }();
+  return bitcode;
+}
+
+// Runtime intrinsics are named for the functions they implement:
+// fb_dxop_<op> for dx.op.<op> and fb_Fallback_<name> for \01?Fallback_<name>.
+// The pending versions, fb_dxop_pending_<op> and fb_Fallback_Pending<name>,
+// replace them in anyhit shaders.
+struct IntrinsicTarget
+{
+  std::string intrinsicName; // <op> or Fallback_<name>
+  std::string calledPrefix;  // Prefix of the functions the intrinsic replaces
+  bool isDxilOp = false;
+  bool isPending = false;
+};
+
+// Returns false if name isn't a runtime intrinsic.
+static bool getIntrinsicTarget(StringRef name, IntrinsicTarget& target)
+{
+  StringRef dxopPrefix = "fb_dxop_", dxopPendingPrefix = "fb_dxop_pending_";
+  StringRef fallbackPrefix = "fb_Fallback_", fallbackPendingPrefix = "fb_Fallback_Pending";
+  if (name.startswith(dxopPrefix))
+  {
+    target.isDxilOp = true;
+    target.isPending = name.startswith(dxopPendingPrefix);
+    target.intrinsicName = name.substr(target.isPending ? dxopPendingPrefix.size() : dxopPrefix.size());
+    target.calledPrefix = "dx.op." + target.intrinsicName;
+    return true;
+  }
+  if (name.startswith(fallbackPrefix))
+  {
+    target.isDxilOp = false;
+    target.isPending = name.startswith(fallbackPendingPrefix);
+    target.intrinsicName = "Fallback_" + name.substr(target.isPending ? fallbackPendingPrefix.size() : fallbackPrefix.size()).str();
+    target.calledPrefix = "\x1?" + target.intrinsicName;
+    return true;
+  }
+  return false;
+}
+
 void DxrFallbackCompiler::linkRuntime()
 {
+  ErrorOr<std::unique_ptr<Module>> runtimeOrErr = getLazyBitcodeModule(
+    MemoryBuffer::getMemBuffer(getRuntimeBitcode(), "runtime", false), m_module->getContext());
+  IFTBOOLMSG(runtimeOrErr, E_FAIL, "Error loading runtime");
+  std::unique_ptr<Module> runtimeModule = std::move(runtimeOrErr.get());
+
+  // Intrinsics for functions the module doesn't call are made linkonce, so
+  // the linker only brings them in if other runtime code refers to them.
+  // Function bodies are materialized as they are linked, so the others are
+  // never read. The scheduler and launch params functions are looked up by
+  // name, so they are always kept.
+  std::vector<std::string> lazyNames;
+  for (Function& F : *runtimeModule)
+  {
+    IntrinsicTarget target;
+    if (F.getName() == "fb_Fallback_Scheduler" || F.getName() == "fb_Fallback_SetLaunchParams" ||
+        !getIntrinsicTarget(F.getName(), target) ||
+        !getFunctionsWithPrefix(m_module, target.calledPrefix).empty())
+      continue;
+    F.setLinkage(GlobalValue::LinkOnceODRLinkage);
+    lazyNames.push_back(F.getName());
+  }
+
   Linker linker(m_module);
-  std::unique_ptr<Module> runtimeModule = loadModuleFromAsmString(m_module->getContext(), getRuntimeString());
-  bool linkErr = linker.linkInModule(runtimeModule.get());
-  assert(!linkErr && "Error linking runtime");
-  UNREFERENCED_PARAMETER(linkErr);
+  IFTBOOLMSG(!linker.linkInModule(runtimeModule.get()), E_FAIL, "Error linking runtime");
 
+  for (const std::string& name : lazyNames)
+  {
+    if (Function* F = m_module->getFunction(name))
+      F->setLinkage(GlobalValue::ExternalLinkage);
+  }
 }
 
 static void inlineFuncAndAddRet(CallInst* call, Function*F)
@@ -497,6 +588,300 @@ static void collectResources(DxilModule& DM, std::set<Value*>& resources)
 }
 
 
+static void collectStructTypes(Type* T, std::set<StructType*>& structs)
+{
+  if (StructType* ST = dyn_cast<StructType>(T))
+  {
+    if (!structs.insert(ST).second)
+      return;
+  }
+  for (Type* subTy : T->subtypes())
+    collectStructTypes(subTy, structs);
+}
+
+// Hashes what the state function transform of a shader depends on: its body
+// and the bodies of the non-shader functions it reaches, which the transform
+// inlines, the layout of the types they use, which of their callees are
+// shaders, which of the globals they use are resources, and the transform's
+// settings.
+static std::string getStateFunctionCacheKey(
+  Function* F,
+  const std::vector<std::string>& shaderNames,
+  int attributeSize,
+  const std::vector<StateFunctionTransform::ParameterSemanticType>& paramTypes,
+  bool useCommittedAttr,
+  const std::set<Value*>& resources,
+  Type* runtimeDataArgTy
+)
+{
+  std::set<StructType*> structs;
+  std::set<std::string> calledShaders;
+  std::set<std::string> resourceNames;
+  std::map<std::string, Function*> callees;
+  std::vector<Function*> worklist(1, F);
+  collectStructTypes(runtimeDataArgTy, structs);
+  while (!worklist.empty())
+  {
+    Function* G = worklist.back();
+    worklist.pop_back();
+    collectStructTypes(G->getFunctionType(), structs);
+    for (Instruction& I : inst_range(G))
+    {
+      collectStructTypes(I.getType(), structs);
+      for (Value* op : I.operands())
+      {
+        collectStructTypes(op->getType(), structs);
+        if (resources.count(op))
+          resourceNames.insert(op->getName());
+      }
+      if (CallInst* call = dyn_cast<CallInst>(&I))
+      {
+        Function* callee = call->getCalledFunction();
+        if (!callee)
+          continue;
+        std::string calleeName = cleanName(callee->getName());
+        if (std::find(shaderNames.begin(), shaderNames.end(), calleeName) != shaderNames.end())
+          calledShaders.insert(calleeName);
+        else if (!callee->isDeclaration() && callee != F &&
+                 callees.insert(std::make_pair(callee->getName(), callee)).second)
+          worklist.push_back(callee);
+      }
+    }
+  }
+
+  // Printed types only name identified structs, so their bodies are added in
+  // name order.
+  std::set<std::string> structBodies;
+  for (StructType* ST : structs)
+  {
+    std::string body;
+    raw_string_ostream out(body);
+    if (ST->hasName())
+      out << ST->getName() << " =";
+    if (ST->isOpaque())
+      out << " opaque";
+    for (Type* elementTy : ST->elements())
+    {
+      out << ' ';
+      elementTy->print(out);
+    }
+    structBodies.insert(out.str());
+  }
+
+  std::string text;
+  raw_string_ostream out(text);
+  F->print(out);
+  for (auto& kv : callees)
+    kv.second->print(out);
+  out << "\nattributes " << F->getAttributes().getAsString(AttributeSet::FunctionIndex);
+  out << "\nattributeSize " << attributeSize << " useCommittedAttr " << useCommittedAttr << " params";
+  for (StateFunctionTransform::ParameterSemanticType paramType : paramTypes)
+    out << ' ' << (int)paramType;
+  out << "\nruntimeData ";
+  runtimeDataArgTy->print(out);
+  for (const std::string& body : structBodies)
+    out << "\ntype " << body;
+  for (const std::string& name : calledShaders)
+    out << "\nshader " << name;
+  for (const std::string& name : resourceNames)
+    out << "\nresource " << name;
+  out.flush();
+
+  MD5 md5;
+  md5.update(text);
+  MD5::MD5Result result;
+  md5.final(result);
+  SmallString<32> key;
+  MD5::stringifyResult(result, key);
+  return key.str();
+}
+
+// Writes a module holding the state functions, with the other globals only
+// declared. Returns false if they use local globals, which couldn't be linked
+// back by name.
+static bool writeStateFunctions(Module* M, const std::vector<Function*>& stateFunctions, std::string& bitcode)
+{
+  std::set<const GlobalValue*> defined(stateFunctions.begin(), stateFunctions.end());
+  SmallVector<const Constant*, 16> workList;
+  std::set<const Constant*> visited;
+  for (Function* F : stateFunctions)
+  {
+    for (Instruction& I : inst_range(F))
+    {
+      for (Value* op : I.operands())
+      {
+        if (const Constant* C = dyn_cast<Constant>(op))
+          workList.push_back(C);
+      }
+    }
+  }
+  while (!workList.empty())
+  {
+    const Constant* C = workList.pop_back_val();
+    if (!visited.insert(C).second)
+      continue;
+    if (const GlobalValue* GV = dyn_cast<GlobalValue>(C))
+    {
+      if (GV->hasLocalLinkage() && !defined.count(GV))
+        return false;
+      continue;
+    }
+    for (const Value* op : C->operands())
+      workList.push_back(cast<Constant>(op));
+  }
+
+  ValueToValueMapTy VMap;
+  std::unique_ptr<Module> part(CloneModule(M, VMap,
+    [&defined](const GlobalValue* GV) { return defined.count(GV) != 0; }));
+  // Named metadata refers to functions that aren't needed here.
+  while (!part->named_metadata_empty())
+    part->named_metadata_begin()->eraseFromParent();
+
+  raw_string_ostream out(bitcode);
+  WriteBitcodeToFile(part.get(), out);
+  out.flush();
+  return true;
+}
+
+void DxrFallbackCompiler::storeStateFunctions(
+  const std::string& cacheKey,
+  const std::vector<std::string>& shaderNames,
+  const std::vector<Function*>& stateFunctions,
+  unsigned int shaderStackSize
+)
+{
+  StateFunctionCache::Entry entry;
+  if (!writeStateFunctions(m_module, stateFunctions, entry.bitcode))
+    return;
+
+  for (Function* stateF : stateFunctions)
+    entry.stateFunctionNames.push_back(stateF->getName());
+  entry.stackSize = shaderStackSize;
+
+  // State IDs are still placeholders naming shaders by their index in
+  // shaderNames, which can differ in the compile that reuses the entry.
+  if (Function* dummyStateIdFunc = m_module->getFunction("dummyStateId"))
+  {
+    std::set<Function*> stateFunctionSet(stateFunctions.begin(), stateFunctions.end());
+    for (User* U : dummyStateIdFunc->users())
+    {
+      CallInst* call = dyn_cast<CallInst>(U);
+      if (!call || !stateFunctionSet.count(call->getParent()->getParent()))
+        continue;
+      int functionIdx = (int)cast<ConstantInt>(call->getArgOperand(0))->getSExtValue();
+      entry.shaderIndices[functionIdx] = shaderNames[functionIdx];
+    }
+  }
+
+  m_stateFunctionCache->m_entries[cacheKey] = std::move(entry);
+}
+
+// Moves a shader's cached state functions into the module, leaving it as the
+// transform would. Returns false if there are none.
+bool DxrFallbackCompiler::restoreStateFunctions(
+  const std::string& cacheKey,
+  Function* F,
+  const std::vector<std::string>& shaderNames,
+  std::vector<Function*>& stateFunctions,
+  unsigned int& shaderStackSize
+)
+{
+  auto it = m_stateFunctionCache->m_entries.find(cacheKey);
+  if (it == m_stateFunctionCache->m_entries.end())
+    return false;
+  const StateFunctionCache::Entry& entry = it->second;
+
+  std::map<int, int> functionIdxMap;
+  for (auto& kv : entry.shaderIndices)
+  {
+    auto pos = std::find(shaderNames.begin(), shaderNames.end(), kv.second);
+    if (pos == shaderNames.end())
+      return false;
+    functionIdxMap[kv.first] = (int)(pos - shaderNames.begin());
+  }
+
+  // The bitcode reader reuses the module's types, since it reads into the
+  // same context, so only globals need to be mapped.
+  LLVMContext& context = m_module->getContext();
+  ErrorOr<std::unique_ptr<Module>> partOrErr = parseBitcodeFile(MemoryBufferRef(entry.bitcode, "stateFunctions"), context);
+  if (!partOrErr)
+    return false;
+  std::unique_ptr<Module> part = std::move(partOrErr.get());
+
+  ValueToValueMapTy VMap;
+  for (GlobalVariable& partGV : part->globals())
+  {
+    GlobalVariable* GV = m_module->getGlobalVariable(partGV.getName(), /*AllowLocal*/ true);
+    if (!GV || GV->getType() != partGV.getType())
+      return false;
+    VMap[&partGV] = GV;
+  }
+  for (const std::string& name : entry.stateFunctionNames)
+  {
+    if (m_module->getFunction(name))
+      return false;
+  }
+
+  if (Function* dummyStateIdFunc = part->getFunction("dummyStateId"))
+  {
+    for (User* U : dummyStateIdFunc->users())
+    {
+      CallInst* call = cast<CallInst>(U);
+      int functionIdx = (int)cast<ConstantInt>(call->getArgOperand(0))->getSExtValue();
+      call->setArgOperand(0, makeInt32(functionIdxMap[functionIdx], context));
+    }
+  }
+
+  std::vector<std::pair<Function*, Function*>> bodies;
+  for (Function& partF : *part)
+  {
+    if (partF.isDeclaration())
+    {
+      VMap[&partF] = m_module->getOrInsertFunction(partF.getName(), partF.getFunctionType(), partF.getAttributes());
+      continue;
+    }
+    Function* stateF = Function::Create(partF.getFunctionType(), F->getLinkage(), partF.getName(), m_module);
+    stateF->copyAttributesFrom(&partF);
+    VMap[&partF] = stateF;
+    bodies.emplace_back(&partF, stateF);
+  }
+  for (auto& body : bodies)
+  {
+    Function* partF = body.first;
+    Function* stateF = body.second;
+    Function::arg_iterator stateArg = stateF->arg_begin();
+    for (Argument& partArg : partF->args())
+    {
+      stateArg->takeName(&partArg);
+      VMap[&partArg] = stateArg++;
+    }
+    stateF->getBasicBlockList().splice(stateF->end(), partF->getBasicBlockList());
+    for (BasicBlock& BB : *stateF)
+      for (Instruction& I : BB)
+        RemapInstruction(&I, VMap, RF_IgnoreMissingEntries);
+    SmallVector<std::pair<unsigned, MDNode*>, 4> MDs;
+    partF->getAllMetadata(MDs);
+    for (auto& MD : MDs)
+      stateF->setMetadata(MD.first, MapMetadata(MD.second, VMap, RF_IgnoreMissingEntries));
+  }
+
+  // Constants of the part's globals may outlive them.
+  for (Function& partF : *part)
+    partF.removeDeadConstantUsers();
+  for (GlobalVariable& partGV : part->globals())
+    partGV.removeDeadConstantUsers();
+  part.reset();
+
+  for (const std::string& name : entry.stateFunctionNames)
+    stateFunctions.push_back(m_module->getFunction(name));
+  shaderStackSize = entry.stackSize;
+  ++m_stateFunctionCache->m_hits;
+
+  // The transform erases the shader once it is split into state functions.
+  F->eraseFromParent();
+  return true;
+}
+
 void DxrFallbackCompiler::createStateFunctions(
   IntToFuncMap& stateFunctionMap,
   std::vector<int>& shaderEntryStateIds,
@@ -528,14 +913,32 @@ void DxrFallbackCompiler::createStateFunctions(
       sft.setVerbose(true);
     if (m_debugOutputLevel >= 3)
       sft.setDumpFilename("dump.ll");
+    int attributeSize = -1;
     if (shader == "Fallback_TraceRay")
-      sft.setAttributeSize(m_maxAttributeSize);
+    {
+      attributeSize = m_maxAttributeSize;
+      sft.setAttributeSize(attributeSize);
+    }
+    std::vector<StateFunctionTransform::ParameterSemanticType> paramTypes;
+    bool useCommittedAttr = false;
     DXIL::ShaderKind shaderKind = getRayShaderKind(F);
     if (shaderKind != DXIL::ShaderKind::Invalid)
-      sft.setParameterInfo(getParameterTypes(F, shaderKind), shaderKind == DXIL::ShaderKind::ClosestHit);
+    {
+      paramTypes = getParameterTypes(F, shaderKind);
+      useCommittedAttr = shaderKind == DXIL::ShaderKind::ClosestHit;
+      sft.setParameterInfo(paramTypes, useCommittedAttr);
+    }
     sft.setResourceGlobals(resources);
     UINT shaderStackSize = 0;
-    sft.run(stateFunctions, shaderStackSize);
+    std::string cacheKey;
+    if (m_stateFunctionCache)
+      cacheKey = getStateFunctionCacheKey(F, shaderNames, attributeSize, paramTypes, useCommittedAttr, resources, runtimeDataArgTy);
+    if (cacheKey.empty() || !restoreStateFunctions(cacheKey, F, shaderNames, stateFunctions, shaderStackSize))
+    {
+      sft.run(stateFunctions, shaderStackSize);
+      if (!cacheKey.empty())
+        storeStateFunctions(cacheKey, shaderNames, stateFunctions, shaderStackSize);
+    }
 
     shaderEntryStateIds.push_back(stateId);
     shaderStackSizes.push_back(shaderStackSize);
@@ -653,40 +1056,26 @@ void DxrFallbackCompiler::lowerIntrinsics()
   // Replace intrinsics in anyhit shaders with their pending versions
   LLVMContext& C = m_module->getContext();
   std::map<std::string, Function*> pendingIntrinsics;
-  std::string pendingPrefixes[] = { "fb_dxop_pending_",  "fb_Fallback_Pending" };
   for (auto& F : intrinsics)
   {
-    std::string intrinsicName;
-    if (F->getName().startswith(pendingPrefixes[0]))
-      intrinsicName = F->getName().substr(pendingPrefixes[0].length());
-    else if (F->getName().startswith(pendingPrefixes[1]))
-      intrinsicName = "Fallback_" + F->getName().substr(pendingPrefixes[1].length()).str();
-    else
-      continue;
-
-    pendingIntrinsics[intrinsicName] = F;
+    IntrinsicTarget target;
+    if (getIntrinsicTarget(F->getName(), target) && target.isPending)
+      pendingIntrinsics[target.intrinsicName] = F;
   }
 
   for (Function* func : intrinsics)
   {
-    StringRef intrinsicName;
-    std::string name;
-    bool isDxilOp = false;
-    if (func->getName().startswith("fb_Fallback_"))
-    {
-      intrinsicName = func->getName().substr(3); // after the "fb_" prefix
-      name = "\x1?" + intrinsicName.str();
-    }
-    else if (func->getName().startswith("fb_dxop_"))
-    {
-      intrinsicName = func->getName().substr(8);
-      name = "dx.op." + intrinsicName.str();
-      isDxilOp = true;
-    }
-    else
+    IntrinsicTarget target;
+    if (!getIntrinsicTarget(func->getName(), target))
     {
       assert(0 && "Bad intrinsic");
+      continue;
     }
+    if (target.isPending)
+      continue;
+    StringRef intrinsicName = target.intrinsicName;
+    const std::string& name = target.calledPrefix;
+    bool isDxilOp = target.isDxilOp;
     std::vector<Function*> calledFunc = getFunctionsWithPrefix(m_module, name);
     if (calledFunc.empty())
       continue;
@@ -104,6 +104,7 @@ public:
   std::unique_ptr<Module> m_pModule; // Must come after LLVMContext, otherwise unique_ptr will over-delete.
   DxilModule *m_pDxilModule = nullptr;
   bool m_bUsageInMetadata = false;
+  bool m_bBitcodeLoadError = false;
   std::vector<std::unique_ptr<CShaderReflectionConstantBuffer>>    m_CBs;
   std::vector<D3D12_SHADER_INPUT_BIND_DESC>       m_Resources;
   std::vector<std::unique_ptr<CShaderReflectionType>> m_Types;
@@ -120,6 +121,7 @@ public:
 
   HRESULT LoadRDAT(const DxilPartHeader *pPart);
   HRESULT LoadModule(const DxilPartHeader *pPart);
+  HRESULT MaterializeFunctions();
 
   // Common code
   ID3D12ShaderReflectionConstantBuffer* _GetConstantBufferByIndex(UINT Index);
@@ -2060,18 +2062,16 @@ HRESULT DxilModuleReflection::LoadModule(const DxilPartHeader *pShaderPart) {
     GetDxilProgramBitcode((DxilProgramHeader *)pData, &pBitcode, &bitcodeLength);
     std::unique_ptr<MemoryBuffer> pMemBuffer =
         MemoryBuffer::getMemBufferCopy(StringRef(pBitcode, bitcodeLength));
-    bool bBitcodeLoadError = false;
-    auto errorHandler = [&bBitcodeLoadError](const DiagnosticInfo &diagInfo) {
-        bBitcodeLoadError |= diagInfo.getSeverity() == DS_Error;
+    // The handler outlives this call, as function bodies are read lazily.
+    auto errorHandler = [this](const DiagnosticInfo &diagInfo) {
+        m_bBitcodeLoadError |= diagInfo.getSeverity() == DS_Error;
       };
-#if 0 // We materialize eagerly, because we'll need to walk instructions to look for usage information.
+    // Everything but usage information comes from metadata, so function
+    // bodies are only materialized when usage has to be found by walking
+    // instructions; see MaterializeFunctions.
     ErrorOr<std::unique_ptr<Module>> mod =
         getLazyBitcodeModule(std::move(pMemBuffer), Context, errorHandler);
-#else
-    ErrorOr<std::unique_ptr<Module>> mod =
-      parseBitcodeFile(pMemBuffer->getMemBufferRef(), Context, errorHandler);
-#endif
-    if (!mod || bBitcodeLoadError) {
+    if (!mod || m_bBitcodeLoadError) {
       return E_INVALIDARG;
     }
     std::swap(m_pModule, mod.get());
@@ -2087,10 +2087,19 @@ HRESULT DxilModuleReflection::LoadModule(const DxilPartHeader *pShaderPart) {
   CATCH_CPP_RETURN_HRESULT();
 };
 
+HRESULT DxilModuleReflection::MaterializeFunctions() {
+  if (m_pModule->materializeAll() || m_bBitcodeLoadError)
+    return E_INVALIDARG;
+  return S_OK;
+}
+
 HRESULT DxilShaderReflection::Load(const DxilPartHeader *pModulePart,
                                    const DxilPartHeader *pRDATPart) {
   IFR(LoadRDAT(pRDATPart));
   IFR(LoadModule(pModulePart));
+  // Before validator 1.5, usage is not in metadata and needs the bodies.
+  if (!m_bUsageInMetadata)
+    IFR(MaterializeFunctions());
 
   try {
     // Set cbuf usage.
@@ -2729,6 +2738,8 @@ HRESULT DxilLibraryReflection::Load(const DxilPartHeader *pModulePart,
                                     const DxilPartHeader *pRDATPart) {
   IFR(LoadRDAT(pRDATPart));
   IFR(LoadModule(pModulePart));
+  if (!m_bUsageInMetadata)
+    IFR(MaterializeFunctions());
 
   try {
     AddResourceDependencies();
@@ -103,6 +103,8 @@ namespace {
 struct DxilFunctionLinkInfo {
   DxilFunctionLinkInfo(llvm::Function *F);
   llvm::Function *func;
+  // Set once the function is materialized and usedFunctions is built.
+  bool bLoaded;
   // SetVectors for deterministic iteration
   llvm::SetVector<llvm::Function *> usedFunctions;
   llvm::SetVector<llvm::GlobalVariable *> usedGVs;
@@ -131,8 +133,18 @@ public:
   void FixIntrinsicOverloads();
 
 private:
+  void BuildInitFunctionsAndResourceMap();
+
   std::unique_ptr<llvm::Module> m_pModule;
   DxilModule &m_DM;
+  // Link info is built incrementally and kept for the lifetime of the lib,
+  // so each Link only pays for functions no earlier Link has loaded.
+  // It isn't written out with the library: validators reject unknown
+  // container parts and named metadata, so there's nowhere to keep it.
+  // Functions loaded since the last BuildGlobalUsage.
+  llvm::SetVector<llvm::Function *> m_pendingGlobalUsage;
+  // Init functions and resource map are built.
+  bool m_bGlobalUsageBuilt;
   // Map from name to Link info for extern functions.
   llvm::StringMap<std::unique_ptr<DxilFunctionLinkInfo>> m_functionNameMap;
   // Map from resource link global to resource. MapVector for deterministic iteration.
@@ -178,7 +190,8 @@ private:
 //
 // DxilFunctionLinkInfo methods.
 //
-DxilFunctionLinkInfo::DxilFunctionLinkInfo(Function *F) : func(F) {
+DxilFunctionLinkInfo::DxilFunctionLinkInfo(Function *F)
+    : func(F), bLoaded(false) {
   DXASSERT_NOMSG(F);
 }
 
@@ -188,7 +201,8 @@ DxilFunctionLinkInfo::DxilFunctionLinkInfo(Function *F) : func(F) {
 //
 
 DxilLib::DxilLib(std::unique_ptr<llvm::Module> pModule)
-    : m_pModule(std::move(pModule)), m_DM(m_pModule->GetOrCreateDxilModule()) {
+    : m_pModule(std::move(pModule)), m_DM(m_pModule->GetOrCreateDxilModule()),
+      m_bGlobalUsageBuilt(false) {
   Module &M = *m_pModule;
   const std::string MID = (Twine(M.getModuleIdentifier()) + ".").str();
 
@@ -224,6 +238,9 @@ void DxilLib::FixIntrinsicOverloads() {
 void DxilLib::LazyLoadFunction(Function *F) {
   DXASSERT(m_functionNameMap.count(F->getName()), "else invalid Function");
   DxilFunctionLinkInfo *linkInfo = m_functionNameMap[F->getName()].get();
+  // Already loaded by an earlier Link.
+  if (linkInfo->bLoaded)
+    return;
   std::error_code EC = F->materialize();
   DXASSERT_LOCALVAR(EC, !EC, "else fail to materialize");
 
@@ -244,13 +261,41 @@ void DxilLib::LazyLoadFunction(Function *F) {
       linkInfo->usedFunctions.insert(patchConstantFunc);
     }
   }
+  linkInfo->bLoaded = true;
   // Used globals will be build before link.
+  m_pendingGlobalUsage.insert(F);
 }
 
 void DxilLib::BuildGlobalUsage() {
   Module &M = *m_pModule;
 
-  // Collect init functions for static globals.
+  if (!m_bGlobalUsageBuilt) {
+    // Collect init functions for static globals.
+    BuildInitFunctionsAndResourceMap();
+    m_bGlobalUsageBuilt = true;
+  }
+
+  if (m_pendingGlobalUsage.empty())
+    return;
+
+  // Build used globals for functions loaded since the last build.
+  for (GlobalVariable &GV : M.globals()) {
+    llvm::SetVector<Function *> funcSet;
+    CollectUsedFunctions(&GV, funcSet);
+    for (Function *F : funcSet) {
+      if (!m_pendingGlobalUsage.count(F))
+        continue;
+      DXASSERT(m_functionNameMap.count(F->getName()), "must exist in table");
+      DxilFunctionLinkInfo *linkInfo = m_functionNameMap[F->getName()].get();
+      linkInfo->usedGVs.insert(&GV);
+    }
+  }
+  m_pendingGlobalUsage.clear();
+}
+
+void DxilLib::BuildInitFunctionsAndResourceMap() {
+  Module &M = *m_pModule;
+
   if (GlobalVariable *Ctors = M.getGlobalVariable("llvm.global_ctors")) {
     if (ConstantArray *CA = dyn_cast<ConstantArray>(Ctors->getInitializer())) {
       for (User::op_iterator i = CA->op_begin(), e = CA->op_end(); i != e;
@@ -274,17 +319,6 @@ void DxilLib::BuildGlobalUsage() {
     }
   }
 
-  // Build used globals.
-  for (GlobalVariable &GV : M.globals()) {
-    llvm::SetVector<Function *> funcSet;
-    CollectUsedFunctions(&GV, funcSet);
-    for (Function *F : funcSet) {
-      DXASSERT(m_functionNameMap.count(F->getName()), "must exist in table");
-      DxilFunctionLinkInfo *linkInfo = m_functionNameMap[F->getName()].get();
-      linkInfo->usedGVs.insert(&GV);
-    }
-  }
-
   // Build resource map.
   AddResourceMap(m_DM.GetUAVs(), DXIL::ResourceClass::UAV, m_resourceMap, m_DM);
   AddResourceMap(m_DM.GetSRVs(), DXIL::ResourceClass::SRV, m_resourceMap, m_DM);
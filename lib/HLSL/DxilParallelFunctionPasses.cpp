@@ -0,0 +1,545 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// DxilParallelFunctionPasses.cpp                                            //
+// Copyright (C) Microsoft Corporation. All rights reserved.                 //
+// This file is distributed under the University of Illinois Open Source     //
+// License. See LICENSE.TXT for details.                                     //
+//                                                                           //
+// Runs function passes on the functions of a library concurrently.          //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "dxc/HLSL/DxilGenerationPass.h"
+#include "dxc/DXIL/DxilModule.h"
+#include "dxc/DXIL/DxilOperations.h"
+#include "dxc/DXIL/DxilShaderModel.h"
+#include "dxc/Support/Global.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/TypeFinder.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include <atomic>
+#include <exception>
+#include <system_error>
+#include <thread>
+
+using namespace llvm;
+using namespace hlsl;
+
+///////////////////////////////////////////////////////////////////////////////
+// Parallel function passes.
+//
+// LLVMContext isn't thread-safe, so each function is optimized in a context of
+// its own: the module is written out once, and a worker thread reads it
+// lazily, materializing only the function's body and keeping the other
+// functions as declarations.  Once optimized, the body is moved back in place
+// of the original one.
+// Bodies are moved back in module order, which keeps the output independent
+// of the number of threads and of the order in which workers finish.
+
+namespace {
+
+typedef std::function<void(legacy::PassManagerBase &)> AddPassesFn;
+
+// Diagnostic reported while optimizing a function, to report again on the
+// module's context once the function is back.  Its location travels with the
+// function as an operand of the PartDiagnosticLocations named metadata.
+struct PartDiagnostic {
+  DiagnosticSeverity Severity;
+  std::string Message;
+  int LocationIndex; // -1 if the diagnostic has no location
+};
+
+const char PartDiagnosticLocations[] = "dx.part.diag.locs";
+// Identified struct types are renamed to this prefix and their index in
+// FunctionJob::StructNames for the trip back into the module's context.
+const char PartStructPrefix[] = "dx.part.struct.";
+
+// What a worker needs to rebuild the DxilModule state the passes rely on.
+struct PartOptions {
+  const ShaderModel *SM;
+  bool UseMinPrecision;
+  bool DisableMathRefactoring;
+};
+
+// A function optimized on its own.  Bitcode holds the optimized module.
+struct FunctionJob {
+  Function *F;
+  unsigned FunctionIndex;
+  std::string Bitcode;
+  // For each global of the optimized module, the index of the module global
+  // it stands for, or -1 for globals added by the passes.
+  std::vector<int> GlobalIndices;
+  // Names of the identified struct types of the optimized module, which are
+  // the names of the module's types, as the function's context started out
+  // with no types of its own.
+  std::vector<std::string> StructNames;
+  std::vector<PartDiagnostic> Diagnostics;
+  std::exception_ptr Exception;
+};
+
+// Globals in the order the bitcode writer and reader preserve.
+void CollectGlobals(Module &M, SmallVectorImpl<GlobalValue *> &Globals) {
+  for (GlobalVariable &GV : M.globals())
+    Globals.push_back(&GV);
+  for (Function &F : M.functions())
+    Globals.push_back(&F);
+  for (GlobalAlias &GA : M.aliases())
+    Globals.push_back(&GA);
+}
+
+// Reads the module holding a function's definition, declarations of the
+// other functions and the global variables.
+std::unique_ptr<Module> ReadFunctionPart(StringRef ModuleBitcode,
+                                         unsigned FunctionIndex,
+                                         LLVMContext &Context) {
+  ErrorOr<std::unique_ptr<Module>> PartOrErr = getLazyBitcodeModule(
+      MemoryBuffer::getMemBuffer(ModuleBitcode, "",
+                                 /*RequiresNullTerminator*/ false),
+      Context);
+  IFTBOOL(PartOrErr, DXC_E_OPTIMIZATION_FAILED);
+  std::unique_ptr<Module> Part = std::move(PartOrErr.get());
+
+  SmallVector<GlobalValue *, 64> Globals;
+  CollectGlobals(*Part, Globals);
+  IFTBOOL(!Globals[FunctionIndex]->materialize(), DXC_E_OPTIMIZATION_FAILED);
+  // The bodies left unread become declarations, which are external.
+  for (Function &F : *Part) {
+    if (F.isMaterializable()) {
+      F.setIsMaterializable(false);
+      F.setLinkage(GlobalValue::ExternalLinkage);
+    }
+  }
+  IFTBOOL(!Part->materializeAllPermanently(), DXC_E_OPTIMIZATION_FAILED);
+
+  // Named metadata isn't needed to optimize a function body.
+  while (!Part->named_metadata_empty())
+    Part->named_metadata_begin()->eraseFromParent();
+  return Part;
+}
+
+// Diagnostics of a function's passes, with the locations they refer to,
+// which live in the function's context.
+struct PartDiagnosticCollector {
+  std::vector<PartDiagnostic> &Diagnostics;
+  std::vector<TrackingMDNodeRef> Locations;
+};
+
+void CollectPartDiagnostic(const DiagnosticInfo &DI, void *Context) {
+  PartDiagnosticCollector &Collector =
+      *static_cast<PartDiagnosticCollector *>(Context);
+  std::string Message;
+  raw_string_ostream OS(Message);
+  const DILocation *Loc = nullptr;
+  if (const DiagnosticInfoDxil *DxilDI = dyn_cast<DiagnosticInfoDxil>(&DI)) {
+    OS << DxilDI->getMsgStr();
+    Loc = DxilDI->getLocation();
+  } else {
+    DiagnosticPrinterRawOStream DP(OS);
+    DI.print(DP);
+    if (const DiagnosticInfoOptimizationBase *OptDI =
+            dyn_cast<DiagnosticInfoOptimizationBase>(&DI))
+      Loc = OptDI->getDebugLoc().get();
+  }
+  OS.flush();
+  int LocationIndex = -1;
+  if (Loc) {
+    LocationIndex = (int)Collector.Locations.size();
+    Collector.Locations.emplace_back(const_cast<DILocation *>(Loc));
+  }
+  Collector.Diagnostics.push_back(
+      {DI.getSeverity(), std::move(Message), LocationIndex});
+}
+
+void OptimizeFunctionPart(FunctionJob &Job, StringRef ModuleBitcode,
+                          const PartOptions &Opts,
+                          const AddPassesFn &AddPasses) {
+  LLVMContext Context;
+  PartDiagnosticCollector Collector = {Job.Diagnostics, {}};
+  Context.setDiagnosticHandler(CollectPartDiagnostic, &Collector);
+  std::unique_ptr<Module> PartPtr =
+      ReadFunctionPart(ModuleBitcode, Job.FunctionIndex, Context);
+  Module &Part = *PartPtr;
+
+  // Instruction simplification looks up DXIL operations and precise
+  // settings through the DxilModule.
+  DxilModule &DM = Part.GetOrCreateDxilModule(/*skipInit*/ true);
+  DM.SetShaderModel(Opts.SM, Opts.UseMinPrecision);
+  DM.m_ShaderFlags.SetDisableMathRefactoring(Opts.DisableMathRefactoring);
+  DM.GetOP()->RefreshCache();
+
+  SmallVector<GlobalValue *, 64> Globals;
+  CollectGlobals(Part, Globals);
+  std::vector<WeakVH> GlobalHandles(Globals.begin(), Globals.end());
+
+  legacy::FunctionPassManager FPM(&Part);
+  AddPasses(FPM);
+  FPM.doInitialization();
+  FPM.run(*cast<Function>(Globals[Job.FunctionIndex]));
+  FPM.doFinalization();
+
+  DenseMap<Value *, int> Indices;
+  for (unsigned i = 0; i < GlobalHandles.size(); ++i)
+    if (Value *V = GlobalHandles[i])
+      Indices[V] = i;
+  Globals.clear();
+  CollectGlobals(Part, Globals);
+  Job.GlobalIndices.clear();
+  for (GlobalValue *GV : Globals) {
+    auto It = Indices.find(GV);
+    Job.GlobalIndices.push_back(It == Indices.end() ? -1 : It->second);
+  }
+
+  // Reading the module into the module's context would rename the structs
+  // whose names are taken there, so they are given names of their own for
+  // the trip, and mapped back to the types they were cloned from by index.
+  TypeFinder StructTypes;
+  StructTypes.run(Part, /*onlyNamed*/ true);
+  Job.StructNames.clear();
+  for (StructType *ST : StructTypes) {
+    std::string Name = (PartStructPrefix + Twine(Job.StructNames.size())).str();
+    Job.StructNames.push_back(ST->getName());
+    ST->setName(Name);
+  }
+
+  if (!Collector.Locations.empty()) {
+    NamedMDNode *Locations =
+        Part.getOrInsertNamedMetadata(PartDiagnosticLocations);
+    for (TrackingMDNodeRef &Loc : Collector.Locations)
+      Locations->addOperand(Loc.get());
+    Collector.Locations.clear();
+  }
+
+  Job.Bitcode.clear();
+  raw_string_ostream OS(Job.Bitcode);
+  WriteBitcodeToFile(&Part, OS, /*ShouldPreserveUseListOrder*/ true);
+  OS.flush();
+}
+
+// Maps the types of a function's optimized module, read into the module's
+// context, to the module's types.
+class PartTypeRemapper : public ValueMapTypeRemapper {
+public:
+  Type *remapType(Type *SrcTy) override;
+
+  // Maps a struct of the optimized module to the type it was cloned from.
+  void mapStruct(StructType *SrcST, StructType *DstST) {
+    MappedTypes[SrcST] = DstST;
+  }
+
+private:
+  DenseMap<Type *, Type *> MappedTypes;
+};
+
+Type *PartTypeRemapper::remapType(Type *SrcTy) {
+  auto It = MappedTypes.find(SrcTy);
+  if (It != MappedTypes.end())
+    return It->second;
+
+  // Identified structs not mapped by mapStruct were added by the passes, and
+  // are their own.
+  Type *DstTy = SrcTy;
+  if (StructType *ST = dyn_cast<StructType>(SrcTy)) {
+    if (ST->isLiteral()) {
+      SmallVector<Type *, 8> Elts;
+      for (Type *EltTy : ST->elements())
+        Elts.push_back(remapType(EltTy));
+      DstTy = StructType::get(SrcTy->getContext(), Elts, ST->isPacked());
+    }
+  } else if (PointerType *PT = dyn_cast<PointerType>(SrcTy)) {
+    DstTy = PointerType::get(remapType(PT->getElementType()),
+                             PT->getAddressSpace());
+  } else if (ArrayType *AT = dyn_cast<ArrayType>(SrcTy)) {
+    DstTy = ArrayType::get(remapType(AT->getElementType()),
+                           AT->getNumElements());
+  } else if (VectorType *VT = dyn_cast<VectorType>(SrcTy)) {
+    DstTy = VectorType::get(remapType(VT->getElementType()),
+                            VT->getNumElements());
+  } else if (FunctionType *FT = dyn_cast<FunctionType>(SrcTy)) {
+    SmallVector<Type *, 8> Params;
+    for (Type *ParamTy : FT->params())
+      Params.push_back(remapType(ParamTy));
+    DstTy = FunctionType::get(remapType(FT->getReturnType()), Params,
+                              FT->isVarArg());
+  }
+  MappedTypes[SrcTy] = DstTy;
+  return DstTy;
+}
+
+// Creates a global the passes added to the function's module.
+GlobalValue *CreateGlobal(Module &M, GlobalValue *PartGV,
+                          PartTypeRemapper &TypeMapper) {
+  if (Function *PartF = dyn_cast<Function>(PartGV)) {
+    DXASSERT(PartF->isDeclaration(), "passes only add function declarations");
+    Function *F = Function::Create(
+        cast<FunctionType>(TypeMapper.remapType(PartF->getFunctionType())),
+        PartF->getLinkage(), PartF->getName(), &M);
+    F->copyAttributesFrom(PartF);
+    return F;
+  }
+  GlobalVariable *PartGVar = cast<GlobalVariable>(PartGV);
+  GlobalVariable *GVar = new GlobalVariable(
+      M, TypeMapper.remapType(PartGVar->getType()->getElementType()),
+      PartGVar->isConstant(), PartGVar->getLinkage(), nullptr,
+      PartGVar->getName(), nullptr, PartGVar->getThreadLocalMode(),
+      PartGVar->getType()->getAddressSpace());
+  GVar->copyAttributesFrom(PartGVar);
+  return GVar;
+}
+
+void MergeFunctionPart(Module &M, ArrayRef<GlobalValue *> Globals,
+                       FunctionJob &Job) {
+  ErrorOr<std::unique_ptr<Module>> PartOrErr =
+      parseBitcodeFile(MemoryBufferRef(Job.Bitcode, ""), M.getContext());
+  IFTBOOL(PartOrErr, DXC_E_OPTIMIZATION_FAILED);
+  std::unique_ptr<Module> Part = std::move(PartOrErr.get());
+
+  SmallVector<GlobalValue *, 64> PartGlobals;
+  CollectGlobals(*Part, PartGlobals);
+  DXASSERT_NOMSG(PartGlobals.size() == Job.GlobalIndices.size());
+
+  // The struct names are unique to this function's module, as the structs
+  // of functions merged before it are renamed once they're merged.
+  PartTypeRemapper TypeMapper;
+  SmallVector<StructType *, 16> PartStructs;
+  for (unsigned i = 0; i < Job.StructNames.size(); ++i) {
+    StructType *PartST =
+        M.getTypeByName((PartStructPrefix + Twine(i)).str());
+    // The reader only keeps the name if it wasn't taken in the context.
+    IFTBOOL(PartST, DXC_E_OPTIMIZATION_FAILED);
+    StructType *ST = M.getTypeByName(Job.StructNames[i]);
+    if (ST && ST != PartST) {
+      DXASSERT_NOMSG(ST->getNumElements() == PartST->getNumElements());
+      TypeMapper.mapStruct(PartST, ST);
+      PartStructs.push_back(PartST);
+    } else {
+      PartST->setName(Job.StructNames[i]);
+    }
+  }
+
+  ValueToValueMapTy VMap;
+  Function *PartF = nullptr;
+  SmallVector<std::pair<GlobalVariable *, GlobalVariable *>, 4> NewGVars;
+  for (unsigned i = 0; i < PartGlobals.size(); ++i) {
+    GlobalValue *PartGV = PartGlobals[i];
+    int Index = Job.GlobalIndices[i];
+    if (Index >= 0) {
+      VMap[PartGV] = Globals[Index];
+      if ((unsigned)Index == Job.FunctionIndex)
+        PartF = cast<Function>(PartGV);
+      continue;
+    }
+    // Reuse what an earlier function added, such as the declaration of a
+    // DXIL operation overload.
+    GlobalValue *GV = nullptr;
+    if (PartGV->hasName() && !PartGV->hasLocalLinkage())
+      GV = M.getNamedValue(PartGV->getName());
+    if (GV && GV->getType() != TypeMapper.remapType(PartGV->getType()))
+      GV = nullptr;
+    if (!GV) {
+      GV = CreateGlobal(M, PartGV, TypeMapper);
+      if (GlobalVariable *PartGVar = dyn_cast<GlobalVariable>(PartGV))
+        if (PartGVar->hasInitializer())
+          NewGVars.emplace_back(PartGVar, cast<GlobalVariable>(GV));
+    }
+    VMap[PartGV] = GV;
+  }
+  for (auto &NewGVar : NewGVars)
+    NewGVar.second->setInitializer(MapValue(NewGVar.first->getInitializer(),
+                                            VMap, RF_None, &TypeMapper));
+
+  // Replace the body with the optimized one.
+  Function *F = Job.F;
+  DXASSERT_NOMSG(PartF && !PartF->isDeclaration());
+  F->dropAllReferences();
+  Function::arg_iterator PartArg = PartF->arg_begin();
+  for (Argument &Arg : F->args())
+    VMap[PartArg++] = &Arg;
+  F->getBasicBlockList().splice(F->end(), PartF->getBasicBlockList());
+  for (BasicBlock &BB : *F)
+    for (Instruction &I : BB)
+      RemapInstruction(&I, VMap, RF_IgnoreMissingEntries, &TypeMapper);
+  SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+  PartF->getAllMetadata(MDs);
+  for (auto &MD : MDs)
+    F->setMetadata(MD.first,
+                   MapMetadata(MD.second, VMap, RF_None, &TypeMapper));
+
+  // Locations are mapped with the body's metadata, so they refer to the
+  // same scopes.
+  SmallVector<const DILocation *, 4> Locations;
+  if (NamedMDNode *PartLocations =
+          Part->getNamedMetadata(PartDiagnosticLocations))
+    for (MDNode *Loc : PartLocations->operands())
+      Locations.push_back(cast_or_null<DILocation>(
+          MapMetadata(Loc, VMap, RF_None, &TypeMapper)));
+
+  // Constants of the part's globals may outlive them.
+  for (GlobalValue *PartGV : PartGlobals)
+    PartGV->removeDeadConstantUsers();
+  Part.reset();
+
+  // Types live as long as the context, so the part's structs give up their
+  // names for the next function's.
+  for (StructType *PartST : PartStructs)
+    PartST->setName("");
+
+  for (const PartDiagnostic &Diag : Job.Diagnostics)
+    M.getContext().diagnose(DiagnosticInfoDxil(
+        F, Diag.LocationIndex < 0 ? nullptr : Locations[Diag.LocationIndex],
+        Diag.Message, Diag.Severity));
+}
+
+class DxilParallelFunctionPasses : public ModulePass {
+public:
+  static char ID; // Pass identification, replacement for typeid
+  explicit DxilParallelFunctionPasses(AddPassesFn AddPasses = nullptr,
+                                      unsigned ThreadCount = 0)
+      : ModulePass(ID), AddPasses(std::move(AddPasses)),
+        ThreadCount(ThreadCount) {}
+
+  const char *getPassName() const override {
+    return "DXIL Parallel Function Passes";
+  }
+
+  bool runOnModule(Module &M) override {
+    if (!AddPasses)
+      return false;
+
+    SmallVector<Function *, 64> Functions;
+    for (Function &F : M)
+      if (!F.isDeclaration())
+        Functions.push_back(&F);
+
+    unsigned NumThreads = 1;
+    // Only library functions are independent of each other, and debug info
+    // would be duplicated by moving bodies across modules.
+    if (llvm_is_multithreaded() && M.HasDxilModule() &&
+        M.GetDxilModule().GetShaderModel()->IsLib() &&
+        !M.getNamedMetadata("llvm.dbg.cu"))
+      NumThreads = std::min<size_t>(
+          ThreadCount ? ThreadCount : std::thread::hardware_concurrency(),
+          Functions.size());
+    if (NumThreads < 2)
+      return RunInPlace(M, Functions);
+
+    SmallVector<GlobalValue *, 64> Globals;
+    CollectGlobals(M, Globals);
+    DenseMap<GlobalValue *, unsigned> GlobalIndices;
+    for (unsigned i = 0; i < Globals.size(); ++i)
+      GlobalIndices[Globals[i]] = i;
+
+    std::vector<FunctionJob> Jobs(Functions.size());
+    for (unsigned i = 0; i < Functions.size(); ++i) {
+      Jobs[i].F = Functions[i];
+      Jobs[i].FunctionIndex = GlobalIndices[Functions[i]];
+    }
+    std::string ModuleBitcode;
+    {
+      raw_string_ostream OS(ModuleBitcode);
+      WriteBitcodeToFile(&M, OS, /*ShouldPreserveUseListOrder*/ true);
+    }
+
+    DxilModule &DM = M.GetDxilModule();
+    PartOptions Opts = {DM.GetShaderModel(), DM.GetUseMinPrecision(),
+                        DM.m_ShaderFlags.GetDisableMathRefactoring()};
+    std::atomic<unsigned> NextJob(0);
+    auto RunJobs = [&]() {
+      for (unsigned i; (i = NextJob++) < Jobs.size();) {
+        try {
+          OptimizeFunctionPart(Jobs[i], ModuleBitcode, Opts, AddPasses);
+        } catch (...) {
+          Jobs[i].Exception = std::current_exception();
+        }
+      }
+    };
+    // Workers allocate with this thread's allocator, since what they return
+    // is freed here.  It stays installed until the thread exits, as a thread
+    // frees its start-up state after its function returns.
+    IMalloc *pMalloc = DxcGetThreadMallocNoRef();
+    // Each worker times its passes with a listener of its own, merged into
+    // this thread's once the workers are done.
+    TimingListener *Listener = getThreadTimingListener();
+    std::vector<std::unique_ptr<TimingListener>> WorkerListeners;
+    auto Worker = [&](TimingListener *WorkerListener) {
+      static thread_local DxcThreadMalloc TM(pMalloc);
+      TimingListener *Prior = setThreadTimingListener(WorkerListener);
+      RunJobs();
+      setThreadTimingListener(Prior);
+    };
+    std::vector<std::thread> Threads;
+    Threads.reserve(NumThreads);
+    WorkerListeners.reserve(NumThreads);
+    for (unsigned i = 0; i < NumThreads; ++i) {
+      std::unique_ptr<TimingListener> WorkerListener;
+      if (Listener)
+        WorkerListener = Listener->createThreadListener();
+      try {
+        Threads.emplace_back(Worker, WorkerListener.get());
+      } catch (const std::system_error &) {
+        // The threads already running take the remaining functions.
+        break;
+      }
+      WorkerListeners.push_back(std::move(WorkerListener));
+    }
+    if (Threads.empty())
+      RunJobs();
+    for (std::thread &T : Threads)
+      T.join();
+    for (std::unique_ptr<TimingListener> &WorkerListener : WorkerListeners)
+      if (WorkerListener)
+        Listener->mergeThreadListener(*WorkerListener);
+
+    for (FunctionJob &Job : Jobs)
+      if (Job.Exception)
+        std::rethrow_exception(Job.Exception);
+    for (FunctionJob &Job : Jobs)
+      MergeFunctionPart(M, Globals, Job);
+
+    // Let the OP cache know about DXIL operations the workers declared.
+    DM.GetOP()->RefreshCache();
+    return true;
+  }
+
+private:
+  bool RunInPlace(Module &M, ArrayRef<Function *> Functions) {
+    legacy::FunctionPassManager FPM(&M);
+    AddPasses(FPM);
+    bool Changed = FPM.doInitialization();
+    for (Function *F : Functions)
+      Changed |= FPM.run(*F);
+    Changed |= FPM.doFinalization();
+    return Changed;
+  }
+
+  AddPassesFn AddPasses;
+  unsigned ThreadCount; // 0 for one per hardware thread
+};
+
+} // namespace
+
+char DxilParallelFunctionPasses::ID = 0;
+
+ModulePass *llvm::createDxilParallelFunctionPassesPass(
+    std::function<void(legacy::PassManagerBase &)> AddPasses,
+    unsigned ThreadCount) {
+  return new DxilParallelFunctionPasses(std::move(AddPasses), ThreadCount);
+}
+
+INITIALIZE_PASS(DxilParallelFunctionPasses, "dxil-parallel-function-passes",
+                "DXIL Parallel Function Passes", false, false)
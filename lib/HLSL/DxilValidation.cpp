@@ -2758,7 +2758,7 @@ static bool GetNodeOperandAsInt(ValidationContext &ValCtx, MDNode *pMD, unsigned
 }
 
 static bool IsPrecise(Instruction &I, ValidationContext &ValCtx) {
-  MDNode *pMD = I.getMetadata(DxilMDHelper::kDxilPreciseAttributeMDName);
+  MDNode *pMD = I.getMetadata(ValCtx.kDxilPreciseMDKind);
   if (pMD == nullptr) {
     return false;
   }
@@ -5792,11 +5792,56 @@ bool VerifyFeatureInfoMatches(llvm::Module *pModule,
   return !ValCtx.Failed;
 }
 
+static void VerifyProgramPartMatches(_In_ ValidationContext &ValCtx,
+                                     _In_opt_ const DxilPartHeader *pProgramPart,
+                                     _In_opt_ const char *pProgramBitcode,
+                                     uint32_t ProgramBitcodeSize) {
+  const char *PartName = "DXIL";
+  if (!pProgramPart) {
+    ValCtx.EmitFormatError(ValidationRule::ContainerPartMissing, { PartName });
+    return;
+  }
+
+  const DxilProgramHeader *pHeader =
+      reinterpret_cast<const DxilProgramHeader *>(GetDxilPartData(pProgramPart));
+  if (!IsValidDxilProgramHeader(pHeader, pProgramPart->PartSize)) {
+    ValCtx.EmitFormatError(ValidationRule::ContainerPartMatches, { PartName });
+    return;
+  }
+
+  // The header must describe the module's shader model.
+  const ShaderModel *pSM = ValCtx.DxilMod.GetShaderModel();
+  unsigned DxilMajor, DxilMinor;
+  pSM->GetDxilVersion(DxilMajor, DxilMinor);
+  const char *pBitcode;
+  uint32_t BitcodeSize;
+  GetDxilProgramBitcode(pHeader, &pBitcode, &BitcodeSize);
+  if (pHeader->ProgramVersion !=
+          EncodeVersion(pSM->GetKind(), pSM->GetMajor(), pSM->GetMinor()) ||
+      pHeader->BitcodeHeader.DxilVersion !=
+          DXIL::MakeDxilVersion(DxilMajor, DxilMinor) ||
+      !isBitcode((const unsigned char *)pBitcode,
+                 (const unsigned char *)pBitcode + BitcodeSize)) {
+    ValCtx.EmitFormatError(ValidationRule::ContainerPartMatches, { PartName });
+    return;
+  }
+
+  // A module that wasn't loaded from the part comes with the bitcode it was
+  // serialized to, which the part must hold.
+  if (pProgramBitcode &&
+      (BitcodeSize != ProgramBitcodeSize ||
+       memcmp(pBitcode, pProgramBitcode, ProgramBitcodeSize) != 0)) {
+    ValCtx.EmitFormatError(ValidationRule::ContainerPartMatches, { PartName });
+  }
+}
+
 _Use_decl_annotations_
 HRESULT ValidateDxilContainerParts(llvm::Module *pModule,
                                    llvm::Module *pDebugModule,
                                    const DxilContainerHeader *pContainer,
-                                   uint32_t ContainerSize) {
+                                   uint32_t ContainerSize,
+                                   const char *pProgramBitcode,
+                                   uint32_t ProgramBitcodeSize) {
 
   DXASSERT_NOMSG(pModule);
   if (!pContainer || !IsValidDxilContainer(pContainer, ContainerSize)) {
@@ -5818,6 +5863,7 @@ HRESULT ValidateDxilContainerParts(llvm::Module *pModule,
   std::unordered_set<uint32_t> FourCCFound;
   const DxilPartHeader *pRootSignaturePart = nullptr;
   const DxilPartHeader *pPSVPart = nullptr;
+  const DxilPartHeader *pProgramPart = nullptr;
 
   for (auto it = begin(pContainer), itEnd = end(pContainer); it != itEnd; ++it) {
     const DxilPartHeader *pPart = *it;
@@ -5880,11 +5926,15 @@ HRESULT ValidateDxilContainerParts(llvm::Module *pModule,
     case DFCC_ResourceDef:
     case DFCC_ShaderStatistics:
     case DFCC_PrivateData:
-    case DFCC_DXIL:
     case DFCC_ShaderDebugInfoDXIL:
     case DFCC_ShaderDebugName:
       continue;
 
+    // Checked below with the other required parts.
+    case DFCC_DXIL:
+      pProgramPart = pPart;
+      break;
+
     case DFCC_ShaderHash:
       if (pPart->PartSize != sizeof(DxilShaderHash)) {
         ValCtx.EmitFormatError(ValidationRule::ContainerPartInvalid, { szFourCC });
@@ -5907,6 +5957,9 @@ HRESULT ValidateDxilContainerParts(llvm::Module *pModule,
     }
   }
 
+  VerifyProgramPartMatches(ValCtx, pProgramPart, pProgramBitcode,
+                           ProgramBitcodeSize);
+
   // Verify required parts found
   if (ValCtx.isLibProfile) {
     if (FourCCFound.find(DFCC_RuntimeData) == FourCCFound.end()) {
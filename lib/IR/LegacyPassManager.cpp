@@ -1335,6 +1335,7 @@ bool BBPassManager::runOnFunction(Function &F) {
         // If the pass crashes, remember this.
         PassManagerPrettyStackEntry X(BP, *I);
         TimeRegion PassTimer(getPassTimer(BP));
+        TimingListenerRegion PassRegion(BP->getPassName()); // HLSL Change
 
         LocalChanged |= BP->runOnBasicBlock(*I);
       }
@@ -1563,6 +1564,7 @@ bool FPPassManager::runOnFunction(Function &F) {
     {
       PassManagerPrettyStackEntry X(FP, F);
       TimeRegion PassTimer(getPassTimer(FP));
+      TimingListenerRegion PassRegion(FP->getPassName()); // HLSL Change
 
       LocalChanged |= FP->runOnFunction(F);
     }
@@ -1639,6 +1641,7 @@ MPPassManager::runOnModule(Module &M) {
     {
       PassManagerPrettyStackEntry X(MP, M);
       TimeRegion PassTimer(getPassTimer(MP));
+      TimingListenerRegion PassRegion(MP->getPassName()); // HLSL Change
 
       LocalChanged |= MP->runOnModule(M);
     }
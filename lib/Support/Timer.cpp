@@ -19,6 +19,7 @@
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Mutex.h"
 #include "llvm/Support/Process.h"
+#include "llvm/Support/ThreadLocal.h" // HLSL Change
 #include "llvm/Support/raw_ostream.h"
 using namespace llvm;
 
@@ -402,3 +403,17 @@ void TimerGroup::printAll(raw_ostream &OS) {
   for (TimerGroup *TG = TimerGroupList; TG; TG = TG->Next)
     TG->print(OS);
 }
+
+// HLSL Change Starts - per-thread region timing
+static ManagedStatic<sys::ThreadLocal<TimingListener> > ThreadTimingListener;
+
+TimingListener *llvm::setThreadTimingListener(TimingListener *L) {
+  TimingListener *Prior = ThreadTimingListener->get();
+  ThreadTimingListener->set(L);
+  return Prior;
+}
+
+TimingListener *llvm::getThreadTimingListener() {
+  return ThreadTimingListener->get();
+}
+// HLSL Change Ends
@@ -207,7 +207,43 @@ void PassManagerBuilder::populateFunctionPassManager(
 }
 
 // HLSL Change Starts
-static void addHLSLPasses(bool HLSLHighLevel, unsigned OptLevel, bool OnlyWarnOnUnrollFail, bool StructurizeLoopExitsForUnroll, bool EnableLifetimeMarkers, hlsl::HLSLExtensionsCodegenHelper *ExtHelper, legacy::PassManagerBase &MPM) {
+// Function passes that run once DXIL is generated.  They only look at the
+// function they run on, so they can run on the functions of a library
+// concurrently.
+static void addHLSLFunctionPasses(unsigned OptLevel, bool OnlyWarnOnUnrollFail, bool StructurizeLoopExitsForUnroll, unsigned UnrollBudget, legacy::PassManagerBase &PM) {
+  bool NoOpt = OptLevel == 0;
+  if (!NoOpt)
+    PM.add(createSimplifyInstPass());
+
+  // scalarize vector to scalar
+  PM.add(createScalarizerPass(!NoOpt /* AllowFolding */));
+
+  // Remove vector instructions
+  PM.add(createDxilEliminateVectorPass());
+
+  // Passes to handle [unroll]
+  // Needs to happen after SROA since loop count may depend on
+  // struct members.
+  // Needs to happen before resources are lowered and before HL
+  // module is gone.
+  PM.add(createDxilLoopUnrollPass(1024, OnlyWarnOnUnrollFail, StructurizeLoopExitsForUnroll, UnrollBudget));
+
+  // Default unroll pass. This is purely for optimizing loops without
+  // attributes.
+  if (OptLevel > 2) {
+    PM.add(createLoopUnrollPass(-1, -1, -1, -1, StructurizeLoopExitsForUnroll));
+  }
+
+  if (!NoOpt)
+    PM.add(createSimplifyInstPass());
+
+  if (!NoOpt)
+    PM.add(createCFGSimplificationPass());
+
+  PM.add(createDeadCodeEliminationPass());
+}
+
+static void addHLSLPasses(bool HLSLHighLevel, unsigned OptLevel, bool OnlyWarnOnUnrollFail, bool StructurizeLoopExitsForUnroll, unsigned UnrollBudget, bool EnableLifetimeMarkers, bool ParallelFunctionOpt, unsigned ParallelFunctionThreads, hlsl::HLSLExtensionsCodegenHelper *ExtHelper, legacy::PassManagerBase &MPM) {
 
   // Don't do any lowering if we're targeting high-level.
   if (HLSLHighLevel) {
@@ -286,36 +322,18 @@ static void addHLSLPasses(bool HLSLHighLevel, unsigned OptLevel, bool OnlyWarnOn
   // Propagate precise attribute.
   MPM.add(createDxilPrecisePropagatePass());
 
-  if (!NoOpt)
-    MPM.add(createSimplifyInstPass());
-
-  // scalarize vector to scalar
-  MPM.add(createScalarizerPass(!NoOpt /* AllowFolding */));
-
-  // Remove vector instructions
-  MPM.add(createDxilEliminateVectorPass());
-
-  // Passes to handle [unroll]
-  // Needs to happen after SROA since loop count may depend on
-  // struct members.
-  // Needs to happen before resources are lowered and before HL
-  // module is gone.
-  MPM.add(createDxilLoopUnrollPass(1024, OnlyWarnOnUnrollFail, StructurizeLoopExitsForUnroll));
-
-  // Default unroll pass. This is purely for optimizing loops without
-  // attributes.
-  if (OptLevel > 2) {
-    MPM.add(createLoopUnrollPass(-1, -1, -1, -1, StructurizeLoopExitsForUnroll));
+  if (ParallelFunctionOpt) {
+    MPM.add(createDxilParallelFunctionPassesPass(
+        [=](legacy::PassManagerBase &PM) {
+          addHLSLFunctionPasses(OptLevel, OnlyWarnOnUnrollFail,
+                                StructurizeLoopExitsForUnroll, UnrollBudget, PM);
+        },
+        ParallelFunctionThreads));
+  } else {
+    addHLSLFunctionPasses(OptLevel, OnlyWarnOnUnrollFail,
+                          StructurizeLoopExitsForUnroll, UnrollBudget, MPM);
   }
 
-  if (!NoOpt)
-    MPM.add(createSimplifyInstPass());
-
-  if (!NoOpt)
-    MPM.add(createCFGSimplificationPass());
-
-  MPM.add(createDeadCodeEliminationPass());
-
   if (OptLevel > 0) {
     MPM.add(createDxilFixConstArrayInitializerPass());
   }
@@ -362,7 +380,10 @@ void PassManagerBuilder::populateModulePassManager(
     addHLSLPasses(HLSLHighLevel, OptLevel,
       this->HLSLOnlyWarnOnUnrollFail,
       this->StructurizeLoopExitsForUnroll,
+      this->HLSLUnrollBudget,
       this->HLSLEnableLifetimeMarkers,
+      this->HLSLParallelFunctionOpt,
+      this->HLSLParallelFunctionThreads,
       this->HLSLExtensionsCodeGen,
       MPM);
 
@@ -403,7 +424,7 @@ void PassManagerBuilder::populateModulePassManager(
     delete Inliner;
     Inliner = nullptr;
   }
-  addHLSLPasses(HLSLHighLevel, OptLevel, this->HLSLOnlyWarnOnUnrollFail, this->StructurizeLoopExitsForUnroll, this->HLSLEnableLifetimeMarkers, HLSLExtensionsCodeGen, MPM); // HLSL Change
+  addHLSLPasses(HLSLHighLevel, OptLevel, this->HLSLOnlyWarnOnUnrollFail, this->StructurizeLoopExitsForUnroll, this->HLSLUnrollBudget, this->HLSLEnableLifetimeMarkers, this->HLSLParallelFunctionOpt, this->HLSLParallelFunctionThreads, HLSLExtensionsCodeGen, MPM); // HLSL Change
   // HLSL Change Ends
 
   // Add LibraryInfo if we have some.
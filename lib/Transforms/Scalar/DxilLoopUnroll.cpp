@@ -51,6 +51,16 @@
 //    fail to do so.
 //
 //
+// 4. Keep each function within its unroll budget, if one is given.
+//
+//    Every instruction cloned counts against a per-function budget. When the
+//    trip count is known up front and a full unroll would go over, or when
+//    unrolling runs out of budget while looking for the exit condition, the
+//    loop is only unrolled if it has to be (it indexes resources or arrays by
+//    the induction variable). Otherwise it is partially unrolled, or left
+//    alone, with a warning.
+//
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Pass.h"
@@ -77,6 +87,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Analysis/ScalarEvolutionExpressions.h"
 
@@ -85,12 +96,23 @@
 #include "dxc/HLSL/HLModule.h"
 #include "llvm/Analysis/DxilValueCache.h"
 #include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Support/Timer.h"
 
 #include "DxilRemoveUnstructuredLoopExits.h"
 
+#include <climits>
+#include <unordered_map>
+
 using namespace llvm;
 using namespace hlsl;
 
+#define DEBUG_TYPE "dxil-loop-unroll"
+
+STATISTIC(NumFullyUnrolled, "Number of [unroll] loops fully unrolled");
+STATISTIC(NumPartiallyUnrolled, "Number of [unroll] loops partially unrolled over budget");
+STATISTIC(NumOverBudget, "Number of [unroll] loops over the unroll budget");
+STATISTIC(NumClonedInstructions, "Number of instructions cloned by [unroll]");
+
 // Copied over from LoopUnroll.cpp - RemapInstruction()
 static inline void RemapInstruction(Instruction *I,
                                     ValueToValueMapTy &VMap) {
@@ -118,13 +140,17 @@ public:
   static char ID;
 
   std::unordered_set<Function *> CleanedUpAlloca;
+  std::unordered_map<Function *, unsigned> UnrolledSize; // Instructions cloned so far
   unsigned MaxIterationAttempt = 0;
+  unsigned MaxUnrolledSize = 0; // Per function, 0 for no limit
   bool OnlyWarnOnFail = false;
   bool StructurizeLoopExits = false;
 
-  DxilLoopUnroll(unsigned MaxIterationAttempt = 1024, bool OnlyWarnOnFail=false, bool StructurizeLoopExits=false) :
+  DxilLoopUnroll(unsigned MaxIterationAttempt = 1024, bool OnlyWarnOnFail=false, bool StructurizeLoopExits=false,
+                 unsigned MaxUnrolledSize = 0) :
     LoopPass(ID),
     MaxIterationAttempt(MaxIterationAttempt),
+    MaxUnrolledSize(MaxUnrolledSize),
     OnlyWarnOnFail(OnlyWarnOnFail),
     StructurizeLoopExits(StructurizeLoopExits)
   {
@@ -132,7 +158,13 @@ public:
   }
   const char *getPassName() const override { return "Dxil Loop Unroll"; }
   bool runOnLoop(Loop *L, LPPassManager &LPM) override;
+  bool doFinalization() override {
+    UnrolledSize.clear();
+    return false;
+  }
   bool IsLoopSafeToClone(Loop *L);
+  bool UnrollOverBudget(Loop *L, LPPassManager &LPM, unsigned TripCount,
+                        unsigned BodySize, uint64_t EstimatedSize);
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.addRequired<LoopInfoWrapperPass>();
     AU.addRequired<AssumptionCacheTracker>();
@@ -147,11 +179,13 @@ public:
   // Function overrides that resolve options when used for DxOpt
   void applyOptions(PassOptions O) override {
     GetPassOptionUnsigned(O, "MaxIterationAttempt", &MaxIterationAttempt, false);
+    GetPassOptionUnsigned(O, "MaxUnrolledSize", &MaxUnrolledSize, false);
     GetPassOptionBool(O, "OnlyWarnOnFail", &OnlyWarnOnFail, false);
   }
   void dumpConfig(raw_ostream &OS) override {
     LoopPass::dumpConfig(OS);
     OS << ",MaxIterationAttempt=" << MaxIterationAttempt;
+    OS << ",MaxUnrolledSize=" << MaxUnrolledSize;
     OS << ",OnlyWarnOnFail=" << OnlyWarnOnFail;
   }
 
@@ -167,6 +201,55 @@ static void FailLoopUnroll(bool WarnOnly, Function *F, DebugLoc DL, const Twine
   Ctx.diagnose(DiagnosticInfoDxil(F, DL.get(), Message, severity));
 }
 
+// Adds to a count on the region of the time report the pass is running in.
+static void CountLoopUnroll(StringRef Counter, int64_t Delta) {
+  if (TimingListener *Listener = getThreadTimingListener())
+    Listener->regionCount(Counter, Delta);
+}
+
+// Number of instructions a block adds each time it's cloned.
+static unsigned GetUnrollSize(BasicBlock *BB) {
+  unsigned Size = 0;
+  for (Instruction &I : *BB) {
+    if (!isa<PHINode>(I) && !isa<DbgInfoIntrinsic>(I))
+      Size++;
+  }
+  return Size;
+}
+
+// Copied over from LoopUnrollPass.cpp - SetLoopAlreadyUnrolled()
+static void SetLoopAlreadyUnrolled(Loop *L) {
+  MDNode *LoopID = L->getLoopID();
+  if (!LoopID) return;
+
+  // First remove any existing loop unrolling metadata.
+  SmallVector<Metadata *, 4> MDs;
+  // Reserve first location for self reference to the LoopID metadata node.
+  MDs.push_back(nullptr);
+  for (unsigned i = 1, ie = LoopID->getNumOperands(); i < ie; ++i) {
+    bool IsUnrollMetadata = false;
+    MDNode *MD = dyn_cast<MDNode>(LoopID->getOperand(i));
+    if (MD) {
+      const MDString *S = dyn_cast<MDString>(MD->getOperand(0));
+      IsUnrollMetadata = S && S->getString().startswith("llvm.loop.unroll.");
+    }
+    if (!IsUnrollMetadata)
+      MDs.push_back(LoopID->getOperand(i));
+  }
+
+  // Add unroll(disable) metadata to disable future unrolling.
+  LLVMContext &Context = L->getHeader()->getContext();
+  SmallVector<Metadata *, 1> DisableOperands;
+  DisableOperands.push_back(MDString::get(Context, "llvm.loop.unroll.disable"));
+  MDNode *DisableNode = MDNode::get(Context, DisableOperands);
+  MDs.push_back(DisableNode);
+
+  MDNode *NewLoopID = MDNode::get(Context, MDs);
+  // Set operand 0 to refer to the loop id itself.
+  NewLoopID->replaceOperandWith(0, NewLoopID);
+  L->setLoopID(NewLoopID);
+}
+
 struct LoopIteration {
   SmallVector<BasicBlock *, 16> Body;
   BasicBlock *Latch = nullptr;
@@ -673,6 +756,58 @@ bool DxilLoopUnroll::IsLoopSafeToClone(Loop *L) {
   return true;
 }
 
+// Handles a loop that doesn't have to be fully unrolled, but would go over
+// the function's unroll budget if it were: partially unrolls it by as much as
+// the budget allows, or leaves it rolled if that's not worth doing.
+bool DxilLoopUnroll::UnrollOverBudget(Loop *L, LPPassManager &LPM,
+                                      unsigned TripCount, unsigned BodySize,
+                                      uint64_t EstimatedSize) {
+  Function *F = L->getHeader()->getParent();
+  DebugLoc LoopLoc = L->getStartLoc();
+  unsigned &UsedSize = UnrolledSize[F];
+  unsigned RemainingSize = UsedSize < MaxUnrolledSize ? MaxUnrolledSize - UsedSize : 0;
+  std::string Reason = (Twine("A full unroll would add an estimated ") +
+                        Twine(EstimatedSize) +
+                        " instructions, over the remaining unroll budget of " +
+                        Twine(RemainingSize) + ".").str();
+
+  // Each copy of the body past the first adds BodySize instructions.
+  unsigned Count = 0;
+  if (TripCount > 1)
+    Count = (unsigned)std::min<uint64_t>(RemainingSize / BodySize + 1, TripCount - 1);
+
+  bool Changed = false;
+  if (Count >= 2) {
+    ScalarEvolution *SE = &getAnalysis<ScalarEvolution>();
+    LoopInfo *LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    AssumptionCache *AC =
+      &getAnalysis<AssumptionCacheTracker>().getAssumptionCache(*F);
+    unsigned TripMultiple = SE->getSmallConstantTripMultiple(L, L->getLoopLatch());
+    Changed = UnrollLoop(L, Count, TripCount, /*AllowRuntime*/ false,
+                         /*AllowExpensiveTripCount*/ false, TripMultiple, LI,
+                         this, &LPM, AC);
+  }
+
+  if (Changed) {
+    ++NumPartiallyUnrolled;
+    NumClonedInstructions += (Count - 1) * BodySize;
+    CountLoopUnroll("loops partially unrolled", 1);
+    CountLoopUnroll("instructions cloned", (Count - 1) * BodySize);
+    UsedSize += (Count - 1) * BodySize;
+    FailLoopUnroll(true /*warn only*/, F, LoopLoc,
+                   Twine("Loop partially unrolled ") + Twine(Count) + " times. " + Reason);
+  } else {
+    FailLoopUnroll(true /*warn only*/, F, LoopLoc, "Loop not unrolled. " + Reason);
+  }
+  DEBUG(dbgs() << "DxilLoopUnroll: " << F->getName() << ": loop over budget, "
+               << "estimated " << EstimatedSize << " instructions, "
+               << (Changed ? "partially unrolled\n" : "not unrolled\n"));
+
+  // The remaining loop is as unrolled as it's going to get.
+  SetLoopAlreadyUnrolled(L);
+  return true;
+}
+
 bool DxilLoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
 
   DebugLoc LoopLoc = L->getStartLoc(); // Debug location for the start of the loop.
@@ -749,6 +884,38 @@ bool DxilLoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
   std::unordered_set<BasicBlock *> ProblemBlocks;
   FindProblemBlocks(L->getHeader(), BlocksInLoop, ProblemBlocks, ProblemAllocas);
 
+  // Estimate the size of a full unroll and check it against what's left of
+  // the function's budget before changing anything. Loops that index
+  // resources or arrays with the induction variable have to be unrolled;
+  // the rest can fall back to a partial unroll.
+  bool UnrollRequired = !ProblemBlocks.empty();
+  unsigned BodySize = 0;
+  for (BasicBlock *BB : L->getBlocks())
+    BodySize += GetUnrollSize(BB);
+  for (BasicBlock *BB : ExitBlocks) {
+    if (ProblemBlocks.count(BB))
+      BodySize += GetUnrollSize(BB);
+  }
+  BodySize = std::max(BodySize, 1u);
+
+  unsigned UsedSize = UnrolledSize[F];
+  unsigned RemainingSize = UINT_MAX;
+  if (MaxUnrolledSize)
+    RemainingSize = UsedSize < MaxUnrolledSize ? MaxUnrolledSize - UsedSize : 0;
+  unsigned EstimatedTrips = TripCount ? TripCount : ExplicitUnrollCount;
+  uint64_t EstimatedSize = (uint64_t)BodySize * EstimatedTrips;
+  if (MaxUnrolledSize && EstimatedTrips && EstimatedSize > RemainingSize) {
+    ++NumOverBudget;
+    CountLoopUnroll("loops over budget", 1);
+    if (!UnrollRequired)
+      return UnrollOverBudget(L, LPM, TripCount, BodySize, EstimatedSize);
+    FailLoopUnroll(OnlyWarnOnFail, F, LoopLoc,
+      Twine("Could not unroll loop. Unrolling would add an estimated ") +
+      Twine(EstimatedSize) + " instructions, over the remaining unroll budget of " +
+      Twine(RemainingSize) + ".");
+    return false;
+  }
+
   if (StructurizeLoopExits && hlsl::RemoveUnstructuredLoopExits(L, LI, DT, /* exclude */&ProblemBlocks)) {
     // Recompute the loop if we managed to simplify the exit blocks
 
@@ -845,6 +1012,11 @@ bool DxilLoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
 
   SmallVector<std::unique_ptr<LoopIteration>, 16> Iterations; // List of cloned iterations
   bool Succeeded = false;
+  bool OverBudget = false;
+
+  unsigned CloneSize = 0; // Instructions added by each iteration
+  for (BasicBlock *BB : ToBeCloned)
+    CloneSize += GetUnrollSize(BB);
 
   unsigned MaxAttempt = this->MaxIterationAttempt;
   // If we were able to figure out the definitive trip count,
@@ -858,6 +1030,12 @@ bool DxilLoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
 
   for (unsigned IterationI = 0; IterationI < MaxAttempt; IterationI++) {
 
+    // Give up before another iteration would go over the function's budget.
+    if (MaxUnrolledSize && (uint64_t)CloneSize * (IterationI + 1) > RemainingSize) {
+      OverBudget = true;
+      break;
+    }
+
     LoopIteration *PrevIteration = nullptr;
     if (Iterations.size())
       PrevIteration = Iterations.back().get();
@@ -906,7 +1084,10 @@ bool DxilLoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
           if (Itor != CurIteration.VarMap.end())
             NewIncoming = Itor->second;
           PN->addIncoming(NewIncoming, ClonedBB);
+          DVC->Invalidate(PN);
         }
+        // The new edge isn't visible to the value cache.
+        DVC->Invalidate(Succ);
       }
     }
 
@@ -948,6 +1129,7 @@ bool DxilLoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
         for (unsigned i = 0; i < BI->getNumSuccessors(); i++) {
           if (BI->getSuccessor(i) == PrevIteration->Header) {
             BI->setSuccessor(i, CurIteration.Header);
+            DVC->Invalidate(BI);
             break;
           }
         }
@@ -995,6 +1177,16 @@ bool DxilLoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
   }
 
   if (Succeeded) {
+    unsigned ClonedSize = CloneSize * Iterations.size();
+    UnrolledSize[F] += ClonedSize;
+    ++NumFullyUnrolled;
+    NumClonedInstructions += ClonedSize;
+    CountLoopUnroll("loops unrolled", 1);
+    CountLoopUnroll("instructions cloned", ClonedSize);
+    DEBUG(dbgs() << "DxilLoopUnroll: " << F->getName() << ": unrolled loop "
+                 << Iterations.size() << " times, cloning " << ClonedSize
+                 << " instructions\n");
+
     // We are going to be cleaning them up later. Maker sure
     // they're in entry block so deleting loop blocks don't 
     // kill them too.
@@ -1010,6 +1202,7 @@ bool DxilLoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
           BI->setSuccessor(i, FirstIteration.Header);
         }
       }
+      DVC->Invalidate(BI);
     }
 
     if (OuterL) {
@@ -1079,15 +1272,33 @@ bool DxilLoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
 
   // If we were unsuccessful in unrolling the loop
   else {
-    const char *Msg =
-        "Could not unroll loop. Loop bound could not be deduced at compile time. "
-        "Use [unroll(n)] to give an explicit count.";
-    if (OnlyWarnOnFail) {
-      FailLoopUnroll(true /*warn only*/, F, LoopLoc, Msg);
+    if (OverBudget) {
+      ++NumOverBudget;
+      CountLoopUnroll("loops over budget", 1);
+      std::string Msg = (Twine("Unrolling ran out of budget after ") +
+                         Twine((unsigned)Iterations.size()) +
+                         " iterations without finding the loop bound. The "
+                         "remaining unroll budget is " +
+                         Twine(RemainingSize) + " instructions.").str();
+      if (!UnrollRequired) {
+        FailLoopUnroll(true /*warn only*/, F, LoopLoc, "Loop not unrolled. " + Msg);
+        SetLoopAlreadyUnrolled(L);
+      }
+      else {
+        FailLoopUnroll(OnlyWarnOnFail, F, LoopLoc, "Could not unroll loop. " + Msg);
+      }
     }
     else {
-      FailLoopUnroll(false /*warn only*/, F, LoopLoc,
-        Twine(Msg) + Twine(" Use '-HV 2016' to treat this as warning."));
+      const char *Msg =
+          "Could not unroll loop. Loop bound could not be deduced at compile time. "
+          "Use [unroll(n)] to give an explicit count.";
+      if (OnlyWarnOnFail) {
+        FailLoopUnroll(true /*warn only*/, F, LoopLoc, Msg);
+      }
+      else {
+        FailLoopUnroll(false /*warn only*/, F, LoopLoc,
+          Twine(Msg) + Twine(" Use '-HV 2016' to treat this as warning."));
+      }
     }
 
     // Remove all the cloned blocks
@@ -1113,8 +1324,8 @@ bool DxilLoopUnroll::runOnLoop(Loop *L, LPPassManager &LPM) {
 
 }
 
-Pass *llvm::createDxilLoopUnrollPass(unsigned MaxIterationAttempt, bool OnlyWarnOnFail, bool StructurizeLoopExits) {
-  return new DxilLoopUnroll(MaxIterationAttempt, OnlyWarnOnFail, StructurizeLoopExits);
+Pass *llvm::createDxilLoopUnrollPass(unsigned MaxIterationAttempt, bool OnlyWarnOnFail, bool StructurizeLoopExits, unsigned MaxUnrolledSize) {
+  return new DxilLoopUnroll(MaxIterationAttempt, OnlyWarnOnFail, StructurizeLoopExits, MaxUnrolledSize);
 }
 
 INITIALIZE_PASS_BEGIN(DxilLoopUnroll, "dxil-loop-unroll", "Dxil Unroll loops", false, false)
@@ -585,7 +585,7 @@ struct MemcpySplitter {
 public:
   MemcpySplitter(llvm::LLVMContext &context, DxilTypeSystem &typeSys)
       : m_context(context), m_typeSys(typeSys) {}
-  void Split(llvm::Function &F);
+  void Split(llvm::Module &M);
 
   static void PatchMemCpyWithZeroIdxGEP(Module &M);
   static void PatchMemCpyWithZeroIdxGEP(MemCpyInst *MI, const DataLayout &DL);
@@ -757,12 +757,14 @@ void SplitCpy(Type *Ty, Value *Dest, Value *Src,
 
   } else if (ArrayType *AT = dyn_cast<ArrayType>(Ty)) {
     Type *ET = AT->getElementType();
+    // Every element has the same type, so only ask once.
+    const bool bEltIsMemCpy = bEltMemCpy && IsMemCpyTy(ET, typeSys);
 
     for (uint32_t i = 0; i < AT->getNumElements(); i++) {
       Constant *idx = Constant::getIntegerValue(
           IntegerType::get(Ty->getContext(), 32), APInt(32, i));
       idxList.emplace_back(idx);
-      if (bEltMemCpy && IsMemCpyTy(ET, typeSys)) {
+      if (bEltIsMemCpy) {
         EltMemCpy(ET, Dest, Src, idxList, Builder, DL);
       } else {
         SplitCpy(ET, Dest, Src, idxList, Builder, DL, typeSys, fieldAnnotation,
@@ -1050,19 +1052,19 @@ void MemcpySplitter::SplitMemCpy(MemCpyInst *MI, const DataLayout &DL,
   DeleteMemcpy(MI);
 }
 
-void MemcpySplitter::Split(llvm::Function &F) {
-  const DataLayout &DL = F.getParent()->getDataLayout();
+void MemcpySplitter::Split(llvm::Module &M) {
+  const DataLayout &DL = M.getDataLayout();
   SmallVector<Function *, 2> memcpys;
-  for (Function &Fn : F.getParent()->functions()) {
+  for (Function &Fn : M.functions()) {
     if (Fn.getIntrinsicID() == Intrinsic::memcpy) {
       memcpys.emplace_back(&Fn);
     }
   }
+  // Split every function's memcpys in one walk of the users, rather than
+  // walking all of them once per function.
   for (Function *memcpy : memcpys) {
     for (auto U = memcpy->user_begin(); U != memcpy->user_end();) {
       MemCpyInst *MI = cast<MemCpyInst>(*(U++));
-      if (MI->getParent()->getParent() != &F)
-        continue;
       // Matrix is treated as scalar type, will not use memcpy.
       // So use nullptr for fieldAnnotation should be safe here.
       SplitMemCpy(MI, DL, /*fieldAnnotation*/ nullptr, m_typeSys,
@@ -1113,11 +1115,17 @@ bool markPrecise(Function &F) {
   return Changed;
 }
 
-bool Cleanup(Function &F, DxilTypeSystem &typeSys) {
+bool Cleanup(Module &M, DxilTypeSystem &typeSys) {
   // change rest memcpy into ld/st.
-  MemcpySplitter splitter(F.getContext(), typeSys);
-  splitter.Split(F);
-  return markPrecise(F);
+  MemcpySplitter splitter(M.getContext(), typeSys);
+  splitter.Split(M);
+  bool Changed = false;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    Changed |= markPrecise(F);
+  }
+  return Changed;
 }
 } // namespace
 
@@ -1486,10 +1494,54 @@ static bool HasPadding(Type *Ty, const DataLayout &DL) {
   return false;
 }
 
+/// SROATypeLayoutCache - Layout facts about the types of the allocas and
+/// globals SROA visits. The same aggregate types come up for every value of
+/// that type and for every element split off of one, so each type is only
+/// looked at once.
+class SROATypeLayoutCache {
+public:
+  struct Layout {
+    uint64_t AllocSize;
+    unsigned NestedLevel;  // Single-element structs wrapping the type.
+    bool IsUnitSizeStruct; // Struct with a single element.
+    bool IsEmptyStruct;    // See SROA_Helper::IsEmptyStructType.
+    signed char Padding;   // See HasPadding; -1 until asked.
+  };
+
+  SROATypeLayoutCache(const DataLayout &DL, DxilTypeSystem &typeSys)
+      : DL(DL), typeSys(typeSys) {}
+
+  const Layout &get(Type *Ty) {
+    auto It = Layouts.find(Ty);
+    if (It != Layouts.end())
+      return It->second;
+    Layout &L = Layouts[Ty];
+    L.AllocSize = DL.getTypeAllocSize(Ty);
+    L.NestedLevel = getNestedLevelInStruct(Ty);
+    L.IsUnitSizeStruct = Ty->isStructTy() && Ty->getStructNumElements() == 1;
+    L.IsEmptyStruct = SROA_Helper::IsEmptyStructType(Ty, typeSys);
+    L.Padding = -1;
+    return L;
+  }
+
+  // Only for arrays and structs.
+  bool hasPadding(Type *Ty) {
+    Layout &L = const_cast<Layout &>(get(Ty));
+    if (L.Padding < 0)
+      L.Padding = HasPadding(Ty, DL);
+    return L.Padding != 0;
+  }
+
+private:
+  const DataLayout &DL;
+  DxilTypeSystem &typeSys;
+  std::unordered_map<Type *, Layout> Layouts; // References stay valid.
+};
+
 /// isSafeStructAllocaToScalarRepl - Check to see if the specified allocation of
 /// an aggregate can be broken down into elements.  Return 0 if not, 3 if safe,
 /// or 1 if safe after canonicalization has been performed.
-bool isSafeAllocaToScalarRepl(AllocaInst *AI) {
+bool isSafeAllocaToScalarRepl(AllocaInst *AI, SROATypeLayoutCache &LayoutCache) {
   // Loop over the use list of the alloca.  We can only transform it if all of
   // the users are safe to transform.
   AllocaInfo Info(AI);
@@ -1504,15 +1556,13 @@ bool isSafeAllocaToScalarRepl(AllocaInst *AI) {
   if (Info.hasVectorIndexing)
     return false;
 
-  const DataLayout &DL = AI->getModule()->getDataLayout();
-
   // Okay, we know all the users are promotable.  If the aggregate is a memcpy
   // source and destination, we have to be careful.  In particular, the memcpy
   // could be moving around elements that live in structure padding of the LLVM
   // types, but may actually be used.  In these cases, we refuse to promote the
   // struct.
   if (Info.isMemCpySrc && Info.isMemCpyDst &&
-      HasPadding(AI->getAllocatedType(), DL))
+      LayoutCache.hasPadding(AI->getAllocatedType()))
     return false;
 
   return true;
@@ -1619,23 +1669,26 @@ bool SROAGlobalAndAllocas(HLModule &HLM, bool bHasDbgInfo) {
   // alloca. Big alloca will be split to smaller piece first, when process the
   // alloca, it will be alloca flattened from big alloca instead of a GEP of
   // big alloca.
-  auto size_cmp = [&DL](const Value *a0, const Value *a1) -> bool {
-    Type *a0ty = a0->getType()->getPointerElementType();
-    Type *a1ty = a1->getType()->getPointerElementType();
-    bool isUnitSzStruct0 =
-        a0ty->isStructTy() && a0ty->getStructNumElements() == 1;
-    bool isUnitSzStruct1 =
-        a1ty->isStructTy() && a1ty->getStructNumElements() == 1;
-    auto sz0 = DL.getTypeAllocSize(a0ty);
-    auto sz1 = DL.getTypeAllocSize(a1ty);
-    if (sz0 == sz1 && (isUnitSzStruct0 || isUnitSzStruct1))
-      return getNestedLevelInStruct(a0ty) < getNestedLevelInStruct(a1ty);
-    return sz0 < sz1;
+  // Work items carry the layout of their type, so ordering them doesn't go
+  // back to the data layout on every comparison.
+  SROATypeLayoutCache LayoutCache(DL, typeSys);
+  typedef std::pair<const SROATypeLayoutCache::Layout *, Value *> WorkItem;
+  auto size_cmp = [](const WorkItem &a0, const WorkItem &a1) -> bool {
+    const SROATypeLayoutCache::Layout &L0 = *a0.first;
+    const SROATypeLayoutCache::Layout &L1 = *a1.first;
+    if (L0.AllocSize == L1.AllocSize &&
+        (L0.IsUnitSizeStruct || L1.IsUnitSizeStruct))
+      return L0.NestedLevel < L1.NestedLevel;
+    return L0.AllocSize < L1.AllocSize;
   };
 
-  std::priority_queue<Value *, std::vector<Value *>,
-                      std::function<bool(Value *, Value *)>>
+  std::priority_queue<WorkItem, std::vector<WorkItem>,
+                      std::function<bool(const WorkItem &, const WorkItem &)>>
       WorkList(size_cmp);
+  auto AddToWorkList = [&WorkList, &LayoutCache](Value *V) {
+    WorkList.push(WorkItem(
+        &LayoutCache.get(V->getType()->getPointerElementType()), V));
+  };
 
   // Flatten internal global.
   llvm::SetVector<GlobalVariable *> staticGVs;
@@ -1654,7 +1707,7 @@ bool SROAGlobalAndAllocas(HLModule &HLM, bool bHasDbgInfo) {
   }
   // Add static GVs to work list.
   for (GlobalVariable *GV : staticGVs)
-    WorkList.push(GV);
+    AddToWorkList(GV);
 
   DenseMap<Function *, DominatorTree> domTreeMap;
   for (Function &F : M) {
@@ -1668,7 +1721,7 @@ bool SROAGlobalAndAllocas(HLModule &HLM, bool bHasDbgInfo) {
     for (BasicBlock::iterator I = BB.begin(), E = BB.end(); I != E; ++I)
       if (AllocaInst *A = dyn_cast<AllocaInst>(I)) {
         if (!A->user_empty()) {
-          WorkList.push(A);
+          AddToWorkList(A);
           // merge GEP use for the allocs
           HLModule::MergeGepUse(A);
         }
@@ -1691,7 +1744,7 @@ bool SROAGlobalAndAllocas(HLModule &HLM, bool bHasDbgInfo) {
 
   bool Changed = false;
   while (!WorkList.empty()) {
-    Value *V = WorkList.top();
+    Value *V = WorkList.top().second;
     WorkList.pop();
 
     if (AllocaInst *AI = dyn_cast<AllocaInst>(V)) {
@@ -1727,7 +1780,7 @@ bool SROAGlobalAndAllocas(HLModule &HLM, bool bHasDbgInfo) {
 
       Type *Ty = AI->getAllocatedType();
       // Skip empty struct type.
-      if (SROA_Helper::IsEmptyStructType(Ty, typeSys)) {
+      if (LayoutCache.get(Ty).IsEmptyStruct) {
         SROA_Helper::MarkEmptyStructUsers(AI, DeadInsts);
         DeleteDeadInstructions(DeadInsts);
         continue;
@@ -1750,7 +1803,8 @@ bool SROAGlobalAndAllocas(HLModule &HLM, bool bHasDbgInfo) {
       // if
       // all its users can be transformed, then split up the aggregate into its
       // separate elements.
-      if (ShouldAttemptScalarRepl(AI) && isSafeAllocaToScalarRepl(AI)) {
+      if (ShouldAttemptScalarRepl(AI) &&
+          isSafeAllocaToScalarRepl(AI, LayoutCache)) {
         std::vector<Value *> Elts;
         IRBuilder<> Builder(dxilutil::FindAllocaInsertionPt(AI));
         bool hasPrecise = HLModule::HasPreciseAttributeWithMetadata(AI);
@@ -1785,7 +1839,7 @@ bool SROAGlobalAndAllocas(HLModule &HLM, bool bHasDbgInfo) {
           // Push Elts into workList.
           for (unsigned EltIdx = 0; EltIdx < Elts.size(); ++EltIdx) {
             AllocaInst *EltAlloca = cast<AllocaInst>(Elts[EltIdx]);
-            WorkList.push(EltAlloca);
+            AddToWorkList(EltAlloca);
           }
 
           // Now erase any instructions that were made dead while rewriting the
@@ -1862,7 +1916,7 @@ bool SROAGlobalAndAllocas(HLModule &HLM, bool bHasDbgInfo) {
         unsigned offset = 0;
         // Push Elts into workList.
         for (auto iter = Elts.begin(); iter != Elts.end(); iter++) {
-          WorkList.push(*iter);
+          AddToWorkList(*iter);
           GlobalVariable *EltGV = cast<GlobalVariable>(*iter);
           if (bHasDbgInfo) {
             StringRef OriginEltName = EltGV->getName();
@@ -1905,11 +1959,7 @@ bool SROAGlobalAndAllocas(HLModule &HLM, bool bHasDbgInfo) {
   // Remove unused internal global.
   RemoveUnusedInternalGlobalVariable(M);
   // Cleanup memcpy for allocas and mark precise.
-  for (Function &F : M) {
-    if (F.isDeclaration())
-      continue;
-    Cleanup(F, typeSys);
-  }
+  Cleanup(M, typeSys);
 
   return true;
 }
@@ -33,6 +33,14 @@ Module *llvm::CloneModule(const Module *M) {
 }
 
 Module *llvm::CloneModule(const Module *M, ValueToValueMapTy &VMap) {
+  // HLSL Change Begin - clone selected definitions only.
+  return CloneModule(M, VMap, [](const GlobalValue *) { return true; });
+}
+
+Module *llvm::CloneModule(
+    const Module *M, ValueToValueMapTy &VMap,
+    std::function<bool(const GlobalValue *)> ShouldCloneDefinition) {
+  // HLSL Change End
   // First off, we need to create the new module.
   Module *New = new Module(M->getModuleIdentifier(), M->getContext());
   New->setDataLayout(M->getDataLayout());
@@ -81,6 +89,12 @@ Module *llvm::CloneModule(const Module *M, ValueToValueMapTy &VMap) {
   for (Module::const_global_iterator I = M->global_begin(), E = M->global_end();
        I != E; ++I) {
     GlobalVariable *GV = cast<GlobalVariable>(VMap[I]);
+    // HLSL Change Begin - clone selected definitions only.
+    if (!I->isDeclaration() && !ShouldCloneDefinition(I)) {
+      GV->setLinkage(GlobalValue::ExternalLinkage);
+      continue;
+    }
+    // HLSL Change End
     if (I->hasInitializer())
       GV->setInitializer(MapValue(I->getInitializer(), VMap));
   }
@@ -89,6 +103,12 @@ Module *llvm::CloneModule(const Module *M, ValueToValueMapTy &VMap) {
   //
   for (Module::const_iterator I = M->begin(), E = M->end(); I != E; ++I) {
     Function *F = cast<Function>(VMap[I]);
+    // HLSL Change Begin - clone selected definitions only.
+    if (!I->isDeclaration() && !ShouldCloneDefinition(I)) {
+      F->setLinkage(GlobalValue::ExternalLinkage);
+      continue;
+    }
+    // HLSL Change End
     if (!I->isDeclaration()) {
       Function::arg_iterator DestI = F->arg_begin();
       for (Function::const_arg_iterator J = I->arg_begin(); J != I->arg_end();
@@ -590,6 +590,33 @@ public:
     this->NumWarnings = NumWarnings;
   }
 
+  // HLSL Change Starts
+  /// \brief The sticky error flags and error count, saved so that checks run
+  /// independently of one another on one engine each start from the same
+  /// state. Error traps are unaffected, as their counts only grow.
+  struct ErrorState {
+    bool ErrorOccurred;
+    bool UncompilableErrorOccurred;
+    bool FatalErrorOccurred;
+    bool UnrecoverableErrorOccurred;
+    unsigned NumErrors;
+  };
+
+  ErrorState getErrorState() const {
+    return ErrorState{ErrorOccurred, UncompilableErrorOccurred,
+                      FatalErrorOccurred, UnrecoverableErrorOccurred,
+                      NumErrors};
+  }
+
+  void setErrorState(const ErrorState &State) {
+    ErrorOccurred = State.ErrorOccurred;
+    UncompilableErrorOccurred = State.UncompilableErrorOccurred;
+    FatalErrorOccurred = State.FatalErrorOccurred;
+    UnrecoverableErrorOccurred = State.UnrecoverableErrorOccurred;
+    NumErrors = State.NumErrors;
+  }
+  // HLSL Change Ends
+
   /// \brief Return an ID for a diagnostic with the specified format string and
   /// level.
   ///
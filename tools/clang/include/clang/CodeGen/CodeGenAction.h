@@ -12,10 +12,13 @@
 
 #include "clang/Frontend/FrontendAction.h"
 #include <memory>
+#include <string> // HLSL Change
+#include <vector> // HLSL Change
 
 namespace llvm {
   class LLVMContext;
   class Module;
+  class raw_pwrite_stream; // HLSL Change
 }
 
 namespace clang {
@@ -104,6 +107,62 @@ class EmitOptDumpAction : public CodeGenAction {
 public:
   EmitOptDumpAction(llvm::LLVMContext *_VMContext = nullptr);
 };
+
+class DiagnosticConsumer;
+class DiagnosticsEngine;
+class MultiEntryBackendConsumer;
+
+/// Emits bitcode for several entry points from a single parse of the input.
+/// Each entry is code generated with its own options, LLVM context, output
+/// stream and diagnostics; the translation unit checks for each entry run once
+/// parsing completes. The parse uses the language options of the compiler
+/// instance, which should have no entry function set.
+class EmitBCMultiEntryAction : public ASTFrontendAction {
+public:
+  struct EntryPoint {
+    std::string Name;
+    std::string Profile;
+    llvm::LLVMContext *VMContext;
+    llvm::raw_pwrite_stream *OS;
+    /// Receives codegen diagnostics and translation unit checks for the
+    /// entry; not owned.
+    DiagnosticConsumer *DiagClient;
+  };
+
+private:
+  friend class MultiEntryBackendConsumer;
+  struct EntryState;
+  std::vector<EntryPoint> Entries;
+  std::vector<std::unique_ptr<EntryState>> States;
+  MultiEntryBackendConsumer *Consumer;
+  bool StageDependent;
+
+protected:
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
+                                                 StringRef InFile) override;
+
+  void EndSourceFileAction() override;
+
+public:
+  EmitBCMultiEntryAction(std::vector<EntryPoint> Entries);
+  ~EmitBCMultiEntryAction() override;
+
+  /// True if the source tests the shader stage in the preprocessor. The parse
+  /// can't be shared between stages then, and no code is generated.
+  bool isStageDependent() const { return StageDependent; }
+
+  /// Whether errors were reported for the given entry, after the action has
+  /// been run. Errors in the shared parse are reported by the compiler
+  /// instance's diagnostics instead.
+  bool hasEntryErrorOccurred(unsigned Index) const;
+
+  /// Diagnostics engine used to generate code for the given entry.
+  DiagnosticsEngine &getEntryDiagnostics(unsigned Index);
+
+  /// Take the generated LLVM module for the given entry, for use after the
+  /// action has been run. The result may be null on failure.
+  std::unique_ptr<llvm::Module> takeModule(unsigned Index);
+};
 // HLSL Change Ends
 
 }
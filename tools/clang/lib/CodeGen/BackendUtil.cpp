@@ -341,6 +341,31 @@ void EmitAssemblyHelper::CreatePasses() {
                         CodeGenOpts.HLSLOptimizationToggles.find("structurize-loop-exits-for-unroll")->second;
 
   PMBuilder.HLSLEnableLifetimeMarkers = CodeGenOpts.HLSLEnableLifetimeMarkers;
+
+  PMBuilder.HLSLParallelFunctionOpt =
+                        CodeGenOpts.HLSLOptimizationToggles.count("parallel-function-opt") &&
+                        CodeGenOpts.HLSLOptimizationToggles.find("parallel-function-opt")->second;
+
+  auto UnrollBudget = CodeGenOpts.HLSLOptimizationSelects.find("unroll-budget");
+  if (UnrollBudget != CodeGenOpts.HLSLOptimizationSelects.end() &&
+      StringRef(UnrollBudget->second).getAsInteger(10, PMBuilder.HLSLUnrollBudget)) {
+    unsigned DiagID = Diags.getCustomDiagID(
+        DiagnosticsEngine::Error, "invalid value '%0' for -opt-select "
+                                  "unroll-budget, expected an instruction count");
+    Diags.Report(DiagID) << UnrollBudget->second;
+  }
+
+  auto ParallelFunctionThreads =
+      CodeGenOpts.HLSLOptimizationSelects.find("parallel-function-threads");
+  if (ParallelFunctionThreads != CodeGenOpts.HLSLOptimizationSelects.end() &&
+      StringRef(ParallelFunctionThreads->second)
+          .getAsInteger(10, PMBuilder.HLSLParallelFunctionThreads)) {
+    unsigned DiagID = Diags.getCustomDiagID(
+        DiagnosticsEngine::Error, "invalid value '%0' for -opt-select "
+                                  "parallel-function-threads, expected a "
+                                  "thread count");
+    Diags.Report(DiagID) << ParallelFunctionThreads->second;
+  }
   // HLSL Change - end
 
   PMBuilder.DisableUnitAtATime = !CodeGenOpts.UnitAtATime;
@@ -21,7 +21,10 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h" // HLSL Change
+#include "clang/Lex/MacroInfo.h"        // HLSL Change
 #include "clang/Lex/Preprocessor.h"
+#include "clang/Sema/SemaConsumer.h"     // HLSL Change
+#include "clang/Sema/SemaHLSL.h"         // HLSL Change
 #include "llvm/ADT/SmallString.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/IR/DebugInfo.h"
@@ -113,6 +116,7 @@ namespace clang {
       PrettyStackTraceDecl CrashInfo(*D.begin(), SourceLocation(),
                                      Context->getSourceManager(),
                                      "LLVM IR generation of declaration");
+      llvm::TimingListenerRegion Region("IR generation of declarations"); // HLSL Change
 
       if (llvm::TimePassesIsEnabled)
         LLVMIRGeneration.startTimer();
@@ -141,6 +145,7 @@ namespace clang {
     void HandleTranslationUnit(ASTContext &C) override {
       {
         PrettyStackTraceString CrashInfo("Per-file LLVM IR generation");
+        llvm::TimingListenerRegion Region("IR generation of module (CGHLSLMS)"); // HLSL Change
         if (llvm::TimePassesIsEnabled)
           LLVMIRGeneration.startTimer();
 
@@ -188,9 +193,12 @@ namespace clang {
       void *OldDiagnosticContext = Ctx.getDiagnosticContext();
       Ctx.setDiagnosticHandler(DiagnosticHandler, this);
 
-      EmitBackendOutput(Diags, CodeGenOpts, TargetOpts, LangOpts,
-                        C.getTargetInfo().getTargetDescription(),
-                        TheModule.get(), Action, AsmOutStream);
+      {
+        llvm::TimingListenerRegion Region("Optimization and DXIL lowering"); // HLSL Change
+        EmitBackendOutput(Diags, CodeGenOpts, TargetOpts, LangOpts,
+                          C.getTargetInfo().getTargetDescription(),
+                          TheModule.get(), Action, AsmOutStream);
+      }
 
       Ctx.setInlineAsmDiagnosticHandler(OldHandler, OldContext);
 
@@ -834,3 +842,242 @@ void EmitOptDumpAction::anchor() { }
 EmitOptDumpAction::EmitOptDumpAction(llvm::LLVMContext *_VMContext)
   : CodeGenAction(Backend_EmitPasses, _VMContext) {}
 // HLSL Change Ends
+
+// HLSL Change Starts - multi-entry code generation from a single parse
+struct EmitBCMultiEntryAction::EntryState {
+  CodeGenOptions CodeGenOpts;
+  std::unique_ptr<DiagnosticsEngine> Diags;
+  BackendConsumer *Consumer = nullptr; // Owned by MultiEntryBackendConsumer.
+  std::unique_ptr<llvm::Module> TheModule;
+  bool ErrorOccurred = false;
+};
+
+namespace clang {
+/// Forwards the AST to a BackendConsumer per entry point. Decl emission and
+/// the translation unit checks look at the entry point and profile in the
+/// shared language options, so those are swapped in around every call into
+/// an entry's consumer.
+class MultiEntryBackendConsumer : public SemaConsumer {
+  typedef EmitBCMultiEntryAction::EntryPoint EntryPoint;
+  typedef EmitBCMultiEntryAction::EntryState EntryState;
+
+  LangOptions &LangOpts;
+  Preprocessor &PP;
+  DiagnosticsEngine &Diags;
+  Sema *S;
+  const std::vector<EntryPoint> &Entries;
+  std::vector<std::unique_ptr<EntryState>> &States;
+  std::vector<std::unique_ptr<BackendConsumer>> Consumers;
+  bool &StageDependent;
+
+  template <typename Fn> void ForEachEntry(Fn F) {
+    std::string SavedEntry = LangOpts.HLSLEntryFunction;
+    std::string SavedProfile = LangOpts.HLSLProfile;
+    for (unsigned i = 0, e = Entries.size(); i != e; ++i) {
+      LangOpts.HLSLEntryFunction = Entries[i].Name;
+      LangOpts.HLSLProfile = Entries[i].Profile;
+      F(Entries[i], *States[i]);
+    }
+    LangOpts.HLSLEntryFunction = SavedEntry;
+    LangOpts.HLSLProfile = SavedProfile;
+  }
+
+  // Decls are only generated while the shared parse is error free, as
+  // they would be if each entry had been parsed on its own.
+  template <typename Fn> void ForwardToEntries(Fn F) {
+    if (Diags.hasErrorOccurred())
+      return;
+    ForEachEntry(F);
+  }
+
+  // The stage is the only part of the profile visible to the preprocessor
+  // that may differ between entries.
+  bool IsStageTested() {
+    IdentifierInfo *II = PP.getIdentifierInfo("__SHADER_TARGET_STAGE");
+    for (MacroDirective *MD = PP.getLocalMacroDirectiveHistory(II); MD;
+         MD = MD->getPrevious()) {
+      if (DefMacroDirective *Def = dyn_cast<DefMacroDirective>(MD))
+        if (Def->getInfo()->isUsed())
+          return true;
+    }
+    return false;
+  }
+
+public:
+  MultiEntryBackendConsumer(CompilerInstance &CI, StringRef InFile,
+                            const std::vector<EntryPoint> &Entries,
+                            std::vector<std::unique_ptr<EntryState>> &States,
+                            bool &StageDependent)
+      : LangOpts(CI.getLangOpts()), PP(CI.getPreprocessor()),
+        Diags(CI.getDiagnostics()), S(nullptr), Entries(Entries),
+        States(States), StageDependent(StageDependent) {
+    for (unsigned i = 0, e = Entries.size(); i != e; ++i) {
+      EntryState &State = *States[i];
+      Consumers.emplace_back(new BackendConsumer(
+          Backend_EmitBC, *State.Diags, CI.getHeaderSearchOpts(),
+          CI.getPreprocessorOpts(), State.CodeGenOpts, CI.getTargetOpts(),
+          CI.getLangOpts(), CI.getFrontendOpts().ShowTimers, InFile, nullptr,
+          Entries[i].OS, *Entries[i].VMContext));
+      State.Consumer = Consumers.back().get();
+    }
+  }
+
+  void InitializeSema(Sema &TheSema) override { S = &TheSema; }
+  void ForgetSema() override { S = nullptr; }
+
+  void Initialize(ASTContext &Ctx) override {
+    ForEachEntry([&](const EntryPoint &, EntryState &State) {
+      State.Consumer->Initialize(Ctx);
+    });
+  }
+
+  bool HandleTopLevelDecl(DeclGroupRef D) override {
+    ForwardToEntries([&](const EntryPoint &, EntryState &State) {
+      State.Consumer->HandleTopLevelDecl(D);
+    });
+    return true;
+  }
+
+  void HandleInlineMethodDefinition(CXXMethodDecl *D) override {
+    ForwardToEntries([&](const EntryPoint &, EntryState &State) {
+      State.Consumer->HandleInlineMethodDefinition(D);
+    });
+  }
+
+  void HandleCXXStaticMemberVarInstantiation(VarDecl *VD) override {
+    ForwardToEntries([&](const EntryPoint &, EntryState &State) {
+      State.Consumer->HandleCXXStaticMemberVarInstantiation(VD);
+    });
+  }
+
+  void HandleTagDeclDefinition(TagDecl *D) override {
+    ForwardToEntries([&](const EntryPoint &, EntryState &State) {
+      State.Consumer->HandleTagDeclDefinition(D);
+    });
+  }
+
+  void HandleTagDeclRequiredDefinition(const TagDecl *D) override {
+    ForwardToEntries([&](const EntryPoint &, EntryState &State) {
+      State.Consumer->HandleTagDeclRequiredDefinition(D);
+    });
+  }
+
+  void CompleteTentativeDefinition(VarDecl *D) override {
+    ForwardToEntries([&](const EntryPoint &, EntryState &State) {
+      State.Consumer->CompleteTentativeDefinition(D);
+    });
+  }
+
+  void HandleVTable(CXXRecordDecl *RD) override {
+    ForwardToEntries([&](const EntryPoint &, EntryState &State) {
+      State.Consumer->HandleVTable(RD);
+    });
+  }
+
+  void HandleTranslationUnit(ASTContext &C) override {
+    if (IsStageTested()) {
+      StageDependent = true;
+      return;
+    }
+    if (Diags.hasErrorOccurred()) {
+      for (std::unique_ptr<EntryState> &State : States)
+        State->ErrorOccurred = true;
+      return;
+    }
+
+    // Every entry is checked from the error-free state the parse left, so an
+    // entry that fails its checks doesn't skip them for the ones after it.
+    const DiagnosticsEngine::ErrorState ParseErrorState = Diags.getErrorState();
+    ForEachEntry([&](const EntryPoint &Entry, EntryState &State) {
+      Diags.setErrorState(ParseErrorState);
+      DiagnosticErrorTrap Trap(Diags);
+
+      // Run the checks the parse skipped for this entry, reporting them
+      // through the entry's own consumer.
+      DiagnosticConsumer *Client = Diags.getClient();
+      bool OwnsClient = Diags.ownsClient();
+      std::unique_ptr<DiagnosticConsumer> Owner = Diags.takeClient();
+      Diags.setClient(Entry.DiagClient, /*ShouldOwnClient*/ false);
+      hlsl::DiagnoseTranslationUnit(S);
+      Diags.setClient(OwnsClient ? Owner.release() : Client, OwnsClient);
+
+      if (!Trap.hasErrorOccurred())
+        State.Consumer->HandleTranslationUnit(C);
+      State.ErrorOccurred = Trap.hasErrorOccurred() ||
+                            State.Diags->hasErrorOccurred();
+    });
+    Diags.setErrorState(ParseErrorState);
+  }
+};
+} // namespace clang
+
+EmitBCMultiEntryAction::EmitBCMultiEntryAction(std::vector<EntryPoint> Entries)
+    : Entries(std::move(Entries)), Consumer(nullptr), StageDependent(false) {}
+
+EmitBCMultiEntryAction::~EmitBCMultiEntryAction() {}
+
+std::unique_ptr<ASTConsumer>
+EmitBCMultiEntryAction::CreateASTConsumer(CompilerInstance &CI,
+                                          StringRef InFile) {
+  DiagnosticsEngine &Diags = CI.getDiagnostics();
+  States.clear();
+  for (const EntryPoint &Entry : Entries) {
+    std::unique_ptr<EntryState> State(new EntryState());
+    State->CodeGenOpts = CI.getCodeGenOpts();
+    State->CodeGenOpts.HLSLEntryFunction = Entry.Name;
+    State->CodeGenOpts.HLSLProfile = Entry.Profile;
+    // Arguments recorded in debug info name the entry being compiled.
+    State->CodeGenOpts.HLSLArguments.push_back("-E");
+    State->CodeGenOpts.HLSLArguments.push_back(Entry.Name);
+    State->CodeGenOpts.HLSLArguments.push_back("-T");
+    State->CodeGenOpts.HLSLArguments.push_back(Entry.Profile);
+
+    State->Diags.reset(new DiagnosticsEngine(Diags.getDiagnosticIDs(),
+                                             &CI.getDiagnosticOpts(),
+                                             Entry.DiagClient,
+                                             /*ShouldOwnClient*/ false));
+    ProcessWarningOptions(*State->Diags, CI.getDiagnosticOpts(),
+                          /*ReportDiags*/ false);
+    State->Diags->setIgnoreAllWarnings(Diags.getIgnoreAllWarnings());
+    State->Diags->setWarningsAsErrors(Diags.getWarningsAsErrors());
+    State->Diags->setSourceManager(&CI.getSourceManager());
+    Entry.DiagClient->BeginSourceFile(CI.getLangOpts(), &CI.getPreprocessor());
+    States.push_back(std::move(State));
+  }
+
+  std::unique_ptr<MultiEntryBackendConsumer> Result(
+      new MultiEntryBackendConsumer(CI, InFile, Entries, States,
+                                    StageDependent));
+  Consumer = Result.get();
+  return std::move(Result);
+}
+
+void EmitBCMultiEntryAction::EndSourceFileAction() {
+  // If the consumer creation failed, do nothing.
+  if (!getCompilerInstance().hasASTConsumer())
+    return;
+
+  for (unsigned i = 0, e = Entries.size(); i != e; ++i) {
+    // Modules of entries that failed or weren't finished are released with
+    // the consumer.
+    if (!hasEntryErrorOccurred(i))
+      States[i]->TheModule = States[i]->Consumer->takeModule();
+    Entries[i].DiagClient->EndSourceFile();
+  }
+}
+
+bool EmitBCMultiEntryAction::hasEntryErrorOccurred(unsigned Index) const {
+  // No state means the consumer was never created.
+  if (Index >= States.size())
+    return true;
+  return StageDependent || States[Index]->ErrorOccurred;
+}
+
+DiagnosticsEngine &EmitBCMultiEntryAction::getEntryDiagnostics(unsigned Index) {
+  return *States[Index]->Diags;
+}
+
+std::unique_ptr<llvm::Module> EmitBCMultiEntryAction::takeModule(unsigned Index) {
+  return std::move(States[Index]->TheModule);
+}
+// HLSL Change Ends
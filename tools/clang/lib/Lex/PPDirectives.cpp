@@ -27,6 +27,7 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/SaveAndRestore.h"
+#include "llvm/Support/Timer.h" // HLSL Change
 #include "clang/Lex/PreprocessorOptions.h" // HLSL Change - ignore line directives.
 using namespace clang;
 
@@ -753,6 +754,10 @@ private:
 /// lexer/preprocessor state, and advances the lexer(s) so that the next token
 /// read is the correct one.
 void Preprocessor::HandleDirective(Token &Result) {
+  // HLSL Change - time directives, including the #include lookups and skipped
+  // #if blocks, apart from the parse that lexes the tokens between them.
+  llvm::TimingListenerRegion Region("Preprocessor directives");
+
   // FIXME: Traditional: # with whitespace before it not recognized by K&R?
 
   // We just parsed a # character at the start of a line, so we're in directive
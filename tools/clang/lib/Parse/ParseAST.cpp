@@ -24,6 +24,7 @@
 #include "clang/Sema/SemaConsumer.h"
 #include "clang/Sema/SemaHLSL.h" // HLSL Change
 #include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/Timer.h" // HLSL Change
 #include <cstdio>
 #include <memory>
 
@@ -120,6 +121,12 @@ void clang::ParseAST(Sema &S, bool PrintStats, bool SkipFunctionBodies) {
   llvm::CrashRecoveryContextCleanupRegistrar<Parser>
     CleanupParser(ParseOP.get());
 
+  // HLSL Change Starts - time parsing apart from the IR generation and
+  // optimization that HandleTranslationUnit runs.
+  std::unique_ptr<llvm::TimingListenerRegion> ParseRegion(
+      new llvm::TimingListenerRegion("Parse and Sema"));
+  // HLSL Change Ends
+
   S.getPreprocessor().EnterMainSourceFile();
   P.Initialize();
 
@@ -156,6 +163,7 @@ void clang::ParseAST(Sema &S, bool PrintStats, bool SkipFunctionBodies) {
   // errors in the front-end, without relying on code generation being
   // available.
   hlsl::DiagnoseTranslationUnit(&S);
+  ParseRegion.reset();
   // HLSL Change Ends
   Consumer->HandleTranslationUnit(S.getASTContext());
 
@@ -20,6 +20,7 @@
 #include "clang/SPIRV/AstTypeProbe.h"
 #include "clang/Sema/Sema.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Timer.h"
 
 #include "InitListHandler.h"
 #include "dxc/DXIL/DxilConstants.h"
@@ -627,10 +628,28 @@ void SpirvEmitter::HandleTranslationUnit(ASTContext &context) {
                         spirvOptions.flattenResourceArrays ||
                         declIdMapper.requiresFlatteningCompositeResources();
 
+    // Run legalization and optimization passes
+    const bool needsOptimization =
+        theCompilerInstance.getCodeGenOpts().OptimizationLevel > 0;
+    bool optimized = false;
+    if (needsLegalization && needsOptimization) {
+      // Both can run in one optimizer, which builds the IR only once. If it
+      // fails, start over and run the two separately to tell which one did.
+      std::vector<uint32_t> original = m;
+      std::string messages;
+      optimized = spirvToolsOptimize(&m, /*legalize*/ true, /*optimize*/ true,
+                                     &messages);
+      if (!optimized)
+        m = std::move(original);
+      else if (!messages.empty())
+        emitWarning("SPIR-V legalization: %0", {}) << messages;
+    }
+
     // Run legalization passes
-    if (needsLegalization) {
+    if (needsLegalization && !optimized) {
       std::string messages;
-      if (!spirvToolsLegalize(&m, &messages)) {
+      if (!spirvToolsOptimize(&m, /*legalize*/ true, /*optimize*/ false,
+                              &messages)) {
         emitFatalError("failed to legalize SPIR-V: %0", {}) << messages;
         emitNote("please file a bug report on "
                  "https://github.com/Microsoft/DirectXShaderCompiler/issues "
@@ -643,9 +662,10 @@ void SpirvEmitter::HandleTranslationUnit(ASTContext &context) {
     }
 
     // Run optimization passes
-    if (theCompilerInstance.getCodeGenOpts().OptimizationLevel > 0) {
+    if (needsOptimization && !optimized) {
       std::string messages;
-      if (!spirvToolsOptimize(&m, &messages)) {
+      if (!spirvToolsOptimize(&m, /*legalize*/ false, /*optimize*/ true,
+                              &messages)) {
         emitFatalError("failed to optimize SPIR-V: %0", {}) << messages;
         emitNote("please file a bug report on "
                  "https://github.com/Microsoft/DirectXShaderCompiler/issues "
@@ -11971,59 +11991,128 @@ bool SpirvEmitter::spirvToolsValidate(std::vector<uint32_t> *mod,
 }
 
 bool SpirvEmitter::spirvToolsOptimize(std::vector<uint32_t> *mod,
+                                      bool legalize, bool optimize,
                                       std::string *messages) {
   spvtools::Optimizer optimizer(featureManager.getTargetEnv());
 
-  optimizer.SetMessageConsumer(
-      [messages](spv_message_level_t /*level*/, const char * /*source*/,
-                 const spv_position_t & /*position*/,
-                 const char *message) { *messages += message; });
+  auto consumer = [messages](spv_message_level_t /*level*/,
+                             const char * /*source*/,
+                             const spv_position_t & /*position*/,
+                             const char *message) { *messages += message; };
+  optimizer.SetMessageConsumer(consumer);
 
   spvtools::OptimizerOptions options;
   options.set_run_validator(false);
 
-  if (spirvOptions.optConfig.empty()) {
-    // Add performance passes.
-    optimizer.RegisterPerformancePasses();
-
-    // Add compact ID pass.
+  if (legalize) {
+    optimizer.RegisterLegalizationPasses();
+    // Add flattening of resources if needed.
+    if (spirvOptions.flattenResourceArrays ||
+        declIdMapper.requiresFlatteningCompositeResources()) {
+      optimizer.RegisterPass(spvtools::CreateDescriptorScalarReplacementPass());
+      // ADCE should be run after desc_sroa in order to remove potentially
+      // illegal types such as structures containing opaque types.
+      optimizer.RegisterPass(spvtools::CreateAggressiveDCEPass());
+    }
+    optimizer.RegisterPass(spvtools::CreateReplaceInvalidOpcodePass());
     optimizer.RegisterPass(spvtools::CreateCompactIdsPass());
-  } else {
-    // Command line options use llvm::SmallVector and llvm::StringRef, whereas
-    // SPIR-V optimizer uses std::vector and std::string.
-    std::vector<std::string> stdFlags;
-    for (const auto &f : spirvOptions.optConfig)
-      stdFlags.push_back(f.str());
-    if (!optimizer.RegisterPassesFromFlags(stdFlags))
+  }
+
+  std::vector<std::string> configFlags;
+  if (optimize) {
+    configFlags = getOptConfigFlags();
+    if (configFlags.empty()) {
+      // Add performance passes.
+      optimizer.RegisterPerformancePasses();
+
+      // Add compact ID pass.
+      optimizer.RegisterPass(spvtools::CreateCompactIdsPass());
+    } else if (!optimizer.RegisterPassesFromFlags(configFlags)) {
       return false;
+    }
   }
 
-  return optimizer.Run(mod->data(), mod->size(), mod, options);
+  const bool tune =
+      optimize && configFlags.empty() && spirvOptions.tunedOptConfig;
+  if (!spirvOptions.timeReport && !tune)
+    return optimizer.Run(mod->data(), mod->size(), mod, options);
+
+  // Per-pass statistics and recipe tuning run each pass in an optimizer of
+  // its own, registered from "--" plus its name, and compare the binaries
+  // before and after it. Every pass is checked to have a flag before any
+  // run; if one doesn't, the passes run together as usual and the shader is
+  // marked as one whose recipe can't be tuned.
+  std::vector<std::string> passFlags;
+  {
+    spvtools::Optimizer check(featureManager.getTargetEnv());
+    check.SetMessageConsumer([](spv_message_level_t, const char *,
+                                const spv_position_t &, const char *) {});
+    for (const char *name : optimizer.GetPassNames()) {
+      std::string flag = std::string("--") + name;
+      if (!check.RegisterPassFromFlag(flag)) {
+        if (tune)
+          *spirvOptions.tunedOptConfig = {kSpirvOptRecipeUntunable};
+        return optimizer.Run(mod->data(), mod->size(), mod, options);
+      }
+      passFlags.push_back(std::move(flag));
+    }
+  }
+
+  std::vector<std::pair<std::string, bool>> passes;
+  std::vector<uint32_t> result;
+  for (const std::string &flag : passFlags) {
+    spvtools::Optimizer pass(featureManager.getTargetEnv());
+    pass.SetMessageConsumer(consumer);
+    pass.RegisterPassFromFlag(flag);
+    {
+      llvm::TimingListenerRegion region("spirv-opt " + flag.substr(2));
+      if (!pass.Run(mod->data(), mod->size(), &result, options))
+        return false;
+      region.count("words", (int64_t)result.size() - (int64_t)mod->size());
+    }
+    passes.emplace_back(flag, result != *mod);
+    mod->swap(result);
+  }
+  if (tune)
+    tuneOptConfig(passes);
+  return true;
 }
 
-bool SpirvEmitter::spirvToolsLegalize(std::vector<uint32_t> *mod,
-                                      std::string *messages) {
-  spvtools::Optimizer optimizer(featureManager.getTargetEnv());
-  optimizer.SetMessageConsumer(
-      [messages](spv_message_level_t /*level*/, const char * /*source*/,
-                 const spv_position_t & /*position*/,
-                 const char *message) { *messages += message; });
+void SpirvEmitter::tuneOptConfig(
+    const std::vector<std::pair<std::string, bool>> &passes) {
+  // The performance passes and compact IDs ran last, after any legalization.
+  spvtools::Optimizer recipe(featureManager.getTargetEnv());
+  recipe.RegisterPerformancePasses();
+  recipe.RegisterPass(spvtools::CreateCompactIdsPass());
+  const size_t recipeSize = recipe.GetPassNames().size();
+  if (passes.size() < recipeSize)
+    return;
 
-  spvtools::OptimizerOptions options;
-  options.set_run_validator(false);
-  optimizer.RegisterLegalizationPasses();
-  // Add flattening of resources if needed.
-  if (spirvOptions.flattenResourceArrays ||
-      declIdMapper.requiresFlatteningCompositeResources()) {
-    optimizer.RegisterPass(spvtools::CreateDescriptorScalarReplacementPass());
-    // ADCE should be run after desc_sroa in order to remove potentially
-    // illegal types such as structures containing opaque types.
-    optimizer.RegisterPass(spvtools::CreateAggressiveDCEPass());
-  }
-  optimizer.RegisterPass(spvtools::CreateReplaceInvalidOpcodePass());
-  optimizer.RegisterPass(spvtools::CreateCompactIdsPass());
-
-  return optimizer.Run(mod->data(), mod->size(), mod, options);
+  // Passes that left the module as it was are left out.
+  std::vector<std::string> changedFlags;
+  for (size_t i = passes.size() - recipeSize; i < passes.size(); ++i)
+    if (passes[i].second)
+      changedFlags.push_back(passes[i].first);
+  *spirvOptions.tunedOptConfig = std::move(changedFlags);
+}
+
+std::vector<std::string> SpirvEmitter::getOptConfigFlags() {
+  // Command line options use llvm::SmallVector and llvm::StringRef, whereas
+  // SPIR-V optimizer uses std::vector and std::string.
+  std::vector<std::string> flags;
+  for (const auto &f : spirvOptions.optConfig)
+    flags.push_back(f.str());
+  if (!flags.empty() || spirvOptions.optRecipe.empty())
+    return flags;
+
+  // A saved recipe with flags this optimizer doesn't know, such as one that
+  // was damaged or written by another version, is tuned again instead.
+  spvtools::Optimizer optimizer(featureManager.getTargetEnv());
+  optimizer.SetMessageConsumer([](spv_message_level_t, const char *,
+                                  const spv_position_t &, const char *) {});
+  if (optimizer.RegisterPassesFromFlags(spirvOptions.optRecipe))
+    flags = spirvOptions.optRecipe;
+  return flags;
 }
 
 SpirvInstruction *
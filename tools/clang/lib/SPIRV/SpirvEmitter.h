@@ -998,17 +998,27 @@ private:
                               const clang::FunctionDecl *,
                               bool isEntryFunction);
 
-  /// \brief Helper function to run SPIRV-Tools optimizer's performance passes.
-  /// Runs the SPIRV-Tools optimizer on the given SPIR-V module |mod|, and
-  /// gets the info/warning/error messages via |messages|.
-  /// Returns true on success and false otherwise.
-  bool spirvToolsOptimize(std::vector<uint32_t> *mod, std::string *messages);
-
-  /// \brief Helper function to run SPIRV-Tools optimizer's legalization passes.
-  /// Runs the SPIRV-Tools legalization on the given SPIR-V module |mod|, and
-  /// gets the info/warning/error messages via |messages|.
+  /// \brief Helper function to run the SPIRV-Tools optimizer.
+  /// Runs the legalization passes if |legalize| is true, followed by the
+  /// performance passes (or the -Oconfig passes) if |optimize| is true, on the
+  /// given SPIR-V module |mod|. The passes run in a single optimizer, unless
+  /// they are timed or tuned, in which case each runs in one of its own.
+  /// Gets the info/warning/error messages via |messages|, without saying
+  /// which of the two steps they came from.
   /// Returns true on success and false otherwise.
-  bool spirvToolsLegalize(std::vector<uint32_t> *mod, std::string *messages);
+  bool spirvToolsOptimize(std::vector<uint32_t> *mod, bool legalize,
+                          bool optimize, std::string *messages);
+
+  /// \brief Saves the flags of the performance passes that changed the module
+  /// as the tuned recipe, given the flags of the |passes| that ran, in order,
+  /// each with whether it changed the module.
+  void tuneOptConfig(const std::vector<std::pair<std::string, bool>> &passes);
+
+  /// \brief Returns the flags of the passes to run in place of the
+  /// performance passes: the -Oconfig passes, or else the saved recipe if
+  /// every one of its flags names a pass. Returns an empty list if the
+  /// performance passes are to run.
+  std::vector<std::string> getOptConfigFlags();
 
   /// \brief Helper function to run the SPIRV-Tools validator.
   /// Runs the SPIRV-Tools validator on the given SPIR-V module |mod|, and
@@ -12,6 +12,7 @@
 
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Attr.h"
 #include "clang/AST/DeclCXX.h"
@@ -2358,101 +2359,76 @@ bool TemplateHasDefaultType(ArBasicKind kind)
   }
 }
 
+/// <summary>
+/// An intrinsic definition returned by an external intrinsic table.
+/// </summary>
+struct ExternalIntrinsic {
+  unsigned TableIndex;              // Index of the table in the external source.
+  const HLSL_INTRINSIC* Intrinsic;  // Definition, alive as long as the table.
+};
+typedef std::vector<ExternalIntrinsic> ExternalIntrinsicList;
+
 /// <summary>
 /// Use this class to iterate over intrinsic definitions that come from an external source.
 /// </summary>
 class IntrinsicTableDefIter
 {
 private:
-  StringRef _typeName;
-  StringRef _functionName;
   llvm::SmallVector<CComPtr<IDxcIntrinsicTable>, 2>& _tables;
-  const HLSL_INTRINSIC* _tableIntrinsic;
-  UINT64 _tableLookupCookie;
-  unsigned _tableIndex;
+  const ExternalIntrinsicList* _intrinsics; // nullptr for the end iterator.
+  size_t _index;
   unsigned _argCount;
-  bool _firstChecked;
 
   IntrinsicTableDefIter(
     llvm::SmallVector<CComPtr<IDxcIntrinsicTable>, 2>& tables,
-    StringRef typeName,
-    StringRef functionName,
+    const ExternalIntrinsicList* intrinsics,
     unsigned argCount) :
-    _typeName(typeName), _functionName(functionName), _tables(tables),
-    _tableIntrinsic(nullptr), _tableLookupCookie(0), _tableIndex(0),
-    _argCount(argCount), _firstChecked(false)
+    _tables(tables), _intrinsics(intrinsics), _index(0), _argCount(argCount)
   {
+    SkipMismatches();
   }
 
-  void CheckForIntrinsic() {
-    if (_tableIndex >= _tables.size()) {
-      return;
-    }
-
-    _firstChecked = true;
-
-    // TODO: review this - this will allocate at least once per string
-    CA2WEX<> typeName(_typeName.str().c_str(), CP_UTF8);
-    CA2WEX<> functionName(_functionName.str().c_str(), CP_UTF8);
-
-    if (FAILED(_tables[_tableIndex]->LookupIntrinsic(
-            typeName, functionName, &_tableIntrinsic, &_tableLookupCookie))) {
-      _tableLookupCookie = 0;
-      _tableIntrinsic = nullptr;
-    }
+  bool IsEnd() const {
+    return _intrinsics == nullptr || _index == _intrinsics->size();
   }
 
-  void MoveToNext() {
-    for (;;) {
-      // If we don't have an intrinsic, try the following table.
-      if (_firstChecked && _tableIntrinsic == nullptr) {
-        _tableIndex++;
-      }
-
-      CheckForIntrinsic();
-      if (_tableIndex == _tables.size() ||
-          (_tableIntrinsic != nullptr &&
-           _tableIntrinsic->uNumArgs ==
-               (_argCount + 1))) // uNumArgs includes return
-        break;
-    }
+  void SkipMismatches() {
+    while (!IsEnd() &&
+           (*_intrinsics)[_index].Intrinsic->uNumArgs !=
+               (_argCount + 1)) // uNumArgs includes return
+      _index++;
   }
 
 public:
   static IntrinsicTableDefIter CreateStart(llvm::SmallVector<CComPtr<IDxcIntrinsicTable>, 2>& tables,
-    StringRef typeName,
-    StringRef functionName,
+    const ExternalIntrinsicList& intrinsics,
     unsigned argCount)
   {
-    IntrinsicTableDefIter result(tables, typeName, functionName, argCount);
+    IntrinsicTableDefIter result(tables, &intrinsics, argCount);
     return result;
   }
 
   static IntrinsicTableDefIter CreateEnd(llvm::SmallVector<CComPtr<IDxcIntrinsicTable>, 2>& tables)
   {
-    IntrinsicTableDefIter result(tables, StringRef(), StringRef(), 0);
-    result._tableIndex = tables.size();
+    IntrinsicTableDefIter result(tables, nullptr, 0);
     return result;
   }
 
   bool operator!=(const IntrinsicTableDefIter& other)
   {
-    if (!_firstChecked) {
-      MoveToNext();
-    }
-    return _tableIndex != other._tableIndex; // More things could be compared but we only match end.
+    return IsEnd() != other.IsEnd(); // More things could be compared but we only match end.
   }
 
   const HLSL_INTRINSIC* operator*()
   {
-    DXASSERT(_firstChecked, "otherwise deref without comparing to end");
-    return _tableIntrinsic;
+    DXASSERT(!IsEnd(), "otherwise deref past the end");
+    return (*_intrinsics)[_index].Intrinsic;
   }
 
   LPCSTR GetTableName()
   {
     LPCSTR tableName = nullptr;
-    if (FAILED(_tables[_tableIndex]->GetTableName(&tableName))) {
+    if (FAILED(_tables[(*_intrinsics)[_index].TableIndex]->GetTableName(&tableName))) {
       return nullptr;
     }
     return tableName;
@@ -2460,8 +2436,9 @@ public:
 
   LPCSTR GetLoweringStrategy()
   {
+    const ExternalIntrinsic& current = (*_intrinsics)[_index];
     LPCSTR lowering = nullptr;
-    if (FAILED(_tables[_tableIndex]->GetLoweringStrategy(_tableIntrinsic->Op, &lowering))) {
+    if (FAILED(_tables[current.TableIndex]->GetLoweringStrategy(current.Intrinsic->Op, &lowering))) {
       return nullptr;
     }
     return lowering;
@@ -2469,7 +2446,8 @@ public:
 
   IntrinsicTableDefIter& operator++()
   {
-    MoveToNext();
+    _index++;
+    SkipMismatches();
     return *this;
   }
 };
@@ -2925,6 +2903,9 @@ private:
   // Intrinsic tables available externally.
   llvm::SmallVector<CComPtr<IDxcIntrinsicTable>, 2> m_intrinsicTables;
 
+  // Definitions found in m_intrinsicTables, keyed on "type::function" name.
+  llvm::StringMap<ExternalIntrinsicList> m_externalIntrinsics;
+
   // Scalar types indexed by HLSLScalarType.
   QualType m_scalarTypes[HLSLScalarTypeCount];
 
@@ -3989,6 +3970,7 @@ public:
   void RegisterIntrinsicTable(_In_ IDxcIntrinsicTable *table) {
     DXASSERT_NOMSG(table != nullptr);
     m_intrinsicTables.push_back(table);
+    m_externalIntrinsics.clear();
     // If already initialized, add methods immediately.
     if (m_sema != nullptr) {
       AddIntrinsicTableMethods(table);
@@ -4226,6 +4208,38 @@ public:
     _In_ const HLSL_INTRINSIC *pIntrinsic,
     _In_ QualType objectElement);
 
+  /// <summary>
+  /// Returns the definitions the external intrinsic tables provide for the
+  /// given type and function name, querying the tables once per name.
+  /// </summary>
+  const ExternalIntrinsicList& LookupExternalIntrinsics(StringRef typeName, StringRef functionName)
+  {
+    static const ExternalIntrinsicList noIntrinsics;
+    if (m_intrinsicTables.empty()) {
+      return noIntrinsics;
+    }
+
+    std::string key = (typeName + "::" + functionName).str();
+    auto found = m_externalIntrinsics.find(key);
+    if (found != m_externalIntrinsics.end()) {
+      return found->second;
+    }
+
+    ExternalIntrinsicList& intrinsics = m_externalIntrinsics[key];
+    CA2WEX<> wideTypeName(typeName.str().c_str(), CP_UTF8);
+    CA2WEX<> wideFunctionName(functionName.str().c_str(), CP_UTF8);
+    for (unsigned i = 0; i < m_intrinsicTables.size(); i++) {
+      const HLSL_INTRINSIC* pIntrinsic = nullptr;
+      UINT64 lookupCookie = 0;
+      while (SUCCEEDED(m_intrinsicTables[i]->LookupIntrinsic(
+                 wideTypeName, wideFunctionName, &pIntrinsic, &lookupCookie)) &&
+             pIntrinsic != nullptr) {
+        intrinsics.push_back(ExternalIntrinsic{ i, pIntrinsic });
+      }
+    }
+    return intrinsics;
+  }
+
   // Returns the iterator with the first entry that matches the requirement
   IntrinsicDefIter FindIntrinsicByNameAndArgCount(
     _In_count_(tableSize) const HLSL_INTRINSIC* table,
@@ -4234,17 +4248,30 @@ public:
     StringRef nameIdentifier,
     size_t argumentCount)
   {
-    // This is implemented by a linear scan for now.
-    // We tested binary search on tables, and there was no performance gain on
-    // samples probably for the following reasons.
-    // 1. The tables are not big enough to make noticable difference
-    // 2. The user of this function assumes that it returns the first entry in
-    // the table that matches name and argument count. So even in the binary
-    // search, we have to scan backwards until the entry does not match the name
-    // or arg count. For linear search this is not a problem
-    for (unsigned int i = 0; i < tableSize; i++) {
-      const HLSL_INTRINSIC* pIntrinsic = &table[i];
+    // The global table is large and searched for every unresolved call, so
+    // narrow it down to the overloads of the name through its sorted index.
+    // Object method tables are small enough for a linear scan.
+    const HLSL_INTRINSIC* first = table;
+    const HLSL_INTRINSIC* last = table + tableSize;
+    if (table == g_Intrinsics) {
+      const HLSL_INTRINSIC_NAME_INDEX* indexEnd =
+        g_IntrinsicsNameIndex + _countof(g_IntrinsicsNameIndex);
+      const HLSL_INTRINSIC_NAME_INDEX* entry = std::lower_bound(
+        g_IntrinsicsNameIndex, indexEnd, nameIdentifier,
+        [](const HLSL_INTRINSIC_NAME_INDEX& e, StringRef name) {
+          return StringRef(e.pName) < name;
+        });
+      if (entry != indexEnd && nameIdentifier.equals(entry->pName)) {
+        first = table + entry->uFirst;
+        last = first + entry->uCount;
+      } else {
+        first = last;
+      }
+    }
 
+    // The user of this function assumes that it returns the first entry in
+    // the table that matches name and argument count.
+    for (const HLSL_INTRINSIC* pIntrinsic = first; pIntrinsic != last; pIntrinsic++) {
       const bool isVariadicFn = IsVariadicIntrinsicFunction(pIntrinsic);
 
       // Do some quick checks to verify size and name.
@@ -4256,11 +4283,13 @@ public:
       }
 
       return IntrinsicDefIter::CreateStart(table, tableSize, pIntrinsic,
-        IntrinsicTableDefIter::CreateStart(m_intrinsicTables, typeName, nameIdentifier, argumentCount));
+        IntrinsicTableDefIter::CreateStart(m_intrinsicTables,
+          LookupExternalIntrinsics(typeName, nameIdentifier), argumentCount));
     }
 
     return IntrinsicDefIter::CreateStart(table, tableSize, table + tableSize,
-      IntrinsicTableDefIter::CreateStart(m_intrinsicTables, typeName, nameIdentifier, argumentCount));
+      IntrinsicTableDefIter::CreateStart(m_intrinsicTables,
+        LookupExternalIntrinsics(typeName, nameIdentifier), argumentCount));
   }
 
   bool AddOverloadedCallCandidates(
@@ -6286,6 +6286,224 @@ static const HLSL_INTRINSIC g_VkSubpassInputMSMethods[] =
 #endif // ENABLE_SPIRV_CODEGEN
 // HLSL-INTRINSICS:END
 
+// Index of g_Intrinsics sorted by name; each entry covers the contiguous run
+// of overloads sharing that name.
+struct HLSL_INTRINSIC_NAME_INDEX {
+  LPCSTR pName; // Name, as in pArgs[0].pName of the overloads.
+  UINT uFirst;  // Index of the first overload in g_Intrinsics.
+  UINT uCount;  // Count of overloads.
+};
+
+/* <py::lines('HLSL-INTRINSIC-NAME-INDEX')>hctdb_instrhelp.get_hlsl_intrinsic_name_index()</py>*/
+// HLSL-INTRINSIC-NAME-INDEX:BEGIN
+static const HLSL_INTRINSIC_NAME_INDEX g_IntrinsicsNameIndex[] =
+{
+    {"$hidden$AllocateRayQuery", 4, 1},
+    {"AcceptHitAndEndSearch", 0, 1},
+    {"AddUint64", 1, 1},
+    {"AllMemoryBarrier", 2, 1},
+    {"AllMemoryBarrierWithGroupSync", 3, 1},
+    {"CallShader", 5, 1},
+    {"CheckAccessFullyMapped", 6, 1},
+    {"CreateResourceFromHeap", 7, 1},
+    {"D3DCOLORtoUBYTE4", 8, 1},
+    {"DeviceMemoryBarrier", 9, 1},
+    {"DeviceMemoryBarrierWithGroupSync", 10, 1},
+    {"DispatchMesh", 11, 1},
+    {"DispatchRaysDimensions", 12, 1},
+    {"DispatchRaysIndex", 13, 1},
+    {"EvaluateAttributeAtSample", 14, 1},
+    {"EvaluateAttributeCentroid", 15, 1},
+    {"EvaluateAttributeSnapped", 16, 1},
+    {"GeometryIndex", 17, 1},
+    {"GetAttributeAtVertex", 18, 1},
+    {"GetRenderTargetSampleCount", 19, 1},
+    {"GetRenderTargetSamplePosition", 20, 1},
+    {"GroupMemoryBarrier", 21, 1},
+    {"GroupMemoryBarrierWithGroupSync", 22, 1},
+    {"HitKind", 23, 1},
+    {"IgnoreHit", 24, 1},
+    {"InstanceID", 25, 1},
+    {"InstanceIndex", 26, 1},
+    {"InterlockedAdd", 27, 2},
+    {"InterlockedAnd", 29, 2},
+    {"InterlockedCompareExchange", 31, 1},
+    {"InterlockedCompareStore", 32, 1},
+    {"InterlockedExchange", 33, 1},
+    {"InterlockedMax", 34, 2},
+    {"InterlockedMin", 36, 2},
+    {"InterlockedOr", 38, 2},
+    {"InterlockedXor", 40, 2},
+    {"NonUniformResourceIndex", 42, 1},
+    {"ObjectRayDirection", 43, 1},
+    {"ObjectRayOrigin", 44, 1},
+    {"ObjectToWorld", 45, 1},
+    {"ObjectToWorld3x4", 46, 1},
+    {"ObjectToWorld4x3", 47, 1},
+    {"PrimitiveIndex", 48, 1},
+    {"Process2DQuadTessFactorsAvg", 49, 1},
+    {"Process2DQuadTessFactorsMax", 50, 1},
+    {"Process2DQuadTessFactorsMin", 51, 1},
+    {"ProcessIsolineTessFactors", 52, 1},
+    {"ProcessQuadTessFactorsAvg", 53, 1},
+    {"ProcessQuadTessFactorsMax", 54, 1},
+    {"ProcessQuadTessFactorsMin", 55, 1},
+    {"ProcessTriTessFactorsAvg", 56, 1},
+    {"ProcessTriTessFactorsMax", 57, 1},
+    {"ProcessTriTessFactorsMin", 58, 1},
+    {"QuadReadAcrossDiagonal", 59, 1},
+    {"QuadReadAcrossX", 60, 1},
+    {"QuadReadAcrossY", 61, 1},
+    {"QuadReadLaneAt", 62, 1},
+    {"RayFlags", 63, 1},
+    {"RayTCurrent", 64, 1},
+    {"RayTMin", 65, 1},
+    {"ReportHit", 66, 1},
+    {"SetMeshOutputCounts", 67, 1},
+    {"TraceRay", 68, 1},
+    {"WaveActiveAllEqual", 69, 1},
+    {"WaveActiveAllTrue", 70, 1},
+    {"WaveActiveAnyTrue", 71, 1},
+    {"WaveActiveBallot", 72, 1},
+    {"WaveActiveBitAnd", 73, 1},
+    {"WaveActiveBitOr", 74, 1},
+    {"WaveActiveBitXor", 75, 1},
+    {"WaveActiveCountBits", 76, 1},
+    {"WaveActiveMax", 77, 1},
+    {"WaveActiveMin", 78, 1},
+    {"WaveActiveProduct", 79, 1},
+    {"WaveActiveSum", 80, 1},
+    {"WaveGetLaneCount", 81, 1},
+    {"WaveGetLaneIndex", 82, 1},
+    {"WaveIsFirstLane", 83, 1},
+    {"WaveMatch", 84, 1},
+    {"WaveMultiPrefixBitAnd", 85, 1},
+    {"WaveMultiPrefixBitOr", 86, 1},
+    {"WaveMultiPrefixBitXor", 87, 1},
+    {"WaveMultiPrefixCountBits", 88, 1},
+    {"WaveMultiPrefixProduct", 89, 1},
+    {"WaveMultiPrefixSum", 90, 1},
+    {"WavePrefixCountBits", 91, 1},
+    {"WavePrefixProduct", 92, 1},
+    {"WavePrefixSum", 93, 1},
+    {"WaveReadLaneAt", 94, 1},
+    {"WaveReadLaneFirst", 95, 1},
+    {"WorldRayDirection", 96, 1},
+    {"WorldRayOrigin", 97, 1},
+    {"WorldToObject", 98, 1},
+    {"WorldToObject3x4", 99, 1},
+    {"WorldToObject4x3", 100, 1},
+    {"abort", 101, 1},
+    {"abs", 102, 1},
+    {"acos", 103, 1},
+    {"all", 104, 1},
+    {"any", 105, 1},
+    {"asdouble", 106, 1},
+    {"asfloat", 107, 1},
+    {"asfloat16", 108, 1},
+    {"asin", 109, 1},
+    {"asint", 110, 1},
+    {"asint16", 111, 1},
+    {"asuint", 112, 2},
+    {"asuint16", 114, 1},
+    {"atan", 115, 1},
+    {"atan2", 116, 1},
+    {"ceil", 117, 1},
+    {"clamp", 118, 1},
+    {"clip", 119, 1},
+    {"cos", 120, 1},
+    {"cosh", 121, 1},
+    {"countbits", 122, 1},
+    {"cross", 123, 1},
+    {"ddx", 124, 1},
+    {"ddx_coarse", 125, 1},
+    {"ddx_fine", 126, 1},
+    {"ddy", 127, 1},
+    {"ddy_coarse", 128, 1},
+    {"ddy_fine", 129, 1},
+    {"degrees", 130, 1},
+    {"determinant", 131, 1},
+    {"distance", 132, 1},
+    {"dot", 133, 1},
+    {"dot2add", 134, 1},
+    {"dot4add_i8packed", 135, 1},
+    {"dot4add_u8packed", 136, 1},
+    {"dst", 137, 1},
+    {"exp", 138, 1},
+    {"exp2", 139, 1},
+    {"f16tof32", 140, 1},
+    {"f32tof16", 141, 1},
+    {"faceforward", 142, 1},
+    {"firstbithigh", 143, 1},
+    {"firstbitlow", 144, 1},
+    {"floor", 145, 1},
+    {"fma", 146, 1},
+    {"fmod", 147, 1},
+    {"frac", 148, 1},
+    {"frexp", 149, 1},
+    {"fwidth", 150, 1},
+    {"isfinite", 151, 1},
+    {"isinf", 152, 1},
+    {"isnan", 153, 1},
+    {"ldexp", 154, 1},
+    {"length", 155, 1},
+    {"lerp", 156, 1},
+    {"lit", 157, 1},
+    {"log", 158, 1},
+    {"log10", 159, 1},
+    {"log2", 160, 1},
+    {"mad", 161, 1},
+    {"max", 162, 1},
+    {"min", 163, 1},
+    {"modf", 164, 1},
+    {"msad4", 165, 1},
+    {"mul", 166, 9},
+    {"normalize", 175, 1},
+    {"pow", 176, 1},
+    {"printf", 177, 1},
+    {"radians", 178, 1},
+    {"rcp", 179, 1},
+    {"reflect", 180, 1},
+    {"refract", 181, 1},
+    {"reversebits", 182, 1},
+    {"round", 183, 1},
+    {"rsqrt", 184, 1},
+    {"saturate", 185, 1},
+    {"sign", 186, 1},
+    {"sin", 187, 1},
+    {"sincos", 188, 1},
+    {"sinh", 189, 1},
+    {"smoothstep", 190, 1},
+    {"source_mark", 191, 1},
+    {"sqrt", 192, 1},
+    {"step", 193, 1},
+    {"tan", 194, 1},
+    {"tanh", 195, 1},
+    {"tex1D", 196, 2},
+    {"tex1Dbias", 198, 1},
+    {"tex1Dgrad", 199, 1},
+    {"tex1Dlod", 200, 1},
+    {"tex1Dproj", 201, 1},
+    {"tex2D", 202, 2},
+    {"tex2Dbias", 204, 1},
+    {"tex2Dgrad", 205, 1},
+    {"tex2Dlod", 206, 1},
+    {"tex2Dproj", 207, 1},
+    {"tex3D", 208, 2},
+    {"tex3Dbias", 210, 1},
+    {"tex3Dgrad", 211, 1},
+    {"tex3Dlod", 212, 1},
+    {"tex3Dproj", 213, 1},
+    {"texCUBE", 214, 2},
+    {"texCUBEbias", 216, 1},
+    {"texCUBEgrad", 217, 1},
+    {"texCUBElod", 218, 1},
+    {"texCUBEproj", 219, 1},
+    {"transpose", 220, 1},
+    {"trunc", 221, 1},
+};
+// HLSL-INTRINSIC-NAME-INDEX:END
+
 /* <py::lines('HLSL-INTRINSIC-STATS')>hctdb_instrhelp.get_hlsl_intrinsic_stats()</py>*/
 // HLSL-INTRINSIC-STATS:BEGIN
 static const UINT g_uAppendStructuredBufferMethodsCount = 2;
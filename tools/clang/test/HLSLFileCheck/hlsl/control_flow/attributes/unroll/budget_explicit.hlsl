@@ -0,0 +1,22 @@
+// RUN: %dxc -E main -T ps_6_0 -opt-select unroll-budget 100000 %s | FileCheck %s
+// RUN: %dxc -E main -T ps_6_0 -opt-select unroll-budget lots %s | FileCheck %s -check-prefix=INVALID
+
+// CHECK-NOT: unroll budget
+// CHECK: @main
+// CHECK-NOT: br i1
+
+// INVALID: invalid value 'lots' for -opt-select unroll-budget, expected an instruction count
+
+// Check that a loop within an explicit unroll budget is fully unrolled, and
+// that a budget that isn't a number is reported.
+
+float main(float y : Y) : SV_Target {
+  float x = 0;
+
+  [unroll]
+  for (uint i = 0; i < 512; ++i)
+  {
+    x = x * x + y;
+  }
+  return x;
+}
@@ -0,0 +1,23 @@
+// RUN: %dxc -E main -T ps_6_0 -opt-select unroll-budget 64 %s | FileCheck %s
+// RUN: %dxc -E main -T ps_6_0 %s | FileCheck %s -check-prefix=NOBUDGET
+
+// CHECK: warning: Loop
+// CHECK-SAME: over the remaining unroll budget of 64.
+// CHECK: @main
+
+// NOBUDGET-NOT: unroll budget
+// NOBUDGET: @main
+
+// Check that a loop that doesn't have to be unrolled only warns when it goes
+// over the unroll budget, and that there's no budget unless one is given.
+
+float main(float y : Y) : SV_Target {
+  float x = 0;
+
+  [unroll]
+  for (uint i = 0; i < 512; ++i)
+  {
+    x = x * x + y;
+  }
+  return x;
+}
@@ -0,0 +1,25 @@
+// RUN: %dxc -E main -T ps_6_0 -opt-select unroll-budget 4 %s | FileCheck %s
+// CHECK: Could not unroll loop. Unrolling would add an estimated
+// CHECK-SAME: over the remaining unroll budget of 4.
+// CHECK-NOT: @main
+
+// Check that a loop that has to be unrolled, because it indexes resources
+// with the induction variable, fails when it goes over the unroll budget.
+
+AppendStructuredBuffer<float4> buf0;
+AppendStructuredBuffer<float4> buf1;
+AppendStructuredBuffer<float4> buf2;
+AppendStructuredBuffer<float4> buf3;
+
+float main() : SV_Target {
+
+  AppendStructuredBuffer<float4> buffers[] = { buf0, buf1, buf2, buf3, };
+
+  float result = 0;
+  [unroll]
+  for (uint j = 0; j < 4; j++) {
+    buffers[j].Append(result);
+    result += 1;
+  }
+  return result;
+}
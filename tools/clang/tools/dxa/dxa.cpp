@@ -16,9 +16,15 @@
 #include "dxc/dxcapi.h"
 #include "dxc/Support/dxcapi.use.h"
 #include "dxc/Support/HLSLOptions.h"
+#include "dxc/Support/FileIOHelper.h"
 #include "dxc/DxilContainer/DxilContainer.h"
+#include "dxc/DxilContainer/DxilContainerArchive.h"
 
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MSFileSystem.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
 #include <dia2.h>
 #include <intsafe.h>
 
@@ -48,6 +54,20 @@ static cl::opt<bool> ListFiles("listfiles",
 static cl::opt<std::string>
     ExtractFile("extractfile", cl::desc("Extract file from debug information (use '*' for all files)"));
 
+static cl::list<std::string> MoreInputFilenames(cl::Positional,
+                                                cl::ZeroOrMore,
+                                                cl::desc("<more inputs for -pack>"));
+
+static cl::opt<bool> Pack("pack",
+                          cl::desc("Pack the input containers into the archive named by -o"),
+                          cl::init(false));
+static cl::opt<bool> Unpack("unpack",
+                            cl::desc("Unpack the input archive into the directory named by -o"),
+                            cl::init(false));
+static cl::opt<std::string>
+    UnpackHash("hash", cl::desc("With -unpack, extract only the container with "
+                                "this container or shader hash digest to -o"));
+
 
 class DxaContext {
 
@@ -63,6 +83,8 @@ public:
   bool ExtractPart(const char *pName);
   void ListFiles();
   void ListParts();
+  void PackArchive();
+  bool UnpackArchive();
 };
 
 void DxaContext::Assemble() {
@@ -176,7 +198,7 @@ void DxaContext::ListFiles() {
   CComPtr<IDxcBlob> pTargetBlob;
   CComPtr<IDxcLibrary> pLibrary;
   CComPtr<IDiaTable> pTable;
-  ReadFileIntoBlob(m_dxcSupport, StringRefUtf16(InputFilename), &pSource);
+  MapFileIntoBlob(StringRefUtf16(InputFilename), &pSource);
   IFTARG(pSource->GetBufferSize() >= 4);
   IFT(m_dxcSupport.CreateInstance(CLSID_DxcLibrary, &pLibrary));
   IFT(FindModule(hlsl::DxilFourCC::DFCC_ShaderDebugInfoDXIL, pSource, pLibrary, &pTargetBlob));
@@ -208,7 +230,7 @@ bool DxaContext::ExtractFile(const char *pName) {
   CComPtr<IDxcBlob> pTargetBlob;
   CComPtr<IDxcLibrary> pLibrary;
   CComPtr<IDiaTable> pTable;
-  ReadFileIntoBlob(m_dxcSupport, StringRefUtf16(InputFilename), &pSource);
+  MapFileIntoBlob(StringRefUtf16(InputFilename), &pSource);
   IFTARG(pSource->GetBufferSize() >= 4);
   IFT(m_dxcSupport.CreateInstance(CLSID_DxcLibrary, &pLibrary));
   IFT(FindModule(hlsl::DxilFourCC::DFCC_ShaderDebugInfoDXIL, pSource, pLibrary, &pTargetBlob));
@@ -266,7 +288,7 @@ bool DxaContext::ExtractPart(const char *pName) {
     extractModule = true;
   }
 
-  ReadFileIntoBlob(m_dxcSupport, StringRefUtf16(InputFilename), &pSource);
+  MapFileIntoBlob(StringRefUtf16(InputFilename), &pSource);
   IFT(m_dxcSupport.CreateInstance(CLSID_DxcContainerReflection, &pReflection));
   IFT(pReflection->Load(pSource));
   IFT(pReflection->GetPartCount(&partCount));
@@ -320,39 +342,187 @@ bool DxaContext::ExtractPart(const char *pName) {
 
 void DxaContext::ListParts() {
   CComPtr<IDxcBlobEncoding> pSource;
-  ReadFileIntoBlob(m_dxcSupport, StringRefUtf16(InputFilename), &pSource);
+  MapFileIntoBlob(StringRefUtf16(InputFilename), &pSource);
+
+  // Only the part headers are needed, so walk them in place rather than
+  // creating a blob per part; the payloads are never touched.
+  const hlsl::DxilContainerHeader *pHeader = hlsl::IsDxilContainerLike(
+      pSource->GetBufferPointer(), pSource->GetBufferSize());
+  IFTBOOL(pHeader != nullptr &&
+              hlsl::IsValidDxilContainer(pHeader, pSource->GetBufferSize()),
+          E_INVALIDARG);
+  printf("Part count: %u\n", pHeader->PartCount);
+
+  UINT32 i = 0;
+  for (auto it = hlsl::begin(pHeader), e = hlsl::end(pHeader); it != e;
+       ++it, ++i) {
+    const hlsl::DxilPartHeader *pPart = *it;
+    // Part kind is typically four characters.
+    char kindText[5];
+    hlsl::PartKindToCharArray(pPart->PartFourCC, kindText);
 
-  CComPtr<IDxcContainerReflection> pReflection;
-  IFT(m_dxcSupport.CreateInstance(CLSID_DxcContainerReflection, &pReflection));
-  IFT(pReflection->Load(pSource));
+    printf("#%u - %s (%u bytes)\n", i, kindText, (unsigned)pPart->PartSize);
+  }
+}
 
-  UINT32 partCount;
-  IFT(pReflection->GetPartCount(&partCount));
-  printf("Part count: %u\n", partCount);
+static std::string DigestToHex(const uint8_t *pDigest) {
+  std::string Hex;
+  llvm::raw_string_ostream OS(Hex);
+  for (unsigned i = 0; i < hlsl::DxilContainerHashSize; ++i)
+    OS << format("%.2x", pDigest[i]);
+  return OS.str();
+}
 
-  for (UINT32 i = 0; i < partCount; ++i) {
-    UINT32 partKind;
-    IFT(pReflection->GetPartKind(i, &partKind));
-    // Part kind is typically four characters.
-    char kindText[5];
-    hlsl::PartKindToCharArray(partKind, kindText);
+static bool HexToDigest(StringRef Hex, uint8_t *pDigest) {
+  if (Hex.size() != hlsl::DxilContainerHashSize * 2)
+    return false;
+  for (unsigned i = 0; i < hlsl::DxilContainerHashSize; ++i) {
+    unsigned Byte;
+    if (Hex.substr(i * 2, 2).getAsInteger(16, Byte))
+      return false;
+    pDigest[i] = (uint8_t)Byte;
+  }
+  return true;
+}
 
-    CComPtr<IDxcBlob> partContent;
-    IFT(pReflection->GetPartContent(i, &partContent));
+void DxaContext::PackArchive() {
+  IFTMSG(OutputFilename.empty() ? E_INVALIDARG : S_OK,
+         "-pack requires an output archive (-o)");
+
+  // The archive is written next to its final name and renamed into place
+  // once it has its footer, so a failed pack never leaves an archive that
+  // can't be read.
+  std::string TempFilename = OutputFilename + ".tmp";
+  std::error_code EC;
+  std::unique_ptr<raw_fd_ostream> OS(
+      new raw_fd_ostream(TempFilename, EC, sys::fs::F_None));
+  IFTLLVM(EC);
+
+  // Containers are mapped and streamed into the archive one at a time, so
+  // memory use is bounded by the index rather than the input.
+  hlsl::DxilArchiveWriter Writer(*OS);
+  std::vector<std::string> Inputs(1, InputFilename);
+  Inputs.insert(Inputs.end(), MoreInputFilenames.begin(),
+                MoreInputFilenames.end());
+  unsigned Duplicates = 0;
+  try {
+    for (const std::string &Input : Inputs) {
+      CComPtr<IDxcBlobEncoding> pSource;
+      try {
+        MapFileIntoBlob(StringRefUtf16(Input), &pSource);
+      } catch (const ::hlsl::Exception &) {
+        printf("Skipping %s - the file can't be read.\n", Input.c_str());
+        continue;
+      }
+      HRESULT hr = Writer.AddContainer(pSource->GetBufferPointer(),
+                                       (uint32_t)pSource->GetBufferSize());
+      if (hr == S_FALSE)
+        ++Duplicates;
+      else if (hr == DXC_E_DATA_TOO_LARGE)
+        printf("Skipping %s - archive would be larger than 4GB.\n",
+               Input.c_str());
+      else if (FAILED(hr))
+        printf("Skipping %s - not a container that can be packed.\n",
+               Input.c_str());
+    }
+    Writer.Finish();
+    OS->close();
+    IFTBOOLMSG(!OS->has_error(), E_FAIL, "failed to write the archive");
+    IFTLLVM(sys::fs::rename(TempFilename, OutputFilename));
+  } catch (...) {
+    OS->clear_error();
+    OS.reset();
+    sys::fs::remove(TempFilename);
+    throw;
+  }
+  printf("Packed %u containers (%u duplicates) with %u distinct parts into %s\n",
+         Writer.GetShaderCount(), Duplicates, Writer.GetPartCount(),
+         OutputFilename.c_str());
+}
+
+bool DxaContext::UnpackArchive() {
+  CComPtr<IDxcBlobEncoding> pSource;
+  MapFileIntoBlob(StringRefUtf16(InputFilename), &pSource);
+  hlsl::DxilArchiveReader Reader;
+  IFTMSG(Reader.Load(pSource->GetBufferPointer(), pSource->GetBufferSize()),
+         "input is not a container archive");
+
+  auto WriteContainer = [&](uint32_t Index, const std::string &FileName) {
+    CComPtr<hlsl::AbstractMemoryStream> pStream;
+    IFT(hlsl::CreateMemoryStream(hlsl::GetGlobalHeapMalloc(), &pStream));
+    Reader.UnpackContainer(Index, pStream);
+    hlsl::WriteBinaryFile(StringRefUtf16(FileName), pStream->GetPtr(),
+                          pStream->GetPtrSize());
+  };
+
+  if (!UnpackHash.empty()) {
+    uint8_t Digest[hlsl::DxilContainerHashSize];
+    uint32_t Index;
+    IFTMSG(HexToDigest(UnpackHash, Digest) ? S_OK : E_INVALIDARG,
+           "-hash must be 32 hexadecimal digits");
+    if (!Reader.FindShader(Digest, &Index)) {
+      // Not a container digest; try the shader hash, which containers with
+      // the same program share.
+      std::vector<uint32_t> Indices;
+      Reader.FindShadersByHash(Digest, Indices);
+      if (Indices.empty()) {
+        printf("No container with digest %s\n", UnpackHash.c_str());
+        return false;
+      }
+      if (Indices.size() > 1) {
+        printf("%u containers have shader hash %s:\n",
+               (unsigned)Indices.size(), UnpackHash.c_str());
+        for (uint32_t i : Indices) {
+          const hlsl::DxilArchiveShader &Shader = Reader.GetShader(i);
+          printf("  %s\n", DigestToHex(Shader.ContainerDigest.Digest).c_str());
+        }
+        return false;
+      }
+      Index = Indices[0];
+    }
+    std::string FileName = OutputFilename.empty() ? UnpackHash + ".dxbc"
+                                                  : OutputFilename.getValue();
+    WriteContainer(Index, FileName);
+    printf("%u bytes written to %s\n", Reader.GetContainerSize(Index),
+           FileName.c_str());
+    return true;
+  }
 
-    printf("#%u - %s (%u bytes)\n", i, kindText, (unsigned)partContent->GetBufferSize());
+  std::string Directory =
+      OutputFilename.empty() ? "." : OutputFilename.getValue();
+  for (uint32_t i = 0; i < Reader.GetShaderCount(); ++i) {
+    const hlsl::DxilArchiveShader &Shader = Reader.GetShader(i);
+    WriteContainer(i, Directory + "/" +
+                          DigestToHex(Shader.ContainerDigest.Digest) + ".dxbc");
   }
+  printf("%u containers written to %s\n", Reader.GetShaderCount(),
+         Directory.c_str());
+  return true;
 }
 
 using namespace hlsl::options;
 
 int __cdecl main(int argc, _In_reads_z_(argc) char **argv) {
   const char *pStage = "Operation";
+  if (llvm::sys::fs::SetupPerThreadFileSystem())
+    return 1;
+  llvm::sys::fs::AutoCleanupPerThreadFileSystem auto_cleanup_fs;
   try {
+    llvm::sys::fs::MSFileSystem *msfPtr;
+    IFT(CreateMSFileSystemForDisk(&msfPtr));
+    std::unique_ptr<::llvm::sys::fs::MSFileSystem> msf(msfPtr);
+
+    ::llvm::sys::fs::AutoPerThreadSystem pts(msf.get());
+    IFTLLVM(pts.error_code());
+
     pStage = "Argument processing";
 
     // Parse command line options.
     cl::ParseCommandLineOptions(argc, argv, "dxil assembly\n");
+    if (!Pack && !MoreInputFilenames.empty()) {
+      printf("Only -pack takes more than one input file.\n");
+      return 1;
+    }
     DxcDllSupport dxcSupport;
 
     // Read options and check errors.
@@ -379,6 +549,16 @@ int __cdecl main(int argc, _In_reads_z_(argc) char **argv) {
         return 1;
       }
     }
+    else if (Pack) {
+      pStage = "Packing";
+      context.PackArchive();
+    }
+    else if (Unpack) {
+      pStage = "Unpacking";
+      if (!context.UnpackArchive()) {
+        return 1;
+      }
+    }
     else {
       pStage = "Assembling";
       context.Assemble();
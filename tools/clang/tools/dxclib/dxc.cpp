@@ -262,6 +262,18 @@ static void WriteDxcExtraOuputs(IDxcResult *pResult) {
   }
 }
 
+static void WriteDxcTimeReport(IDxcOperationResult *pCompileResult) {
+  CComPtr<IDxcResult> pResult;
+  if (FAILED(pCompileResult->QueryInterface(&pResult)) ||
+      !pResult->HasOutput(DXC_OUT_TIME_REPORT)) {
+    return;
+  }
+
+  CComPtr<IDxcBlob> pReport;
+  IFT(pResult->GetOutput(DXC_OUT_TIME_REPORT, IID_PPV_ARGS(&pReport), nullptr));
+  WriteBlobToConsole(pReport, STD_ERROR_HANDLE);
+}
+
 // This function is called either after the compilation is done or /dumpbin option is provided
 // Performing options that are used to process dxil container.
 int DxcContext::ActOnBlob(IDxcBlob *pBlob) {
@@ -889,6 +901,7 @@ int DxcContext::Compile() {
   else {
     WriteOperationErrorsToConsole(pCompileResult, m_Opts.OutputWarnings);
   }
+  WriteDxcTimeReport(pCompileResult);
 
   HRESULT status;
   IFT(pCompileResult->GetStatus(&status));
@@ -913,7 +926,7 @@ int DxcContext::Compile() {
 
 int DxcContext::DumpBinary() {
   CComPtr<IDxcBlobEncoding> pSource;
-  ReadFileIntoBlob(m_dxcSupport, StringRefUtf16(m_Opts.InputFile), &pSource);
+  MapFileIntoBlob(StringRefUtf16(m_Opts.InputFile), &pSource);
   return ActOnBlob(pSource.p);
 }
 
@@ -0,0 +1,350 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// dxccompilecache.cpp                                                       //
+// Copyright (C) Microsoft Corporation. All rights reserved.                 //
+// This file is distributed under the University of Illinois Open Source     //
+// License. See LICENSE.TXT for details.                                     //
+//                                                                           //
+// Content-addressed cache of compile results for dxcompiler.                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "dxccompilecache.h"
+#include "dxc/Support/Global.h"
+#include "dxc/Support/WinIncludes.h"
+#include "dxc/Support/FileIOHelper.h"
+#include "dxc/Support/dxcapi.impl.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Process.h"
+#include <cstdio>
+
+using namespace llvm;
+using namespace hlsl;
+
+namespace {
+
+// Serialized entry layout, shared by the memory and disk tiers:
+//   EntryHeader, then per output an OutputHeader followed by the UTF-8 name
+//   and the output data.
+static const UINT32 kEntryMagic = 0x43435844; // 'DXCC'
+static const UINT32 kEntryVersion = 1;
+
+struct EntryHeader {
+  UINT32 Magic;
+  UINT32 Version;
+  UINT32 TotalSize;
+  UINT32 PrimaryKind;
+  UINT32 OutputCount;
+  char Key[32];
+};
+
+struct OutputHeader {
+  UINT32 Kind;
+  UINT32 EncodingKnown;
+  UINT32 Encoding;
+  UINT32 NameSize;
+  UINT32 DataSize;
+};
+
+template <typename T>
+static void AppendPod(std::string &Data, const T &Value) {
+  Data.append(reinterpret_cast<const char *>(&Value), sizeof(Value));
+}
+
+// Returns false if the result holds anything that can't be round-tripped.
+static bool SerializeResult(const dxcutil::DxcCompileCache::Key &key,
+                            IDxcResult *pResult, std::string &Data) {
+  EntryHeader Header = {};
+  Header.Magic = kEntryMagic;
+  Header.Version = kEntryVersion;
+  Header.PrimaryKind = pResult->PrimaryOutput();
+  DXASSERT_NOMSG(key.size() == sizeof(Header.Key));
+  memcpy(Header.Key, key.data(), sizeof(Header.Key));
+  Data.clear();
+  AppendPod(Data, Header);
+
+  for (unsigned i = DXC_OUT_NONE + 1; i <= kNumDxcOutputTypes; ++i) {
+    DXC_OUT_KIND kind = (DXC_OUT_KIND)i;
+    if (!pResult->HasOutput(kind))
+      continue;
+    if (DxcGetOutputType(kind) == DxcOutputType_None)
+      return false;
+    CComPtr<IDxcBlob> pBlob;
+    CComPtr<IDxcBlobUtf16> pName;
+    if (FAILED(pResult->GetOutput(kind, IID_PPV_ARGS(&pBlob), &pName)) || !pBlob)
+      return false;
+
+    OutputHeader Output = {};
+    Output.Kind = kind;
+    CComPtr<IDxcBlobEncoding> pEncoding;
+    if (SUCCEEDED(pBlob.QueryInterface(&pEncoding))) {
+      BOOL known = FALSE;
+      IFT(pEncoding->GetEncoding(&known, &Output.Encoding));
+      Output.EncodingKnown = known ? 1 : 0;
+    }
+    std::string Name;
+    if (pName)
+      Name = CW2A(pName->GetStringPointer(), CP_UTF8).m_psz;
+    Output.NameSize = Name.size();
+    Output.DataSize = pBlob->GetBufferSize();
+    AppendPod(Data, Output);
+    Data.append(Name);
+    Data.append((const char *)pBlob->GetBufferPointer(), pBlob->GetBufferSize());
+    ++Header.OutputCount;
+  }
+
+  Header.TotalSize = Data.size();
+  memcpy(&Data[0], &Header, sizeof(Header));
+  return true;
+}
+
+// Returns false if the data is truncated or belongs to another key.
+static bool DeserializeResult(const dxcutil::DxcCompileCache::Key &key,
+                              StringRef Data, UINT32 textEncoding,
+                              IDxcResult **ppResult) {
+  EntryHeader Header;
+  if (Data.size() < sizeof(Header))
+    return false;
+  memcpy(&Header, Data.data(), sizeof(Header));
+  if (Header.Magic != kEntryMagic || Header.Version != kEntryVersion ||
+      Header.TotalSize != Data.size() ||
+      key.compare(0, key.size(), Header.Key, sizeof(Header.Key)) != 0)
+    return false;
+  Data = Data.drop_front(sizeof(Header));
+
+  CComPtr<DxcResult> pResult = DxcResult::Alloc(DxcGetThreadMallocNoRef());
+  IFTBOOL(pResult, E_OUTOFMEMORY);
+  IFT(pResult->SetEncoding(textEncoding));
+  for (UINT32 i = 0; i < Header.OutputCount; ++i) {
+    OutputHeader Output;
+    if (Data.size() < sizeof(Output))
+      return false;
+    memcpy(&Output, Data.data(), sizeof(Output));
+    Data = Data.drop_front(sizeof(Output));
+    if ((UINT64)Data.size() < (UINT64)Output.NameSize + Output.DataSize)
+      return false;
+    std::string Name = Data.substr(0, Output.NameSize);
+    StringRef Bytes = Data.substr(Output.NameSize, Output.DataSize);
+    Data = Data.drop_front(Output.NameSize + Output.DataSize);
+
+    CComPtr<IDxcBlobEncoding> pBlob;
+    IFT(DxcCreateBlob(Bytes.data(), Bytes.size(), false, true,
+                      Output.EncodingKnown != 0, Output.Encoding,
+                      DxcGetThreadMallocNoRef(), &pBlob));
+    DxcOutputObject Object;
+    Object.kind = (DXC_OUT_KIND)Output.Kind;
+    IFT(Object.SetObject(pBlob, textEncoding));
+    if (!Name.empty())
+      IFT(Object.SetName(Name.c_str()));
+    IFT(pResult->SetOutput(Object));
+  }
+  IFT(pResult->SetStatusAndPrimaryResult(S_OK, (DXC_OUT_KIND)Header.PrimaryKind));
+  *ppResult = pResult.Detach();
+  return true;
+}
+
+static bool ReadEntryFile(const std::wstring &Path, std::string &Data) {
+  void *pData = nullptr;
+  DWORD dataSize = 0;
+  try {
+    ReadBinaryFile(GetGlobalHeapMalloc(), Path.c_str(), &pData, &dataSize);
+  } catch (...) {
+    return false;
+  }
+  Data.assign((const char *)pData, dataSize);
+  GetGlobalHeapMalloc()->Free(pData);
+  return true;
+}
+
+static void DeleteEntryFile(const std::wstring &Path) {
+#ifdef _WIN32
+  DeleteFileW(Path.c_str());
+#else
+  std::remove(CW2A(Path.c_str(), CP_UTF8));
+#endif
+}
+
+// The entry is written next to its final name and renamed into place, so
+// another process sharing the directory reads either no entry or all of it.
+static bool WriteEntryFile(const std::wstring &Path, StringRef Data) {
+  std::wstring TempPath =
+      Path + L"." + std::to_wstring(sys::Process::GetRandomNumber()) + L".tmp";
+  try {
+    WriteBinaryFile(TempPath.c_str(), Data.data(), Data.size());
+  } catch (...) {
+    DeleteEntryFile(TempPath);
+    return false;
+  }
+#ifdef _WIN32
+  if (!MoveFileExW(TempPath.c_str(), Path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+  if (std::rename(CW2A(TempPath.c_str(), CP_UTF8),
+                  CW2A(Path.c_str(), CP_UTF8)) != 0) {
+#endif
+    DeleteEntryFile(TempPath);
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+namespace dxcutil {
+
+DxcCompileCache::Key DxcCompileCache::ComputeKey(ArrayRef<StringRef> Parts) {
+  MD5 Hash;
+  for (StringRef Part : Parts) {
+    uint64_t Size = Part.size();
+    Hash.update(ArrayRef<uint8_t>((const uint8_t *)&Size, sizeof(Size)));
+    Hash.update(Part);
+  }
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Str;
+  MD5::stringifyResult(Result, Str);
+  return Str.str();
+}
+
+void DxcCompileCache::Configure(LPCWSTR pDirectory, UINT64 maxMemoryBytes,
+                                UINT64 maxDiskBytes) {
+  sys::ScopedLock Lock(m_mutex);
+  m_directory = pDirectory ? pDirectory : L"";
+  if (!m_directory.empty() && m_directory.back() != L'/' &&
+      m_directory.back() != L'\\')
+    m_directory += L'/';
+  m_maxMemoryBytes = maxMemoryBytes;
+  m_maxDiskBytes = m_directory.empty() ? 0 : maxDiskBytes;
+  m_diskEntries.clear();
+  m_diskLRU.clear();
+  m_diskBytes = 0;
+  EvictMemoryEntries();
+}
+
+bool DxcCompileCache::IsEnabled() {
+  sys::ScopedLock Lock(m_mutex);
+  return m_maxMemoryBytes != 0 || m_maxDiskBytes != 0;
+}
+
+HRESULT DxcCompileCache::Lookup(const Key &key, UINT32 textEncoding,
+                                IDxcResult **ppResult) {
+  *ppResult = nullptr;
+  sys::ScopedLock Lock(m_mutex);
+
+  auto it = m_memoryEntries.find(key);
+  if (it != m_memoryEntries.end()) {
+    m_memoryLRU.splice(m_memoryLRU.begin(), m_memoryLRU, it->second.LRUPos);
+    if (DeserializeResult(key, it->second.Data, textEncoding, ppResult)) {
+      ++m_stats.Hits;
+      return S_OK;
+    }
+  }
+
+  if (m_maxDiskBytes != 0) {
+    std::string Data;
+    if (ReadEntryFile(GetEntryPath(key), Data) &&
+        DeserializeResult(key, Data, textEncoding, ppResult)) {
+      ++m_stats.Hits;
+      ++m_stats.DiskHits;
+      // Entries left by earlier processes are only counted once they are
+      // read, so the directory is trimmed here as well as on store.
+      TouchDiskEntry(key, Data.size());
+      EvictDiskEntries();
+      InsertMemoryEntry(key, std::move(Data));
+      return S_OK;
+    }
+  }
+
+  ++m_stats.Misses;
+  return S_FALSE;
+}
+
+void DxcCompileCache::Store(const Key &key, IDxcResult *pResult) {
+  std::string Data;
+  if (!SerializeResult(key, pResult, Data))
+    return;
+
+  sys::ScopedLock Lock(m_mutex);
+  if (m_maxDiskBytes != 0 && Data.size() <= m_maxDiskBytes &&
+      WriteEntryFile(GetEntryPath(key), Data)) {
+    TouchDiskEntry(key, Data.size());
+    EvictDiskEntries();
+  }
+  InsertMemoryEntry(key, std::move(Data));
+}
+
+void DxcCompileCache::GetStatistics(DxcCompileCacheStatistics *pStats) {
+  sys::ScopedLock Lock(m_mutex);
+  *pStats = m_stats;
+  pStats->EntryCount = m_memoryEntries.size();
+  pStats->MemoryBytes = m_memoryBytes;
+}
+
+void DxcCompileCache::Clear() {
+  sys::ScopedLock Lock(m_mutex);
+  m_memoryEntries.clear();
+  m_memoryLRU.clear();
+  m_memoryBytes = 0;
+  m_stats = DxcCompileCacheStatistics();
+}
+
+std::wstring DxcCompileCache::GetEntryPath(const Key &key) const {
+  std::wstring Path = m_directory;
+  Path.append(key.begin(), key.end());
+  Path += L".dxcc";
+  return Path;
+}
+
+void DxcCompileCache::InsertMemoryEntry(const Key &key, std::string &&Data) {
+  if (Data.size() > m_maxMemoryBytes)
+    return;
+  auto it = m_memoryEntries.find(key);
+  if (it != m_memoryEntries.end()) {
+    m_memoryBytes -= it->second.Data.size();
+    m_memoryLRU.erase(it->second.LRUPos);
+    m_memoryEntries.erase(it);
+  }
+  m_memoryBytes += Data.size();
+  m_memoryLRU.push_front(key);
+  MemoryEntry &Entry = m_memoryEntries[key];
+  Entry.Data = std::move(Data);
+  Entry.LRUPos = m_memoryLRU.begin();
+  EvictMemoryEntries();
+}
+
+void DxcCompileCache::TouchDiskEntry(const Key &key, UINT64 size) {
+  auto it = m_diskEntries.find(key);
+  if (it != m_diskEntries.end()) {
+    m_diskBytes -= it->second.Size;
+    m_diskLRU.erase(it->second.LRUPos);
+    m_diskEntries.erase(it);
+  }
+  m_diskBytes += size;
+  m_diskLRU.push_front(key);
+  DiskEntry &Entry = m_diskEntries[key];
+  Entry.Size = size;
+  Entry.LRUPos = m_diskLRU.begin();
+}
+
+void DxcCompileCache::EvictMemoryEntries() {
+  while (m_memoryBytes > m_maxMemoryBytes && !m_memoryLRU.empty()) {
+    auto it = m_memoryEntries.find(m_memoryLRU.back());
+    m_memoryBytes -= it->second.Data.size();
+    m_memoryEntries.erase(it);
+    m_memoryLRU.pop_back();
+    ++m_stats.Evictions;
+  }
+}
+
+void DxcCompileCache::EvictDiskEntries() {
+  while (m_diskBytes > m_maxDiskBytes && !m_diskLRU.empty()) {
+    auto it = m_diskEntries.find(m_diskLRU.back());
+    DeleteEntryFile(GetEntryPath(it->first));
+    m_diskBytes -= it->second.Size;
+    m_diskEntries.erase(it);
+    m_diskLRU.pop_back();
+    ++m_stats.Evictions;
+  }
+}
+
+} // namespace dxcutil
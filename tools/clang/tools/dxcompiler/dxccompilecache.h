@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// dxccompilecache.h                                                         //
+// Copyright (C) Microsoft Corporation. All rights reserved.                 //
+// This file is distributed under the University of Illinois Open Source     //
+// License. See LICENSE.TXT for details.                                     //
+//                                                                           //
+// Content-addressed cache of compile results for dxcompiler.                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "dxc/dxcapi.h"
+#include "dxc/Support/microcom.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Mutex.h"
+#include <list>
+#include <map>
+#include <string>
+
+namespace dxcutil {
+
+// Caches the outputs of successful compiles, keyed on a digest computed by
+// the caller from everything that can influence them.  Entries live in an
+// LRU list bounded by size in memory and are optionally persisted to a
+// directory, which is bounded by the size of the files this process knows
+// about.
+class DxcCompileCache {
+public:
+  typedef std::string Key; // Hex digest
+
+  // Hashes the given parts, separated so that concatenations don't collide.
+  static Key ComputeKey(llvm::ArrayRef<llvm::StringRef> Parts);
+
+  void Configure(_In_opt_z_ LPCWSTR pDirectory, UINT64 maxMemoryBytes,
+                 UINT64 maxDiskBytes);
+  bool IsEnabled();
+
+  // Returns S_OK and a new result on a hit, S_FALSE on a miss.
+  HRESULT Lookup(const Key &key, UINT32 textEncoding,
+                 _COM_Outptr_result_maybenull_ IDxcResult **ppResult);
+  // Records the outputs of a successful compile.
+  void Store(const Key &key, _In_ IDxcResult *pResult);
+
+  void GetStatistics(_Out_ DxcCompileCacheStatistics *pStats);
+  void Clear();
+
+private:
+  struct MemoryEntry {
+    std::string Data;
+    std::list<Key>::iterator LRUPos;
+  };
+  struct DiskEntry {
+    UINT64 Size;
+    std::list<Key>::iterator LRUPos;
+  };
+
+  std::wstring GetEntryPath(const Key &key) const;
+  void InsertMemoryEntry(const Key &key, std::string &&Data);
+  void TouchDiskEntry(const Key &key, UINT64 size);
+  void EvictMemoryEntries();
+  void EvictDiskEntries();
+
+  llvm::sys::Mutex m_mutex;
+  std::wstring m_directory;
+  UINT64 m_maxMemoryBytes = 0;
+  UINT64 m_maxDiskBytes = 0;
+  UINT64 m_memoryBytes = 0;
+  UINT64 m_diskBytes = 0;
+  std::map<Key, MemoryEntry> m_memoryEntries;
+  std::list<Key> m_memoryLRU; // Most recently used first
+  std::map<Key, DiskEntry> m_diskEntries;
+  std::list<Key> m_diskLRU;   // Most recently used first
+  DxcCompileCacheStatistics m_stats = {};
+};
+
+} // namespace dxcutil
@@ -0,0 +1,318 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// dxccompileprofile.cpp                                                     //
+// Copyright (C) Microsoft Corporation. All rights reserved.                 //
+// This file is distributed under the University of Illinois Open Source     //
+// License. See LICENSE.TXT for details.                                     //
+//                                                                           //
+// Per-compile timing and allocation profile for dxcompiler.                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#include "dxccompileprofile.h"
+#include "dxc/Support/microcom.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+
+using namespace llvm;
+
+namespace dxcutil {
+
+// Forwards to an inner allocator, keeping the size of every live allocation
+// made through it so that the bytes in use and their peak can be tracked.
+class DxcTrackingMalloc : public IMalloc {
+private:
+  DXC_MICROCOM_TM_REF_FIELDS()
+
+  // The size table allocates from the inner allocator directly, since this
+  // one may be the thread allocator that operator new goes through.
+  template <typename T> struct InnerAllocator {
+    typedef T value_type;
+    IMalloc *pMalloc;
+    explicit InnerAllocator(IMalloc *pMalloc) : pMalloc(pMalloc) {}
+    template <typename U>
+    InnerAllocator(const InnerAllocator<U> &Other) : pMalloc(Other.pMalloc) {}
+    T *allocate(size_t n) {
+      void *P = pMalloc->Alloc(n * sizeof(T));
+      if (P == nullptr)
+        throw std::bad_alloc();
+      return (T *)P;
+    }
+    void deallocate(T *P, size_t) { pMalloc->Free(P); }
+    template <typename U> bool operator==(const InnerAllocator<U> &Other) const {
+      return pMalloc == Other.pMalloc;
+    }
+    template <typename U> bool operator!=(const InnerAllocator<U> &Other) const {
+      return pMalloc != Other.pMalloc;
+    }
+  };
+  typedef std::pair<void *const, SIZE_T> SizeEntry;
+  typedef std::unordered_map<void *, SIZE_T, std::hash<void *>,
+                             std::equal_to<void *>, InnerAllocator<SizeEntry>>
+      SizeMap;
+
+  sys::Mutex m_mutex;
+  SizeMap m_sizes;
+  int64_t m_currentBytes = 0;
+  int64_t m_peakBytes = 0;
+  std::atomic<bool> m_tracking;
+
+  // Callers hold m_mutex.
+  void Track(void *pv, SIZE_T cb) {
+    // Tracking may have stopped since the caller checked.
+    if (!m_tracking)
+      return;
+    // An address still in the table was freed without going through here,
+    // such as by operator delete once the compile's allocator was restored.
+    SIZE_T &size = m_sizes[pv];
+    m_currentBytes += (int64_t)cb - (int64_t)size;
+    size = cb;
+    m_peakBytes = std::max(m_peakBytes, m_currentBytes);
+  }
+  void Untrack(void *pv) {
+    // Memory allocated before profiling started isn't in the table.
+    auto it = m_sizes.find(pv);
+    if (it == m_sizes.end())
+      return;
+    m_currentBytes -= it->second;
+    m_sizes.erase(it);
+  }
+
+public:
+  DXC_MICROCOM_TM_ADDREF_RELEASE_IMPL()
+
+  DxcTrackingMalloc(IMalloc *pMalloc)
+      : m_dwRef(0), m_pMalloc(pMalloc),
+        m_sizes(0, std::hash<void *>(), std::equal_to<void *>(),
+                InnerAllocator<SizeEntry>(pMalloc)),
+        m_tracking(true) {}
+
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void **ppvObject) override {
+    return DoBasicQueryInterface<IMalloc>(this, iid, ppvObject);
+  }
+
+  void *STDMETHODCALLTYPE Alloc(_In_ SIZE_T cb) override {
+    void *P = m_pMalloc->Alloc(cb);
+    if (P && m_tracking) {
+      sys::ScopedLock Lock(m_mutex);
+      Track(P, cb);
+    }
+    return P;
+  }
+
+  void *STDMETHODCALLTYPE Realloc(_In_opt_ void *pv, _In_ SIZE_T cb) override {
+    void *P = m_pMalloc->Realloc(pv, cb);
+    // A failed reallocation leaves pv alone, unless it was freed by cb == 0.
+    if ((P || cb == 0) && m_tracking) {
+      sys::ScopedLock Lock(m_mutex);
+      if (pv)
+        Untrack(pv);
+      if (P)
+        Track(P, cb);
+    }
+    return P;
+  }
+
+  void STDMETHODCALLTYPE Free(_In_opt_ void *pv) override {
+    if (pv && m_tracking) {
+      // Untrack first, as the address may be reused as soon as it's freed.
+      sys::ScopedLock Lock(m_mutex);
+      Untrack(pv);
+    }
+    m_pMalloc->Free(pv);
+  }
+
+#ifdef _WIN32
+  SIZE_T STDMETHODCALLTYPE GetSize(_In_opt_ void *pv) override {
+    return m_pMalloc->GetSize(pv);
+  }
+  int STDMETHODCALLTYPE DidAlloc(_In_opt_ void *pv) override {
+    return m_pMalloc->DidAlloc(pv);
+  }
+  void STDMETHODCALLTYPE HeapMinimize(void) override {
+    m_pMalloc->HeapMinimize();
+  }
+#endif
+
+  // Forwards to the inner allocator from now on, for the blobs that outlive
+  // the compile.
+  void StopTracking() {
+    sys::ScopedLock Lock(m_mutex);
+    m_tracking = false;
+    SizeMap(0, std::hash<void *>(), std::equal_to<void *>(),
+            m_sizes.get_allocator())
+        .swap(m_sizes);
+  }
+
+  // Starts a nested peak; returns the bytes in use and the enclosing peak.
+  void BeginPeak(int64_t &currentBytes, int64_t &outerPeakBytes) {
+    sys::ScopedLock Lock(m_mutex);
+    currentBytes = m_currentBytes;
+    outerPeakBytes = m_peakBytes;
+    m_peakBytes = m_currentBytes;
+  }
+  // Ends a nested peak; returns its highest bytes in use.
+  int64_t EndPeak(int64_t outerPeakBytes) {
+    sys::ScopedLock Lock(m_mutex);
+    int64_t peakBytes = m_peakBytes;
+    m_peakBytes = std::max(outerPeakBytes, m_peakBytes);
+    return peakBytes;
+  }
+};
+
+DxcCompileProfile::DxcCompileProfile(IMalloc *pMalloc) : m_nodes(1) {
+#ifdef _WIN32
+  m_pMalloc = CreateOnMalloc<DxcTrackingMalloc>(pMalloc);
+  if (m_pMalloc == nullptr)
+    throw std::bad_alloc();
+#endif
+}
+
+DxcCompileProfile::DxcCompileProfile() : m_nodes(1) {}
+
+DxcCompileProfile::~DxcCompileProfile() {
+  if (m_pMalloc)
+    m_pMalloc->StopTracking();
+}
+
+IMalloc *DxcCompileProfile::GetMalloc() { return m_pMalloc; }
+
+unsigned DxcCompileProfile::GetChild(unsigned ParentIndex, StringRef Name) {
+  for (unsigned ChildIndex : m_nodes[ParentIndex].Children)
+    if (m_nodes[ChildIndex].Name == Name)
+      return ChildIndex;
+  unsigned NodeIndex = m_nodes.size();
+  m_nodes.emplace_back();
+  m_nodes.back().Name = Name;
+  m_nodes[ParentIndex].Children.push_back(NodeIndex);
+  return NodeIndex;
+}
+
+void DxcCompileProfile::regionStarted(StringRef Name) {
+  OpenRegion Region;
+  Region.NodeIndex =
+      GetChild(m_open.empty() ? 0 : m_open.back().NodeIndex, Name);
+  if (m_pMalloc)
+    m_pMalloc->BeginPeak(Region.StartBytes, Region.OuterPeakBytes);
+  Region.StartSeconds = TimeRecord::getCurrentTime(true).getWallTime();
+  m_open.push_back(Region);
+}
+
+void DxcCompileProfile::regionFinished() {
+  DXASSERT(!m_open.empty(), "else region finished without being started");
+  double EndSeconds = TimeRecord::getCurrentTime(false).getWallTime();
+  const OpenRegion &Region = m_open.back();
+  Node &N = m_nodes[Region.NodeIndex];
+  N.Calls++;
+  N.WallSeconds += EndSeconds - Region.StartSeconds;
+  if (m_pMalloc) {
+    int64_t PeakBytes = m_pMalloc->EndPeak(Region.OuterPeakBytes);
+    N.PeakBytes = std::max(N.PeakBytes, PeakBytes - Region.StartBytes);
+  }
+  m_open.pop_back();
+}
+
+void DxcCompileProfile::regionCount(StringRef Counter, int64_t Delta) {
+  // Counts outside of any region have nowhere to go.
+  if (m_open.empty())
+    return;
+  Node &N = m_nodes[m_open.back().NodeIndex];
+  for (auto &Count : N.Counts) {
+    if (Count.first == Counter) {
+      Count.second += Delta;
+      return;
+    }
+  }
+  N.Counts.emplace_back(Counter, Delta);
+}
+
+std::unique_ptr<TimingListener> DxcCompileProfile::createThreadListener() {
+  if (m_open.empty())
+    return nullptr;
+  return std::unique_ptr<TimingListener>(new DxcCompileProfile());
+}
+
+void DxcCompileProfile::mergeThreadListener(TimingListener &L) {
+  // Only listeners from createThreadListener come back here.
+  const DxcCompileProfile &Other = static_cast<const DxcCompileProfile &>(L);
+  DXASSERT(!m_open.empty() && Other.m_open.empty(),
+           "else thread listener merged outside of the region it was for");
+  for (unsigned OtherIndex : Other.m_nodes[0].Children)
+    MergeNode(GetChild(m_open.back().NodeIndex, Other.m_nodes[OtherIndex].Name),
+              Other, OtherIndex);
+}
+
+void DxcCompileProfile::MergeNode(unsigned NodeIndex,
+                                  const DxcCompileProfile &Other,
+                                  unsigned OtherIndex) {
+  const Node &O = Other.m_nodes[OtherIndex];
+  {
+    Node &N = m_nodes[NodeIndex];
+    N.Calls += O.Calls;
+    N.WallSeconds += O.WallSeconds;
+    N.PeakBytes = std::max(N.PeakBytes, O.PeakBytes);
+    for (const auto &OtherCount : O.Counts) {
+      auto It = std::find_if(N.Counts.begin(), N.Counts.end(),
+                             [&](const std::pair<std::string, int64_t> &C) {
+                               return C.first == OtherCount.first;
+                             });
+      if (It == N.Counts.end())
+        N.Counts.push_back(OtherCount);
+      else
+        It->second += OtherCount.second;
+    }
+  }
+  // GetChild may grow m_nodes, so N isn't used past this point.
+  for (unsigned OtherChild : O.Children)
+    MergeNode(GetChild(NodeIndex, Other.m_nodes[OtherChild].Name), Other,
+              OtherChild);
+}
+
+void DxcCompileProfile::WriteReport(raw_ostream &OS) const {
+  if (!m_pMalloc)
+    OS << "; peak allocation isn't available on this platform\n";
+  OS << "; calls    wall (ms)    peak (KB)  region\n";
+  for (unsigned ChildIndex : m_nodes[0].Children)
+    WriteNode(OS, ChildIndex, 0);
+}
+
+void DxcCompileProfile::WriteNode(raw_ostream &OS, unsigned NodeIndex,
+                                  unsigned Depth) const {
+  const Node &N = m_nodes[NodeIndex];
+  OS << format("%7u %12.3f ", N.Calls, N.WallSeconds * 1000.0);
+  // Regions timed on other threads don't have a peak of their own.
+  if (N.PeakBytes < 0)
+    OS.indent(11) << "-  ";
+  else
+    OS << format("%12lld  ", (long long)(N.PeakBytes / 1024));
+  OS.indent(Depth * 2) << N.Name;
+  for (const auto &Count : N.Counts)
+    OS << "  " << Count.first << ": " << Count.second;
+  OS << '\n';
+  for (unsigned ChildIndex : N.Children)
+    WriteNode(OS, ChildIndex, Depth + 1);
+}
+
+DxcCompileProfileScope::DxcCompileProfileScope(DxcCompileProfile *pProfile,
+                                               StringRef Name)
+    : m_pProfile(pProfile), m_pPriorListener(nullptr) {
+  if (m_pProfile == nullptr)
+    return;
+  if (IMalloc *pMalloc = m_pProfile->GetMalloc())
+    m_pThreadMalloc.reset(new DxcThreadMalloc(pMalloc));
+  m_pPriorListener = setThreadTimingListener(m_pProfile);
+  m_pProfile->regionStarted(Name);
+}
+
+DxcCompileProfileScope::~DxcCompileProfileScope() {
+  if (m_pProfile == nullptr)
+    return;
+  m_pProfile->regionFinished();
+  setThreadTimingListener(m_pPriorListener);
+}
+
+} // namespace dxcutil
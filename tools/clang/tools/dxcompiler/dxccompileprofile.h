@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// dxccompileprofile.h                                                       //
+// Copyright (C) Microsoft Corporation. All rights reserved.                 //
+// This file is distributed under the University of Illinois Open Source     //
+// License. See LICENSE.TXT for details.                                     //
+//                                                                           //
+// Per-compile timing and allocation profile for dxcompiler.                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "dxc/Support/Global.h"
+#include "dxc/Support/WinIncludes.h"
+#include "llvm/Support/Timer.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+}
+
+namespace dxcutil {
+
+class DxcTrackingMalloc;
+
+// Collects the wall time and peak allocation of the regions timed on a thread
+// while a compile runs: the compile phases and every pass run by the pass
+// managers.  Regions with the same name under the same parent are merged, so
+// a function pass shows up once with the number of functions it ran on.
+// Peak allocation is only known where operator new goes through the thread
+// allocator, which is on Windows.
+class DxcCompileProfile : public llvm::TimingListener {
+public:
+  explicit DxcCompileProfile(IMalloc *pMalloc);
+  ~DxcCompileProfile() override;
+
+  // Allocator that attributes what it allocates to the open regions, or null
+  // if allocations aren't tracked.  It stops tracking once the profile is
+  // destroyed, but stays usable for the blobs allocated with it.
+  IMalloc *GetMalloc();
+
+  void regionStarted(llvm::StringRef Name) override;
+  void regionFinished() override;
+  void regionCount(llvm::StringRef Counter, int64_t Delta) override;
+  std::unique_ptr<llvm::TimingListener> createThreadListener() override;
+  void mergeThreadListener(llvm::TimingListener &L) override;
+
+  // Writes a line per region, indented by nesting depth and followed by the
+  // region's counts.
+  void WriteReport(llvm::raw_ostream &OS) const;
+
+private:
+  struct Node {
+    std::string Name;
+    unsigned Calls = 0;
+    double WallSeconds = 0;
+    // Above the bytes live when the region started, or -1 if not measured.
+    int64_t PeakBytes = -1;
+    std::vector<unsigned> Children;
+    std::vector<std::pair<std::string, int64_t>> Counts; // In first-seen order
+  };
+  struct OpenRegion {
+    unsigned NodeIndex;
+    double StartSeconds;
+    int64_t StartBytes;
+    int64_t OuterPeakBytes;
+  };
+
+  // Profile of another thread's regions.  Allocations are tracked across all
+  // threads, so only the profile of the compile's thread measures peaks.
+  DxcCompileProfile();
+
+  unsigned GetChild(unsigned ParentIndex, llvm::StringRef Name);
+  void MergeNode(unsigned NodeIndex, const DxcCompileProfile &Other,
+                 unsigned OtherIndex);
+  void WriteNode(llvm::raw_ostream &OS, unsigned NodeIndex,
+                 unsigned Depth) const;
+
+  CComPtr<DxcTrackingMalloc> m_pMalloc;
+  std::vector<Node> m_nodes; // m_nodes[0] is the root
+  std::vector<OpenRegion> m_open;
+};
+
+// Makes a profile the thread's timing listener and allocator, if it has one,
+// and times the scope as a region of it.  Does nothing for a null profile.
+class DxcCompileProfileScope {
+public:
+  DxcCompileProfileScope(DxcCompileProfile *pProfile, llvm::StringRef Name);
+  ~DxcCompileProfileScope();
+
+private:
+  DxcCompileProfile *m_pProfile;
+  llvm::TimingListener *m_pPriorListener;
+  std::unique_ptr<DxcThreadMalloc> m_pThreadMalloc;
+};
+
+} // namespace dxcutil
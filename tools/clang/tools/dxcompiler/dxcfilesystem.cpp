@@ -21,6 +21,8 @@
 #include "dxc/Support/Unicode.h"
 #include "clang/Frontend/CompilerInstance.h"
 
+#include <unordered_map>
+
 #ifndef _WIN32
 #include <sys/stat.h>
 #include <unistd.h>
@@ -71,8 +73,7 @@ namespace {
 enum class HandleKind {
   Special = 0,
   File = 1,
-  FileDir = 2,
-  SearchDir = 3
+  Dir = 2
 };
 enum class SpecialValue {
   Unknown = 0,
@@ -81,30 +82,22 @@ enum class SpecialValue {
   Source = 3,
   Output = 4
 };
+// Handles double as file descriptors, so they must stay positive ints.
 struct HandleBits {
-  unsigned Offset : 8;
-  unsigned Length : 8;
+  unsigned Offset : 27;
   unsigned Kind : 4;
 };
 struct DxcArgsHandle {
   DxcArgsHandle(HANDLE h) : Handle(h) {}
-  DxcArgsHandle(unsigned fileIndex) {
-    Handle = 0;
-    Bits.Offset = fileIndex;
-    Bits.Length = 0;
-    Bits.Kind = (unsigned)HandleKind::File;
-  }
-  DxcArgsHandle(HandleKind HK, unsigned fileIndex, unsigned dirLength) {
+  DxcArgsHandle(HandleKind HK, unsigned index) {
     Handle = 0;
-    Bits.Offset = fileIndex;
-    Bits.Length = dirLength;
+    Bits.Offset = index;
     Bits.Kind = (unsigned)HK;
   }
   DxcArgsHandle(SpecialValue V) {
     Handle = 0;
     Bits.Offset = (unsigned)V;
-    Bits.Length = 0;
-    Bits.Kind = (unsigned)HandleKind::Special;;
+    Bits.Kind = (unsigned)HandleKind::Special;
   }
 
   union {
@@ -115,9 +108,7 @@ struct DxcArgsHandle {
   HandleKind GetKind() const { return (HandleKind)Bits.Kind; }
   bool IsFileKind() const { return GetKind() == HandleKind::File; }
   bool IsSpecialUnknown() const { return Handle == 0; }
-  bool IsDirHandle() const {
-    return GetKind() == HandleKind::FileDir || GetKind() == HandleKind::SearchDir;
-  }
+  bool IsDirHandle() const { return GetKind() == HandleKind::Dir; }
   bool IsStdHandle() const {
     return GetKind() == HandleKind::Special &&
            (GetSpecialValue() == SpecialValue::StdErr ||
@@ -131,7 +122,6 @@ struct DxcArgsHandle {
     DXASSERT_NOMSG(GetKind() == HandleKind::Special);
     return (SpecialValue)Bits.Offset;
   }
-  unsigned Length() const { return Bits.Length; }
 };
 
 static_assert(sizeof(DxcArgsHandle) == sizeof(HANDLE), "else can't transparently typecast");
@@ -141,10 +131,9 @@ const DxcArgsHandle StdOutHandle(SpecialValue::StdOut);
 const DxcArgsHandle StdErrHandle(SpecialValue::StdErr);
 const DxcArgsHandle OutputHandle(SpecialValue::Output);
 
-/// Max number of included files (1:1 to their directories) or search directories.
-/// If programs include more than a handful, DxcArgsFileSystem will need to do better than linear scans.
+/// Max number of included files or directories, bounded by the handle bits.
 /// If this is fired, ERROR_OUT_OF_STRUCTURES will be returned by an attempt to open a file.
-static const size_t MaxIncludedFiles = 1000;
+static const size_t MaxHandleIndex = (1 << 27) - 1;
 
 bool IsAbsoluteOrCurDirRelativeW(LPCWSTR Path) {
   if (!Path || !Path[0]) return FALSE;
@@ -227,7 +216,7 @@ private:
   LPCWSTR m_pOutputStreamName;
   std::wstring m_pAbsOutputStreamName;
   CComPtr<IDxcIncludeHandler> m_includeLoader;
-  std::vector<std::wstring> m_searchEntries;
+  bool m_bSearchEntriesSet;
   bool m_bDisplayIncludeProcess;
 
   // Some constraints of the current design: opening the same file twice
@@ -239,52 +228,54 @@ private:
     IncludedFile(std::wstring &&name, IDxcBlobUtf8 *pBlob, IStream *pStream)
       : Blob(pBlob), BlobStream(pStream), Name(name) { }
   };
-  llvm::SmallVector<IncludedFile, 4> m_includedFiles;
-
-  static bool IsDirOf(LPCWSTR lpDir, size_t dirLen, const std::wstring &fileName) {
-    if (fileName.size() <= dirLen) return false;
-    if (0 != wcsncmp(lpDir, fileName.data(), dirLen)) return false;
-
-    // Prefix matches, c:\\ to c:\\foo.hlsl or ./bar to ./bar/file.hlsl
-    // Ensure there are no additional characters, don't match ./ba if ./bar.hlsl exists
-    if (lpDir[dirLen - 1] == '\\' || lpDir[dirLen - 1] == '/') {
-      // The file name was already terminated in a separator.
-      return true;
+  std::vector<IncludedFile> m_includedFiles;
+  std::unordered_map<std::wstring, unsigned> m_includedFileIndices;
+  // Every directory containing an included file or search entry, spelled
+  // with and without the trailing separator, mapped to its handle index.
+  std::unordered_map<std::wstring, unsigned> m_dirIndices;
+
+  static bool IsSeparator(wchar_t c) { return c == L'\\' || c == L'/'; }
+
+  // Registers the directories above path, and path itself if it's a dir.
+  void AddDirsOf(const std::wstring &path, bool isDir) {
+    for (size_t i = 0, e = path.size(); i < e; ++i) {
+      if (IsSeparator(path[i])) {
+        AddDir(path.substr(0, i));
+        AddDir(path.substr(0, i + 1));
+      }
     }
-
-    return fileName.data()[dirLen] == '\\' || fileName.data()[dirLen] == '/';
+    if (isDir)
+      AddDir(path);
   }
-
-  static bool IsDirPrefixOrSame(LPCWSTR lpDir, size_t dirLen, const std::wstring &path) {
-    if (0 == wcscmp(lpDir, path.c_str())) return true;
-    return IsDirOf(lpDir, dirLen, path);
+  void AddDir(const std::wstring &dir) {
+    if (dir.empty() || m_dirIndices.count(dir))
+      return;
+    if (m_dirIndices.size() == MaxHandleIndex)
+      throw hlsl::Exception(HRESULT_FROM_WIN32(ERROR_OUT_OF_STRUCTURES));
+    unsigned index = m_dirIndices.size();
+    m_dirIndices.emplace(dir, index);
   }
 
   HANDLE TryFindDirHandle(LPCWSTR lpDir) const {
-    size_t dirLen = wcslen(lpDir);
-    for (size_t i = 0; i < m_includedFiles.size(); ++i) {
-      const std::wstring &fileName = m_includedFiles[i].Name;
-      if (IsDirOf(lpDir, dirLen, fileName)) {
-        return DxcArgsHandle(HandleKind::FileDir, i, dirLen).Handle;
-      }
-    }
-    for (size_t i = 0; i < m_searchEntries.size(); ++i) {
-      if (IsDirPrefixOrSame(lpDir, dirLen, m_searchEntries[i])) {
-        return DxcArgsHandle(HandleKind::SearchDir, i, dirLen).Handle;
-      }
-    }
-    return INVALID_HANDLE_VALUE;
+    auto it = m_dirIndices.find(lpDir);
+    if (it == m_dirIndices.end())
+      return INVALID_HANDLE_VALUE;
+    return DxcArgsHandle(HandleKind::Dir, it->second).Handle;
+  }
+  void AddIncludedFile(std::wstring &&name, IDxcBlobUtf8 *pBlob, IStream *pStream) {
+    AddDirsOf(name, /*isDir*/ false);
+    m_includedFileIndices.emplace(name, m_includedFiles.size());
+    m_includedFiles.emplace_back(std::move(name), pBlob, pStream);
   }
   DWORD TryFindOrOpen(LPCWSTR lpFileName, size_t &index) {
-    for (size_t i = 0; i < m_includedFiles.size(); ++i) {
-      if (0 == wcscmp(lpFileName, m_includedFiles[i].Name.data())) {
-        index = i;
-        return ERROR_SUCCESS;
-      }
+    auto it = m_includedFileIndices.find(lpFileName);
+    if (it != m_includedFileIndices.end()) {
+      index = it->second;
+      return ERROR_SUCCESS;
     }
 
     if (m_includeLoader.p != nullptr) {
-      if (m_includedFiles.size() == MaxIncludedFiles) {
+      if (m_includedFiles.size() == MaxHandleIndex) {
         return ERROR_OUT_OF_STRUCTURES;
       }
 
@@ -302,7 +293,11 @@ private:
         if (FAILED(hlsl::CreateReadOnlyBlobStream(fileBlobUtf8, &fileStream))) {
           return ERROR_UNHANDLED_EXCEPTION;
         }
-        m_includedFiles.emplace_back(std::wstring(lpFileName), fileBlobUtf8, fileStream);
+        try {
+          AddIncludedFile(std::wstring(lpFileName), fileBlobUtf8, fileStream);
+        } catch (...) {
+          return ERROR_OUT_OF_STRUCTURES;
+        }
         index = m_includedFiles.size() - 1;
 
         if (m_bDisplayIncludeProcess) {
@@ -322,7 +317,7 @@ private:
     return ERROR_NOT_FOUND;
   }
   static HANDLE IncludedFileIndexToHandle(size_t index) {
-    return DxcArgsHandle(index).Handle;
+    return DxcArgsHandle(HandleKind::File, index).Handle;
   }
   bool IsKnownHandle(HANDLE h) const {
     return !DxcArgsHandle(h).IsSpecialUnknown();
@@ -336,10 +331,11 @@ private:
 public:
   DxcArgsFileSystemImpl(_In_ IDxcBlobUtf8 *pSource, LPCWSTR pSourceName, _In_opt_ IDxcIncludeHandler* pHandler)
       : m_pSource(pSource), m_pSourceName(pSourceName), m_pOutputStreamName(nullptr),
-        m_includeLoader(pHandler), m_bDisplayIncludeProcess(false) {
+        m_includeLoader(pHandler), m_bSearchEntriesSet(false),
+        m_bDisplayIncludeProcess(false) {
     MakeAbsoluteOrCurDirRelativeW(m_pSourceName, m_pAbsSourceName);
     IFT(CreateReadOnlyBlobStream(m_pSource, &m_pSourceStream));
-    m_includedFiles.push_back(IncludedFile(std::wstring(m_pSourceName), m_pSource, m_pSourceStream));
+    AddIncludedFile(std::wstring(m_pSourceName), m_pSource, m_pSourceStream);
   }
   void EnableDisplayIncludeProcess() override {
     m_bDisplayIncludeProcess = true;
@@ -384,23 +380,21 @@ public:
   }
 
   void SetupForCompilerInstance(clang::CompilerInstance &compiler) override {
-    DXASSERT(m_searchEntries.size() == 0, "else compiler instance being set twice");
+    DXASSERT(!m_bSearchEntriesSet, "else compiler instance being set twice");
+    m_bSearchEntriesSet = true;
     // Turn these into UTF-16 to avoid converting later, and ensure they
     // are fully-qualified or relative to the current directory.
     const std::vector<clang::HeaderSearchOptions::Entry> &entries =
       compiler.getHeaderSearchOpts().UserEntries;
-    if (entries.size() > MaxIncludedFiles) {
-      throw hlsl::Exception(HRESULT_FROM_WIN32(ERROR_OUT_OF_STRUCTURES));
-    }
     for (unsigned i = 0, e = entries.size(); i != e; ++i) {
       const clang::HeaderSearchOptions::Entry &E = entries[i];
       if (dxcutil::IsAbsoluteOrCurDirRelative(E.Path.c_str())) {
-        m_searchEntries.emplace_back(Unicode::UTF8ToUTF16StringOrThrow(E.Path.c_str()));
+        AddDirsOf(Unicode::UTF8ToUTF16StringOrThrow(E.Path.c_str()), /*isDir*/ true);
       }
       else {
         std::wstring ws(L"./");
         ws += Unicode::UTF8ToUTF16StringOrThrow(E.Path.c_str());
-        m_searchEntries.emplace_back(std::move(ws));
+        AddDirsOf(ws, /*isDir*/ true);
       }
     }
   }
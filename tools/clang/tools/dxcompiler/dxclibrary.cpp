@@ -12,8 +12,11 @@
 #include "dxc/Support/WinIncludes.h"
 #include "dxc/Support/Global.h"
 #include "dxc/Support/Unicode.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/MSFileSystem.h"
+#include "llvm/Support/Mutex.h"
 #include "dxc/Support/microcom.h"
 #include "dxc/Support/FileIOHelper.h"
 
@@ -22,6 +25,8 @@
 #include "dxc/DxilContainer/DxilContainer.h"
 #include "dxc/DXIL/DxilPDB.h"
 
+#include <algorithm>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -63,6 +68,148 @@ public:
   }
 };
 
+// Serves files from disk like DxcIncludeHandlerForFS, keeping them mapped
+// until cleared. Lookups that fail are remembered as well, since include
+// search probes every directory on the path.
+class DxcIncludeCacheForFS : public IDxcIncludeCache {
+private:
+  DXC_MICROCOM_TM_REF_FIELDS()
+  struct PathEntry {
+    HRESULT Status;
+    std::string ContentHash;
+  };
+  llvm::sys::Mutex m_mutex;
+  std::unordered_map<std::wstring, PathEntry> m_paths;
+  std::unordered_map<std::string, CComPtr<IDxcBlobEncoding>> m_contents;
+
+  // Include search spells the same file several ways, like "a.h", "./a.h"
+  // and "dir/../a.h", so entries are keyed by the resolved path. Windows
+  // paths are also folded to one case and separator. A path that doesn't
+  // resolve, like a missing file, keeps its spelling minus "." components.
+  static std::wstring NormalizePath(LPCWSTR pFilename) {
+    std::wstring path;
+#ifdef _WIN32
+    DWORD length = GetFullPathNameW(pFilename, 0, nullptr, nullptr);
+    if (length != 0) {
+      path.resize(length);
+      path.resize(GetFullPathNameW(pFilename, length, &path[0], nullptr));
+    }
+    if (path.empty())
+      path = pFilename;
+    std::replace(path.begin(), path.end(), L'\\', L'/');
+    CharLowerBuffW(&path[0], (DWORD)path.size());
+#else
+    char resolved[PATH_MAX];
+    if (realpath(CW2A(pFilename, CP_UTF8), resolved) != nullptr)
+      return std::wstring(CA2W(resolved, CP_UTF8));
+    path = pFilename;
+#endif
+    std::wstring normalized;
+    size_t begin = 0;
+    for (;;) {
+      size_t end = path.find(L'/', begin);
+      std::wstring part = path.substr(
+          begin, end == std::wstring::npos ? end : end - begin);
+      if (part != L".") {
+        normalized += part;
+        if (end != std::wstring::npos)
+          normalized += L'/';
+      }
+      if (end == std::wstring::npos)
+        break;
+      begin = end + 1;
+    }
+    return normalized;
+  }
+
+  static std::string HashContent(IDxcBlob *pBlob) {
+    MD5 Hash;
+    Hash.update(StringRef((const char *)pBlob->GetBufferPointer(),
+                          pBlob->GetBufferSize()));
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    SmallString<32> Str;
+    MD5::stringifyResult(Result, Str);
+    return Str.str();
+  }
+
+  // Only a load that worked or found no file is an answer worth keeping.
+  // Other failures, like a sharing violation or running out of memory, may
+  // not happen on the next attempt.
+  static bool IsCacheableStatus(HRESULT hr) {
+    return SUCCEEDED(hr) || hr == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)
+#ifdef _WIN32
+           || hr == HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND)
+#endif
+        ;
+  }
+
+  HRESULT GetCachedSource(const PathEntry &entry, IDxcBlob **ppIncludeSource) {
+    if (SUCCEEDED(entry.Status)) {
+      IDxcBlobEncoding *pBlob = m_contents[entry.ContentHash];
+      pBlob->AddRef();
+      *ppIncludeSource = pBlob;
+    }
+    return entry.Status;
+  }
+
+public:
+  DXC_MICROCOM_TM_ADDREF_RELEASE_IMPL()
+  DXC_MICROCOM_TM_CTOR(DxcIncludeCacheForFS)
+
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void **ppvObject) override {
+    return DoBasicQueryInterface<IDxcIncludeHandler, IDxcIncludeCache>(this, iid, ppvObject);
+  }
+
+  HRESULT STDMETHODCALLTYPE LoadSource(
+    _In_ LPCWSTR pFilename,                                   // Candidate filename.
+    _COM_Outptr_result_maybenull_ IDxcBlob **ppIncludeSource  // Resultant source object for included file, nullptr if not found.
+    ) override {
+    DxcThreadMalloc TM(m_pMalloc);
+    *ppIncludeSource = nullptr;
+    try {
+      std::wstring path = NormalizePath(pFilename);
+      {
+        sys::ScopedLock Lock(m_mutex);
+        auto it = m_paths.find(path);
+        if (it != m_paths.end())
+          return GetCachedSource(it->second, ppIncludeSource);
+      }
+
+      // Map outside the lock so compiles don't wait on each other's I/O. The
+      // mapping is only paged in as the compiler reads it, and identical
+      // files share one.
+      PathEntry entry;
+      CComPtr<IDxcBlobEncoding> pEncoding;
+      entry.Status = ::hlsl::DxcCreateBlobFromFileMapping(m_pMalloc, pFilename,
+                                                          nullptr, &pEncoding);
+      if (SUCCEEDED(entry.Status))
+        entry.ContentHash = HashContent(pEncoding);
+      if (!IsCacheableStatus(entry.Status))
+        return entry.Status;
+
+      sys::ScopedLock Lock(m_mutex);
+      if (SUCCEEDED(entry.Status)) {
+        CComPtr<IDxcBlobEncoding> &pShared = m_contents[entry.ContentHash];
+        if (pShared == nullptr)
+          pShared = pEncoding;
+      }
+      // Another compile may have loaded the same path in the meantime.
+      auto it = m_paths.emplace(std::move(path), std::move(entry)).first;
+      return GetCachedSource(it->second, ppIncludeSource);
+    }
+    CATCH_CPP_RETURN_HRESULT();
+  }
+
+  HRESULT STDMETHODCALLTYPE Clear() override {
+    DxcThreadMalloc TM(m_pMalloc);
+    sys::ScopedLock Lock(m_mutex);
+    m_paths.clear();
+    m_contents.clear();
+    return S_OK;
+  }
+};
+
 class DxcCompilerArgs : public IDxcCompilerArgs {
 private:
   DXC_MICROCOM_TM_REF_FIELDS()
@@ -218,7 +365,7 @@ public:
     _In_ IDxcBlob *pBlob, _COM_Outptr_ IDxcBlobEncoding **pBlobEncoding) override;
 };
 
-class DxcUtils : public IDxcUtils {
+class DxcUtils : public IDxcUtils2 {
   friend class DxcLibrary;
 private:
   DXC_MICROCOM_TM_REF_FIELDS()
@@ -229,7 +376,7 @@ public:
   DXC_MICROCOM_TM_ALLOC(DxcUtils)
 
   HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void **ppvObject) override {
-    HRESULT hr = DoBasicQueryInterface<IDxcUtils>(this, iid, ppvObject);
+    HRESULT hr = DoBasicQueryInterface<IDxcUtils, IDxcUtils2>(this, iid, ppvObject);
     if (FAILED(hr)) {
       return DoBasicQueryInterface<IDxcLibrary>(&m_Library, iid, ppvObject);
     }
@@ -306,6 +453,18 @@ public:
     return S_OK;
   }
 
+  virtual HRESULT STDMETHODCALLTYPE CreateIncludeCache(
+    _COM_Outptr_ IDxcIncludeCache **ppResult) override {
+    DxcThreadMalloc TM(m_pMalloc);
+    CComPtr<DxcIncludeCacheForFS> result;
+    result = DxcIncludeCacheForFS::Alloc(m_pMalloc);
+    if (result.p == nullptr) {
+      return E_OUTOFMEMORY;
+    }
+    *ppResult = result.Detach();
+    return S_OK;
+  }
+
   virtual HRESULT STDMETHODCALLTYPE GetBlobAsUtf8(
     _In_ IDxcBlob *pBlob, _COM_Outptr_ IDxcBlobUtf8 **pBlobEncoding) override {
     DxcThreadMalloc TM(m_pMalloc);
@@ -93,7 +93,7 @@ public:
 
   void Initialize() {
     UINT32 valMajor, valMinor;
-    dxcutil::GetValidatorVersion(&valMajor, &valMinor);
+    dxcutil::GetValidatorVersion(&valMajor, &valMinor, &m_validatorSession);
     m_pLinker.reset(DxilLinker::CreateLinker(m_Ctx, valMajor, valMinor));
   }
 
@@ -106,6 +106,7 @@ private:
   DXC_MICROCOM_TM_REF_FIELDS()
   LLVMContext m_Ctx;
   std::unique_ptr<DxilLinker> m_pLinker;
+  dxcutil::ValidatorSession m_validatorSession;
   CComPtr<IDxcContainerEventsHandler> m_pDxcContainerEventsHandler;
   std::vector<CComPtr<IDxcBlob>> m_blobs; // Keep blobs live for lazy load.
 };
@@ -272,6 +273,7 @@ HRESULT STDMETHODCALLTYPE DxcLinker::Link(
           std::move(pM), pOutputBlob, pMalloc, SerializeFlags,
           pOutputStream,
           opts.DebugInfo, opts.DebugFile, &Diag);
+        inputs.pValidatorSession = &m_validatorSession;
         if (needsValidation) {
           valHR = dxcutil::ValidateAndAssembleToContainer(inputs);
         } else {
@@ -24,15 +24,19 @@
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/CodeGen/CodeGenAction.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/Process.h"
 #include "dxc/Support/WinIncludes.h"
 #include "dxc/HLSL/HLSLExtensionsCodegenHelper.h"
 #include "dxc/DxilRootSignature/DxilRootSignature.h"
 #include "dxcutil.h"
+#include "dxccompilecache.h"
+#include "dxccompileprofile.h"
 #include "dxc/Support/dxcfilesystem.h"
 #include "dxc/Support/WinIncludes.h"
 #include "dxc/DxilContainer/DxilContainerAssembler.h"
 #include "dxc/dxcapi.internal.h"
 #include "dxc/DXIL/DxilPDB.h"
+#include "dxc/DXIL/DxilShaderModel.h"
 
 #include "dxc/Support/dxcapi.use.h"
 #include "dxc/Support/Global.h"
@@ -49,6 +53,12 @@
 #include "dxcompileradapter.h"
 #include <algorithm>
 #include <cfloat>
+#include <cstdio>
+#ifndef _WIN32
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#endif
 
 // SPIRV change starts
 #ifdef ENABLE_SPIRV_CODEGEN
@@ -56,9 +66,7 @@
 #endif
 // SPIRV change ends
 
-#ifdef SUPPORT_QUERY_GIT_COMMIT_INFO
 #include "clang/Basic/Version.h"
-#endif // SUPPORT_QUERY_GIT_COMMIT_INFO
 
 #define CP_UTF16 1200
 
@@ -78,7 +86,8 @@ HRESULT RunInternalValidator(_In_ IDxcValidator *pValidator,
                              _In_ llvm::Module *pModule,
                              _In_ llvm::Module *pDebugModule,
                              _In_ IDxcBlob *pShader, UINT32 Flags,
-                             _In_ IDxcOperationResult **ppResult);
+                             _In_ IDxcOperationResult **ppResult,
+                             _In_opt_ hlsl::AbstractMemoryStream *pProgramBitcode = nullptr);
 
 static bool ShouldPartBeIncludedInPDB(UINT32 FourCC) {
   switch (FourCC) {
@@ -410,9 +419,189 @@ static void CreateDefineStrings(
   }
 }
 
+#ifdef ENABLE_SPIRV_CODEGEN
+// SPIR-V optimizer recipes are text files of -Oconfig flags, one per line,
+// named after the shader class they were tuned for. A class whose passes
+// can't be saved as flags gets a recipe of just kSpirvOptRecipeUntunable.
+static std::wstring GetSpirvOptRecipePath(
+    const clang::spirv::SpirvCodeGenOptions &spirvOpts) {
+  std::string path = spirvOpts.optRecipeDir;
+  if (path.back() != '/' && path.back() != '\\')
+    path += '/';
+  path += spirvOpts.optRecipeClass;
+  path += ".spvopt";
+  return std::wstring(CA2W(path.c_str(), CP_UTF8));
+}
+
+static bool ReadSpirvOptRecipe(const std::wstring &path,
+                               std::vector<std::string> &flags) {
+  void *pData = nullptr;
+  DWORD dataSize = 0;
+  try {
+    ReadBinaryFile(GetGlobalHeapMalloc(), path.c_str(), &pData, &dataSize);
+  } catch (...) {
+    return false;
+  }
+  std::string text((const char *)pData, dataSize);
+  GetGlobalHeapMalloc()->Free(pData);
+
+  // A recipe that is empty or isn't a list of flags, as left by a write that
+  // didn't complete, is tuned again; the optimizer checks the flags name
+  // passes it knows.
+  SmallVector<StringRef, 16> lines;
+  StringRef(text).split(lines, "\n", -1, false);
+  for (StringRef line : lines) {
+    line = line.trim();
+    if (line.empty())
+      continue;
+    if (line == clang::spirv::kSpirvOptRecipeUntunable && lines.size() == 1) {
+      flags.push_back(line);
+      continue;
+    }
+    if (!line.startswith("--") ||
+        std::any_of(line.begin(), line.end(),
+                    [](char c) { return (unsigned char)c < ' '; })) {
+      flags.clear();
+      return false;
+    }
+    flags.push_back(line);
+  }
+  return !flags.empty();
+}
+
+static void WriteSpirvOptRecipe(const std::wstring &path,
+                                const std::vector<std::string> &flags) {
+  std::string text;
+  for (const std::string &flag : flags) {
+    text += flag;
+    text += '\n';
+  }
+  // The recipe is written next to its final name and renamed into place, so
+  // compiles reading it concurrently see either no recipe or all of it. A
+  // recipe that can't be saved is tuned again by the next compile.
+  std::wstring tempPath = path + L"." +
+                          std::to_wstring(llvm::sys::Process::GetRandomNumber()) +
+                          L".tmp";
+  try {
+    WriteBinaryFile(tempPath.c_str(), text.data(), text.size());
+  } catch (...) {
+    return;
+  }
+#ifdef _WIN32
+  if (!MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+    DeleteFileW(tempPath.c_str());
+#else
+  CW2A utf8TempPath(tempPath.c_str(), CP_UTF8);
+  if (std::rename(utf8TempPath, CW2A(path.c_str(), CP_UTF8)) != 0)
+    std::remove(utf8TempPath);
+#endif
+}
+
+// A directory shared by many shader classes would otherwise only grow. Past
+// this many recipes, those written longest ago are removed; a class whose
+// recipe is gone is tuned again by its next compile.
+static const size_t kMaxSpirvOptRecipes = 256;
+
+static void EvictSpirvOptRecipes(StringRef recipeDir) {
+  std::string dir = recipeDir;
+  if (dir.back() != '/' && dir.back() != '\\')
+    dir += '/';
+  // Recipes by modification time, then path.
+  std::vector<std::pair<uint64_t, std::string>> recipes;
+#ifdef _WIN32
+  WIN32_FIND_DATAW data;
+  std::wstring pattern(CA2W(dir.c_str(), CP_UTF8));
+  pattern += L"*.spvopt";
+  HANDLE hFind = FindFirstFileW(pattern.c_str(), &data);
+  if (hFind == INVALID_HANDLE_VALUE)
+    return;
+  do {
+    recipes.emplace_back(
+        ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+            data.ftLastWriteTime.dwLowDateTime,
+        dir + (const char *)CW2A(data.cFileName, CP_UTF8));
+  } while (FindNextFileW(hFind, &data));
+  FindClose(hFind);
+#else
+  DIR *pDir = opendir(dir.c_str());
+  if (pDir == nullptr)
+    return;
+  while (struct dirent *pEntry = readdir(pDir)) {
+    std::string path = dir + pEntry->d_name;
+    struct stat st;
+    if (StringRef(pEntry->d_name).endswith(".spvopt") &&
+        stat(path.c_str(), &st) == 0)
+      recipes.emplace_back((uint64_t)st.st_mtime, std::move(path));
+  }
+  closedir(pDir);
+#endif
+  if (recipes.size() <= kMaxSpirvOptRecipes)
+    return;
+  std::sort(recipes.begin(), recipes.end());
+  for (size_t i = 0; i < recipes.size() - kMaxSpirvOptRecipes; ++i) {
+#ifdef _WIN32
+    DeleteFileW(CA2W(recipes[i].second.c_str(), CP_UTF8));
+#else
+    std::remove(recipes[i].second.c_str());
+#endif
+  }
+}
+#endif // ENABLE_SPIRV_CODEGEN
+
+// Identifies this build of the compiler for cache keys that outlive the
+// process: the compiler version, plus the path, size and modification time
+// of the dxcompiler binary, since builds from the same sources needn't report
+// different versions. Returns an empty string if the binary can't be found.
+static const std::string &GetCompilerBuildIdentity() {
+  static const std::string identity = []() {
+    std::string binary;
+#ifdef _WIN32
+    HMODULE hModule = nullptr;
+    wchar_t path[MAX_PATH];
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                               GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                           (LPCWSTR)&GetCompilerBuildIdentity, &hModule)) {
+      DWORD length = GetModuleFileNameW(hModule, path, _countof(path));
+      if (length != 0 && length < _countof(path) &&
+          GetFileAttributesExW(path, GetFileExInfoStandard, &data)) {
+        raw_string_ostream OS(binary);
+        OS << (const char *)CW2A(path, CP_UTF8) << ";"
+           << (((UINT64)data.nFileSizeHigh << 32) | data.nFileSizeLow) << ";"
+           << (((UINT64)data.ftLastWriteTime.dwHighDateTime << 32) |
+               data.ftLastWriteTime.dwLowDateTime);
+      }
+    }
+#else
+    Dl_info info;
+    struct stat st;
+    if (dladdr((void *)&GetCompilerBuildIdentity, &info) != 0 &&
+        info.dli_fname != nullptr && stat(info.dli_fname, &st) == 0) {
+      raw_string_ostream OS(binary);
+      OS << info.dli_fname << ";" << (uint64_t)st.st_size << ";"
+         << (int64_t)st.st_mtime;
+    }
+#endif
+    if (binary.empty())
+      return std::string();
+    std::string identity = getClangFullVersion();
+#ifdef SUPPORT_QUERY_GIT_COMMIT_INFO
+    identity += ";";
+    identity += getGitCommitHash();
+#endif // SUPPORT_QUERY_GIT_COMMIT_INFO
+    identity += ";";
+    identity += binary;
+    return identity;
+  }();
+  return identity;
+}
+
 class DxcCompiler : public IDxcCompiler3,
+                    public IDxcMultiEntryCompiler,
                     public IDxcLangExtensions2,
                     public IDxcContainerEvent,
+                    public IDxcCompileCache,
+                    public IDxcValidatorSession,
 #ifdef SUPPORT_QUERY_GIT_COMMIT_INFO
                     public IDxcVersionInfo2
 #else
@@ -424,6 +613,87 @@ private:
   DxcLangExtensionsHelper m_langExtensionsHelper;
   CComPtr<IDxcContainerEventsHandler> m_pDxcContainerEventsHandler;
   DxcCompilerAdapter m_DxcCompilerAdapter;
+  dxcutil::DxcCompileCache m_compileCache;
+  dxcutil::ValidatorSession m_validatorSession;
+
+  // Outputs that depend on state not captured by the cache key, or on
+  // callbacks with side effects, are never cached.
+  bool IsCompileCacheable(const hlsl::options::DxcOpts &opts) {
+    return m_compileCache.IsEnabled() &&
+           !opts.AstDump && !opts.OptDump && !opts.TimeReport &&
+#ifdef ENABLE_SPIRV_CODEGEN
+           // The recipe read or saved is outside of the key.
+           opts.SpirvOptions.optRecipeDir.empty() &&
+#endif
+           // Macro bodies don't survive preprocessing.
+           opts.RootSignatureDefine.empty() &&
+           m_pDxcContainerEventsHandler == nullptr &&
+           m_langExtensionsHelper.GetIntrinsicTables().empty() &&
+           m_langExtensionsHelper.GetSemanticDefines().empty();
+  }
+
+  // The key covers the preprocessed translation unit (source, includes and
+  // defines), the normalized arguments, the compiler/validator versions and
+  // the build of the compiler. Returns false if the build can't be identified
+  // or the source doesn't preprocess.
+  //
+  // Every keyed compile pays for a preprocess, hit or miss: which includes a
+  // shader reads, and what they hold, is only known once it is preprocessed,
+  // and a key that skipped them would return stale results. Preprocessing is
+  // a small part of a compile, and with an include cache (IDxcIncludeCache)
+  // the files are read from disk once for both passes.
+  bool ComputeCompileCacheKey(_In_ const DxcBuffer *pSource,
+                              _In_count_(argCount) LPCWSTR *pArguments,
+                              _In_ UINT32 argCount,
+                              _In_opt_ IDxcIncludeHandler *pIncludeHandler,
+                              _In_ hlsl::options::DxcOpts &opts,
+                              _Out_ dxcutil::DxcCompileCache::Key &key) {
+    const std::string &buildIdentity = GetCompilerBuildIdentity();
+    if (buildIdentity.empty())
+      return false;
+    std::vector<LPCWSTR> PreprocessArgs;
+    PreprocessArgs.reserve(argCount + 2);
+    PreprocessArgs.assign(pArguments, pArguments + argCount);
+    PreprocessArgs.push_back(L"-P");
+    PreprocessArgs.push_back(L"preprocessed.hlsl");
+    CComPtr<IDxcResult> pPreprocessResult;
+    IFT(Compile(pSource, PreprocessArgs.data(), PreprocessArgs.size(),
+                pIncludeHandler, IID_PPV_ARGS(&pPreprocessResult)));
+    HRESULT status;
+    IFT(pPreprocessResult->GetStatus(&status));
+    if (FAILED(status))
+      return false;
+    CComPtr<IDxcBlob> pPreprocessed;
+    IFT(pPreprocessResult->GetOutput(DXC_OUT_HLSL, IID_PPV_ARGS(&pPreprocessed), nullptr));
+
+    unsigned valMajor, valMinor;
+    if (opts.ValVerMajor != UINT_MAX) {
+      valMajor = opts.ValVerMajor;
+      valMinor = opts.ValVerMinor;
+    } else {
+      dxcutil::GetValidatorVersion(&valMajor, &valMinor, &m_validatorSession);
+    }
+    std::string versions;
+    raw_string_ostream versionStream(versions);
+    versionStream << DXIL::kDxilMajor << "." << DXIL::kDxilMinor << ";"
+                  << valMajor << "." << valMinor << ";"
+                  << (DxilLibIsEnabled() ? "dxil.dll" : "internal") << ";"
+                  << buildIdentity;
+    versionStream.flush();
+
+    std::vector<std::string> normalizedArgs;
+    for (const llvm::opt::Arg *A : opts.Args)
+      normalizedArgs.push_back(A->getAsString(opts.Args));
+
+    std::vector<StringRef> parts;
+    parts.push_back(StringRef((const char *)pPreprocessed->GetBufferPointer(),
+                              pPreprocessed->GetBufferSize()));
+    parts.push_back(versions);
+    for (const std::string &arg : normalizedArgs)
+      parts.push_back(arg);
+    key = dxcutil::DxcCompileCache::ComputeKey(parts);
+    return true;
+  }
 
 public:
   DxcCompiler(IMalloc *pMalloc) : m_dwRef(0), m_pMalloc(pMalloc), m_DxcCompilerAdapter(this, pMalloc) {}
@@ -446,9 +716,12 @@ public:
   HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void **ppvObject) override {
     HRESULT hr = DoBasicQueryInterface<
       IDxcCompiler3,
+      IDxcMultiEntryCompiler,
       IDxcLangExtensions,
       IDxcLangExtensions2,
       IDxcContainerEvent,
+      IDxcCompileCache,
+      IDxcValidatorSession,
       IDxcVersionInfo
 #ifdef SUPPORT_QUERY_GIT_COMMIT_INFO
       ,IDxcVersionInfo2
@@ -499,19 +772,10 @@ public:
       hlsl::options::DxcOpts opts;
       std::string warnings;
       raw_string_ostream w(warnings);
-      {
-        bool finished = false;
-        CComPtr<AbstractMemoryStream> pOptionErrorStream;
-        IFT(CreateMemoryStream(m_pMalloc, &pOptionErrorStream));
-        dxcutil::ReadOptsAndValidate(mainArgs, opts, pOptionErrorStream, &pDxcOperationResult, finished);
-        if (finished) {
-          IFT(pDxcOperationResult->QueryInterface(riid, ppResult));
-          hr = S_OK;
-          goto Cleanup;
-        }
-        if (pOptionErrorStream->GetPtrSize() > 0) {
-          w << StringRef((const char*)pOptionErrorStream->GetPtr(), (size_t)pOptionErrorStream->GetPtrSize());
-        }
+      if (ReadCompileOptions(mainArgs, opts, w, &pDxcOperationResult)) {
+        IFT(pDxcOperationResult->QueryInterface(riid, ppResult));
+        hr = S_OK;
+        goto Cleanup;
       }
 
       bool isPreprocessing = !opts.Preprocess.empty();
@@ -523,10 +787,38 @@ public:
         bCompileStarted = true;
       }
 
+      dxcutil::DxcCompileCache::Key cacheKey;
+      bool useCompileCache = !isPreprocessing && IsCompileCacheable(opts);
+      if (useCompileCache && GetCompilerBuildIdentity().empty()) {
+        w << "warning: compile cache bypassed - the dxcompiler binary could "
+             "not be identified.\n";
+        useCompileCache = false;
+      }
+      useCompileCache = useCompileCache &&
+        ComputeCompileCacheKey(pSource, pArguments, argCount, pIncludeHandler,
+                               opts, cacheKey);
+      if (useCompileCache) {
+        CComPtr<IDxcResult> pCachedResult;
+        if (m_compileCache.Lookup(cacheKey, opts.DefaultTextCodePage,
+                                  &pCachedResult) == S_OK) {
+          IFT(pCachedResult->QueryInterface(riid, ppResult));
+          hr = S_OK;
+          goto Cleanup;
+        }
+      }
+
       CComPtr<DxcResult> pResult = DxcResult::Alloc(m_pMalloc);
       IFT(pResult->SetEncoding(opts.DefaultTextCodePage));
       DxcOutputObject primaryOutput;
 
+      // With -ftime-report, the rest of the compile and every pass it runs are
+      // timed, and allocations are counted against the open regions.
+      std::unique_ptr<dxcutil::DxcCompileProfile> pProfile;
+      if (opts.TimeReport)
+        pProfile.reset(new dxcutil::DxcCompileProfile(m_pMalloc));
+      std::unique_ptr<dxcutil::DxcCompileProfileScope> pProfileScope(
+          new dxcutil::DxcCompileProfileScope(pProfile.get(), "Compile"));
+
       // Formerly API values.
       const char *pUtf8SourceName = opts.InputFile.empty() ? "hlsl.hlsl" : opts.InputFile.data();
       CA2W pUtf16SourceName(pUtf8SourceName, CP_UTF8);
@@ -652,6 +944,7 @@ public:
 
         FrontendInputFile file(pUtf8SourceName, IK_HLSL);
         clang::PrintPreprocessedAction action;
+        llvm::TimingListenerRegion Region("Preprocess");
         if (action.BeginSourceFile(compiler, file)) {
           action.Execute();
           action.EndSourceFile();
@@ -687,21 +980,7 @@ public:
           opts.KeepReflectionInDxil = true;
         }
 
-        if (opts.ValVerMajor != UINT_MAX) {
-          // user-specified validator version override
-          compiler.getCodeGenOpts().HLSLValidatorMajorVer = opts.ValVerMajor;
-          compiler.getCodeGenOpts().HLSLValidatorMinorVer = opts.ValVerMinor;
-        } else {
-          // Version from dxil.dll, or internal validator if unavailable
-          dxcutil::GetValidatorVersion(&compiler.getCodeGenOpts().HLSLValidatorMajorVer,
-                                      &compiler.getCodeGenOpts().HLSLValidatorMinorVer);
-        }
-
-        // Root signature-only container validation is only supported on 1.5 and above.
-        validateRootSigContainer = DXIL::CompareVersions(
-          compiler.getCodeGenOpts().HLSLValidatorMajorVer,
-          compiler.getCodeGenOpts().HLSLValidatorMinorVer,
-          1, 5) >= 0;
+        validateRootSigContainer = SetupValidatorVersion(compiler, opts);
       }
 
       if (opts.AstDump) {
@@ -747,7 +1026,7 @@ public:
             CComPtr<IDxcBlobEncoding> pValErrors;
             // Validation failure communicated through diagnostic error
             dxcutil::ValidateRootSignatureInContainer(
-              pOutputBlob, &compiler.getDiagnostics());
+              pOutputBlob, &compiler.getDiagnostics(), &m_validatorSession);
           }
         }
       }
@@ -761,6 +1040,24 @@ public:
         opts.SpirvOptions.codeGenHighLevel = opts.CodeGenHighLevel;
         opts.SpirvOptions.defaultRowMajor = opts.DefaultRowMajor;
         opts.SpirvOptions.disableValidation = opts.DisableValidation;
+        opts.SpirvOptions.timeReport = opts.TimeReport;
+        // Optimize with the recipe saved for the shader class, or tune one
+        // and save it once the compile succeeds. The optimizer also tunes
+        // again if the saved recipe names passes it doesn't know. A class
+        // marked untunable runs the performance passes without tuning.
+        std::wstring recipePath;
+        std::vector<std::string> tunedRecipe;
+        if (!opts.SpirvOptions.optRecipeDir.empty() && !opts.CodeGenHighLevel &&
+            opts.OptLevel > 0) {
+          std::vector<std::string> &recipe = opts.SpirvOptions.optRecipe;
+          recipePath = GetSpirvOptRecipePath(opts.SpirvOptions);
+          ReadSpirvOptRecipe(recipePath, recipe);
+          if (recipe.size() == 1 &&
+              recipe[0] == clang::spirv::kSpirvOptRecipeUntunable)
+            recipe.clear();
+          else
+            opts.SpirvOptions.tunedOptConfig = &tunedRecipe;
+        }
         // Store a string representation of command line options.
         if (opts.DebugInfo)
           for (auto opt : mainArgs.getArrayRef())
@@ -773,6 +1070,11 @@ public:
         action.Execute();
         action.EndSourceFile();
         outStream.flush();
+        if (!tunedRecipe.empty() &&
+            !compiler.getDiagnostics().hasErrorOccurred()) {
+          WriteSpirvOptRecipe(recipePath, tunedRecipe);
+          EvictSpirvOptRecipes(opts.SpirvOptions.optRecipeDir);
+        }
       }
 #endif
       // SPIRV change ends
@@ -781,6 +1083,8 @@ public:
         FrontendInputFile file(pUtf8SourceName, IK_HLSL);
         bool compileOK;
         if (action.BeginSourceFile(compiler, file)) {
+          // The parse, the IR generation and the optimization passes each
+          // report their own regions from within Execute.
           action.Execute();
           action.EndSourceFile();
           compileOK = !compiler.getDiagnostics().hasErrorOccurred();
@@ -790,109 +1094,20 @@ public:
         }
         outStream.flush();
 
-        SerializeDxilFlags SerializeFlags = SerializeDxilFlags::None;
-        if (opts.EmbedPDBName()) {
-          SerializeFlags |= SerializeDxilFlags::IncludeDebugNamePart;
-        }
-        // If -Qembed_debug specified, embed the debug info.
-        // Or, if there is no output pointer for the debug blob (such as when called by Compile()),
-        // embed the debug info and emit a note.
-        if (opts.EmbedDebugInfo()) {
-          SerializeFlags |= SerializeDxilFlags::IncludeDebugInfoPart;
-        }
-        if (opts.DebugNameForSource) {
-          // Implies name part
-          SerializeFlags |= SerializeDxilFlags::IncludeDebugNamePart;
-          SerializeFlags |= SerializeDxilFlags::DebugNameDependOnSource;
-        } else if (opts.DebugNameForBinary) {
-          // Implies name part
-          SerializeFlags |= SerializeDxilFlags::IncludeDebugNamePart;
-        }
-        if (!opts.KeepReflectionInDxil) {
-          SerializeFlags |= SerializeDxilFlags::StripReflectionFromDxilPart;
-        }
-        if (!opts.StripReflection) {
-          SerializeFlags |= SerializeDxilFlags::IncludeReflectionPart;
-        }
-        if (opts.StripRootSignature) {
-          SerializeFlags |= SerializeDxilFlags::StripRootSignature;
-        }
-
         // Don't do work to put in a container if an error has occurred
         // Do not create a container when there is only a a high-level representation in the module.
         if (compileOK && !opts.CodeGenHighLevel) {
-          HRESULT valHR = S_OK;
-          CComPtr<AbstractMemoryStream> pReflectionStream;
-          CComPtr<AbstractMemoryStream> pRootSigStream;
-          IFT(CreateMemoryStream(DxcGetThreadMallocNoRef(), &pReflectionStream));
-          IFT(CreateMemoryStream(DxcGetThreadMallocNoRef(), &pRootSigStream));
-
-          dxcutil::AssembleInputs inputs(
-                action.takeModule(), pOutputBlob, m_pMalloc, SerializeFlags,
-                pOutputStream, opts.IsDebugInfoEnabled(),
-                opts.GetPDBName(), &compiler.getDiagnostics(),
-                &ShaderHashContent, pReflectionStream, pRootSigStream);
-          if (needsValidation) {
-            valHR = dxcutil::ValidateAndAssembleToContainer(inputs);
-          } else {
-            dxcutil::AssembleToContainer(inputs);
-          }
-
-          // Callback after valid DXIL is produced
-          if (SUCCEEDED(valHR)) {
-            CComPtr<IDxcBlob> pTargetBlob;
-            if (m_pDxcContainerEventsHandler != nullptr) {
-              HRESULT hr = m_pDxcContainerEventsHandler->OnDxilContainerBuilt(pOutputBlob, &pTargetBlob);
-              if (SUCCEEDED(hr) && pTargetBlob != nullptr) {
-                std::swap(pOutputBlob, pTargetBlob);
-              }
-            }
-
-            if (pOutputBlob && produceFullContainer && (SerializeFlags & SerializeDxilFlags::IncludeDebugNamePart) != 0) {
-              const DxilContainerHeader *pContainer = reinterpret_cast<DxilContainerHeader *>(pOutputBlob->GetBufferPointer());
-              DXASSERT(IsValidDxilContainer(pContainer, pOutputBlob->GetBufferSize()), "else invalid container generated");
-              auto it = std::find_if(begin(pContainer), end(pContainer), DxilPartIsType(DFCC_ShaderDebugName));
-              if (it != end(pContainer)) {
-                const char *pDebugName;
-                if (GetDxilShaderDebugName(*it, &pDebugName, nullptr) && pDebugName && *pDebugName) {
-                  IFT(pResult->SetOutputName(DXC_OUT_PDB, pDebugName));
-                }
-              }
-            }
-
-            if (pReflectionStream && pReflectionStream->GetPtrSize()) {
-              CComPtr<IDxcBlob> pReflection;
-              IFT(pReflectionStream->QueryInterface(&pReflection));
-              IFT(pResult->SetOutputObject(DXC_OUT_REFLECTION, pReflection));
-            }
-            if (pRootSigStream && pRootSigStream->GetPtrSize()) {
-              CComPtr<IDxcBlob> pRootSignature;
-              IFT(pRootSigStream->QueryInterface(&pRootSignature));
-              if (validateRootSigContainer && needsValidation) {
-                CComPtr<IDxcBlobEncoding> pValErrors;
-                // Validation failure communicated through diagnostic error
-                dxcutil::ValidateRootSignatureInContainer(pRootSignature, &compiler.getDiagnostics());
-              }
-              IFT(pResult->SetOutputObject(DXC_OUT_ROOT_SIGNATURE, pRootSignature));
-            }
-            CComPtr<IDxcBlob> pHashBlob;
-            IFT(hlsl::DxcCreateBlobOnHeapCopy(&ShaderHashContent, (UINT32)sizeof(ShaderHashContent), &pHashBlob));
-            IFT(pResult->SetOutputObject(DXC_OUT_SHADER_HASH, pHashBlob));
-          } // SUCCEEDED(valHR)
-        } // compileOK && !opts.CodeGenHighLevel
+          AssembleCompiledModule(action.takeModule(), opts, needsValidation,
+                                 produceFullContainer, validateRootSigContainer,
+                                 compiler.getDiagnostics(), pOutputStream,
+                                 pOutputBlob, ShaderHashContent, pResult);
+        }
       }
 
       // Add std err to warnings.
       msfPtr->WriteStdErrToStream(w);
-      CComPtr<IStream> pErrorStream;
-      msfPtr->GetStdOutpuHandleStream(&pErrorStream);
-      CComPtr<IDxcBlob> pErrorBlob;
-      IFT(pErrorStream.QueryInterface(&pErrorBlob));
-      if (IsBlobNullOrEmpty(pErrorBlob)) {
-        IFT(pResult->SetOutputString(DXC_OUT_ERRORS, warnings.c_str(), warnings.size()));
-      } else {
-        IFT(pResult->SetOutputObject(DXC_OUT_ERRORS, pErrorBlob));
-      }
+      w.flush();
+      SetErrorsOutput(msfPtr, warnings, pResult);
 
       bool hasErrorOccurred = compiler.getDiagnostics().hasErrorOccurred();
 
@@ -904,19 +1119,25 @@ public:
 #endif
       // SPIRV change ends
 
-      if (!hasErrorOccurred && writePDB) {
-        CComPtr<IDxcBlob> pDebugBlob;
-        IFT(pOutputStream.QueryInterface(&pDebugBlob));
-        CComPtr<IDxcBlob> pStrippedContainer;
-        IFT(CreateContainerForPDB(m_pMalloc, pOutputBlob, pDebugBlob, &pStrippedContainer));
-        pDebugBlob.Release();
-        IFT(hlsl::pdb::WriteDxilPDB(m_pMalloc, pStrippedContainer, ShaderHashContent.Digest, &pDebugBlob));
-        IFT(pResult->SetOutputObject(DXC_OUT_PDB, pDebugBlob));
-      }
+      if (!hasErrorOccurred && writePDB)
+        SetPDBOutput(pOutputStream, pOutputBlob, ShaderHashContent, pResult);
 
       IFT(primaryOutput.SetObject(pOutputBlob, opts.DefaultTextCodePage));
       IFT(pResult->SetOutput(primaryOutput));
+
+      pProfileScope.reset();
+      if (pProfile) {
+        std::string timeReport;
+        raw_string_ostream timeReportOS(timeReport);
+        pProfile->WriteReport(timeReportOS);
+        timeReportOS.flush();
+        IFT(pResult->SetOutputString(DXC_OUT_TIME_REPORT, timeReport.c_str(),
+                                     timeReport.size()));
+      }
+
       IFT(pResult->SetStatusAndPrimaryResult(hasErrorOccurred ? E_FAIL : S_OK, primaryOutput.kind));
+      if (useCompileCache && !hasErrorOccurred)
+        m_compileCache.Store(cacheKey, pResult);
       IFT(pResult->QueryInterface(riid, ppResult));
 
       hr = S_OK;
@@ -946,6 +1167,262 @@ public:
     return hr;
   }
 
+  // IDxcMultiEntryCompiler
+  HRESULT STDMETHODCALLTYPE CompileEntries(
+    _In_ const DxcBuffer *pSource,                // Source text to compile
+    _In_opt_count_(argCount) LPCWSTR *pArguments, // Array of pointers to arguments
+    _In_ UINT32 argCount,                         // Number of arguments
+    _In_opt_ IDxcIncludeHandler *pIncludeHandler, // user-provided interface to handle #include directives (optional)
+    _In_count_(entryCount) const DxcEntryPoint *pEntries, // Array of entry points
+    _In_ UINT32 entryCount,                       // Number of entry points
+    _Out_writes_(entryCount) IDxcResult **ppResults // Result for each entry point
+  ) override {
+    if (pSource == nullptr ||
+        (argCount > 0 && pArguments == nullptr) ||
+        (entryCount > 0 && (pEntries == nullptr || ppResults == nullptr)))
+      return E_INVALIDARG;
+    for (UINT32 i = 0; i < entryCount; ++i) {
+      if (pEntries[i].Name == nullptr || pEntries[i].Profile == nullptr)
+        return E_INVALIDARG;
+      ppResults[i] = nullptr;
+    }
+
+    HRESULT hr = S_OK;
+    DxcThreadMalloc TM(m_pMalloc);
+    try {
+      // The shader model version is visible to the preprocessor, so only
+      // entries that share it can share a parse.
+      std::vector<bool> compiled(entryCount, false);
+      for (UINT32 i = 0; i < entryCount; ++i) {
+        if (compiled[i])
+          continue;
+        const ShaderModel *pSM = GetEntryShaderModel(pEntries[i]);
+        std::vector<UINT32> group(1, i);
+        for (UINT32 j = i + 1; j < entryCount && pSM; ++j) {
+          const ShaderModel *pOtherSM = GetEntryShaderModel(pEntries[j]);
+          if (!compiled[j] && pOtherSM &&
+              pOtherSM->GetMajor() == pSM->GetMajor() &&
+              pOtherSM->GetMinor() == pSM->GetMinor())
+            group.push_back(j);
+        }
+        for (UINT32 j : group)
+          compiled[j] = true;
+
+        if (group.size() > 1 &&
+            CompileEntryGroup(pSource, pArguments, argCount, pIncludeHandler,
+                              pEntries, group, ppResults) == S_OK)
+          continue;
+
+        for (UINT32 j : group)
+          IFT(CompileEntry(pSource, pArguments, argCount, pIncludeHandler,
+                           pEntries[j], &ppResults[j]));
+      }
+    }
+    CATCH_CPP_ASSIGN_HRESULT();
+
+    if (FAILED(hr)) {
+      for (UINT32 i = 0; i < entryCount; ++i) {
+        if (ppResults[i]) {
+          ppResults[i]->Release();
+          ppResults[i] = nullptr;
+        }
+      }
+    }
+    return hr;
+  }
+
+  // Returns the shader model of an entry that may share a parse, or null.
+  static const ShaderModel *GetEntryShaderModel(const DxcEntryPoint &entry) {
+    CW2A pUtf8Profile(entry.Profile, CP_UTF8);
+    const ShaderModel *pSM = ShaderModel::GetByName(pUtf8Profile.m_psz);
+    if (!pSM->IsValid() || pSM->IsLib())
+      return nullptr;
+    return pSM;
+  }
+
+  HRESULT CompileEntry(_In_ const DxcBuffer *pSource,
+                       _In_count_(argCount) LPCWSTR *pArguments,
+                       _In_ UINT32 argCount,
+                       _In_opt_ IDxcIncludeHandler *pIncludeHandler,
+                       const DxcEntryPoint &entry,
+                       _COM_Outptr_ IDxcResult **ppResult) {
+    std::vector<LPCWSTR> entryArgs;
+    entryArgs.reserve(argCount + 4);
+    entryArgs.assign(pArguments, pArguments + argCount);
+    entryArgs.push_back(L"-E");
+    entryArgs.push_back(entry.Name);
+    entryArgs.push_back(L"-T");
+    entryArgs.push_back(entry.Profile);
+    return Compile(pSource, entryArgs.data(), entryArgs.size(),
+                   pIncludeHandler, IID_PPV_ARGS(ppResult));
+  }
+
+  // Compiles the entries in group from a single parse, storing a result for
+  // each of them. Returns S_FALSE without storing results when the options
+  // or the source call for a parse per entry.
+  HRESULT CompileEntryGroup(_In_ const DxcBuffer *pSource,
+                            _In_count_(argCount) LPCWSTR *pArguments,
+                            _In_ UINT32 argCount,
+                            _In_opt_ IDxcIncludeHandler *pIncludeHandler,
+                            _In_ const DxcEntryPoint *pEntries,
+                            const std::vector<UINT32> &group,
+                            _Out_ IDxcResult **ppResults) {
+    DefaultFPEnvScope fpEnvScope;
+
+    // Parse command-line options into DxcOpts. The profile of the first entry
+    // stands in for the group until each entry is generated.
+    int argCountInt;
+    IFT(UIntToInt(argCount, &argCountInt));
+    hlsl::options::MainArgs mainArgs(argCountInt, pArguments, 0);
+    hlsl::options::DxcOpts opts;
+    CW2A pUtf8Profile(pEntries[group[0]].Profile, CP_UTF8);
+    opts.TargetProfile = pUtf8Profile.m_psz;
+    std::string warnings;
+    raw_string_ostream w(warnings);
+    CComPtr<IDxcOperationResult> pOptionResult;
+    // Compiling each entry on its own reports these.
+    if (ReadCompileOptions(mainArgs, opts, w, &pOptionResult))
+      return S_FALSE;
+    opts.TargetProfile = pUtf8Profile.m_psz;
+
+    if (!opts.Preprocess.empty() || opts.AstDump || opts.OptDump)
+      return S_FALSE;
+#ifdef ENABLE_SPIRV_CODEGEN
+    if (opts.GenSPIRV)
+      return S_FALSE;
+#endif // ENABLE_SPIRV_CODEGEN
+
+    const char *pUtf8SourceName = opts.InputFile.empty() ? "hlsl.hlsl" : opts.InputFile.data();
+    CA2W pUtf16SourceName(pUtf8SourceName, CP_UTF8);
+
+    // Wrap source in blob
+    CComPtr<IDxcBlobEncoding> pSourceEncoding;
+    IFT(hlsl::DxcCreateBlob(pSource->Ptr, pSource->Size,
+      true, false, pSource->Encoding != 0, pSource->Encoding,
+      nullptr, &pSourceEncoding));
+    CComPtr<IDxcBlobUtf8> utf8Source;
+    IFT(hlsl::DxcGetBlobAsUtf8(pSourceEncoding, m_pMalloc, &utf8Source));
+
+    dxcutil::DxcArgsFileSystem *msfPtr =
+      dxcutil::CreateDxcArgsFileSystem(utf8Source, pUtf16SourceName.m_psz, pIncludeHandler);
+    std::unique_ptr<::llvm::sys::fs::MSFileSystem> msf(msfPtr);
+
+    ::llvm::sys::fs::AutoPerThreadSystem pts(msf.get());
+    IFTLLVM(pts.error_code());
+
+    if (opts.DisplayIncludeProcess)
+      msfPtr->EnableDisplayIncludeProcess();
+    IFT(msfPtr->CreateStdStreams(m_pMalloc));
+
+    std::vector<std::string> defines;
+    CreateDefineStrings(opts.Defines.data(), opts.Defines.size(), defines);
+
+    // Each entry gets its own context, bitcode and diagnostics, all of which
+    // outlive the compiler instance.
+    struct EntryOutput {
+      llvm::LLVMContext Context;
+      SmallVector<char, 0> Bitcode;
+      llvm::raw_svector_ostream BitcodeStream;
+      std::string Diagnostics;
+      raw_string_ostream DiagnosticsStream;
+      std::unique_ptr<TextDiagnosticPrinter> DiagPrinter;
+      EntryOutput() : BitcodeStream(Bitcode), DiagnosticsStream(Diagnostics) {}
+    };
+    std::vector<std::unique_ptr<EntryOutput>> outputs;
+
+    CompilerInstance compiler;
+    std::unique_ptr<TextDiagnosticPrinter> diagPrinter =
+        llvm::make_unique<TextDiagnosticPrinter>(w, &compiler.getDiagnosticOpts());
+    SetupCompilerForCompile(compiler, &m_langExtensionsHelper, pUtf8SourceName, diagPrinter.get(), defines, opts, pArguments, argCount);
+    msfPtr->SetupForCompilerInstance(compiler);
+
+    // The parse itself has no entry point; each entry is checked and
+    // generated with its own.
+    compiler.getLangOpts().HLSLEntryFunction =
+      compiler.getCodeGenOpts().HLSLEntryFunction = "";
+    compiler.getLangOpts().HLSLProfile =
+      compiler.getCodeGenOpts().HLSLProfile = opts.TargetProfile;
+    compiler.getLangOpts().IsHLSLLibrary = false;
+
+    bool produceFullContainer = !opts.CodeGenHighLevel;
+    bool needsValidation = produceFullContainer && !opts.DisableValidation;
+    bool validateRootSigContainer = SetupValidatorVersion(compiler, opts);
+
+    std::vector<EmitBCMultiEntryAction::EntryPoint> entryPoints;
+    for (UINT32 index : group) {
+      outputs.emplace_back(new EntryOutput());
+      EntryOutput &output = *outputs.back();
+      output.DiagPrinter = llvm::make_unique<TextDiagnosticPrinter>(
+          output.DiagnosticsStream, &compiler.getDiagnosticOpts());
+      CW2A pUtf8EntryName(pEntries[index].Name, CP_UTF8);
+      CW2A pUtf8EntryProfile(pEntries[index].Profile, CP_UTF8);
+      EmitBCMultiEntryAction::EntryPoint entry;
+      entry.Name = pUtf8EntryName.m_psz;
+      entry.Profile = pUtf8EntryProfile.m_psz;
+      entry.VMContext = &output.Context;
+      entry.OS = &output.BitcodeStream;
+      entry.DiagClient = output.DiagPrinter.get();
+      entryPoints.push_back(std::move(entry));
+    }
+
+    // Entries are generated one after another: code generation reads the
+    // shared AST and Sema, which aren't thread-safe, and assembly shares the
+    // per-thread file system, allocator and validator session of this call.
+    EmitBCMultiEntryAction action(std::move(entryPoints));
+    FrontendInputFile file(pUtf8SourceName, IK_HLSL);
+    if (action.BeginSourceFile(compiler, file)) {
+      action.Execute();
+      action.EndSourceFile();
+    }
+    if (action.isStageDependent())
+      return S_FALSE;
+
+    // Add std err to warnings.
+    msfPtr->WriteStdErrToStream(w);
+    w.flush();
+
+    for (unsigned i = 0, e = group.size(); i != e; ++i) {
+      EntryOutput &output = *outputs[i];
+      CComPtr<DxcResult> pResult = DxcResult::Alloc(m_pMalloc);
+      IFT(pResult->SetEncoding(opts.DefaultTextCodePage));
+
+      CComPtr<AbstractMemoryStream> pOutputStream;
+      IFT(CreateMemoryStream(m_pMalloc, &pOutputStream));
+      StringRef bitcode = output.BitcodeStream.str();
+      ULONG cbWritten;
+      IFT(pOutputStream->Write(bitcode.data(), bitcode.size(), &cbWritten));
+      CComPtr<IDxcBlob> pOutputBlob;
+      IFT(pOutputStream.QueryInterface(&pOutputBlob));
+
+      DxilShaderHash ShaderHashContent;
+      bool hasErrorOccurred = action.hasEntryErrorOccurred(i);
+      if (!hasErrorOccurred && !opts.CodeGenHighLevel) {
+        clang::DiagnosticsEngine &entryDiags = action.getEntryDiagnostics(i);
+        AssembleCompiledModule(action.takeModule(i), opts, needsValidation,
+                               produceFullContainer, validateRootSigContainer,
+                               entryDiags, pOutputStream, pOutputBlob,
+                               ShaderHashContent, pResult);
+        hasErrorOccurred = entryDiags.hasErrorOccurred();
+      }
+
+      // Diagnostics from the shared parse precede the entry's own.
+      std::string errors = warnings;
+      errors += output.DiagnosticsStream.str();
+      SetErrorsOutput(msfPtr, errors, pResult);
+
+      if (!hasErrorOccurred && opts.IsDebugInfoEnabled() && produceFullContainer)
+        SetPDBOutput(pOutputStream, pOutputBlob, ShaderHashContent, pResult);
+
+      DxcOutputObject primaryOutput;
+      primaryOutput.kind = DXC_OUT_OBJECT;
+      IFT(primaryOutput.SetObject(pOutputBlob, opts.DefaultTextCodePage));
+      IFT(pResult->SetOutput(primaryOutput));
+      IFT(pResult->SetStatusAndPrimaryResult(hasErrorOccurred ? E_FAIL : S_OK, primaryOutput.kind));
+      IFT(pResult.QueryInterface(&ppResults[group[i]]));
+    }
+    return S_OK;
+  }
+
   // Disassemble a program.
   virtual HRESULT STDMETHODCALLTYPE Disassemble(
     _In_ const DxcBuffer *pObject,                // Program to disassemble: dxil container or bitcode.
@@ -1007,6 +1484,175 @@ public:
     return hr;
   }
 
+  // Reads the compile options in mainArgs into opts, writing option warnings
+  // to w. Returns true when the options alone finish the compile, as with an
+  // option error or /?, with the result to return in ppOptionResult.
+  bool ReadCompileOptions(hlsl::options::MainArgs &mainArgs,
+                          hlsl::options::DxcOpts &opts, raw_ostream &w,
+                          _COM_Outptr_ IDxcOperationResult **ppOptionResult) {
+    bool finished = false;
+    CComPtr<AbstractMemoryStream> pOptionErrorStream;
+    IFT(CreateMemoryStream(m_pMalloc, &pOptionErrorStream));
+    dxcutil::ReadOptsAndValidate(mainArgs, opts, pOptionErrorStream, ppOptionResult, finished);
+    if (finished)
+      return true;
+    if (pOptionErrorStream->GetPtrSize() > 0) {
+      w << StringRef((const char*)pOptionErrorStream->GetPtr(), (size_t)pOptionErrorStream->GetPtrSize());
+    }
+    return false;
+  }
+
+  // Sets the validator version that code generation targets. Returns true if
+  // that validator can validate root signature-only containers.
+  bool SetupValidatorVersion(CompilerInstance &compiler,
+                             const hlsl::options::DxcOpts &opts) {
+    if (opts.ValVerMajor != UINT_MAX) {
+      // user-specified validator version override
+      compiler.getCodeGenOpts().HLSLValidatorMajorVer = opts.ValVerMajor;
+      compiler.getCodeGenOpts().HLSLValidatorMinorVer = opts.ValVerMinor;
+    } else {
+      // Version from dxil.dll, or internal validator if unavailable
+      dxcutil::GetValidatorVersion(&compiler.getCodeGenOpts().HLSLValidatorMajorVer,
+                                  &compiler.getCodeGenOpts().HLSLValidatorMinorVer,
+                                  &m_validatorSession);
+    }
+
+    // Root signature-only container validation is only supported on 1.5 and above.
+    return DXIL::CompareVersions(
+      compiler.getCodeGenOpts().HLSLValidatorMajorVer,
+      compiler.getCodeGenOpts().HLSLValidatorMinorVer,
+      1, 5) >= 0;
+  }
+
+  // Records the errors output: what the compile wrote to its standard
+  // output, if anything, or else the errors text.
+  void SetErrorsOutput(dxcutil::DxcArgsFileSystem *msfPtr, StringRef errors,
+                       DxcResult *pResult) {
+    CComPtr<IStream> pErrorStream;
+    msfPtr->GetStdOutpuHandleStream(&pErrorStream);
+    CComPtr<IDxcBlob> pErrorBlob;
+    IFT(pErrorStream.QueryInterface(&pErrorBlob));
+    if (IsBlobNullOrEmpty(pErrorBlob)) {
+      IFT(pResult->SetOutputString(DXC_OUT_ERRORS, errors.data(), errors.size()));
+    } else {
+      IFT(pResult->SetOutputObject(DXC_OUT_ERRORS, pErrorBlob));
+    }
+  }
+
+  // Records the PDB output, built from the debug module in pOutputStream and
+  // the container in pOutputBlob.
+  void SetPDBOutput(AbstractMemoryStream *pOutputStream, IDxcBlob *pOutputBlob,
+                    const DxilShaderHash &ShaderHashContent,
+                    DxcResult *pResult) {
+    CComPtr<IDxcBlob> pDebugBlob;
+    IFT(pOutputStream->QueryInterface(&pDebugBlob));
+    CComPtr<IDxcBlob> pStrippedContainer;
+    IFT(CreateContainerForPDB(m_pMalloc, pOutputBlob, pDebugBlob, &pStrippedContainer));
+    pDebugBlob.Release();
+    IFT(hlsl::pdb::WriteDxilPDB(m_pMalloc, pStrippedContainer, ShaderHashContent.Digest, &pDebugBlob));
+    IFT(pResult->SetOutputObject(DXC_OUT_PDB, pDebugBlob));
+  }
+
+  // Serializes a compiled module into pOutputBlob, validating it when
+  // needed, and records the reflection, root signature and hash outputs.
+  void AssembleCompiledModule(std::unique_ptr<llvm::Module> pModule,
+                              hlsl::options::DxcOpts &opts,
+                              bool needsValidation, bool produceFullContainer,
+                              bool validateRootSigContainer,
+                              clang::DiagnosticsEngine &Diags,
+                              CComPtr<AbstractMemoryStream> &pOutputStream,
+                              CComPtr<IDxcBlob> &pOutputBlob,
+                              DxilShaderHash &ShaderHashContent,
+                              DxcResult *pResult) {
+    SerializeDxilFlags SerializeFlags = SerializeDxilFlags::None;
+    if (opts.EmbedPDBName()) {
+      SerializeFlags |= SerializeDxilFlags::IncludeDebugNamePart;
+    }
+    // If -Qembed_debug specified, embed the debug info.
+    // Or, if there is no output pointer for the debug blob (such as when called by Compile()),
+    // embed the debug info and emit a note.
+    if (opts.EmbedDebugInfo()) {
+      SerializeFlags |= SerializeDxilFlags::IncludeDebugInfoPart;
+    }
+    if (opts.DebugNameForSource) {
+      // Implies name part
+      SerializeFlags |= SerializeDxilFlags::IncludeDebugNamePart;
+      SerializeFlags |= SerializeDxilFlags::DebugNameDependOnSource;
+    } else if (opts.DebugNameForBinary) {
+      // Implies name part
+      SerializeFlags |= SerializeDxilFlags::IncludeDebugNamePart;
+    }
+    if (!opts.KeepReflectionInDxil) {
+      SerializeFlags |= SerializeDxilFlags::StripReflectionFromDxilPart;
+    }
+    if (!opts.StripReflection) {
+      SerializeFlags |= SerializeDxilFlags::IncludeReflectionPart;
+    }
+    if (opts.StripRootSignature) {
+      SerializeFlags |= SerializeDxilFlags::StripRootSignature;
+    }
+
+    HRESULT valHR = S_OK;
+    CComPtr<AbstractMemoryStream> pReflectionStream;
+    CComPtr<AbstractMemoryStream> pRootSigStream;
+    IFT(CreateMemoryStream(DxcGetThreadMallocNoRef(), &pReflectionStream));
+    IFT(CreateMemoryStream(DxcGetThreadMallocNoRef(), &pRootSigStream));
+
+    dxcutil::AssembleInputs inputs(
+        std::move(pModule), pOutputBlob, m_pMalloc, SerializeFlags,
+        pOutputStream, opts.IsDebugInfoEnabled(),
+        opts.GetPDBName(), &Diags,
+        &ShaderHashContent, pReflectionStream, pRootSigStream);
+    inputs.pValidatorSession = &m_validatorSession;
+    if (needsValidation) {
+      valHR = dxcutil::ValidateAndAssembleToContainer(inputs);
+    } else {
+      dxcutil::AssembleToContainer(inputs);
+    }
+
+    // Callback after valid DXIL is produced
+    if (SUCCEEDED(valHR)) {
+      CComPtr<IDxcBlob> pTargetBlob;
+      if (m_pDxcContainerEventsHandler != nullptr) {
+        HRESULT hr = m_pDxcContainerEventsHandler->OnDxilContainerBuilt(pOutputBlob, &pTargetBlob);
+        if (SUCCEEDED(hr) && pTargetBlob != nullptr) {
+          std::swap(pOutputBlob, pTargetBlob);
+        }
+      }
+
+      if (pOutputBlob && produceFullContainer && (SerializeFlags & SerializeDxilFlags::IncludeDebugNamePart) != 0) {
+        const DxilContainerHeader *pContainer = reinterpret_cast<DxilContainerHeader *>(pOutputBlob->GetBufferPointer());
+        DXASSERT(IsValidDxilContainer(pContainer, pOutputBlob->GetBufferSize()), "else invalid container generated");
+        auto it = std::find_if(begin(pContainer), end(pContainer), DxilPartIsType(DFCC_ShaderDebugName));
+        if (it != end(pContainer)) {
+          const char *pDebugName;
+          if (GetDxilShaderDebugName(*it, &pDebugName, nullptr) && pDebugName && *pDebugName) {
+            IFT(pResult->SetOutputName(DXC_OUT_PDB, pDebugName));
+          }
+        }
+      }
+
+      if (pReflectionStream && pReflectionStream->GetPtrSize()) {
+        CComPtr<IDxcBlob> pReflection;
+        IFT(pReflectionStream->QueryInterface(&pReflection));
+        IFT(pResult->SetOutputObject(DXC_OUT_REFLECTION, pReflection));
+      }
+      if (pRootSigStream && pRootSigStream->GetPtrSize()) {
+        CComPtr<IDxcBlob> pRootSignature;
+        IFT(pRootSigStream->QueryInterface(&pRootSignature));
+        if (validateRootSigContainer && needsValidation) {
+          CComPtr<IDxcBlobEncoding> pValErrors;
+          // Validation failure communicated through diagnostic error
+          dxcutil::ValidateRootSignatureInContainer(pRootSignature, &Diags, &m_validatorSession);
+        }
+        IFT(pResult->SetOutputObject(DXC_OUT_ROOT_SIGNATURE, pRootSignature));
+      }
+      CComPtr<IDxcBlob> pHashBlob;
+      IFT(hlsl::DxcCreateBlobOnHeapCopy(&ShaderHashContent, (UINT32)sizeof(ShaderHashContent), &pHashBlob));
+      IFT(pResult->SetOutputObject(DXC_OUT_SHADER_HASH, pHashBlob));
+    } // SUCCEEDED(valHR)
+  }
+
   void SetupCompilerForCompile(CompilerInstance &compiler,
                                _In_ DxcLangExtensionsHelper *helper,
                                _In_ LPCSTR pMainFile, _In_ TextDiagnosticPrinter *diagPrinter,
@@ -1193,6 +1839,37 @@ public:
     }
   }
 
+  // IDxcCompileCache
+  HRESULT STDMETHODCALLTYPE Configure(_In_opt_z_ LPCWSTR pDirectory,
+                                      _In_ UINT64 maxMemoryBytes,
+                                      _In_ UINT64 maxDiskBytes) override {
+    DxcThreadMalloc TM(m_pMalloc);
+    try {
+      m_compileCache.Configure(pDirectory, maxMemoryBytes, maxDiskBytes);
+      return S_OK;
+    }
+    CATCH_CPP_RETURN_HRESULT();
+  }
+  HRESULT STDMETHODCALLTYPE GetStatistics(_Out_ DxcCompileCacheStatistics *pStats) override {
+    if (pStats == nullptr)
+      return E_INVALIDARG;
+    m_compileCache.GetStatistics(pStats);
+    return S_OK;
+  }
+  HRESULT STDMETHODCALLTYPE Clear() override {
+    DxcThreadMalloc TM(m_pMalloc);
+    m_compileCache.Clear();
+    return S_OK;
+  }
+
+  // IDxcValidatorSession
+  HRESULT STDMETHODCALLTYPE GetValidatorCreateCount(_Out_ UINT32 *pCount) override {
+    if (pCount == nullptr)
+      return E_INVALIDARG;
+    *pCount = m_validatorSession.GetCreateCount();
+    return S_OK;
+  }
+
   // IDxcVersionInfo
   HRESULT STDMETHODCALLTYPE GetVersion(_Out_ UINT32 *pMajor, _Out_ UINT32 *pMinor) override {
     if (pMajor == nullptr || pMinor == nullptr)
@@ -23,8 +23,8 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
-#include "llvm/Transforms/Utils/Cloning.h"
 #include "dxc/Support/dxcapi.impl.h"
 #include "dxc/Support/HLSLOptions.h"
 #include "dxc/DXIL/DxilModule.h"
@@ -44,7 +44,8 @@ HRESULT RunInternalValidator(_In_ IDxcValidator *pValidator,
                              _In_ llvm::Module *pModule,
                              _In_ llvm::Module *pDebugModule,
                              _In_ IDxcBlob *pShader, UINT32 Flags,
-                             _In_ IDxcOperationResult **ppResult);
+                             _In_ IDxcOperationResult **ppResult,
+                             _In_opt_ hlsl::AbstractMemoryStream *pProgramBitcode = nullptr);
 
 namespace {
 // AssembleToContainer helper functions.
@@ -89,10 +90,53 @@ AssembleInputs::AssembleInputs(std::unique_ptr<llvm::Module> &&pM,
     pRootSigOut(pRootSigOut)
 {}
 
-void GetValidatorVersion(unsigned *pMajor, unsigned *pMinor) {
+void ValidatorSession::EnsureValidator() {
+  if (m_pValidator)
+    return;
+  CComPtr<IDxcValidator> pValidator;
+  bool bInternalValidator = CreateValidator(pValidator);
+  CComPtr<IDxcVersionInfo> pVersionInfo;
+  if (SUCCEEDED(pValidator.QueryInterface(&pVersionInfo))) {
+    IFT(pVersionInfo->GetVersion(&m_major, &m_minor));
+  } else {
+    // Default to 1.0
+    m_major = 1;
+    m_minor = 0;
+  }
+  m_bInternalValidator = bInternalValidator;
+  m_pValidator = pValidator;
+  ++m_createCount;
+}
+
+bool ValidatorSession::GetValidator(CComPtr<IDxcValidator> &pValidator) {
+  sys::ScopedLock Lock(m_mutex);
+  EnsureValidator();
+  pValidator = m_pValidator;
+  return m_bInternalValidator;
+}
+
+void ValidatorSession::GetVersion(unsigned *pMajor, unsigned *pMinor) {
+  sys::ScopedLock Lock(m_mutex);
+  EnsureValidator();
+  *pMajor = m_major;
+  *pMinor = m_minor;
+}
+
+unsigned ValidatorSession::GetCreateCount() {
+  sys::ScopedLock Lock(m_mutex);
+  return m_createCount;
+}
+
+void GetValidatorVersion(unsigned *pMajor, unsigned *pMinor,
+                         ValidatorSession *pSession) {
   if (pMajor == nullptr || pMinor == nullptr)
     return;
 
+  if (pSession) {
+    pSession->GetVersion(pMajor, pMinor);
+    return;
+  }
+
   CComPtr<IDxcValidator> pValidator;
   CreateValidator(pValidator);
 
@@ -107,11 +151,13 @@ void GetValidatorVersion(unsigned *pMajor, unsigned *pMinor) {
 }
 
 void AssembleToContainer(AssembleInputs &inputs) {
+  llvm::TimingListenerRegion Region("Container assembly");
   CComPtr<AbstractMemoryStream> pContainerStream;
   IFT(CreateMemoryStream(inputs.pMalloc, &pContainerStream));
   SerializeDxilContainerForModule(&inputs.pM->GetOrCreateDxilModule(),
                                   inputs.pModuleBitcode, pContainerStream, inputs.DebugName, inputs.SerializeFlags,
-                                  inputs.pShaderHashOut, inputs.pReflectionOut, inputs.pRootSigOut);
+                                  inputs.pShaderHashOut, inputs.pReflectionOut, inputs.pRootSigOut,
+                                  &inputs.pProgramBitcode);
   inputs.pOutputContainerBlob.Release();
   IFT(pContainerStream.QueryInterface(&inputs.pOutputContainerBlob));
 }
@@ -143,12 +189,10 @@ void ReadOptsAndValidate(hlsl::options::MainArgs &mainArgs,
 HRESULT ValidateAndAssembleToContainer(AssembleInputs &inputs) {
   HRESULT valHR = S_OK;
 
-  // If we have debug info, this will be a clone of the module before debug info is stripped.
-  // This is used with internal validator to provide more useful error messages.
-  std::unique_ptr<llvm::Module> llvmModuleWithDebugInfo;
-
   CComPtr<IDxcValidator> pValidator;
-  bool bInternalValidator = CreateValidator(pValidator);
+  bool bInternalValidator = inputs.pValidatorSession
+                                ? inputs.pValidatorSession->GetValidator(pValidator)
+                                : CreateValidator(pValidator);
   // Warning on internal Validator
 
   if (bInternalValidator) {
@@ -159,14 +203,6 @@ HRESULT ValidateAndAssembleToContainer(AssembleInputs &inputs) {
                                "signed for use in release environments.\r\n");
       inputs.pDiag->Report(diagID);
     }
-    // If using the internal validator, we'll use the modules directly.
-    // In this case, we'll want to make a clone to avoid
-    // SerializeDxilContainerForModule stripping all the debug info. The debug
-    // info will be stripped from the orginal module, but preserved in the cloned
-    // module.
-    if (inputs.bDebugInfo) {
-      llvmModuleWithDebugInfo.reset(llvm::CloneModule(inputs.pM.get()));
-    }
   }
 
   // Verify validator version can validate this module
@@ -192,12 +228,36 @@ HRESULT ValidateAndAssembleToContainer(AssembleInputs &inputs) {
   AssembleToContainer(inputs);
 
   CComPtr<IDxcOperationResult> pValResult;
+  llvm::TimingListenerRegion Region("Validation");
   // Important: in-place edit is required so the blob is reused and thus
   // dxil.dll can be released.
   if (bInternalValidator) {
-    IFT(RunInternalValidator(pValidator, inputs.pM.get(),
-                             llvmModuleWithDebugInfo.get(), inputs.pOutputContainerBlob,
-                             DxcValidatorFlags_InPlaceEdit, &pValResult));
+    IFT(RunInternalValidator(pValidator, inputs.pM.get(), nullptr,
+                             inputs.pOutputContainerBlob,
+                             DxcValidatorFlags_InPlaceEdit, &pValResult,
+                             inputs.pProgramBitcode));
+    // SerializeDxilContainerForModule strips debug info from the module. The
+    // internal validator can point its errors at source locations given the
+    // module with debug info, so rather than cloning the module up front for
+    // every compile, load it from the emitted bitcode and validate again only
+    // if validation failed.
+    IFT(pValResult->GetStatus(&valHR));
+    if (FAILED(valHR) && inputs.bDebugInfo && inputs.pModuleBitcode) {
+      llvm::MemoryBufferRef bitcode(
+          StringRef((const char *)inputs.pModuleBitcode->GetPtr(),
+                    inputs.pModuleBitcode->GetPtrSize()),
+          "");
+      llvm::ErrorOr<std::unique_ptr<llvm::Module>> llvmModuleWithDebugInfo =
+          llvm::parseBitcodeFile(bitcode, inputs.pM->getContext());
+      if (llvmModuleWithDebugInfo) {
+        pValResult.Release();
+        IFT(RunInternalValidator(pValidator, inputs.pM.get(),
+                                 llvmModuleWithDebugInfo.get().get(),
+                                 inputs.pOutputContainerBlob,
+                                 DxcValidatorFlags_InPlaceEdit, &pValResult,
+                                 inputs.pProgramBitcode));
+      }
+    }
   } else {
     IFT(pValidator->Validate(inputs.pOutputContainerBlob, DxcValidatorFlags_InPlaceEdit,
                              &pValResult));
@@ -227,11 +287,15 @@ HRESULT ValidateAndAssembleToContainer(AssembleInputs &inputs) {
 }
 
 HRESULT ValidateRootSignatureInContainer(
-    IDxcBlob *pRootSigContainer, clang::DiagnosticsEngine *pDiag) {
+    IDxcBlob *pRootSigContainer, clang::DiagnosticsEngine *pDiag,
+    ValidatorSession *pSession) {
   HRESULT valHR = S_OK;
   CComPtr<IDxcValidator> pValidator;
   CComPtr<IDxcOperationResult> pValResult;
-  CreateValidator(pValidator);
+  if (pSession)
+    pSession->GetValidator(pValidator);
+  else
+    CreateValidator(pValidator);
   IFT(pValidator->Validate(pRootSigContainer,
         DxcValidatorFlags_RootSignatureOnly | DxcValidatorFlags_InPlaceEdit,
         &pValResult));
@@ -15,6 +15,7 @@
 #include "dxc/Support/microcom.h"
 #include <memory>
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Mutex.h"
 
 namespace clang {
 class DiagnosticsEngine;
@@ -39,6 +40,30 @@ class DxcOpts;
 } // namespace hlsl
 
 namespace dxcutil {
+// Validator instance and version kept alive across the compiles of one
+// compiler object, so that dxil.dll isn't probed and a validator isn't
+// created and queried for every compile. This is the only state a compile
+// reuses. The option table is already built once per process. The target
+// info and Sema's HLSL type and intrinsic tables are built for each compile:
+// they belong to the compile's ASTContext, so reusing them would mean
+// reusing the CompilerInstance and its AST.
+class ValidatorSession {
+public:
+  // Returns true if the validator is the internal (non-signing) one.
+  bool GetValidator(CComPtr<IDxcValidator> &pValidator);
+  void GetVersion(unsigned *pMajor, unsigned *pMinor);
+  unsigned GetCreateCount();
+
+private:
+  void EnsureValidator();
+
+  llvm::sys::Mutex m_mutex;
+  CComPtr<IDxcValidator> m_pValidator;
+  bool m_bInternalValidator = false;
+  unsigned m_major = 0, m_minor = 0;
+  unsigned m_createCount = 0;
+};
+
 struct AssembleInputs {
   AssembleInputs(std::unique_ptr<llvm::Module> &&pM,
                  CComPtr<IDxcBlob> &pOutputContainerBlob,
@@ -62,11 +87,16 @@ struct AssembleInputs {
   hlsl::DxilShaderHash *pShaderHashOut = nullptr;
   hlsl::AbstractMemoryStream *pReflectionOut = nullptr;
   hlsl::AbstractMemoryStream *pRootSigOut = nullptr;
+  ValidatorSession *pValidatorSession = nullptr;
+  // Set by AssembleToContainer to the bitcode in the program part.
+  CComPtr<hlsl::AbstractMemoryStream> pProgramBitcode;
 };
 HRESULT ValidateAndAssembleToContainer(AssembleInputs &inputs);
 HRESULT ValidateRootSignatureInContainer(
-    IDxcBlob *pRootSigContainer, clang::DiagnosticsEngine *pDiag = nullptr);
-void GetValidatorVersion(unsigned *pMajor, unsigned *pMinor);
+    IDxcBlob *pRootSigContainer, clang::DiagnosticsEngine *pDiag = nullptr,
+    ValidatorSession *pSession = nullptr);
+void GetValidatorVersion(unsigned *pMajor, unsigned *pMinor,
+                         ValidatorSession *pSession = nullptr);
 void AssembleToContainer(AssembleInputs &inputs);
 HRESULT Disassemble(IDxcBlob *pProgram, llvm::raw_string_ostream &Stream);
 void ReadOptsAndValidate(hlsl::options::MainArgs &mainArgs,
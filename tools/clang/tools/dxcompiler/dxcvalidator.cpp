@@ -68,6 +68,7 @@ private:
     _In_ UINT32 Flags,                            // Validation flags.
     _In_ llvm::Module *pModule,                   // Module to validate, if available.
     _In_ llvm::Module *pDebugModule,              // Debug module to validate, if available
+    _In_opt_ AbstractMemoryStream *pProgramBitcode, // Bitcode the module was serialized to, if available
     _In_ AbstractMemoryStream *pDiagStream);
 
   HRESULT RunRootSignatureValidation(
@@ -88,7 +89,8 @@ public:
     _In_ UINT32 Flags,                            // Validation flags.
     _In_ llvm::Module *pModule,                   // Module to validate, if available.
     _In_ llvm::Module *pDebugModule,              // Debug module to validate, if available
-    _COM_Outptr_ IDxcOperationResult **ppResult   // Validation output status, buffer, and errors
+    _COM_Outptr_ IDxcOperationResult **ppResult,  // Validation output status, buffer, and errors
+    _In_opt_ AbstractMemoryStream *pProgramBitcode = nullptr // Bitcode the module was serialized to, if available
   );
 
   // IDxcValidator
@@ -127,7 +129,8 @@ HRESULT DxcValidator::ValidateWithOptModules(
   _In_ UINT32 Flags,                            // Validation flags.
   _In_ llvm::Module *pModule,                   // Module to validate, if available.
   _In_ llvm::Module *pDebugModule,              // Debug module to validate, if available
-  _COM_Outptr_ IDxcOperationResult **ppResult   // Validation output status, buffer, and errors
+  _COM_Outptr_ IDxcOperationResult **ppResult,  // Validation output status, buffer, and errors
+  _In_opt_ AbstractMemoryStream *pProgramBitcode // Bitcode the module was serialized to, if available
 ) {
   *ppResult = nullptr;
   HRESULT hr = S_OK;
@@ -143,7 +146,8 @@ HRESULT DxcValidator::ValidateWithOptModules(
     if (Flags & DxcValidatorFlags_RootSignatureOnly) {
       validationStatus = RunRootSignatureValidation(pShader, pDiagStream);
     } else {
-      validationStatus = RunValidation(pShader, Flags, pModule, pDebugModule, pDiagStream);
+      validationStatus = RunValidation(pShader, Flags, pModule, pDebugModule,
+                                       pProgramBitcode, pDiagStream);
     }
     if (FAILED(validationStatus)) {
       std::string msg("Validation failed.\n");
@@ -206,6 +210,7 @@ HRESULT DxcValidator::RunValidation(
   _In_ UINT32 Flags,                            // Validation flags.
   _In_ llvm::Module *pModule,                   // Module to validate, if available.
   _In_ llvm::Module *pDebugModule,              // Debug module to validate, if available
+  _In_opt_ AbstractMemoryStream *pProgramBitcode, // Bitcode the module was serialized to, if available
   _In_ AbstractMemoryStream *pDiagStream) {
 
   // Run validation may throw, but that indicates an inability to validate,
@@ -237,7 +242,9 @@ HRESULT DxcValidator::RunValidation(
   if (!(Flags & DxcValidatorFlags_ModuleOnly)) {
     IFR(ValidateDxilContainerParts(pModule, pDebugModule,
                       IsDxilContainerLike(pShader->GetBufferPointer(), pShader->GetBufferSize()),
-                      (uint32_t)pShader->GetBufferSize()));
+                      (uint32_t)pShader->GetBufferSize(),
+                      pProgramBitcode ? (const char *)pProgramBitcode->GetPtr() : nullptr,
+                      pProgramBitcode ? pProgramBitcode->GetPtrSize() : 0));
   }
 
   if (DiagContext.HasErrors() || DiagContext.HasWarnings()) {
@@ -294,7 +301,8 @@ HRESULT RunInternalValidator(_In_ IDxcValidator *pValidator,
                              _In_ llvm::Module *pModule,
                              _In_ llvm::Module *pDebugModule,
                              _In_ IDxcBlob *pShader, UINT32 Flags,
-                             _COM_Outptr_ IDxcOperationResult **ppResult) {
+                             _COM_Outptr_ IDxcOperationResult **ppResult,
+                             _In_opt_ AbstractMemoryStream *pProgramBitcode) {
   DXASSERT_NOMSG(pValidator != nullptr);
   DXASSERT_NOMSG(pModule != nullptr);
   DXASSERT_NOMSG(pShader != nullptr);
@@ -302,7 +310,8 @@ HRESULT RunInternalValidator(_In_ IDxcValidator *pValidator,
 
   DxcValidator *pInternalValidator = (DxcValidator *)pValidator;
   return pInternalValidator->ValidateWithOptModules(pShader, Flags, pModule,
-                                                    pDebugModule, ppResult);
+                                                    pDebugModule, ppResult,
+                                                    pProgramBitcode);
 }
 
 HRESULT CreateDxcValidator(_In_ REFIID riid, _Out_ LPVOID* ppv) {
@@ -126,7 +126,8 @@ static void saveModuleToAsmFile(const llvm::Module* mod, const std::string& file
   }
 }
 
-class DxcDxrFallbackCompiler : public IDxcDxrFallbackCompiler
+class DxcDxrFallbackCompiler : public IDxcDxrFallbackCompiler,
+                               public IDxcDxrFallbackCompilerStats
 {
 private:
   DXC_MICROCOM_TM_REF_FIELDS()
@@ -135,13 +136,19 @@ private:
 
   // Only used for test purposes when exports aren't explicitly listed
   std::unique_ptr<DxrFallbackCompiler::IntToFuncNameMap> m_pCachedMap;
+
+  // State functions of the shaders compiled so far, reused by later compiles
+  // of the same shaders
+  DxrFallbackCompiler::StateFunctionCache m_stateFunctionCache;
 public:
   DXC_MICROCOM_TM_ADDREF_RELEASE_IMPL()
     DXC_MICROCOM_TM_CTOR(DxcDxrFallbackCompiler)
 
     HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void **ppvObject)
   {
-    return DoBasicQueryInterface<IDxcDxrFallbackCompiler>(this, iid, ppvObject);
+    return DoBasicQueryInterface<IDxcDxrFallbackCompiler,
+                                 IDxcDxrFallbackCompilerStats>(this, iid,
+                                                               ppvObject);
   }
 
   __override HRESULT STDMETHODCALLTYPE SetFindCalledShaders(bool val)
@@ -156,6 +163,15 @@ public:
     return S_OK;
   }
 
+  // IDxcDxrFallbackCompilerStats
+  __override HRESULT STDMETHODCALLTYPE GetStateFunctionCacheHits(_Out_ UINT32 *pHits)
+  {
+    if (pHits == nullptr)
+      return E_POINTER;
+    *pHits = m_stateFunctionCache.hits();
+    return S_OK;
+  }
+
   __override HRESULT STDMETHODCALLTYPE PatchShaderBindingTables(
       _In_ const LPCWSTR pEntryName,
       _In_ DxcShaderBytecode *pShaderBytecode,
@@ -695,6 +711,7 @@ HRESULT STDMETHODCALLTYPE DxcDxrFallbackCompiler::Compile(
     std::vector<unsigned int> shaderStackSizes;
     DxrFallbackCompiler compiler(M.get(), shaderNames, maxAttributeSize, 0, m_findCalledShaders);
     compiler.setDebugOutputLevel(m_debugOutput);
+    compiler.setStateFunctionCache(&m_stateFunctionCache);
     compiler.compile(shaderEntryStateIds, shaderStackSizes, m_pCachedMap.get());
     if (m_debugOutput)
     {
@@ -43,7 +43,7 @@ void DxvContext::Validate() {
 
   {
     CComPtr<IDxcBlobEncoding> pSource;
-    ReadFileIntoBlob(m_dxcSupport, StringRefUtf16(InputFilename), &pSource);
+    MapFileIntoBlob(StringRefUtf16(InputFilename), &pSource);
 
     CComPtr<IDxcAssembler> pAssembler;
     CComPtr<IDxcOperationResult> pAsmResult;
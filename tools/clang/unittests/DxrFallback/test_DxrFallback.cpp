@@ -85,18 +85,13 @@ void CompileToDxilFromFile(DxcDllSupport& dxcSupport, LPCWSTR pShaderTextFilePat
   }
 }
 
-bool DxrCompile(
-  DxcDllSupport& dxrFallbackSupport,
-  const std::string& entryName,
+void DxrCompileCollection(
+  IDxcDxrFallbackCompiler* pCompiler,
   std::vector<IDxcBlob*>& libs,
   const std::vector<std::string>& shaderNames,
   std::vector<DxcShaderInfo>& shaderIds,
-  bool findCalledShaders,
-  IDxcBlob** ppResultBlob)
+  IDxcBlob** ppCompiledCollection)
 {
-  CComPtr<IDxcDxrFallbackCompiler> pCompiler;
-  IFT(dxrFallbackSupport.CreateInstance(CLSID_DxcDxrFallbackCompiler, &pCompiler));
-
   std::vector<std::wstring> shaderNamesW(shaderNames.size());
   std::vector<LPCWSTR> shaderNamePtrs(shaderNames.size());
   for (size_t i = 0; i < shaderNames.size(); ++i)
@@ -108,20 +103,44 @@ bool DxrCompile(
   const UINT maxAttributeSize = 32;
   shaderIds.resize(shaderNames.size());
   CComPtr<IDxcOperationResult> pCompileResult;
-  CComPtr<IDxcBlob> pCompiledCollection;
   std::vector<DxcShaderBytecode> bytecode(libs.size());
   for (UINT i = 0; i < libs.size(); i++)
   {
       bytecode[i] = { (LPBYTE)libs[i]->GetBufferPointer(), (UINT32)libs[i]->GetBufferSize() };
   }
 
-  IFT(pCompiler->SetFindCalledShaders(findCalledShaders));
-  IFT(pCompiler->SetDebugOutput(DEBUG_OUTPUT_LEVEL));
   IFT(pCompiler->Compile(
     bytecode.data(), libs.size(),
     shaderNamePtrs.data(), shaderIds.data(), shaderNamePtrs.size(), maxAttributeSize,
     &pCompileResult));
-  pCompileResult->GetResult(&pCompiledCollection);
+  pCompileResult->GetResult(ppCompiledCollection);
+}
+
+bool DxrCompile(
+  DxcDllSupport& dxrFallbackSupport,
+  const std::string& entryName,
+  std::vector<IDxcBlob*>& libs,
+  const std::vector<std::string>& shaderNames,
+  std::vector<DxcShaderInfo>& shaderIds,
+  bool findCalledShaders,
+  IDxcBlob** ppResultBlob)
+{
+  CComPtr<IDxcDxrFallbackCompiler> pCompiler;
+  IFT(dxrFallbackSupport.CreateInstance(CLSID_DxcDxrFallbackCompiler, &pCompiler));
+
+  std::vector<std::wstring> shaderNamesW(shaderNames.size());
+  std::vector<LPCWSTR> shaderNamePtrs(shaderNames.size());
+  for (size_t i = 0; i < shaderNames.size(); ++i)
+  {
+    shaderNamesW[i] = s2ws(shaderNames[i]);
+    shaderNamePtrs[i] = shaderNamesW[i].c_str();
+  }
+
+  const UINT maxAttributeSize = 32;
+  CComPtr<IDxcBlob> pCompiledCollection;
+  IFT(pCompiler->SetFindCalledShaders(findCalledShaders));
+  IFT(pCompiler->SetDebugOutput(DEBUG_OUTPUT_LEVEL));
+  DxrCompileCollection(pCompiler, libs, shaderNames, shaderIds, &pCompiledCollection);
 
   IDxcBlob *compiledCollections[] = { pCompiledCollection };
   CComPtr<IDxcOperationResult> pResult;
@@ -293,6 +312,90 @@ public:
     return runTest(pComputeShader, shaderIds[0].Identifier, input, expectedOutput);
   }
 
+  // Compiles shaderNames, then the same shaders in the reverse order with the
+  // same compiler object, which should reuse the shaders' state functions.
+  // The result must match a compile of the reversed order without a cache.
+  //
+  // Returns the number of failures.
+  int runCacheTest(const std::vector<std::string>& shaderNames)
+  {
+    std::vector<std::string> reversedNames(shaderNames.rbegin(), shaderNames.rend());
+    CComPtr<IDxcDxrFallbackCompiler> pCompiler;
+    CComPtr<IDxcDxrFallbackCompiler> pUncachedCompiler;
+    IFT(m_dxrFallbackSupport.CreateInstance(CLSID_DxcDxrFallbackCompiler, &pCompiler));
+    IFT(m_dxrFallbackSupport.CreateInstance(CLSID_DxcDxrFallbackCompiler, &pUncachedCompiler));
+
+    std::vector<DxcShaderInfo> shaderIds;
+    CComPtr<IDxcBlob> pFirst, pCached, pUncached;
+    DxrCompileCollection(pCompiler, m_inputBlobPtrs, shaderNames, shaderIds, &pFirst);
+    DxrCompileCollection(pCompiler, m_inputBlobPtrs, reversedNames, shaderIds, &pCached);
+    DxrCompileCollection(pUncachedCompiler, m_inputBlobPtrs, reversedNames, shaderIds, &pUncached);
+
+    CComPtr<IDxcDxrFallbackCompilerStats> pStats;
+    IFT(pCompiler.QueryInterface(&pStats));
+    UINT32 hits = 0;
+    IFT(pStats->GetStateFunctionCacheHits(&hits));
+    bool passed = pCached && pUncached && hits > 0 &&
+      pCached->GetBufferSize() == pUncached->GetBufferSize() &&
+      memcmp(pCached->GetBufferPointer(), pUncached->GetBufferPointer(), pCached->GetBufferSize()) == 0;
+    std::cout << "cache hits: " << hits << "\n";
+    std::cout << (passed ? "PASSED" : "FAILED") << "\n";
+    return passed ? 0 : 1;
+  }
+
+  // Compiles a collection of shaders that use only some of the runtime
+  // intrinsics. The runtime functions for unusedIntrinsic must be left out of
+  // the collection, which must still link into a shader that validates.
+  //
+  // Returns the number of failures.
+  int runPrunedRuntimeTest(const std::vector<std::string>& shaderNames, const std::string& unusedIntrinsic)
+  {
+    CComPtr<IDxcDxrFallbackCompiler> pCompiler;
+    IFT(m_dxrFallbackSupport.CreateInstance(CLSID_DxcDxrFallbackCompiler, &pCompiler));
+
+    std::vector<DxcShaderInfo> shaderIds;
+    CComPtr<IDxcBlob> pCollection;
+    DxrCompileCollection(pCompiler, m_inputBlobPtrs, shaderNames, shaderIds, &pCollection);
+    bool passed = pCollection != nullptr;
+
+    if (passed)
+    {
+      CComPtr<IDxcCompiler> pDxcCompiler;
+      CComPtr<IDxcBlobEncoding> pDisassembly;
+      IFT(m_dxcSupport.CreateInstance(CLSID_DxcCompiler, &pDxcCompiler));
+      IFT(pDxcCompiler->Disassemble(pCollection, &pDisassembly));
+      std::string text((const char*)pDisassembly->GetBufferPointer(), pDisassembly->GetBufferSize());
+      passed = text.find("@" + unusedIntrinsic + "(") == std::string::npos;
+    }
+
+    if (passed)
+    {
+      // Link validates the shader it produces.
+      std::vector<std::wstring> shaderNamesW(shaderNames.size());
+      std::vector<LPCWSTR> shaderNamePtrs(shaderNames.size());
+      for (size_t i = 0; i < shaderNames.size(); ++i)
+      {
+        shaderNamesW[i] = s2ws(shaderNames[i]);
+        shaderNamePtrs[i] = shaderNamesW[i].c_str();
+      }
+      IDxcBlob *compiledCollections[] = { pCollection };
+      CComPtr<IDxcOperationResult> pResult;
+      IFT(pCompiler->Link(
+          s2ws(m_entryName).c_str(),
+          compiledCollections, ARRAYSIZE(compiledCollections),
+          shaderNamePtrs.data(), shaderIds.data(), shaderNamePtrs.size(),
+          32, 1024, &pResult));
+      HRESULT status;
+      IFT(pResult->GetStatus(&status));
+      passed = SUCCEEDED(status);
+      if (!passed)
+        printErrors(pResult);
+    }
+
+    std::cout << (passed ? "PASSED" : "FAILED") << "\n";
+    return passed ? 0 : 1;
+  }
+
   void compileTest(const std::vector<std::string>& shaderNames, const std::string& entryName)
   {
     std::vector<DxcShaderInfo> shaderIds(shaderNames.size());
@@ -878,6 +981,9 @@ int main(int argc, const char* argv[])
       numFailed += tester.runSingleTest({ "raygen_tri", "chTri", "intersection", "continuation", "Fallback_TraceRay" }, { 1002 }, { -98, -97, 555, 666, -99, 1010 });
       numFailed += tester.runSingleTest({ "raygen_custom", "chCustom1", "chCustom2", "intersection", "continuation", "Fallback_TraceRay" }, { 1003, 1005 }, { -98, -95, 19, 10, 11, 12, 13, -100, -99, 500, -96, 333, 444, -99, 1010, -98, -95, 59, 50, 51, 52, 53, -100, -99, 500, -96, 333, 444, -99, 1110 });
 
+      numFailed += tester.runCacheTest({ "raygen_tri", "chTri", "intersection", "continuation", "Fallback_TraceRay" });
+      numFailed += tester.runPrunedRuntimeTest({ "no_call" }, "fb_dxop_worldToObject");
+
       tester.setFiles({ "testShader3.hlsl" });
       numFailed += tester.runSingleTest({ "pass_struct", "Fallback_TraceRay" }, {}, { -99, 1, 2, 3, 4, 5, 6, 7, 8, 11 });
 
@@ -21,9 +21,11 @@
 #include <sstream>
 #include <algorithm>
 #include <cfloat>
+#include <chrono>
 #include "dxc/DxilContainer/DxilContainer.h"
 #include "dxc/Support/WinIncludes.h"
 #include "dxc/dxcapi.h"
+#include "dxc/dxcapi.internal.h"
 #include "dxc/dxcpix.h"
 #ifdef _WIN32
 #include <atlfile.h>
@@ -137,6 +139,15 @@ public:
   TEST_METHOD(CompileWhenIncludeMissingThenFail)
   TEST_METHOD(CompileWhenIncludeHasPathThenOK)
   TEST_METHOD(CompileWhenIncludeEmptyThenOK)
+  TEST_METHOD(IncludeCacheWhenLoadedThenHitUntilClear)
+  TEST_METHOD(CompileWhenCacheEnabledThenRepeatHits)
+  TEST_METHOD(CompileWhenCachedThenSameAsUncached)
+  TEST_METHOD(CompileWhenRepeatedThenValidatorCreatedOnce)
+  TEST_METHOD(CompileEntriesWhenOneFailsThenNextSucceeds)
+  TEST_METHOD(CompileEntriesWhenBothFailThenBothReported)
+  TEST_METHOD(CompileEntriesWhenBatchedThenSameAsSeparate)
+  TEST_METHOD(CompileWhenParallelFunctionOptThenSameAsSequential)
+  TEST_METHOD(CompileWhenTimeReportThenPhasesReported)
 
   TEST_METHOD(CompileWhenODumpThenPassConfig)
   TEST_METHOD(CompileWhenODumpThenOptimizerMatch)
@@ -204,6 +215,12 @@ public:
   BEGIN_TEST_METHOD(CodeGenHashStability)
       TEST_METHOD_PROPERTY(L"Priority", L"2")
   END_TEST_METHOD()
+  BEGIN_TEST_METHOD(CompileWhenDeepNestedStructsThenSROAFlattens)
+      TEST_METHOD_PROPERTY(L"Priority", L"2")
+  END_TEST_METHOD()
+  BEGIN_TEST_METHOD(BenchmarkParallelFunctionOpt)
+      TEST_METHOD_PROPERTY(L"Priority", L"2")
+  END_TEST_METHOD()
 
   dxc::DxcDllSupport m_dllSupport;
   VersionSupportInfo m_ver;
@@ -1282,6 +1299,575 @@ TEST_F(CompilerTest, CompileWhenIncludeEmptyThenOK) {
   VERIFY_ARE_EQUAL_WSTR(L"./empty.h;", pInclude->GetAllFileNames().c_str());
 }
 
+TEST_F(CompilerTest, IncludeCacheWhenLoadedThenHitUntilClear) {
+  llvm::sys::fs::MSFileSystem *msfPtr;
+  VERIFY_SUCCEEDED(CreateMSFileSystemForDisk(&msfPtr));
+  std::unique_ptr<llvm::sys::fs::MSFileSystem> msf(msfPtr);
+  llvm::sys::fs::AutoPerThreadSystem pts(msf.get());
+  IFTLLVM(pts.error_code());
+
+  auto WriteHeader = [](llvm::SmallString<128> &Path, const char *Text) {
+    std::ofstream Out(Path.c_str(), std::ios::out | std::ios::trunc);
+    Out << Text;
+  };
+  auto LoadText = [](IDxcIncludeCache *pCache, llvm::SmallString<128> &Path,
+                     std::string &Text) -> HRESULT {
+    CComPtr<IDxcBlob> pBlob;
+    CA2W WidePath(Path.c_str(), CP_UTF8);
+    HRESULT hr = pCache->LoadSource(WidePath, &pBlob);
+    Text = pBlob ? BlobToUtf8(pBlob) : std::string();
+    return hr;
+  };
+
+  // One header that exists, and one path that doesn't exist yet.
+  llvm::SmallString<128> Present, Missing;
+  VERIFY_IS_FALSE(llvm::sys::fs::createTemporaryFile("include-cache", "h", Present));
+  VERIFY_IS_FALSE(llvm::sys::fs::createTemporaryFile("include-cache", "h", Missing));
+  VERIFY_IS_FALSE(llvm::sys::fs::remove(Missing));
+  WriteHeader(Present, "#define VALUE 1\n");
+
+  CComPtr<IDxcUtils2> pUtils;
+  CComPtr<IDxcIncludeCache> pCache;
+  VERIFY_SUCCEEDED(m_dllSupport.CreateInstance(CLSID_DxcUtils, &pUtils));
+  VERIFY_SUCCEEDED(pUtils->CreateIncludeCache(&pCache));
+
+  std::string Text;
+  VERIFY_SUCCEEDED(LoadText(pCache, Present, Text));
+  VERIFY_ARE_EQUAL_STR("#define VALUE 1\n", Text.c_str());
+  VERIFY_FAILED(LoadText(pCache, Missing, Text));
+
+  // Both answers are served from the cache under any spelling of the path,
+  // even after the missing file appears. Cached headers stay mapped, so the
+  // present one is only rewritten after Clear.
+  llvm::SmallString<128> PresentAlias(llvm::sys::path::parent_path(Present));
+  llvm::sys::path::append(PresentAlias, ".", llvm::sys::path::filename(Present));
+  llvm::SmallString<128> MissingAlias(llvm::sys::path::parent_path(Missing));
+  llvm::sys::path::append(MissingAlias, ".", llvm::sys::path::filename(Missing));
+  WriteHeader(Missing, "#define OTHER 1\n");
+  VERIFY_SUCCEEDED(LoadText(pCache, PresentAlias, Text));
+  VERIFY_ARE_EQUAL_STR("#define VALUE 1\n", Text.c_str());
+  VERIFY_FAILED(LoadText(pCache, Missing, Text));
+  VERIFY_FAILED(LoadText(pCache, MissingAlias, Text));
+
+  // Clear drops both, so the files are read again.
+  VERIFY_SUCCEEDED(pCache->Clear());
+  WriteHeader(Present, "#define VALUE 2\n");
+  VERIFY_SUCCEEDED(LoadText(pCache, Present, Text));
+  VERIFY_ARE_EQUAL_STR("#define VALUE 2\n", Text.c_str());
+  VERIFY_SUCCEEDED(LoadText(pCache, Missing, Text));
+  VERIFY_ARE_EQUAL_STR("#define OTHER 1\n", Text.c_str());
+
+  // A path that can't be read for another reason, here a directory, isn't
+  // cached, so the file that later takes its place is read.
+  llvm::SmallString<128> Unreadable;
+  VERIFY_IS_FALSE(llvm::sys::fs::createTemporaryFile("include-cache", "h", Unreadable));
+  VERIFY_IS_FALSE(llvm::sys::fs::remove(Unreadable));
+  VERIFY_IS_FALSE(llvm::sys::fs::create_directory(Unreadable));
+  VERIFY_FAILED(LoadText(pCache, Unreadable, Text));
+  VERIFY_IS_FALSE(llvm::sys::fs::remove(Unreadable));
+  WriteHeader(Unreadable, "#define THIRD 1\n");
+  VERIFY_SUCCEEDED(LoadText(pCache, Unreadable, Text));
+  VERIFY_ARE_EQUAL_STR("#define THIRD 1\n", Text.c_str());
+
+  llvm::sys::fs::remove(Present);
+  llvm::sys::fs::remove(Missing);
+  llvm::sys::fs::remove(Unreadable);
+}
+
+TEST_F(CompilerTest, CompileWhenCacheEnabledThenRepeatHits) {
+  CComPtr<IDxcCompiler> pCompiler;
+  CComPtr<IDxcCompileCache> pCache;
+  CComPtr<IDxcBlobEncoding> pSource;
+
+  VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+  VERIFY_SUCCEEDED(pCompiler.QueryInterface(&pCache));
+  VERIFY_SUCCEEDED(pCache->Configure(nullptr, 1 << 20, 0));
+  CreateBlobFromText("float4 main() : SV_Target { return VALUE; }", &pSource);
+
+  DxcDefine Defines[] = { { L"VALUE", L"1" } };
+  CComPtr<IDxcBlob> pPrograms[2];
+  for (unsigned i = 0; i < 2; ++i) {
+    CComPtr<IDxcOperationResult> pResult;
+    VERIFY_SUCCEEDED(pCompiler->Compile(pSource, L"source.hlsl", L"main",
+                                        L"ps_6_0", nullptr, 0, Defines,
+                                        _countof(Defines), nullptr, &pResult));
+    VerifyOperationSucceeded(pResult);
+    VERIFY_SUCCEEDED(pResult->GetResult(&pPrograms[i]));
+  }
+  VERIFY_ARE_EQUAL(pPrograms[0]->GetBufferSize(), pPrograms[1]->GetBufferSize());
+  VERIFY_IS_TRUE(0 == memcmp(pPrograms[0]->GetBufferPointer(),
+                             pPrograms[1]->GetBufferPointer(),
+                             pPrograms[0]->GetBufferSize()));
+
+  DxcCompileCacheStatistics Stats;
+  VERIFY_SUCCEEDED(pCache->GetStatistics(&Stats));
+  VERIFY_ARE_EQUAL((UINT64)1, Stats.Hits);
+  VERIFY_ARE_EQUAL((UINT64)1, Stats.Misses);
+  VERIFY_ARE_EQUAL((UINT64)1, Stats.EntryCount);
+
+  // A different define changes the preprocessed source, so it must miss.
+  Defines[0].Value = L"2";
+  CComPtr<IDxcOperationResult> pResult;
+  VERIFY_SUCCEEDED(pCompiler->Compile(pSource, L"source.hlsl", L"main",
+                                      L"ps_6_0", nullptr, 0, Defines,
+                                      _countof(Defines), nullptr, &pResult));
+  VerifyOperationSucceeded(pResult);
+  VERIFY_SUCCEEDED(pCache->GetStatistics(&Stats));
+  VERIFY_ARE_EQUAL((UINT64)1, Stats.Hits);
+  VERIFY_ARE_EQUAL((UINT64)2, Stats.Misses);
+}
+
+TEST_F(CompilerTest, CompileWhenCachedThenSameAsUncached) {
+  CComPtr<IDxcBlobEncoding> pSource;
+  CreateBlobFromText(
+    "#include \"helper.h\"\r\n"
+    "float4 main() : SV_Target { float2 v = float4(1, 2, 3, ZERO);\r\n"
+    "  return v.xyxy; }", &pSource);
+
+  // Compile without the cache, then miss and hit on a cached compiler. The
+  // program and the diagnostics must match byte for byte. The key is taken
+  // from a preprocess of its own, so a miss reads each include twice and a
+  // hit once.
+  CComPtr<IDxcCompiler> pCachedCompiler;
+  VERIFY_SUCCEEDED(CreateCompiler(&pCachedCompiler));
+  CComPtr<IDxcCompileCache> pCache;
+  VERIFY_SUCCEEDED(pCachedCompiler.QueryInterface(&pCache));
+  VERIFY_SUCCEEDED(pCache->Configure(nullptr, 1 << 20, 0));
+
+  const wchar_t *ExpectedIncludes[] = { L"./helper.h;",
+                                        L"./helper.h;./helper.h;",
+                                        L"./helper.h;" };
+  std::string Programs[3];
+  std::string Errors[3];
+  for (unsigned i = 0; i < 3; ++i) {
+    CComPtr<IDxcCompiler> pCompiler = pCachedCompiler;
+    if (i == 0) {
+      pCompiler.Release();
+      VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+    }
+    CComPtr<IDxcOperationResult> pResult;
+    CComPtr<TestIncludeHandler> pInclude;
+    pInclude = new TestIncludeHandler(m_dllSupport);
+    pInclude->CallResults.emplace_back("#define ZERO 0");
+    pInclude->CallResults.emplace_back("#define ZERO 0");
+
+    VERIFY_SUCCEEDED(pCompiler->Compile(pSource, L"source.hlsl", L"main",
+      L"ps_6_0", nullptr, 0, nullptr, 0, pInclude, &pResult));
+    VerifyOperationSucceeded(pResult);
+    VERIFY_ARE_EQUAL_WSTR(ExpectedIncludes[i],
+                          pInclude->GetAllFileNames().c_str());
+    CComPtr<IDxcBlob> pProgram;
+    CComPtr<IDxcBlobEncoding> pErrors;
+    VERIFY_SUCCEEDED(pResult->GetResult(&pProgram));
+    VERIFY_SUCCEEDED(pResult->GetErrorBuffer(&pErrors));
+    Programs[i].assign((const char *)pProgram->GetBufferPointer(),
+                       pProgram->GetBufferSize());
+    Errors[i] = BlobToUtf8(pErrors);
+  }
+  VERIFY_ARE_NOT_EQUAL(std::string::npos, Errors[0].find("warning:"));
+  for (unsigned i = 1; i < 3; ++i) {
+    VERIFY_IS_TRUE(Programs[0] == Programs[i]);
+    VERIFY_ARE_EQUAL_STR(Errors[0].c_str(), Errors[i].c_str());
+  }
+
+  DxcCompileCacheStatistics Stats;
+  VERIFY_SUCCEEDED(pCache->GetStatistics(&Stats));
+  VERIFY_ARE_EQUAL((UINT64)1, Stats.Hits);
+  VERIFY_ARE_EQUAL((UINT64)1, Stats.Misses);
+}
+
+TEST_F(CompilerTest, CompileWhenRepeatedThenValidatorCreatedOnce) {
+  CComPtr<IDxcBlobEncoding> pSource;
+  CreateBlobFromText("float4 main() : SV_Target { return 1; }", &pSource);
+
+  // Each compiler object keeps its own validator for all of its compiles.
+  for (unsigned compilerIdx = 0; compilerIdx < 2; ++compilerIdx) {
+    CComPtr<IDxcCompiler> pCompiler;
+    CComPtr<IDxcValidatorSession> pSession;
+    VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+    VERIFY_SUCCEEDED(pCompiler.QueryInterface(&pSession));
+
+    UINT32 Count = 0;
+    VERIFY_SUCCEEDED(pSession->GetValidatorCreateCount(&Count));
+    VERIFY_ARE_EQUAL(0u, Count);
+
+    for (unsigned i = 0; i < 3; ++i) {
+      CComPtr<IDxcOperationResult> pResult;
+      VERIFY_SUCCEEDED(pCompiler->Compile(pSource, L"source.hlsl", L"main",
+                                          L"ps_6_0", nullptr, 0, nullptr, 0,
+                                          nullptr, &pResult));
+      VerifyOperationSucceeded(pResult);
+      VERIFY_SUCCEEDED(pSession->GetValidatorCreateCount(&Count));
+      VERIFY_ARE_EQUAL(1u, Count);
+    }
+  }
+}
+
+static const char TwoPixelShaders[] =
+    "float4 main() : SV_Target { return 1; }\n"
+    "float4 other() : SV_Target { return 2; }\n";
+
+// Compiles TwoPixelShaders for each named entry through CompileEntries, which
+// parses once for entries that share a shader model, and returns whether each
+// succeeded along with its error text.
+static void CompileTwoEntries(IDxcCompiler *pCompiler, LPCWSTR pFirst,
+                              LPCWSTR pSecond, HRESULT (&Status)[2],
+                              std::string (&Errors)[2]) {
+  CComPtr<IDxcMultiEntryCompiler> pMulti;
+  VERIFY_SUCCEEDED(pCompiler->QueryInterface(&pMulti));
+  DxcBuffer Source;
+  Source.Ptr = TwoPixelShaders;
+  Source.Size = sizeof(TwoPixelShaders) - 1;
+  Source.Encoding = DXC_CP_UTF8;
+  DxcEntryPoint Entries[] = { { pFirst, L"ps_6_0" }, { pSecond, L"ps_6_0" } };
+  IDxcResult *pResults[_countof(Entries)] = {};
+  VERIFY_SUCCEEDED(pMulti->CompileEntries(&Source, nullptr, 0, nullptr,
+                                          Entries, _countof(Entries),
+                                          pResults));
+  for (unsigned i = 0; i < _countof(Entries); ++i) {
+    CComPtr<IDxcResult> pResult;
+    pResult.Attach(pResults[i]);
+    VERIFY_IS_NOT_NULL(pResult.p);
+    VERIFY_SUCCEEDED(pResult->GetStatus(&Status[i]));
+    CComPtr<IDxcBlobUtf8> pErrors;
+    VERIFY_SUCCEEDED(pResult->GetOutput(DXC_OUT_ERRORS,
+                                        IID_PPV_ARGS(&pErrors), nullptr));
+    Errors[i] = pErrors ? std::string(pErrors->GetStringPointer(),
+                                      pErrors->GetStringLength())
+                        : std::string();
+  }
+}
+
+TEST_F(CompilerTest, CompileEntriesWhenOneFailsThenNextSucceeds) {
+  CComPtr<IDxcCompiler> pCompiler;
+  VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+
+  HRESULT Status[2];
+  std::string Errors[2];
+  CompileTwoEntries(pCompiler, L"missing", L"other", Status, Errors);
+  VERIFY_FAILED(Status[0]);
+  VERIFY_ARE_NOT_EQUAL(std::string::npos,
+                       Errors[0].find("missing entry point definition"));
+  VERIFY_SUCCEEDED(Status[1]);
+  VERIFY_ARE_EQUAL(std::string::npos, Errors[1].find("error"));
+}
+
+TEST_F(CompilerTest, CompileEntriesWhenBothFailThenBothReported) {
+  CComPtr<IDxcCompiler> pCompiler;
+  VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+
+  // The second entry must be checked, and fail, on its own account rather
+  // than being skipped because the first one already failed.
+  HRESULT Status[2];
+  std::string Errors[2];
+  CompileTwoEntries(pCompiler, L"missing", L"absent", Status, Errors);
+  for (unsigned i = 0; i < 2; ++i) {
+    VERIFY_FAILED(Status[i]);
+    VERIFY_ARE_NOT_EQUAL(std::string::npos,
+                         Errors[i].find("missing entry point definition"));
+  }
+}
+
+TEST_F(CompilerTest, CompileEntriesWhenBatchedThenSameAsSeparate) {
+  CComPtr<IDxcCompiler> pCompiler;
+  CComPtr<IDxcCompiler3> pCompiler3;
+  CComPtr<IDxcMultiEntryCompiler> pMulti;
+  VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+  VERIFY_SUCCEEDED(pCompiler.QueryInterface(&pCompiler3));
+  VERIFY_SUCCEEDED(pCompiler.QueryInterface(&pMulti));
+
+  DxcBuffer Source;
+  Source.Ptr = TwoPixelShaders;
+  Source.Size = sizeof(TwoPixelShaders) - 1;
+  Source.Encoding = DXC_CP_UTF8;
+
+  // Entries sharing ps_6_0 are parsed together, with a failing one between
+  // them; the ps_6_2 entry is a group of its own.
+  DxcEntryPoint Entries[] = { { L"main", L"ps_6_0" },
+                              { L"missing", L"ps_6_0" },
+                              { L"other", L"ps_6_0" },
+                              { L"main", L"ps_6_2" } };
+  const bool Succeeds[] = { true, false, true, true };
+  IDxcResult *pResults[_countof(Entries)] = {};
+  VERIFY_SUCCEEDED(pMulti->CompileEntries(&Source, nullptr, 0, nullptr,
+                                          Entries, _countof(Entries),
+                                          pResults));
+
+  for (unsigned i = 0; i < _countof(Entries); ++i) {
+    CComPtr<IDxcResult> pBatched;
+    pBatched.Attach(pResults[i]);
+    VERIFY_IS_NOT_NULL(pBatched.p);
+
+    LPCWSTR Args[] = { L"-E", Entries[i].Name,
+                       L"-T", Entries[i].Profile };
+    CComPtr<IDxcResult> pSeparate;
+    VERIFY_SUCCEEDED(pCompiler3->Compile(&Source, Args, _countof(Args),
+                                         nullptr, IID_PPV_ARGS(&pSeparate)));
+
+    HRESULT BatchedStatus, SeparateStatus;
+    VERIFY_SUCCEEDED(pBatched->GetStatus(&BatchedStatus));
+    VERIFY_SUCCEEDED(pSeparate->GetStatus(&SeparateStatus));
+    VERIFY_ARE_EQUAL(Succeeds[i], SUCCEEDED(BatchedStatus));
+    VERIFY_ARE_EQUAL(Succeeds[i], SUCCEEDED(SeparateStatus));
+    if (!Succeeds[i])
+      continue;
+
+    CComPtr<IDxcBlob> pBatchedObject, pSeparateObject;
+    VERIFY_SUCCEEDED(pBatched->GetOutput(DXC_OUT_OBJECT,
+                                         IID_PPV_ARGS(&pBatchedObject), nullptr));
+    VERIFY_SUCCEEDED(pSeparate->GetOutput(DXC_OUT_OBJECT,
+                                          IID_PPV_ARGS(&pSeparateObject), nullptr));
+    VERIFY_ARE_EQUAL(pSeparateObject->GetBufferSize(),
+                     pBatchedObject->GetBufferSize());
+    VERIFY_IS_TRUE(0 == memcmp(pSeparateObject->GetBufferPointer(),
+                               pBatchedObject->GetBufferPointer(),
+                               pSeparateObject->GetBufferSize()));
+  }
+}
+
+TEST_F(CompilerTest, CompileWhenParallelFunctionOptThenSameAsSequential) {
+  // Several functions sharing struct types, resources and DXIL operations,
+  // so merging them back has types, globals and declarations to map.
+  const char Source[] =
+      "struct S { float4 a; int b; };\n"
+      "RWStructuredBuffer<S> buf;\n"
+      "S make(uint i) { S s; s.a = buf[i].a * 2; s.b = buf[i].b + 1; return s; }\n"
+      "export float4 f0(uint i) { S s = make(i); return s.a + s.b; }\n"
+      "export void f1(uint i) { S s = make(i);\n"
+      "  [unroll] for (int j = 0; j < 4; ++j) s.a[j] += j; buf[i] = s; }\n"
+      "export int f2(uint i, uint j) { return make(i).b * make(j).b; }\n"
+      "export float f3(float x) { return sin(x) + cos(x) * 0; }\n";
+
+  CComPtr<IDxcCompiler> pCompiler;
+  CComPtr<IDxcBlobEncoding> pSource;
+  VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+  CreateBlobFromText(Source, &pSource);
+
+  // The thread count is set so that the functions are optimized concurrently
+  // even on a machine with one hardware thread.
+  std::string Disassembly[2];
+  for (unsigned i = 0; i < 2; ++i) {
+    LPCWSTR Args[] = { L"-opt-enable", L"parallel-function-opt",
+                       L"-opt-select", L"parallel-function-threads", L"4" };
+    CComPtr<IDxcOperationResult> pResult;
+    CComPtr<IDxcBlob> pProgram;
+    CComPtr<IDxcBlobEncoding> pDisassembly;
+    VERIFY_SUCCEEDED(pCompiler->Compile(pSource, L"source.hlsl", L"",
+                                        L"lib_6_3", Args,
+                                        i ? _countof(Args) : 0, nullptr, 0,
+                                        nullptr, &pResult));
+    VerifyOperationSucceeded(pResult);
+    VERIFY_SUCCEEDED(pResult->GetResult(&pProgram));
+    VERIFY_SUCCEEDED(pCompiler->Disassemble(pProgram, &pDisassembly));
+    Disassembly[i] = BlobToUtf8(pDisassembly);
+  }
+  VERIFY_ARE_EQUAL_STR(Disassembly[0].c_str(), Disassembly[1].c_str());
+}
+
+// Times a library of many functions compiled with and without the parallel
+// function passes, and checks that both produce the same program.
+TEST_F(CompilerTest, BenchmarkParallelFunctionOpt) {
+  const unsigned kFunctions = 128;
+  std::stringstream Source;
+  Source << "RWStructuredBuffer<float4> buf;\n";
+  for (unsigned i = 0; i < kFunctions; ++i)
+    Source << "export float4 f" << i << "(uint n) {\n"
+           << "  float4 r = buf[n];\n"
+           << "  [unroll] for (int j = 0; j < 16; ++j)\n"
+           << "    r = sin(r * " << i + 1 << ") + buf[n + j] * cos(r.yzwx);\n"
+           << "  buf[n] = r;\n"
+           << "  return r;\n"
+           << "}\n";
+
+  CComPtr<IDxcCompiler> pCompiler;
+  CComPtr<IDxcBlobEncoding> pSource;
+  VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+  CreateBlobFromText(Source.str().c_str(), &pSource);
+
+  LPCWSTR Args[] = { L"-opt-enable", L"parallel-function-opt" };
+  std::string Disassembly[2];
+  for (unsigned i = 0; i < 2; ++i) {
+    CComPtr<IDxcOperationResult> pResult;
+    CComPtr<IDxcBlob> pProgram;
+    CComPtr<IDxcBlobEncoding> pDisassembly;
+    auto Start = std::chrono::steady_clock::now();
+    VERIFY_SUCCEEDED(pCompiler->Compile(pSource, L"source.hlsl", L"",
+                                        L"lib_6_3", Args,
+                                        i ? _countof(Args) : 0, nullptr, 0,
+                                        nullptr, &pResult));
+    auto End = std::chrono::steady_clock::now();
+    VerifyOperationSucceeded(pResult);
+    LogCommentFmt(
+        L"%s: %u ms", i ? L"parallel" : L"sequential",
+        (unsigned)std::chrono::duration_cast<std::chrono::milliseconds>(
+            End - Start).count());
+    VERIFY_SUCCEEDED(pResult->GetResult(&pProgram));
+    VERIFY_SUCCEEDED(pCompiler->Disassemble(pProgram, &pDisassembly));
+    Disassembly[i] = BlobToUtf8(pDisassembly);
+  }
+  VERIFY_ARE_EQUAL_STR(Disassembly[0].c_str(), Disassembly[1].c_str());
+}
+
+// Returns the -ftime-report output of a compile, or an empty string if there
+// isn't one.
+static std::string CompileTimeReport(IDxcCompiler3 *pCompiler,
+                                     const char *pSource, LPCWSTR *pArgs,
+                                     UINT32 ArgCount) {
+  DxcBuffer Source;
+  Source.Ptr = pSource;
+  Source.Size = strlen(pSource);
+  Source.Encoding = DXC_CP_UTF8;
+  CComPtr<IDxcResult> pResult;
+  VERIFY_SUCCEEDED(pCompiler->Compile(&Source, pArgs, ArgCount, nullptr,
+                                      IID_PPV_ARGS(&pResult)));
+  HRESULT Status;
+  VERIFY_SUCCEEDED(pResult->GetStatus(&Status));
+  VERIFY_SUCCEEDED(Status);
+  if (!pResult->HasOutput(DXC_OUT_TIME_REPORT))
+    return std::string();
+  CComPtr<IDxcBlobUtf8> pReport;
+  VERIFY_SUCCEEDED(pResult->GetOutput(DXC_OUT_TIME_REPORT,
+                                      IID_PPV_ARGS(&pReport), nullptr));
+  return std::string(pReport->GetStringPointer(), pReport->GetStringLength());
+}
+
+// Region names in a time report follow the counts, indented two spaces per
+// level of nesting.
+static const size_t TimeReportNameColumn = 35;
+
+// Returns the lines of a time report that name a region.
+static std::vector<std::string> TimeReportRegions(const std::string &Report) {
+  std::vector<std::string> Regions;
+  std::stringstream Lines(Report);
+  std::string Line;
+  while (std::getline(Lines, Line))
+    if (!Line.empty() && Line[0] != ';' && Line.size() > TimeReportNameColumn)
+      Regions.push_back(Line);
+  return Regions;
+}
+
+static int TimeReportLineDepth(const std::string &Line) {
+  return (int)(Line.find_first_not_of(' ', TimeReportNameColumn) -
+               TimeReportNameColumn) / 2;
+}
+
+// Returns the index of a region's line, or -1 if it isn't there.
+static int FindTimeReportRegion(const std::vector<std::string> &Regions,
+                                const char *pRegion) {
+  for (unsigned i = 0; i < Regions.size(); ++i) {
+    size_t Start = TimeReportNameColumn + TimeReportLineDepth(Regions[i]) * 2;
+    if (Regions[i].compare(Start, std::string::npos, pRegion) == 0)
+      return (int)i;
+  }
+  return -1;
+}
+
+static int TimeReportDepth(const std::string &Report, const char *pRegion) {
+  std::vector<std::string> Regions = TimeReportRegions(Report);
+  int Index = FindTimeReportRegion(Regions, pRegion);
+  return Index < 0 ? -1 : TimeReportLineDepth(Regions[Index]);
+}
+
+TEST_F(CompilerTest, CompileWhenTimeReportThenPhasesReported) {
+  CComPtr<IDxcCompiler> pCompiler;
+  CComPtr<IDxcCompiler3> pCompiler3;
+  VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+  VERIFY_SUCCEEDED(pCompiler.QueryInterface(&pCompiler3));
+
+  const char Shader[] = "#define ONE 1\n"
+                        "float4 main() : SV_Target { return ONE; }\n";
+  LPCWSTR Args[] = { L"-E", L"main", L"-T", L"ps_6_0", L"-ftime-report" };
+  VERIFY_IS_TRUE(
+      CompileTimeReport(pCompiler3, Shader, Args, _countof(Args) - 1).empty());
+
+  std::string Report = CompileTimeReport(pCompiler3, Shader, Args,
+                                         _countof(Args));
+  LogCommentFmt(L"%S", Report.c_str());
+  VERIFY_ARE_EQUAL(0, TimeReportDepth(Report, "Compile"));
+  VERIFY_ARE_EQUAL(1, TimeReportDepth(Report, "Parse and Sema"));
+  VERIFY_ARE_EQUAL(2, TimeReportDepth(Report, "Preprocessor directives"));
+  VERIFY_ARE_EQUAL(2, TimeReportDepth(Report, "IR generation of declarations"));
+  VERIFY_ARE_EQUAL(1, TimeReportDepth(Report,
+                                      "IR generation of module (CGHLSLMS)"));
+  VERIFY_ARE_EQUAL(1, TimeReportDepth(Report, "Optimization and DXIL lowering"));
+  VERIFY_ARE_EQUAL(1, TimeReportDepth(Report, "Container assembly"));
+  VERIFY_ARE_EQUAL(1, TimeReportDepth(Report, "Validation"));
+
+  // Passes run by the workers of the parallel function passes are merged
+  // under the region that started them.
+  const char Library[] =
+      "export float f0(float x) { return sin(x) + 1; }\n"
+      "export float f1(float x) { return cos(x) * 2; }\n";
+  LPCWSTR LibArgs[] = { L"-T", L"lib_6_3", L"-ftime-report",
+                        L"-opt-enable", L"parallel-function-opt",
+                        L"-opt-select", L"parallel-function-threads", L"2" };
+  Report = CompileTimeReport(pCompiler3, Library, LibArgs, _countof(LibArgs));
+  LogCommentFmt(L"%S", Report.c_str());
+  std::vector<std::string> Regions = TimeReportRegions(Report);
+  int Parallel = FindTimeReportRegion(Regions, "DXIL Parallel Function Passes");
+  VERIFY_IS_TRUE(Parallel >= 0 && Parallel + 1 < (int)Regions.size());
+  VERIFY_ARE_EQUAL(TimeReportLineDepth(Regions[Parallel]) + 1,
+                   TimeReportLineDepth(Regions[Parallel + 1]));
+}
+
+// Stress test for SROA on structured-buffer structs nested several levels
+// deep in arrays. Every aggregate should be broken up by the time the DXIL
+// comes out, including the dynamically indexed static array.
+TEST_F(CompilerTest, CompileWhenDeepNestedStructsThenSROAFlattens) {
+  const unsigned kLevels = 5;
+  const unsigned kArraySize = 3;
+  std::stringstream Source;
+  Source << "struct S0 { float4 a; float b[" << kArraySize << "]; };\n";
+  for (unsigned i = 1; i < kLevels; ++i)
+    Source << "struct S" << i << " { S" << i - 1 << " x[" << kArraySize
+           << "]; float2 y; S" << i - 1 << " z; };\n";
+  Source << "RWStructuredBuffer<S" << kLevels - 1 << "> buf;\n"
+         << "static S" << kLevels - 1 << " g[" << kArraySize << "];\n"
+         << "[numthreads(8,1,1)] void main(uint id : SV_DispatchThreadID) {\n"
+         << "  for (uint i = 0; i < " << kArraySize << "; ++i)\n"
+         << "    g[i] = buf[id + i];\n"
+         << "  S" << kLevels - 1 << " t = g[id % " << kArraySize << "];\n"
+         << "  t.y += t.z";
+  for (unsigned i = 2; i < kLevels; ++i)
+    Source << ".z";
+  Source << ".a.xy;\n"
+         << "  buf[id] = t;\n"
+         << "}\n";
+
+  CComPtr<IDxcCompiler> pCompiler;
+  CComPtr<IDxcOperationResult> pResult;
+  CComPtr<IDxcBlobEncoding> pSource;
+  CComPtr<IDxcBlob> pProgram;
+  CComPtr<IDxcBlobEncoding> pDisassembly;
+  VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+  CreateBlobFromText(Source.str().c_str(), &pSource);
+  VERIFY_SUCCEEDED(pCompiler->Compile(pSource, L"source.hlsl", L"main",
+                                      L"cs_6_0", nullptr, 0, nullptr, 0,
+                                      nullptr, &pResult));
+  VerifyOperationSucceeded(pResult);
+  VERIFY_SUCCEEDED(pResult->GetResult(&pProgram));
+  VERIFY_SUCCEEDED(pCompiler->Disassemble(pProgram, &pDisassembly));
+  std::string Disassembly = BlobToUtf8(pDisassembly);
+
+  // Flattened allocas and static globals hold scalars or arrays of scalars.
+  // Anything that still names a type, like %struct.S0, wasn't broken up.
+  std::stringstream Lines(Disassembly);
+  std::string Line;
+  while (std::getline(Lines, Line)) {
+    for (const char *Decl : { "= alloca ", "internal global " }) {
+      size_t Pos = Line.find(Decl);
+      if (Pos == std::string::npos)
+        continue;
+      std::string Type = Line.substr(Pos + strlen(Decl));
+      Type = Type.substr(0, Type.find(','));
+      VERIFY_ARE_EQUAL(std::string::npos, Type.find('%'),
+                       CA2W(Line.c_str(), CP_UTF8));
+    }
+  }
+  VERIFY_ARE_NOT_EQUAL(std::string::npos,
+                       Disassembly.find("@dx.op.bufferStore"));
+}
+
 static const char EmptyCompute[] = "[numthreads(8,8,1)] void main() { }";
 
 TEST_F(CompilerTest, CompileWhenODumpThenPassConfig) {
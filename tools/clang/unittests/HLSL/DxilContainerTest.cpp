@@ -41,6 +41,7 @@
 #endif
 
 #include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "dxc/Test/HLSLTestData.h"
@@ -49,8 +50,10 @@
 
 #include "dxc/Support/Global.h"
 #include "dxc/Support/dxcapi.use.h"
+#include "dxc/Support/FileIOHelper.h"
 #include "dxc/Support/HLSLOptions.h"
 #include "dxc/DxilContainer/DxilContainer.h"
+#include "dxc/DxilContainer/DxilContainerArchive.h"
 #include "dxc/DxilContainer/DxilRuntimeReflection.h"
 #include <assert.h> // Needed for DxilPipelineStateValidation.h
 #include "dxc/DxilContainer/DxilPipelineStateValidation.h"
@@ -101,6 +104,7 @@ public:
   TEST_METHOD(CompileWhenOkThenCheckReflection1)
   TEST_METHOD(DxcUtils_CreateReflection)
   TEST_METHOD(CompileWhenOKThenIncludesFeatureInfo)
+  TEST_METHOD(CompileWhenKeepReflectThenProgramOmitsRootSignature)
   TEST_METHOD(CompileWhenOKThenIncludesSignatures)
   TEST_METHOD(CompileWhenSigSquareThenIncludeSplit)
   TEST_METHOD(DisassemblyWhenMissingThenFails)
@@ -109,7 +113,10 @@ public:
   TEST_METHOD(DisassemblyWhenValidThenOK)
   TEST_METHOD(ValidateFromLL_Abs2)
   TEST_METHOD(DxilContainerUnitTest)
+  TEST_METHOD(DxilContainerWhenMappedThenPartsMatch)
+  TEST_METHOD(DxilContainerArchiveWhenPackedThenUnpacksSame)
 
+  TEST_METHOD(ReflectionWhenLazyThenMatchesEager)
   TEST_METHOD(ReflectionMatchesDXBC_CheckIn)
   BEGIN_TEST_METHOD(ReflectionMatchesDXBC_Full)
     TEST_METHOD_PROPERTY(L"Priority", L"1")
@@ -1573,6 +1580,41 @@ TEST_F(DxilContainerTest, CompileWhenOKThenIncludesFeatureInfo) {
   VERIFY_ARE_EQUAL(0U, *(const uint64_t *)hlsl::GetDxilPartData(*pPartIter));
 }
 
+TEST_F(DxilContainerTest, CompileWhenKeepReflectThenProgramOmitsRootSignature) {
+  // The root signature lives in its own part, so with reflection kept in the
+  // DXIL part and no debug info, the program part must match the one built
+  // without any root signature.
+  LPCWSTR Args[] = { L"-Qkeep_reflect_in_dxil" };
+  CComPtr<IDxcBlob> pWithRS, pWithoutRS;
+  CompileToProgram("[RootSignature(\"CBV(b0)\")] float4 main() : SV_Target { return 0; }",
+                   L"main", L"ps_6_0", Args, _countof(Args), &pWithRS);
+  CompileToProgram("float4 main() : SV_Target { return 0; }",
+                   L"main", L"ps_6_0", Args, _countof(Args), &pWithoutRS);
+
+  const hlsl::DxilContainerHeader *pHeaderWithRS = hlsl::IsDxilContainerLike(
+      pWithRS->GetBufferPointer(), pWithRS->GetBufferSize());
+  const hlsl::DxilContainerHeader *pHeaderWithoutRS = hlsl::IsDxilContainerLike(
+      pWithoutRS->GetBufferPointer(), pWithoutRS->GetBufferSize());
+  VERIFY_IS_NOT_NULL(hlsl::GetDxilPartByType(pHeaderWithRS, hlsl::DFCC_RootSignature));
+  const hlsl::DxilPartHeader *pProgramWithRS =
+      hlsl::GetDxilPartByType(pHeaderWithRS, hlsl::DFCC_DXIL);
+  const hlsl::DxilPartHeader *pProgramWithoutRS =
+      hlsl::GetDxilPartByType(pHeaderWithoutRS, hlsl::DFCC_DXIL);
+  VERIFY_IS_NOT_NULL(pProgramWithRS);
+  VERIFY_IS_NOT_NULL(pProgramWithoutRS);
+  VERIFY_ARE_EQUAL(pProgramWithoutRS->PartSize, pProgramWithRS->PartSize);
+  VERIFY_IS_TRUE(0 == memcmp(hlsl::GetDxilPartData(pProgramWithoutRS),
+                             hlsl::GetDxilPartData(pProgramWithRS),
+                             pProgramWithRS->PartSize));
+
+  CComPtr<IDxcCompiler> pCompiler;
+  CComPtr<IDxcBlobEncoding> pDisassembly;
+  VERIFY_SUCCEEDED(CreateCompiler(&pCompiler));
+  VERIFY_SUCCEEDED(pCompiler->Disassemble(pWithRS, &pDisassembly));
+  std::string Text = BlobToUtf8(pDisassembly);
+  VERIFY_IS_TRUE(Text.find("!dx.rootSignature") == std::string::npos);
+}
+
 TEST_F(DxilContainerTest, DisassemblyWhenBCInvalidThenFails) {
   CComPtr<IDxcCompiler> pCompiler;
   CComPtr<IDxcBlobEncoding> pSource;
@@ -1801,6 +1843,82 @@ TEST_F(DxilContainerTest, ReflectionMatchesDXBC_CheckIn) {
     D3DCOMPILE_ENABLE_BACKWARDS_COMPATIBILITY);
 }
 
+TEST_F(DxilContainerTest, ReflectionWhenLazyThenMatchesEager) {
+  // From validator 1.5 on, usage is kept in metadata and reflection skips
+  // function bodies. Validator 1.4 output still needs the bodies, so
+  // reflecting the same source both ways must agree.
+  if (m_ver.SkipDxilVersion(1, 5)) return;
+
+  const char *pShader =
+    "cbuffer CB : register(b0) { float4 used; float4 unused; float2 part; };\n"
+    "Texture2D<float4> tex : register(t0);\n"
+    "SamplerState samp : register(s0);\n"
+    "struct PSIn { float4 pos : SV_Position; float4 uv : TEXCOORD0;\n"
+    "              float3 n : NORMAL; };\n"
+    "float4 main(PSIn i) : SV_Target {\n"
+    "  return tex.Sample(samp, i.uv.xy) * used + part.x * i.n.y;\n"
+    "}\n";
+  LPCWSTR eagerArgs[] = { L"-validator-version", L"1.4" };
+
+  CComPtr<IDxcBlob> pLazyProgram, pEagerProgram;
+  CompileToProgram(pShader, L"main", L"ps_6_0", nullptr, 0, &pLazyProgram);
+  CompileToProgram(pShader, L"main", L"ps_6_0", eagerArgs,
+                   _countof(eagerArgs), &pEagerProgram);
+  CComPtr<ID3D12ShaderReflection> pLazy, pEager;
+  CreateReflectionFromBlob(pLazyProgram, &pLazy);
+  CreateReflectionFromBlob(pEagerProgram, &pEager);
+  CompareReflection(pLazy, pEager);
+
+  // CompareReflection allows for fxc differences in usage; these must match.
+  D3D12_SHADER_DESC desc;
+  VERIFY_SUCCEEDED(pLazy->GetDesc(&desc));
+  for (UINT i = 0; i < desc.InputParameters; ++i) {
+    D3D12_SIGNATURE_PARAMETER_DESC lazyParam, eagerParam;
+    VERIFY_SUCCEEDED(pLazy->GetInputParameterDesc(i, &lazyParam));
+    VERIFY_SUCCEEDED(pEager->GetInputParameterDesc(i, &eagerParam));
+    VERIFY_ARE_EQUAL(lazyParam.ReadWriteMask, eagerParam.ReadWriteMask);
+  }
+  for (UINT i = 0; i < desc.OutputParameters; ++i) {
+    D3D12_SIGNATURE_PARAMETER_DESC lazyParam, eagerParam;
+    VERIFY_SUCCEEDED(pLazy->GetOutputParameterDesc(i, &lazyParam));
+    VERIFY_SUCCEEDED(pEager->GetOutputParameterDesc(i, &eagerParam));
+    VERIFY_ARE_EQUAL(lazyParam.ReadWriteMask, eagerParam.ReadWriteMask);
+  }
+
+  // Libraries take the same path through function reflection.
+  CComPtr<IDxcBlob> pLazyLib, pEagerLib;
+  CompileToProgram(Ref1_Shader, L"", L"lib_6_3", nullptr, 0, &pLazyLib);
+  CompileToProgram(Ref1_Shader, L"", L"lib_6_3", eagerArgs,
+                   _countof(eagerArgs), &pEagerLib);
+  CComPtr<ID3D12LibraryReflection> pLazyLibRefl, pEagerLibRefl;
+  {
+    CComPtr<IDxcContainerReflection> pReflection;
+    UINT32 partIdx;
+    VERIFY_SUCCEEDED(m_dllSupport.CreateInstance(CLSID_DxcContainerReflection,
+                                                 &pReflection));
+    VERIFY_SUCCEEDED(pReflection->Load(pLazyLib));
+    VERIFY_SUCCEEDED(pReflection->FindFirstPartKind(hlsl::DFCC_DXIL, &partIdx));
+    VERIFY_SUCCEEDED(pReflection->GetPartReflection(
+        partIdx, IID_PPV_ARGS(&pLazyLibRefl)));
+    VERIFY_SUCCEEDED(pReflection->Load(pEagerLib));
+    VERIFY_SUCCEEDED(pReflection->FindFirstPartKind(hlsl::DFCC_DXIL, &partIdx));
+    VERIFY_SUCCEEDED(pReflection->GetPartReflection(
+        partIdx, IID_PPV_ARGS(&pEagerLibRefl)));
+  }
+  D3D12_LIBRARY_DESC lazyLibDesc, eagerLibDesc;
+  VERIFY_SUCCEEDED(pLazyLibRefl->GetDesc(&lazyLibDesc));
+  VERIFY_SUCCEEDED(pEagerLibRefl->GetDesc(&eagerLibDesc));
+  VERIFY_ARE_EQUAL(lazyLibDesc.FunctionCount, eagerLibDesc.FunctionCount);
+  for (INT iFn = 0; iFn < (INT)lazyLibDesc.FunctionCount; ++iFn) {
+    D3D12_FUNCTION_DESC lazyFn, eagerFn;
+    VERIFY_SUCCEEDED(pLazyLibRefl->GetFunctionByIndex(iFn)->GetDesc(&lazyFn));
+    VERIFY_SUCCEEDED(pEagerLibRefl->GetFunctionByIndex(iFn)->GetDesc(&eagerFn));
+    VERIFY_ARE_EQUAL_STR(lazyFn.Name, eagerFn.Name);
+    VERIFY_ARE_EQUAL(lazyFn.ConstantBuffers, eagerFn.ConstantBuffers);
+    VERIFY_ARE_EQUAL(lazyFn.BoundResources, eagerFn.BoundResources);
+  }
+}
+
 TEST_F(DxilContainerTest, ReflectionMatchesDXBC_Full) {
   WEX::TestExecution::SetVerifyOutput verifySettings(WEX::TestExecution::VerifyOutputSettings::LogOnlyFailures);
   std::wstring codeGenPath = hlsl_test::GetPathToHlslDataFile(L"..\\CodeGenHLSL\\Samples");
@@ -1913,3 +2031,136 @@ TEST_F(DxilContainerTest, DxilContainerUnitTest) {
   VERIFY_IS_NULL(hlsl::GetDxilPartByType(&header, hlsl::DxilFourCC::DFCC_DXIL));
 
 }
+
+TEST_F(DxilContainerTest, DxilContainerWhenMappedThenPartsMatch) {
+  CComPtr<IDxcBlob> pProgram;
+  CompileToProgram("float4 main() : SV_Target { return 0; }", L"main",
+                   L"ps_6_0", nullptr, 0, &pProgram);
+
+  wchar_t TempPath[MAX_PATH];
+  VERIFY_WIN32_BOOL_SUCCEEDED(GetTempPathW(MAX_PATH, TempPath) != 0);
+  std::wstring FileName(TempPath);
+  FileName += L"DxilContainerWhenMappedThenPartsMatch.dxbc";
+  hlsl::WriteBinaryFile(FileName.c_str(), pProgram->GetBufferPointer(),
+                        pProgram->GetBufferSize());
+
+  CComPtr<IDxcBlobEncoding> pMapped;
+  dxc::MapFileIntoBlob(FileName.c_str(), &pMapped);
+  VERIFY_ARE_EQUAL(pProgram->GetBufferSize(), pMapped->GetBufferSize());
+  VERIFY_IS_TRUE(0 == memcmp(pProgram->GetBufferPointer(),
+                             pMapped->GetBufferPointer(),
+                             pMapped->GetBufferSize()));
+
+  // Parts read through the mapping point into it rather than at copies.
+  CComPtr<IDxcContainerReflection> pReflection;
+  VERIFY_SUCCEEDED(m_dllSupport.CreateInstance(CLSID_DxcContainerReflection,
+                                               &pReflection));
+  VERIFY_SUCCEEDED(pReflection->Load(pMapped));
+  const hlsl::DxilContainerHeader *pHeader = hlsl::IsDxilContainerLike(
+      pMapped->GetBufferPointer(), pMapped->GetBufferSize());
+  VERIFY_IS_TRUE(hlsl::IsValidDxilContainer(pHeader, pMapped->GetBufferSize()));
+  UINT32 partCount;
+  VERIFY_SUCCEEDED(pReflection->GetPartCount(&partCount));
+  VERIFY_ARE_EQUAL(pHeader->PartCount, partCount);
+  UINT32 i = 0;
+  for (auto it = hlsl::begin(pHeader), e = hlsl::end(pHeader); it != e;
+       ++it, ++i) {
+    CComPtr<IDxcBlob> pContent;
+    VERIFY_SUCCEEDED(pReflection->GetPartContent(i, &pContent));
+    VERIFY_ARE_EQUAL((const void *)hlsl::GetDxilPartData(*it),
+                     (const void *)pContent->GetBufferPointer());
+    VERIFY_ARE_EQUAL((SIZE_T)(*it)->PartSize, pContent->GetBufferSize());
+  }
+
+  pReflection.Release();
+  pMapped.Release();
+  DeleteFileW(FileName.c_str());
+}
+
+TEST_F(DxilContainerTest, DxilContainerArchiveWhenPackedThenUnpacksSame) {
+  if (m_ver.SkipDxilVersion(1, 5)) return; // Needs the HASH part.
+  // The first two shaders share their root signature and output signature
+  // parts; the third has the first one's program under another root
+  // signature, so only its root signature sets it apart.
+  const char *Programs[] = {
+    "[RootSignature(\"CBV(b0)\")] float4 main() : SV_Target { return 0; }",
+    "[RootSignature(\"CBV(b0)\")] float4 main() : SV_Target { return 1; }",
+    "[RootSignature(\"CBV(b1)\")] float4 main() : SV_Target { return 0; }",
+  };
+  CComPtr<IDxcBlob> pPrograms[_countof(Programs)];
+  std::string Archive;
+  unsigned PartCount = 0;
+  {
+    llvm::raw_string_ostream OS(Archive);
+    hlsl::DxilArchiveWriter Writer(OS);
+    for (unsigned i = 0; i < _countof(Programs); ++i) {
+      CompileToProgram(Programs[i], L"main", L"ps_6_0", nullptr, 0,
+                       &pPrograms[i]);
+      const hlsl::DxilContainerHeader *pHeader = hlsl::IsDxilContainerLike(
+          pPrograms[i]->GetBufferPointer(), pPrograms[i]->GetBufferSize());
+      PartCount += pHeader->PartCount;
+      VERIFY_ARE_EQUAL(S_OK, Writer.AddContainer(
+                                 pPrograms[i]->GetBufferPointer(),
+                                 (uint32_t)pPrograms[i]->GetBufferSize()));
+    }
+    VERIFY_ARE_EQUAL(S_FALSE, Writer.AddContainer(
+                                  pPrograms[0]->GetBufferPointer(),
+                                  (uint32_t)pPrograms[0]->GetBufferSize()));
+    Writer.Finish();
+    VERIFY_ARE_EQUAL((uint32_t)_countof(Programs), Writer.GetShaderCount());
+    VERIFY_IS_TRUE(Writer.GetPartCount() < PartCount);
+  }
+
+  auto GetShaderHash = [&](unsigned i) {
+    const hlsl::DxilContainerHeader *pHeader = hlsl::IsDxilContainerLike(
+        pPrograms[i]->GetBufferPointer(), pPrograms[i]->GetBufferSize());
+    const hlsl::DxilPartHeader *pHashPart =
+        hlsl::GetDxilPartByType(pHeader, hlsl::DxilFourCC::DFCC_ShaderHash);
+    VERIFY_IS_NOT_NULL(pHashPart);
+    return std::string(
+        (const char *)((const hlsl::DxilShaderHash *)hlsl::GetDxilPartData(
+                           pHashPart))->Digest,
+        hlsl::DxilContainerHashSize);
+  };
+  VERIFY_IS_TRUE(GetShaderHash(0) == GetShaderHash(2));
+
+  hlsl::DxilArchiveReader Reader;
+  VERIFY_SUCCEEDED(Reader.Load(Archive.data(), Archive.size()));
+  VERIFY_FAILED(hlsl::DxilArchiveReader().Load(Archive.data(),
+                                               Archive.size() - 1));
+  for (unsigned i = 0; i < _countof(Programs); ++i) {
+    llvm::MD5 Hash;
+    Hash.update(llvm::ArrayRef<uint8_t>(
+        (const uint8_t *)pPrograms[i]->GetBufferPointer(),
+        pPrograms[i]->GetBufferSize()));
+    llvm::MD5::MD5Result Digest;
+    Hash.final(Digest);
+    uint32_t Index;
+    VERIFY_IS_TRUE(Reader.FindShader(Digest, &Index));
+    VERIFY_ARE_EQUAL(i, Index);
+
+    CComPtr<hlsl::AbstractMemoryStream> pStream;
+    VERIFY_SUCCEEDED(
+        hlsl::CreateMemoryStream(hlsl::GetGlobalHeapMalloc(), &pStream));
+    Reader.UnpackContainer(Index, pStream);
+    VERIFY_ARE_EQUAL(Reader.GetContainerSize(Index), pStream->GetPtrSize());
+    VERIFY_ARE_EQUAL((ULONG)pPrograms[i]->GetBufferSize(),
+                     pStream->GetPtrSize());
+    VERIFY_IS_TRUE(0 == memcmp(pPrograms[i]->GetBufferPointer(),
+                               pStream->GetPtr(), pStream->GetPtrSize()));
+  }
+
+  // Looking up by HASH part finds every container with that program.
+  std::vector<uint32_t> Indices;
+  std::string ShaderHash = GetShaderHash(0);
+  Reader.FindShadersByHash((const uint8_t *)ShaderHash.data(), Indices);
+  std::sort(Indices.begin(), Indices.end());
+  VERIFY_ARE_EQUAL(2U, (unsigned)Indices.size());
+  VERIFY_ARE_EQUAL(0U, Indices[0]);
+  VERIFY_ARE_EQUAL(2U, Indices[1]);
+  Indices.clear();
+  ShaderHash = GetShaderHash(1);
+  Reader.FindShadersByHash((const uint8_t *)ShaderHash.data(), Indices);
+  VERIFY_ARE_EQUAL(1U, (unsigned)Indices.size());
+  VERIFY_ARE_EQUAL(1U, Indices[0]);
+}
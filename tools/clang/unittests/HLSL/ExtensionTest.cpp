@@ -530,6 +530,7 @@ public:
   TEST_METHOD(ResourceExtensionIntrinsicCustomLowering1)
   TEST_METHOD(ResourceExtensionIntrinsicCustomLowering2)
   TEST_METHOD(ResourceExtensionIntrinsicCustomLowering3)
+  TEST_METHOD(OverloadResolutionWhenMixedThenPinned)
 };
 
 TEST_F(ExtensionTest, DefineWhenRegisteredThenPreserved) {
@@ -1182,3 +1183,66 @@ TEST_F(ExtensionTest, ResourceExtensionIntrinsicCustomLowering3) {
   };
   CheckMsgs(disassembly.c_str(), disassembly.length(), expected, 1, true);
 }
+
+TEST_F(ExtensionTest, OverloadResolutionWhenMixedThenPinned) {
+  // Pins the overload picked for built-in intrinsics, which are found through
+  // the name index of the global table, and for extension intrinsics, whose
+  // definitions are looked up once per name and then reused.
+  Compiler c(m_dllSupport);
+  c.RegisterIntrinsicTable(new TestIntrinsicTable());
+  auto result = c.Compile(
+    "Texture1D tex1;\n"
+    "cbuffer CB { double d; };\n"
+    "float4 main(float2 v : V, int2 i : I, uint2 u : U) : SV_Target {\n"
+    "  float2 a = test_fn(v);\n"
+    "  float2 b = test_fn(v * 2);\n"
+    "  float2 fm = mad(v, v, v);\n"
+    "  int2 im = mad(i, i, i);\n"
+    "  uint2 um = mad(u, u, u);\n"
+    "  uint lo, hi;\n"
+    "  asuint(d, lo, hi);\n"
+    "  uint bits = asuint(v.x);\n"
+    "  float2 t2 = tex1.MyTextureOp(1, 2);\n"
+    "  float2 t3 = tex1.MyTextureOp(1, 2, 3);\n"
+    "  return float4(a + b + fm + im + um + t2 + t3, lo + hi, bits);\n"
+    "}\n",
+    { L"/Vd" }, {}
+  );
+  CheckOperationResultMsgs(result, {}, true, false);
+  std::string disassembly = c.Disassemble();
+
+  LPCSTR expected[] = {
+    // Extension function from the global namespace.
+    "call float @\"test.\\01?test_fn@hlsl@@YA?AV?$vector@M$01@@V2@@Z.r\"(i32 1, float",
+    // Float, int and uint overloads of mad.
+    "call float @dx.op.tertiary.f32(i32 46",
+    "call i32 @dx.op.tertiary.i32(i32 48",
+    "call i32 @dx.op.tertiary.i32(i32 49",
+    // The three argument overload of asuint.
+    "@dx.op.splitDouble.f64(i32 102",
+  };
+  CheckMsgs(disassembly.c_str(), disassembly.length(), expected,
+            _countof(expected), false);
+
+  // Both overloads of an extension method, told apart by argument count.
+  LPCSTR expectedMethods[] = {
+    "call %dx.types.ResRet.i32 @MyTextureOp\\(i32 17, %dx.types.Handle %.*, i32 1, i32 undef, i32 2, i32 undef, i32 undef\\)",
+    "call %dx.types.ResRet.i32 @MyTextureOp\\(i32 17, %dx.types.Handle %.*, i32 1, i32 undef, i32 2, i32 3, i32 undef\\)",
+  };
+  CheckMsgs(disassembly.c_str(), disassembly.length(), expectedMethods,
+            _countof(expectedMethods), true);
+
+  // No overload takes this many arguments, for a built-in or an extension.
+  Compiler failing(m_dllSupport);
+  failing.RegisterIntrinsicTable(new TestIntrinsicTable());
+  IDxcOperationResult *pCompileResult = failing.Compile(
+    "float2 main(float2 v : V) : SV_Target {\n"
+    "  return test_fn(v, v) + mad(v, v);\n"
+    "}\n",
+    { L"/Vd" }, {}
+  );
+  CheckOperationFailed(pCompileResult);
+  std::string errors = GetCompileErrors(pCompileResult);
+  VERIFY_IS_TRUE(errors.npos != errors.find("'test_fn'"));
+  VERIFY_IS_TRUE(errors.npos != errors.find("'mad'"));
+}
@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// FileIOHelperTest.cpp                                                      //
+// Copyright (C) Microsoft Corporation. All rights reserved.                 //
+// This file is distributed under the University of Illinois Open Source     //
+// License. See LICENSE.TXT for details.                                     //
+//                                                                           //
+// Provides tests for the file and blob helpers of dxcsupport.               //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef UNICODE
+#define UNICODE
+#endif
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "dxc/Support/WinIncludes.h"
+#include "dxc/dxcapi.h"
+
+#ifdef _WIN32
+#include "WexTestClass.h"
+#endif
+#include "dxc/Test/HlslTestUtils.h"
+
+#include "dxc/Support/Global.h"
+#include "dxc/Support/FileIOHelper.h"
+#include "dxc/Support/Unicode.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+
+using namespace std;
+using namespace hlsl_test;
+
+#ifdef _WIN32
+class FileIOHelperTest {
+#else
+class FileIOHelperTest : public ::testing::Test {
+#endif
+public:
+  BEGIN_TEST_CLASS(FileIOHelperTest)
+    TEST_CLASS_PROPERTY(L"Parallel", L"true")
+    TEST_METHOD_PROPERTY(L"Priority", L"0")
+  END_TEST_CLASS()
+
+  TEST_METHOD(MapFileWhenWrittenThenContentsMatch)
+  TEST_METHOD(MapFileWhenEmptyThenEmptyBlob)
+  TEST_METHOD(MapFileWhenMissingThenFail)
+
+  // Returns the path of a file in the temporary directory; each test uses
+  // its own name, as the tests may run in parallel.
+  static std::string GetTempFilePath(const char *pName) {
+    llvm::SmallString<128> Path;
+    llvm::sys::path::system_temp_directory(/*ErasedOnReboot*/ true, Path);
+    llvm::sys::path::append(Path, pName);
+    return Path.str();
+  }
+};
+
+TEST_F(FileIOHelperTest, MapFileWhenWrittenThenContentsMatch) {
+  // Spans several pages and ends partway through one.
+  std::vector<char> Contents(3 * 4096 + 123);
+  for (size_t i = 0; i < Contents.size(); ++i)
+    Contents[i] = (char)(i * 7 + i / 4096);
+  std::string Path = GetTempFilePath("MapFileWhenWrittenThenContentsMatch.bin");
+  CA2W PathW(Path.c_str(), CP_UTF8);
+  hlsl::WriteBinaryFile(PathW, Contents.data(), (DWORD)Contents.size());
+
+  CComPtr<IDxcBlobEncoding> pMapped;
+  UINT32 CodePage = CP_UTF8;
+  VERIFY_SUCCEEDED(hlsl::DxcCreateBlobFromFileMapping(nullptr, PathW,
+                                                      &CodePage, &pMapped));
+  VERIFY_ARE_EQUAL((SIZE_T)Contents.size(), pMapped->GetBufferSize());
+  VERIFY_IS_TRUE(0 == memcmp(Contents.data(), pMapped->GetBufferPointer(),
+                             Contents.size()));
+  BOOL Known;
+  UINT32 MappedCodePage;
+  VERIFY_SUCCEEDED(pMapped->GetEncoding(&Known, &MappedCodePage));
+  VERIFY_IS_TRUE(Known != FALSE);
+  VERIFY_ARE_EQUAL((UINT32)CP_UTF8, MappedCodePage);
+
+  // A second mapping of the same file is a view of its own.
+  CComPtr<IDxcBlobEncoding> pMappedAgain;
+  VERIFY_SUCCEEDED(hlsl::DxcCreateBlobFromFileMapping(nullptr, PathW, nullptr,
+                                                      &pMappedAgain));
+  VERIFY_ARE_NOT_EQUAL(pMapped->GetBufferPointer(),
+                       pMappedAgain->GetBufferPointer());
+  VERIFY_IS_TRUE(0 == memcmp(pMapped->GetBufferPointer(),
+                             pMappedAgain->GetBufferPointer(),
+                             Contents.size()));
+
+  // Releasing the blobs unmaps the views, so the file can be removed.
+  pMapped.Release();
+  pMappedAgain.Release();
+  VERIFY_ARE_EQUAL(0, std::remove(Path.c_str()));
+}
+
+TEST_F(FileIOHelperTest, MapFileWhenEmptyThenEmptyBlob) {
+  std::string Path = GetTempFilePath("MapFileWhenEmptyThenEmptyBlob.bin");
+  CA2W PathW(Path.c_str(), CP_UTF8);
+  hlsl::WriteBinaryFile(PathW, "", 0);
+
+  CComPtr<IDxcBlobEncoding> pMapped;
+  VERIFY_SUCCEEDED(
+      hlsl::DxcCreateBlobFromFileMapping(nullptr, PathW, nullptr, &pMapped));
+  VERIFY_ARE_EQUAL((SIZE_T)0, pMapped->GetBufferSize());
+
+  pMapped.Release();
+  VERIFY_ARE_EQUAL(0, std::remove(Path.c_str()));
+}
+
+TEST_F(FileIOHelperTest, MapFileWhenMissingThenFail) {
+  std::string Path = GetTempFilePath("MapFileWhenMissingThenFail.bin");
+  std::remove(Path.c_str());
+  CA2W PathW(Path.c_str(), CP_UTF8);
+
+  CComPtr<IDxcBlobEncoding> pMapped;
+  VERIFY_FAILED(
+      hlsl::DxcCreateBlobFromFileMapping(nullptr, PathW, nullptr, &pMapped));
+  VERIFY_IS_NULL(pMapped.p);
+}
@@ -65,6 +65,7 @@ public:
   TEST_METHOD(RunLinkWithValidatorVersion);
   TEST_METHOD(RunLinkWithTempReg);
   TEST_METHOD(RunLinkToLibWithGlobalCtor);
+  TEST_METHOD(RunLinkReusedLinkerMatchesFreshLinker);
 
 
   dxc::DxcDllSupport m_dllSupport;
@@ -144,6 +145,23 @@ public:
     CheckNotMsgs(IR.c_str(), IR.size(), pCheckNotMsgs.data(), pCheckNotMsgs.size(), bRegEx);
   }
 
+  std::string LinkToDisassembly(LPCWSTR pEntryName, LPCWSTR pShaderModel,
+                                IDxcLinker *pLinker,
+                                ArrayRef<LPCWSTR> libNames) {
+    CComPtr<IDxcOperationResult> pResult;
+    VERIFY_SUCCEEDED(pLinker->Link(pEntryName, pShaderModel, libNames.data(),
+                                   libNames.size(), nullptr, 0, &pResult));
+    CComPtr<IDxcBlob> pProgram;
+    CheckOperationSucceeded(pResult, &pProgram);
+
+    CComPtr<IDxcCompiler> pCompiler;
+    CComPtr<IDxcBlobEncoding> pDisassembly;
+    VERIFY_SUCCEEDED(
+        m_dllSupport.CreateInstance(CLSID_DxcCompiler, &pCompiler));
+    VERIFY_SUCCEEDED(pCompiler->Disassemble(pProgram, &pDisassembly));
+    return BlobToUtf8(pDisassembly);
+  }
+
   void LinkCheckMsg(LPCWSTR pEntryName, LPCWSTR pShaderModel, IDxcLinker *pLinker,
             ArrayRef<LPCWSTR> libNames, llvm::ArrayRef<LPCSTR> pErrorMsgs,
             llvm::ArrayRef<LPCWSTR> pArguments = {}) {
@@ -789,3 +807,54 @@ TEST_F(LinkerTest, RunLinkToLibWithGlobalCtor) {
        {},
        {});
 }
+
+TEST_F(LinkerTest, RunLinkReusedLinkerMatchesFreshLinker) {
+  // A linker keeps what it learns about a library across Link calls. Linking
+  // entries again, in any order, must give what a fresh linker gives.
+  CComPtr<IDxcBlob> pEntryLib;
+  CompileLib(L"..\\CodeGenHLSL\\lib_entries2.hlsl", &pEntryLib);
+  CComPtr<IDxcBlob> pResLib;
+  CompileLib(L"..\\CodeGenHLSL\\lib_resource2.hlsl", &pResLib);
+  CComPtr<IDxcBlob> pGlobalLib;
+  CompileLib(L"..\\CodeGenHLSL\\lib_global.hlsl", &pGlobalLib, {}, L"lib_6_3");
+
+  LPCWSTR libName = L"entry";
+  LPCWSTR libResName = L"res";
+  LPCWSTR libGlobalName = L"global";
+
+  struct LinkCase {
+    LPCWSTR pEntryName;
+    LPCWSTR pShaderModel;
+    std::vector<LPCWSTR> libNames;
+  };
+  const LinkCase cases[] = {
+    {L"vs_main", L"vs_6_0", {libName}},
+    {L"cs_main", L"cs_6_0", {libName, libResName}},
+    {L"ps_main", L"ps_6_0", {libName}},
+    {L"test", L"ps_6_0", {libGlobalName}},
+  };
+
+  CComPtr<IDxcLinker> pLinker;
+  CreateLinker(&pLinker);
+  RegisterDxcModule(libName, pEntryLib, pLinker);
+  RegisterDxcModule(libResName, pResLib, pLinker);
+  RegisterDxcModule(libGlobalName, pGlobalLib, pLinker);
+
+  for (unsigned pass = 0; pass < 2; ++pass) {
+    for (unsigned i = 0; i < _countof(cases); ++i) {
+      // Second time around, link in reverse order.
+      const LinkCase &c = cases[pass ? _countof(cases) - 1 - i : i];
+      std::string reused =
+          LinkToDisassembly(c.pEntryName, c.pShaderModel, pLinker, c.libNames);
+
+      CComPtr<IDxcLinker> pFreshLinker;
+      CreateLinker(&pFreshLinker);
+      RegisterDxcModule(libName, pEntryLib, pFreshLinker);
+      RegisterDxcModule(libResName, pResLib, pFreshLinker);
+      RegisterDxcModule(libGlobalName, pGlobalLib, pFreshLinker);
+      std::string fresh = LinkToDisassembly(c.pEntryName, c.pShaderModel,
+                                            pFreshLinker, c.libNames);
+      VERIFY_ARE_EQUAL_STR(fresh.c_str(), reused.c_str());
+    }
+  }
+}
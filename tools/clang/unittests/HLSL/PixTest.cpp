@@ -22,6 +22,7 @@
 #include <string>
 #include <map>
 #include <cassert>
+#include <chrono>
 #include <sstream>
 #include <algorithm>
 #include <cfloat>
@@ -191,7 +192,11 @@ public:
   TEST_METHOD(DiaLoadRelocatedBitcode)
   TEST_METHOD(DiaLoadBitcodePlusExtraData)
   TEST_METHOD(DiaCompileArgs)
+  TEST_METHOD(DiaQueryLinesBeforeSymbolsThenOK)
   TEST_METHOD(PixDebugCompileInfo)
+  BEGIN_TEST_METHOD(DiaFindLinesByLinenumBenchmark)
+      TEST_METHOD_PROPERTY(L"Priority", L"2")
+  END_TEST_METHOD()
 
   TEST_METHOD(PixStructAnnotation_Simple)
   TEST_METHOD(PixStructAnnotation_CopiedStruct)
@@ -524,6 +529,32 @@ public:
     return lines;
   }
  
+  // Writes pSymbol and the symbols under it, one per line.
+  void WriteSymbolTree(IDiaSymbol *pSymbol, std::wstringstream &o,
+                       unsigned depth) {
+    DWORD symId;
+    DWORD symTag;
+    CComBSTR name;
+    VERIFY_SUCCEEDED(pSymbol->get_symIndexId(&symId));
+    VERIFY_SUCCEEDED(pSymbol->get_symTag(&symTag));
+    pSymbol->get_name(&name);
+    o << std::wstring(depth * 2, L' ') << symId << L" " << symTag;
+    if (name) {
+      o << L" " << (BSTR)name;
+    }
+    o << L"\n";
+
+    CComPtr<IDiaEnumSymbols> pChildren;
+    CComPtr<IDiaSymbol> pChild;
+    ULONG celt;
+    VERIFY_SUCCEEDED(
+        pSymbol->findChildren(SymTagNull, nullptr, nsNone, &pChildren));
+    while (SUCCEEDED(pChildren->Next(1, &pChild, &celt)) && celt == 1) {
+      WriteSymbolTree(pChild, o, depth + 1);
+      pChild.Release();
+    }
+  }
+
   std::string GetOption(std::string &cmd, char *opt) {
     std::string option = cmd.substr(cmd.find(opt));
     option = option.substr(option.find_first_of(' '));
@@ -1203,6 +1234,18 @@ TEST_F(PixTest, CompileDebugLines) {
   CComBSTR pName;
   VERIFY_SUCCEEDED(pFile->get_fileName(&pName));
   VERIFY_ARE_EQUAL_WSTR(pName, L"source.hlsl");
+
+  // Verify lines are ok when getting by line number.
+  pEnumLineNumbers.Release();
+  VERIFY_SUCCEEDED(pSession->findLinesByLinenum(nullptr, pFile, 5, 0, &pEnumLineNumbers));
+  std::vector<LineNumber> linesByLinenum = ReadLineNumbers(pEnumLineNumbers);
+  VERIFY_ARE_EQUAL(linesByLinenum.size(), 2);
+  VERIFY_ARE_EQUAL(linesByLinenum[0].rva, 16);
+  VERIFY_ARE_EQUAL(linesByLinenum[1].rva, 17);
+
+  pEnumLineNumbers.Release();
+  VERIFY_ARE_EQUAL(S_FALSE, pSession->findLinesByLinenum(nullptr, pFile, 42, 0, &pEnumLineNumbers));
+  VERIFY_ARE_EQUAL(ReadLineNumbers(pEnumLineNumbers).size(), 0);
 }
 
 TEST_F(PixTest, DiaLoadBadBitcodeThenFail) {
@@ -1621,6 +1664,118 @@ TEST_F(PixTest, DiaTableIndexThenOK) {
   VERIFY_FAILED(pEnumTables->Item(vtIndex, &pTable));
 }
 
+TEST_F(PixTest, DiaQueryLinesBeforeSymbolsThenOK) {
+  CComPtr<IDiaDataSource> pDiaSource;
+  VERIFY_SUCCEEDED(CreateDiaSourceForCompile(
+    "struct S { float a; float2 b; };\r\n"
+    "float helper(float v) {\r\n"
+    "  S s;\r\n"
+    "  s.a = v;\r\n"
+    "  s.b = v.xx;\r\n"
+    "  return s.a + s.b.y;\r\n"
+    "}\r\n"
+    "float main(float pos : A) : SV_Target {\r\n"
+    "  float r = 0;\r\n"
+    "  for (int i = 0; i < 2; ++i) {\r\n"
+    "    float t = helper(pos + i);\r\n"
+    "    r += t;\r\n"
+    "  }\r\n"
+    "  return r;\r\n"
+    "}", &pDiaSource));
+
+  // Reads the lines of every instruction; the first RVA past the end fails.
+  auto getLines = [&](IDiaSession *pSession) {
+    std::vector<LineNumber> lines;
+    for (DWORD rva = 0;; ++rva) {
+      CComPtr<IDiaEnumLineNumbers> pEnumLineNumbers;
+      HRESULT hr = pSession->findLinesByRVA(rva, 1, &pEnumLineNumbers);
+      if (hr == E_INVALIDARG)
+        break;
+      VERIFY_SUCCEEDED(hr);
+      std::vector<LineNumber> rvaLines = ReadLineNumbers(pEnumLineNumbers);
+      lines.insert(lines.end(), rvaLines.begin(), rvaLines.end());
+    }
+    return lines;
+  };
+  const DWORD kD3DCodeSection = 1;
+  auto getInlineFrame = [&](IDiaSession *pSession, DWORD rva) {
+    CComPtr<IDiaEnumSymbols> pFrames;
+    CComPtr<IDiaSymbol> pFrame;
+    ULONG celt;
+    VERIFY_SUCCEEDED(pSession->findInlineFramesByAddr(nullptr, kD3DCodeSection,
+                                                      rva, &pFrames));
+    VERIFY_SUCCEEDED(pFrames->Next(1, &pFrame, &celt));
+    VERIFY_IS_TRUE(celt == 1);
+    DWORD symId;
+    VERIFY_SUCCEEDED(pFrame->get_symIndexId(&symId));
+    return symId;
+  };
+  auto getSymbolTree = [&](IDiaSession *pSession) {
+    CComPtr<IDiaSymbol> pGlobalScope;
+    std::wstringstream o;
+    VERIFY_SUCCEEDED(pSession->get_globalScope(&pGlobalScope));
+    WriteSymbolTree(pGlobalScope, o, 0);
+    return o.str();
+  };
+
+  // Lines, then the scope of an instruction, then the symbols. Each step
+  // only creates the symbols it needs.
+  std::vector<LineNumber> linesFirst;
+  DWORD frameAfterLines;
+  std::wstring treeAfterLines;
+  {
+    CComPtr<IDiaSession> pSession;
+    VERIFY_SUCCEEDED(pDiaSource->openSession(&pSession));
+    linesFirst = getLines(pSession);
+    VERIFY_IS_FALSE(linesFirst.empty());
+    frameAfterLines = getInlineFrame(pSession, linesFirst.back().rva);
+    treeAfterLines = getSymbolTree(pSession);
+  }
+
+  // The same, after listing the symbols table creates every symbol.
+  std::vector<LineNumber> linesLast;
+  DWORD frameAfterSymbols;
+  std::wstring treeAfterSymbols;
+  {
+    CComPtr<IDiaSession> pSession;
+    CComPtr<IDiaEnumTables> pTables;
+    CComPtr<IDiaTable> pTable;
+    CComPtr<IDiaEnumSymbols> pSymbols;
+    VERIFY_SUCCEEDED(pDiaSource->openSession(&pSession));
+    VERIFY_SUCCEEDED(pSession->getEnumTables(&pTables));
+    ULONG celt;
+    while (SUCCEEDED(pTables->Next(1, &pTable, &celt)) && celt == 1) {
+      if (SUCCEEDED(pTable->QueryInterface(&pSymbols)))
+        break;
+      pTable.Release();
+    }
+    VERIFY_IS_NOT_NULL(pSymbols.p);
+    LONG count;
+    VERIFY_SUCCEEDED(pSymbols->get_Count(&count));
+    LONG listed = 0;
+    CComPtr<IDiaSymbol> pSymbol;
+    while (SUCCEEDED(pSymbols->Next(1, &pSymbol, &celt)) && celt == 1) {
+      ++listed;
+      pSymbol.Release();
+    }
+    VERIFY_ARE_EQUAL(count, listed);
+
+    treeAfterSymbols = getSymbolTree(pSession);
+    frameAfterSymbols = getInlineFrame(pSession, linesFirst.back().rva);
+    linesLast = getLines(pSession);
+  }
+
+  // Symbol IDs don't depend on the order of the queries.
+  VERIFY_IS_NOT_NULL(wcsstr(treeAfterLines.c_str(), L" main\n"));
+  VERIFY_ARE_EQUAL_WSTR(treeAfterSymbols.c_str(), treeAfterLines.c_str());
+  VERIFY_ARE_EQUAL(frameAfterSymbols, frameAfterLines);
+  VERIFY_ARE_EQUAL(linesLast.size(), linesFirst.size());
+  for (size_t i = 0; i < linesFirst.size(); ++i) {
+    VERIFY_ARE_EQUAL(linesLast[i].line, linesFirst[i].line);
+    VERIFY_ARE_EQUAL(linesLast[i].rva, linesFirst[i].rva);
+  }
+}
+
 TEST_F(PixTest, PixDebugCompileInfo) {
   static const char source[] = R"(
     SamplerState  samp0 : register(s0);
@@ -1730,6 +1885,73 @@ TEST_F(PixTest, PixDebugCompileInfo) {
   VERIFY_ARE_EQUAL(std::wstring(profile), std::wstring(hlslTarget));
 }
 
+TEST_F(PixTest, DiaFindLinesByLinenumBenchmark) {
+  // One statement per line; the session annotates every instruction of the
+  // entry function with its PIX instruction number when it loads.
+  const DWORD kLines = 4000;
+  const DWORD kFirstLine = 3;
+  std::stringstream Source;
+  Source << "float main(float pos : A) : SV_Target {\n"
+         << "  float x = pos;\n";
+  for (DWORD i = 0; i < kLines; ++i)
+    Source << "  x = sin(x) * " << i + 1 << " + pos;\n";
+  Source << "  return x;\n"
+         << "}\n";
+
+  CComPtr<IDiaDataSource> pDiaSource;
+  VERIFY_SUCCEEDED(CreateDiaSourceForCompile(Source.str().c_str(), &pDiaSource));
+  CComPtr<IDiaSession> pSession;
+  VERIFY_SUCCEEDED(pDiaSource->openSession(&pSession));
+  CComPtr<IDiaSourceFile> pFile;
+  VERIFY_SUCCEEDED(pSession->findFileById(0, &pFile));
+
+  // Count the entries per line in the line number table.
+  std::map<DWORD, size_t> EntriesPerLine;
+  size_t TableEntries;
+  {
+    CComPtr<IDiaEnumTables> pTables;
+    CComPtr<IDiaTable> pTable;
+    CComPtr<IDiaEnumLineNumbers> pEnumLineNumbers;
+    VERIFY_SUCCEEDED(pSession->getEnumTables(&pTables));
+    DWORD celt;
+    while (SUCCEEDED(pTables->Next(1, &pTable, &celt)) && celt == 1) {
+      if (SUCCEEDED(pTable->QueryInterface(&pEnumLineNumbers)))
+        break;
+      pTable.Release();
+    }
+    VERIFY_IS_NOT_NULL(pEnumLineNumbers.p);
+    std::vector<LineNumber> Table = ReadLineNumbers(pEnumLineNumbers);
+    TableEntries = Table.size();
+    for (const LineNumber &L : Table)
+      ++EntriesPerLine[L.line];
+  }
+
+  std::vector<CComPtr<IDiaEnumLineNumbers>> Found(kLines);
+  auto Start = std::chrono::steady_clock::now();
+  for (DWORD i = 0; i < kLines; ++i)
+    VERIFY_SUCCEEDED(pSession->findLinesByLinenum(nullptr, pFile,
+                                                  kFirstLine + i, 0,
+                                                  &Found[i]));
+  auto End = std::chrono::steady_clock::now();
+  LogCommentFmt(
+      L"findLinesByLinenum: %u lines, %u table entries, %u ms",
+      (unsigned)kLines, (unsigned)TableEntries,
+      (unsigned)std::chrono::duration_cast<std::chrono::milliseconds>(
+          End - Start).count());
+
+  // Each line of the body has instructions, and a lookup finds exactly the
+  // table's entries for its line.
+  for (DWORD i = 0; i < kLines; ++i) {
+    DWORD Line = kFirstLine + i;
+    VERIFY_IS_NOT_NULL(Found[i].p);
+    std::vector<LineNumber> Lines = ReadLineNumbers(Found[i]);
+    VERIFY_IS_FALSE(Lines.empty());
+    VERIFY_ARE_EQUAL(EntriesPerLine[Line], Lines.size());
+    for (const LineNumber &L : Lines)
+      VERIFY_ARE_EQUAL(Line, L.line);
+  }
+}
+
 // This function lives in lib\DxilPIXPasses\DxilAnnotateWithVirtualRegister.cpp
 // Declared here so we can test it.
 uint32_t CountStructMembers(llvm::Type const* pType);
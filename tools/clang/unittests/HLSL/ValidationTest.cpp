@@ -20,6 +20,10 @@
 #include "llvm/ADT/ArrayRef.h"
 #include "dxc/DxilContainer/DxilContainer.h"
 #include "dxc/DxilContainer/DxilContainerAssembler.h"
+#include "dxc/HLSL/DxilValidation.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
 
 #ifdef _WIN32
 #include <atlbase.h>
@@ -243,6 +247,9 @@ public:
   TEST_METHOD(WhenPSVMismatchThenFail)
   TEST_METHOD(WhenRDATMismatchThenFail)
   TEST_METHOD(WhenFeatureInfoMismatchThenFail)
+  TEST_METHOD(WhenProgramHeaderMismatchThenFail)
+  TEST_METHOD(WhenProgramPartMissingThenFail)
+  TEST_METHOD(WhenProgramPartDiffersFromBitcodeThenFail)
   TEST_METHOD(RayShaderWithSignaturesFail)
 
   TEST_METHOD(ViewIDInCSFail)
@@ -3040,6 +3047,134 @@ TEST_F(ValidationTest, WhenFeatureInfoMismatchThenFail) {
   );
 }
 
+TEST_F(ValidationTest, WhenProgramHeaderMismatchThenFail) {
+  CComPtr<IDxcBlob> pProgram;
+  if (!CompileSource("float4 main() : SV_Target { return 0; }", "ps_6_0",
+                     &pProgram))
+    return;
+
+  // Claim a vertex shader in the program header; the module is still loaded
+  // from the part's bitcode, which is a pixel shader.
+  std::vector<char> container((const char *)pProgram->GetBufferPointer(),
+                              (const char *)pProgram->GetBufferPointer() +
+                                  pProgram->GetBufferSize());
+  DxilContainerHeader *pHeader = (DxilContainerHeader *)container.data();
+  DxilPartIterator it = std::find_if(begin(pHeader), end(pHeader),
+                                     DxilPartIsType(DFCC_DXIL));
+  VERIFY_IS_TRUE(it != end(pHeader));
+  DxilProgramHeader *pProgramHeader =
+      (DxilProgramHeader *)GetDxilPartData(*it);
+  pProgramHeader->ProgramVersion = EncodeVersion(DXIL::ShaderKind::Vertex, 6, 0);
+
+  CheckValidationMsgs(container.data(), container.size(),
+                      {"Container part 'DXIL' does not match expected for module.",
+                       "Validation failed."});
+}
+
+TEST_F(ValidationTest, WhenProgramPartMissingThenFail) {
+  CComPtr<IDxcBlob> pProgram;
+  if (!CompileSource("float4 main() : SV_Target { return 0; }", "ps_6_0",
+                     &pProgram))
+    return;
+
+  // A container can't be validated without its DXIL part unless the module
+  // is supplied separately, as the compiler does, so validate in process.
+  std::string diagStr;
+  llvm::raw_string_ostream diagStream(diagStr);
+  llvm::DiagnosticPrinterRawOStream diagPrinter(diagStream);
+  PrintDiagnosticContext diagContext(diagPrinter);
+  llvm::LLVMContext context, debugContext;
+  context.setDiagnosticHandler(PrintDiagnosticContext::PrintDiagnosticHandler,
+                               &diagContext, true);
+  std::unique_ptr<llvm::Module> pModule, pDebugModule;
+  VERIFY_SUCCEEDED(ValidateLoadModuleFromContainer(
+      pProgram->GetBufferPointer(), (uint32_t)pProgram->GetBufferSize(),
+      pModule, pDebugModule, context, debugContext, diagStream));
+  pModule->GetOrCreateDxilModule();
+
+  const DxilContainerHeader *pHeader = IsDxilContainerLike(
+      pProgram->GetBufferPointer(), pProgram->GetBufferSize());
+  VERIFY_IS_NOT_NULL(pHeader);
+  unique_ptr<DxilContainerWriter> pContainerWriter(NewDxilContainerWriter());
+  for (auto pPart : pHeader) {
+    if (pPart->PartFourCC == DFCC_DXIL)
+      continue;
+    pContainerWriter->AddPart(pPart->PartFourCC, pPart->PartSize, [=](AbstractMemoryStream *pStream) {
+      ULONG cbWritten = 0;
+      pStream->Write(GetDxilPartData(pPart), pPart->PartSize, &cbWritten);
+    });
+  }
+  CComPtr<IMalloc> pMalloc;
+  VERIFY_SUCCEEDED(CoGetMalloc(1, &pMalloc));
+  CComPtr<AbstractMemoryStream> pOutputStream;
+  VERIFY_SUCCEEDED(CreateMemoryStream(pMalloc, &pOutputStream));
+  pOutputStream->Reserve(pContainerWriter->size());
+  pContainerWriter->write(pOutputStream);
+
+  VERIFY_ARE_EQUAL(DXC_E_MALFORMED_CONTAINER,
+                   ValidateDxilContainerParts(
+                       pModule.get(), pDebugModule.get(),
+                       (const DxilContainerHeader *)pOutputStream->GetPtr(),
+                       (uint32_t)pOutputStream->GetPtrSize()));
+  diagStream.flush();
+  VERIFY_IS_TRUE(diagStr.find("Missing part 'DXIL' required by module.") !=
+                 std::string::npos);
+}
+
+TEST_F(ValidationTest, WhenProgramPartDiffersFromBitcodeThenFail) {
+  CComPtr<IDxcBlob> pProgram;
+  if (!CompileSource("float4 main() : SV_Target { return 0; }", "ps_6_0",
+                     &pProgram))
+    return;
+
+  std::string diagStr;
+  llvm::raw_string_ostream diagStream(diagStr);
+  llvm::DiagnosticPrinterRawOStream diagPrinter(diagStream);
+  PrintDiagnosticContext diagContext(diagPrinter);
+  llvm::LLVMContext context, debugContext;
+  context.setDiagnosticHandler(PrintDiagnosticContext::PrintDiagnosticHandler,
+                               &diagContext, true);
+  std::unique_ptr<llvm::Module> pModule, pDebugModule;
+  VERIFY_SUCCEEDED(ValidateLoadModuleFromContainer(
+      pProgram->GetBufferPointer(), (uint32_t)pProgram->GetBufferSize(),
+      pModule, pDebugModule, context, debugContext, diagStream));
+  pModule->GetOrCreateDxilModule();
+
+  const DxilContainerHeader *pHeader = IsDxilContainerLike(
+      pProgram->GetBufferPointer(), pProgram->GetBufferSize());
+  VERIFY_IS_NOT_NULL(pHeader);
+  const DxilProgramHeader *pProgramHeader =
+      GetDxilProgramHeader(pHeader, DFCC_DXIL);
+  VERIFY_IS_NOT_NULL(pProgramHeader);
+  const char *pBitcode;
+  uint32_t bitcodeSize;
+  GetDxilProgramBitcode(pProgramHeader, &pBitcode, &bitcodeSize);
+
+  // The part's own bitcode passes, as the compiler's does.
+  std::vector<char> bitcode(pBitcode, pBitcode + bitcodeSize);
+  VERIFY_SUCCEEDED(ValidateDxilContainerParts(
+      pModule.get(), pDebugModule.get(), pHeader,
+      (uint32_t)pProgram->GetBufferSize(), bitcode.data(),
+      (uint32_t)bitcode.size()));
+
+  // Bitcode that differs in one byte, or in length, doesn't.
+  bitcode.back() ^= 1;
+  VERIFY_ARE_EQUAL(DXC_E_MALFORMED_CONTAINER,
+                   ValidateDxilContainerParts(
+                       pModule.get(), pDebugModule.get(), pHeader,
+                       (uint32_t)pProgram->GetBufferSize(), bitcode.data(),
+                       (uint32_t)bitcode.size()));
+  bitcode.back() ^= 1;
+  VERIFY_ARE_EQUAL(DXC_E_MALFORMED_CONTAINER,
+                   ValidateDxilContainerParts(
+                       pModule.get(), pDebugModule.get(), pHeader,
+                       (uint32_t)pProgram->GetBufferSize(), bitcode.data(),
+                       (uint32_t)bitcode.size() - 4));
+  diagStream.flush();
+  VERIFY_IS_TRUE(diagStr.find("Container part 'DXIL' does not match "
+                              "expected for module.") != std::string::npos);
+}
+
 TEST_F(ValidationTest, RayShaderWithSignaturesFail) {
   if (m_ver.SkipDxilVersion(1, 3)) return;
   RewriteAssemblyCheckMsg(
@@ -8,7 +8,17 @@
 //===----------------------------------------------------------------------===//
 
 #include "FileTestFixture.h"
+#include "FileTestUtils.h"
 #include "WholeFileTestFixture.h"
+#include "dxc/Support/SPIRVOptions.h"
+#include "dxc/Support/WinIncludes.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MSFileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "spirv-tools/optimizer.hpp"
 
 namespace {
 using clang::spirv::FileTest;
@@ -1496,6 +1506,191 @@ TEST_F(FileTest, SpirvOptOconfigInvalidFlag) {
 }
 TEST_F(FileTest, SpirvOptOconfig) { runFileTest("spirv.opt.cl.oconfig.hlsl"); }
 
+// The recipe tests read and write recipes through llvm::sys::fs, which goes
+// through the thread's file system.
+class SpirvOptRecipe : public ::testing::Test {
+protected:
+  void SetUp() override {
+    llvm::sys::fs::MSFileSystem *msfPtr;
+    ASSERT_TRUE(SUCCEEDED(CreateMSFileSystemForDisk(&msfPtr)));
+    msf.reset(msfPtr);
+    pts.reset(new llvm::sys::fs::AutoPerThreadSystem(msf.get()));
+    ASSERT_FALSE(pts->error_code());
+  }
+  void TearDown() override {
+    pts.reset();
+    msf.reset();
+  }
+
+private:
+  std::unique_ptr<llvm::sys::fs::MSFileSystem> msf;
+  std::unique_ptr<llvm::sys::fs::AutoPerThreadSystem> pts;
+};
+
+// Test -fspv-opt-recipe-dir: the first compile tunes and saves a recipe, the
+// next one reuses it, and a damaged recipe is tuned and saved again.
+TEST_F(SpirvOptRecipe, SpirvOptRecipeWhenSavedThenReused) {
+  llvm::SmallString<128> dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("spvopt-recipe", dir));
+  llvm::SmallString<128> recipePath(dir);
+  llvm::sys::path::append(recipePath, "test.spvopt");
+  const std::vector<std::string> args = {
+      "-O3", "-fspv-opt-recipe-dir=" + dir.str().str(),
+      "-fspv-opt-recipe-class=test"};
+  const std::string input =
+      clang::spirv::utils::getAbsPathOfInputDataFile("spirv.opt.cl.oconfig.hlsl");
+
+  auto compile = [&](std::vector<uint32_t> *binary) {
+    std::string errors;
+    EXPECT_TRUE(clang::spirv::utils::runCompilerWithSpirvGeneration(
+        input, "main", "vs_6_0", args, binary, &errors))
+        << errors;
+  };
+  auto readRecipe = [&]() {
+    auto buffer = llvm::MemoryBuffer::getFile(recipePath);
+    return buffer ? buffer.get()->getBuffer().str() : std::string();
+  };
+
+  std::vector<uint32_t> tuned, reused, retuned;
+  compile(&tuned);
+  const std::string recipe = readRecipe();
+  ASSERT_FALSE(recipe.empty());
+  EXPECT_EQ(0u, recipe.find("--"));
+
+  compile(&reused);
+  EXPECT_EQ(recipe, readRecipe());
+  EXPECT_EQ(tuned, reused);
+
+  for (const char *damaged : {"", "--not-a-pass\n", "garbage\n"}) {
+    {
+      std::error_code ec;
+      llvm::raw_fd_ostream os(recipePath, ec, llvm::sys::fs::F_None);
+      ASSERT_FALSE(ec);
+      os << damaged;
+    }
+    retuned.clear();
+    compile(&retuned);
+    EXPECT_EQ(recipe, readRecipe());
+    EXPECT_EQ(tuned, retuned);
+  }
+
+  llvm::sys::fs::remove(recipePath);
+  llvm::sys::fs::remove(dir);
+}
+
+TEST_F(SpirvOptRecipe, SpirvOptRecipeWhenNoClassThenKeyedByProfile) {
+  llvm::SmallString<128> dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("spvopt-recipe", dir));
+  llvm::SmallString<128> recipePath(dir);
+  llvm::sys::path::append(recipePath, "vs_6_0.spvopt");
+  const std::vector<std::string> args = {
+      "-O3", "-fspv-opt-recipe-dir=" + dir.str().str()};
+
+  auto compile = [&](const char *file, std::vector<uint32_t> *binary) {
+    std::string errors;
+    EXPECT_TRUE(clang::spirv::utils::runCompilerWithSpirvGeneration(
+        clang::spirv::utils::getAbsPathOfInputDataFile(file), "main",
+        "vs_6_0", args, binary, &errors))
+        << errors;
+  };
+
+  // Both shaders share the recipe of their profile; the first one tunes it.
+  std::vector<uint32_t> first, second;
+  compile("spirv.opt.cl.oconfig.hlsl", &first);
+  ASSERT_TRUE(llvm::sys::fs::exists(recipePath.str()));
+  compile("semantic.vertex-id.vs.hlsl", &second);
+  EXPECT_FALSE(second.empty());
+
+  unsigned recipeCount = 0;
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator it(dir, ec), end; it != end && !ec;
+       it.increment(ec))
+    ++recipeCount;
+  EXPECT_EQ(1u, recipeCount);
+
+  llvm::sys::fs::remove(recipePath);
+  llvm::sys::fs::remove(dir);
+}
+
+TEST_F(SpirvOptRecipe, SpirvOptRecipeWhenUntunableThenNotTunedAgain) {
+  llvm::SmallString<128> dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("spvopt-recipe", dir));
+  llvm::SmallString<128> recipePath(dir);
+  llvm::sys::path::append(recipePath, "test.spvopt");
+  {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(recipePath, ec, llvm::sys::fs::F_None);
+    ASSERT_FALSE(ec);
+    os << clang::spirv::kSpirvOptRecipeUntunable << "\n";
+  }
+  const std::string input =
+      clang::spirv::utils::getAbsPathOfInputDataFile("spirv.opt.cl.oconfig.hlsl");
+
+  // A class marked untunable compiles like -O3 and keeps its marker.
+  std::vector<uint32_t> plain, marked;
+  std::string errors;
+  EXPECT_TRUE(clang::spirv::utils::runCompilerWithSpirvGeneration(
+      input, "main", "vs_6_0", {"-O3"}, &plain, &errors))
+      << errors;
+  EXPECT_TRUE(clang::spirv::utils::runCompilerWithSpirvGeneration(
+      input, "main", "vs_6_0",
+      {"-O3", "-fspv-opt-recipe-dir=" + dir.str().str(),
+       "-fspv-opt-recipe-class=test"},
+      &marked, &errors))
+      << errors;
+  EXPECT_EQ(plain, marked);
+
+  auto buffer = llvm::MemoryBuffer::getFile(recipePath);
+  ASSERT_TRUE((bool)buffer);
+  EXPECT_EQ(std::string(clang::spirv::kSpirvOptRecipeUntunable) + "\n",
+            buffer.get()->getBuffer().str());
+
+  llvm::sys::fs::remove(recipePath);
+  llvm::sys::fs::remove(dir);
+}
+
+TEST_F(SpirvOptRecipe, SpirvOptWhenTimeReportThenSameOutput) {
+  const std::string input =
+      clang::spirv::utils::getAbsPathOfInputDataFile("spirv.opt.cl.oconfig.hlsl");
+  std::vector<uint32_t> plain, timed;
+  std::string errors;
+  EXPECT_TRUE(clang::spirv::utils::runCompilerWithSpirvGeneration(
+      input, "main", "vs_6_0", {"-O3"}, &plain, &errors))
+      << errors;
+  EXPECT_TRUE(clang::spirv::utils::runCompilerWithSpirvGeneration(
+      input, "main", "vs_6_0", {"-O3", "-ftime-report"}, &timed, &errors))
+      << errors;
+  EXPECT_FALSE(plain.empty());
+  EXPECT_EQ(plain, timed);
+}
+
+// Legalization and optimization run in one optimizer when both are needed.
+// The result should be what running the two one after the other gives: the
+// legalized shader of -O0 followed by the performance passes.
+TEST(SpirvLegalization, LegalizeWhenOptimizedThenSameAsSeparateRuns) {
+  const std::string input = clang::spirv::utils::getAbsPathOfInputDataFile(
+      "spirv.legal.sbuffer.usage.hlsl");
+  std::vector<uint32_t> combined, separate;
+  std::string errors;
+  EXPECT_TRUE(clang::spirv::utils::runCompilerWithSpirvGeneration(
+      input, "main", "ps_6_0", {"-O3"}, &combined, &errors))
+      << errors;
+  EXPECT_TRUE(clang::spirv::utils::runCompilerWithSpirvGeneration(
+      input, "main", "ps_6_0", {"-O0"}, &separate, &errors))
+      << errors;
+
+  spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_0);
+  optimizer.RegisterPerformancePasses();
+  optimizer.RegisterPass(spvtools::CreateCompactIdsPass());
+  spvtools::OptimizerOptions options;
+  options.set_run_validator(false);
+  ASSERT_TRUE(optimizer.Run(separate.data(), separate.size(), &separate,
+                            options));
+
+  EXPECT_FALSE(combined.empty());
+  EXPECT_EQ(separate, combined);
+}
+
 // For shader stage input/output interface
 // For semantic SV_Position, SV_ClipDistance, SV_CullDistance
 TEST_F(FileTest, SpirvStageIOInterfaceVS) {
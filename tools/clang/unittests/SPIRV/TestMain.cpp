@@ -10,6 +10,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Signals.h"
 
 #include "SpirvTestOptions.h"
@@ -140,7 +141,12 @@ int main(int argc, char **argv) {
 
   // DxcInitThreadMalloc()/DxcCleanupThreadMalloc() only once for module.
   DxcInitThreadMalloc();
+  // Tests that touch the disk through llvm::sys::fs set a file system for
+  // their thread.
+  if (llvm::sys::fs::SetupPerThreadFileSystem())
+    return 1;
   int result = RUN_ALL_TESTS();
+  llvm::sys::fs::CleanupPerThreadFileSystem();
   DxcCleanupThreadMalloc();
 
   return result;
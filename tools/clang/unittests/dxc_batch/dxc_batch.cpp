@@ -34,7 +34,10 @@
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <comdef.h>
+#include <deque>
+#include <mutex>
 #include <thread>
 #include <unordered_map>
 #include <ios>
@@ -750,6 +753,37 @@ void DxcContext::WriteHeader(IDxcBlobEncoding *pDisassembly, IDxcBlob *pCode,
   }
 }
 
+// A batch command along with what is known about its cost and its outcome.
+struct BatchJob {
+  llvm::StringRef Command;
+  double ExpectedMs = -1; // From timing history; negative when unknown.
+  double DurationMs = 0;
+  int RetVal = 0;
+  std::string ErrorString;
+};
+
+// Pending jobs of one worker, in decreasing expected cost. The owner and
+// thieves both take from the front so the longest remaining job starts first.
+class BatchWorkQueue {
+public:
+  void Push(unsigned jobIdx) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(jobIdx);
+  }
+  bool Pop(unsigned &jobIdx) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_jobs.empty())
+      return false;
+    jobIdx = m_jobs.front();
+    m_jobs.pop_front();
+    return true;
+  }
+
+private:
+  std::mutex m_mutex;
+  std::deque<unsigned> m_jobs;
+};
+
 class DxcBatchContext {
 public:
   DxcBatchContext(DxcOpts &Opts, DxcDllSupport &dxcSupport)
@@ -760,13 +794,116 @@ public:
 private:
   DxcOpts &m_Opts;
   DxcDllSupport &m_dxcSupport;
+
+  void RunJob(BatchJob &job, llvm::StringRef path, bool bLibLink);
+  void RunJobsInParallel(std::vector<BatchJob> &jobs, llvm::StringRef path,
+                         bool bLibLink);
+  StringRefUtf16 GetTimingHistoryPath();
+  void ReadTimingHistory(std::vector<BatchJob> &jobs);
+  void WriteTimingHistory(const std::vector<BatchJob> &jobs);
 };
 
+void DxcBatchContext::RunJob(BatchJob &job, llvm::StringRef path,
+                             bool bLibLink) {
+  auto t_start = std::chrono::steady_clock::now();
+  job.RetVal =
+      Compile(job.Command, m_dxcSupport, path, bLibLink, job.ErrorString);
+  auto t_end = std::chrono::steady_clock::now();
+  job.DurationMs =
+      std::chrono::duration<double, std::milli>(t_end - t_start).count();
+}
+
+// Runs the jobs on a fixed set of workers. Jobs are dealt to per-worker queues
+// longest-expected-first; a worker that runs dry steals from the others, so a
+// single slow shader only holds up its own worker.
+void DxcBatchContext::RunJobsInParallel(std::vector<BatchJob> &jobs,
+                                        llvm::StringRef path, bool bLibLink) {
+  std::vector<unsigned> order(jobs.size());
+  for (unsigned i = 0; i < jobs.size(); i++)
+    order[i] = i;
+  // Jobs without history are assumed to be expensive and go first.
+  std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+    double costA = jobs[a].ExpectedMs < 0 ? HUGE_VAL : jobs[a].ExpectedMs;
+    double costB = jobs[b].ExpectedMs < 0 ? HUGE_VAL : jobs[b].ExpectedMs;
+    return costA > costB;
+  });
+
+  unsigned threadNum = std::max<unsigned>(
+      1, std::min<unsigned>(std::thread::hardware_concurrency(), jobs.size()));
+  std::vector<BatchWorkQueue> queues(threadNum);
+  for (unsigned i = 0; i < order.size(); i++)
+    queues[i % threadNum].Push(order[i]);
+
+  auto worker = [&](unsigned self) {
+    unsigned jobIdx;
+    for (;;) {
+      bool found = queues[self].Pop(jobIdx);
+      for (unsigned i = 1; !found && i < threadNum; i++)
+        found = queues[(self + i) % threadNum].Pop(jobIdx);
+      if (!found)
+        return; // No job is ever queued after the workers start.
+      RunJob(jobs[jobIdx], path, bLibLink);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(threadNum);
+  for (unsigned i = 0; i < threadNum; i++)
+    threads.emplace_back(worker, i);
+  for (auto &th : threads)
+    th.join();
+}
+
+StringRefUtf16 DxcBatchContext::GetTimingHistoryPath() {
+  return StringRefUtf16((m_Opts.InputFile + ".timing").str());
+}
+
+// The timing history has one "<milliseconds>\t<command>" line per command of
+// the last run. It only affects scheduling, so a missing file is not an error.
+void DxcBatchContext::ReadTimingHistory(std::vector<BatchJob> &jobs) {
+  CComPtr<IDxcBlobEncoding> pHistory;
+  try {
+    ReadFileIntoBlob(m_dxcSupport, GetTimingHistoryPath(), &pHistory);
+  } catch (const ::hlsl::Exception &) {
+    return;
+  }
+  llvm::StringRef history((char *)pHistory->GetBufferPointer(),
+                          pHistory->GetBufferSize());
+  llvm::SmallVector<llvm::StringRef, 4> lines;
+  history.split(lines, "\n", /*MaxSplit*/-1, /*KeepEmpty*/false);
+
+  std::unordered_map<std::string, double> expected;
+  for (llvm::StringRef line : lines) {
+    std::pair<llvm::StringRef, llvm::StringRef> fields = line.split('\t');
+    llvm::StringRef command = fields.second.trim();
+    unsigned long long ms;
+    if (command.empty() || fields.first.getAsInteger(10, ms))
+      continue;
+    expected[command.str()] = (double)ms;
+  }
+  for (BatchJob &job : jobs) {
+    auto it = expected.find(job.Command.str());
+    if (it != expected.end())
+      job.ExpectedMs = it->second;
+  }
+}
+
+void DxcBatchContext::WriteTimingHistory(const std::vector<BatchJob> &jobs) {
+  std::string history;
+  llvm::raw_string_ostream OS(history);
+  for (const BatchJob &job : jobs)
+    OS << (unsigned long long)job.DurationMs << '\t' << job.Command << '\n';
+  OS.flush();
+  try {
+    hlsl::WriteBinaryFile(GetTimingHistoryPath(), history.data(),
+                          history.size());
+  } catch (const ::hlsl::Exception &) {
+    fprintf(stderr, "dxc_batch warning : unable to write timing history.\n");
+  }
+}
+
 int DxcBatchContext::BatchCompile(bool bMultiThread, bool bLibLink) {
   int retVal = 0;
-  DxcOpts tmp_Opts;
-  // tmp_Opts = m_Opts;
-  m_Opts.InputFile;
   SmallString<128> path(m_Opts.InputFile.begin(), m_Opts.InputFile.end());
   llvm::sys::path::remove_filename(path);
 
@@ -777,58 +914,39 @@ int DxcBatchContext::BatchCompile(bool bMultiThread, bool bLibLink) {
   llvm::SmallVector<llvm::StringRef, 4> commands;
   source.split(commands, "\n", /*MaxSplit*/-1, /*KeepEmpty*/false);
 
-  if (bMultiThread) {
-    unsigned int threadNum = std::min<unsigned>(
-        std::thread::hardware_concurrency(), commands.size());
-    auto empty_fn = []() {};
-    std::vector<std::thread> threads(threadNum);
-    std::vector<std::string> errorStrings(threadNum);
-    for (unsigned i = 0; i < threadNum; i++)
-      threads[i] = std::thread(empty_fn);
-
-    for (unsigned i = 0; i < commands.size(); i++) {
-      // trim to remove /r if exist.
-      llvm::StringRef command = commands[i].trim();
-      if (command.empty())
-        continue;
-      if (command.startswith("//"))
-        continue;
-
-      unsigned threadIdx = i % threadNum;
-      threads[threadIdx].join();
+  std::vector<BatchJob> jobs;
+  for (llvm::StringRef command : commands) {
+    // trim to remove /r if exist.
+    command = command.trim();
+    if (command.empty())
+      continue;
+    if (command.startswith("//"))
+      continue;
+    jobs.emplace_back();
+    jobs.back().Command = command;
+  }
 
-      threads[threadIdx] = std::thread(
-          ::Compile, command, std::ref(m_dxcSupport), path.str(), bLibLink,
-                     std::ref(errorStrings[threadIdx]));
+  auto reportJob = [&](const BatchJob &job) {
+    if (job.RetVal && 0 == retVal)
+      retVal = job.RetVal;
+    if (job.ErrorString.size()) {
+      fprintf(stderr, "dxc_batch failed : %s", job.ErrorString.c_str());
+      if (0 == retVal)
+        retVal = 1;
     }
-    for (auto &th : threads)
-      th.join();
+  };
 
-    for (unsigned i = 0; i < threadNum; i++) {
-      auto &errorString = errorStrings[i];
-      if (errorString.size()) {
-        fprintf(stderr, "dxc_batch failed : %s", errorString.c_str());
-        if (0 == retVal)
-          retVal = 1;
-      }
-    }
+  if (bMultiThread) {
+    ReadTimingHistory(jobs);
+    RunJobsInParallel(jobs, path.str(), bLibLink);
+    WriteTimingHistory(jobs);
+    // Report in command order regardless of completion order.
+    for (const BatchJob &job : jobs)
+      reportJob(job);
   } else {
-    for (llvm::StringRef command : commands) {
-      // trim to remove /r if exist.
-      command = command.trim();
-      if (command.empty())
-        continue;
-      if (command.startswith("//"))
-        continue;
-      std::string errorString;
-      int ret = Compile(command, m_dxcSupport, path.str(), bLibLink, errorString);
-      if (ret && 0 == retVal)
-        retVal = ret;
-      if (errorString.size()) {
-        fprintf(stderr, "dxc_batch failed : %s", errorString.c_str());
-        if (0 == retVal)
-          retVal = 1;
-      }
+    for (BatchJob &job : jobs) {
+      RunJob(job, path.str(), bLibLink);
+      reportJob(job);
     }
   }
   return retVal;
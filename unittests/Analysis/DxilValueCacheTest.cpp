@@ -0,0 +1,153 @@
+//===- DxilValueCacheTest.cpp - DxilValueCache invalidation tests ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Analysis/DxilValueCache.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+class DxilValueCacheTest : public testing::Test {
+protected:
+  void ParseAssembly(const char *Assembly) {
+    SMDiagnostic Error;
+    M = parseAssemblyString(Assembly, Error, Context);
+
+    std::string errMsg;
+    raw_string_ostream os(errMsg);
+    Error.print("", os);
+
+    // A failure here means that the test itself is buggy.
+    if (!M)
+      report_fatal_error(os.str().c_str());
+
+    F = M->getFunction("test");
+    if (F == nullptr)
+      report_fatal_error("Test must have a function named @test");
+  }
+
+  Instruction *GetInst(StringRef Name) {
+    for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I)
+      if (I->getName() == Name)
+        return &*I;
+    report_fatal_error("@test is missing a named instruction");
+  }
+
+  BasicBlock *GetBlock(StringRef Name) {
+    for (BasicBlock &BB : *F)
+      if (BB.getName() == Name)
+        return &BB;
+    report_fatal_error("@test is missing a named block");
+  }
+
+  LLVMContext Context;
+  std::unique_ptr<Module> M;
+  Function *F = nullptr;
+  DxilValueCache DVC;
+};
+
+TEST_F(DxilValueCacheTest, ReplacedOperandInvalidatesUsers) {
+  ParseAssembly("define i32 @test(i32 %x) {\n"
+                "entry:\n"
+                "  %A = mul i32 %x, 0\n"
+                "  %B = add i32 %A, 1\n"
+                "  ret i32 %B\n"
+                "}\n");
+  Instruction *A = GetInst("A");
+  Instruction *B = GetInst("B");
+
+  ConstantInt *C = DVC.GetConstInt(B);
+  ASSERT_TRUE(C != nullptr);
+  EXPECT_EQ(1u, C->getZExtValue());
+
+  // %B is now %x + 1, which isn't a constant.
+  A->replaceAllUsesWith(F->arg_begin());
+  EXPECT_EQ(nullptr, DVC.GetConstInt(B));
+}
+
+TEST_F(DxilValueCacheTest, DeletedValueIsForgotten) {
+  ParseAssembly("define i32 @test(i32 %x) {\n"
+                "entry:\n"
+                "  %A = mul i32 %x, 0\n"
+                "  ret i32 %x\n"
+                "}\n");
+  Instruction *A = GetInst("A");
+  Instruction *Ret = A->getParent()->getTerminator();
+
+  ASSERT_TRUE(DVC.GetConstInt(A) != nullptr);
+  A->eraseFromParent();
+
+  // A new instruction may well reuse the deleted one's address.
+  IRBuilder<> Builder(Ret);
+  Value *Add = Builder.CreateAdd(F->arg_begin(), Builder.getInt32(1));
+  EXPECT_EQ(nullptr, DVC.GetConstInt(Add));
+}
+
+TEST_F(DxilValueCacheTest, NewEdgeMakesBlockReachable) {
+  ParseAssembly("define void @test(i1 %c) {\n"
+                "entry:\n"
+                "  br i1 false, label %dead, label %live\n"
+                "dead:\n"
+                "  br label %exit\n"
+                "live:\n"
+                "  br i1 %c, label %exit, label %exit\n"
+                "exit:\n"
+                "  ret void\n"
+                "}\n");
+  BasicBlock *Dead = GetBlock("dead");
+  BasicBlock *Live = GetBlock("live");
+
+  EXPECT_TRUE(DVC.IsUnreachable(Dead));
+  EXPECT_TRUE(DVC.IsAlwaysReachable(Live));
+
+  // Retargeting a branch isn't visible to value handles, so the client that
+  // does it invalidates the block that gained an edge.
+  cast<BranchInst>(Live->getTerminator())->setSuccessor(1, Dead);
+  DVC.Invalidate(Dead);
+  EXPECT_FALSE(DVC.IsUnreachable(Dead));
+  EXPECT_TRUE(DVC.IsAlwaysReachable(Live));
+}
+
+TEST_F(DxilValueCacheTest, ResetUnknownsForgetsReachability) {
+  ParseAssembly("define void @test(i1 %c) {\n"
+                "entry:\n"
+                "  br i1 false, label %dead, label %live\n"
+                "dead:\n"
+                "  br label %exit\n"
+                "live:\n"
+                "  br i1 %c, label %exit, label %exit\n"
+                "exit:\n"
+                "  ret void\n"
+                "}\n");
+  BasicBlock *Dead = GetBlock("dead");
+  BasicBlock *Live = GetBlock("live");
+
+  EXPECT_TRUE(DVC.IsUnreachable(Dead));
+
+  // Reachability is kept across queries until it's reset.
+  cast<BranchInst>(Live->getTerminator())->setSuccessor(1, Dead);
+  EXPECT_TRUE(DVC.IsUnreachable(Dead));
+
+  DVC.ResetUnknowns();
+  EXPECT_FALSE(DVC.IsUnreachable(Dead));
+}
+
+} // end anonymous namespace
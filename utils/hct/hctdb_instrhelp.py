@@ -710,6 +710,30 @@ def get_hlsl_intrinsics():
     result += "\n#endif // ENABLE_SPIRV_CODEGEN\n" if is_vk_table else ""  # SPIRV Change
     return result
 
+def get_hlsl_intrinsic_name_index():
+    # Overloads of an intrinsic are contiguous in g_Intrinsics; emit one entry
+    # per name, sorted for binary search, covering the run of its overloads.
+    db = get_db_hlsl()
+    runs = []
+    row_idx = 0
+    for i in sorted(db.intrinsics, key=lambda x: x.key):
+        if i.ns != "Intrinsics":
+            continue
+        name = i.params[0].name
+        if i.hidden:
+            name = "$hidden$" + name
+        if len(runs) and runs[-1][0] == name:
+            runs[-1][2] += 1
+        else:
+            assert name not in [r[0] for r in runs], "overloads of %s are not contiguous" % name
+            runs.append([name, row_idx, 1])
+        row_idx += 1
+    result = "static const HLSL_INTRINSIC_NAME_INDEX g_IntrinsicsNameIndex[] =\n{\n"
+    for name, first, count in sorted(runs, key=lambda r: r[0]):
+        result += "    {\"%s\", %d, %d},\n" % (name, first, count)
+    result += "};\n"
+    return result
+
 # SPIRV Change Starts
 def wrap_with_ifdef_if_vulkan_specific(intrinsic, text):
     if intrinsic.vulkanSpecific: